@@ -26,9 +26,22 @@
 #include <QApplication>
 
 #include "qt/mainwindow.h"
+#include "opengl/meshkernels.h"
+
+#include <cstring>
 
 int main(int argc, char *argv[])
 {
+    //Microbenchmark of the vectorized mesh kernels, without opening a window
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--benchmark-mesh-kernels") == 0)
+        {
+            MeshKernels::benchmark();
+            return 0;
+        }
+    }
+
     //By default sets OpenGL to OpenGL 4 with Core Profile
     QSurfaceFormat glFormat;
     glFormat.setMajorVersion(4);
@@ -0,0 +1,130 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/allocationcounter.h"
+
+#include <cstdlib>
+#include <new>
+
+//Per thread : no synchronization, and the allocations of the worker threads (e.g. MeshLoader) are not mixed in
+static thread_local quint64 numberOfAllocations = 0;
+
+quint64 AllocationCounter::getNumberOfAllocations()
+{
+    return numberOfAllocations;
+}
+
+bool AllocationCounter::isEnabled()
+{
+#ifdef SHADERLAB_COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef SHADERLAB_COUNT_ALLOCATIONS
+
+#if defined(__GLIBC__)
+
+//The Qt containers allocate with malloc, not operator new : the allocation functions of the C library are interposed.
+//Every library of the process calls these ones, libstdc++ implements operator new with malloc.
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) noexcept
+{
+    ++numberOfAllocations;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept
+{
+    ++numberOfAllocations;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) noexcept
+{
+    ++numberOfAllocations;
+    return __libc_realloc(pointer, size);
+}
+}
+
+#else
+
+void *operator new(std::size_t size)
+{
+    ++numberOfAllocations;
+
+    void *pointer = std::malloc(size > 0 ? size : 1);
+    if (!pointer)
+        throw std::bad_alloc();
+
+    return pointer;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    ++numberOfAllocations;
+    return std::malloc(size > 0 ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept
+{
+    std::free(pointer);
+}
+
+#endif
+
+#endif // SHADERLAB_COUNT_ALLOCATIONS
@@ -0,0 +1,57 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef ALLOCATIONCOUNTER_H
+#define ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+/**
+ * Counts the heap allocations of each thread, e.g. to check that a frame is rendered without any allocation.
+ * With glibc, malloc, calloc and realloc are counted, which includes operator new and the Qt containers.
+ * Elsewhere only operator new is replaced : the allocations made inside the Qt libraries are not counted.
+ * The allocation functions are only replaced in a build configured with SHADERLAB_COUNT_ALLOCATIONS.
+ * @brief The AllocationCounter class
+ */
+class AllocationCounter
+{
+public:
+    /**
+     * Number of heap allocations made by the calling thread since it started.
+     * The difference between two calls gives the allocations of the code in between.
+     * @brief getNumberOfAllocations
+     * @return
+     */
+    static quint64 getNumberOfAllocations();
+
+    /**
+     * Returns true if the allocations are counted (SHADERLAB_COUNT_ALLOCATIONS), otherwise the count stays at 0.
+     * @brief isEnabled
+     * @return
+     */
+    static bool isEnabled();
+};
+
+#endif // ALLOCATIONCOUNTER_H
@@ -155,6 +155,34 @@ QMatrix4x4 Camera::getProjectionMatrix()
     return m_projectionMatrix;
 }
 
+void Camera::getFrustumPlanes(QVector4D planes[NUMBER_OF_FRUSTUM_PLANES])
+{
+    QVector4D row0 = m_projectionMatrix.row(0);
+    QVector4D row1 = m_projectionMatrix.row(1);
+    QVector4D row2 = m_projectionMatrix.row(2);
+    QVector4D row3 = m_projectionMatrix.row(3);
+
+    //Left, right, bottom, top, near and far planes (Gribb and Hartmann)
+    planes[0] = row3 + row0;
+    planes[1] = row3 - row0;
+    planes[2] = row3 + row1;
+    planes[3] = row3 - row1;
+    planes[4] = row3 + row2;
+    planes[5] = row3 - row2;
+
+    for (int k = 0; k < NUMBER_OF_FRUSTUM_PLANES; ++k)
+    {
+        float length = planes[k].toVector3D().length();
+        if (length > 0.0)
+            planes[k] /= length;
+    }
+}
+
+float Camera::getFieldOfView()
+{
+    return m_fieldOfView;
+}
+
 bool Camera::isPerspective()
 {
     return m_perspectiveCamera;
@@ -26,8 +26,12 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#define NUMBER_OF_FRUSTUM_PLANES 6
+
 #include <QMatrix4x4>
 #include <QVector3D>
+#include <QVector4D>
+#include <QVector>
 
 #include <string>
 #include <sstream>
@@ -137,6 +141,15 @@ public:
 
     QMatrix4x4 getViewMatrix();
     QMatrix4x4 getProjectionMatrix();
+    float getFieldOfView();
+
+    /**
+     * Returns the 6 planes (a, b, c, d) of the view frustum in the camera space, extracted from the projection matrix.
+     * (a, b, c) is a unit vector towards the inside : a point p is inside the frustum if a*p.x + b*p.y + c*p.z + d >= 0 for every plane.
+     * @brief getFrustumPlanes
+     * @param planes array of NUMBER_OF_FRUSTUM_PLANES planes, filled without any allocation
+     */
+    void getFrustumPlanes(QVector4D planes[NUMBER_OF_FRUSTUM_PLANES]);
 
     /**
      * Returns true if the camera is a perspective camera.
@@ -24,6 +24,7 @@
 ****************************************************************************/
 
 #include "opengl/framebuffer.h"
+#include "opengl/glstatecache.h"
 
 using namespace std;
 
@@ -42,9 +43,23 @@ m_colourBuffers(vector<Texture>()), m_depthBufferId(0)
 FrameBuffer::~FrameBuffer()
 {
     f->glDeleteFramebuffers(1, &m_framebufferId);
+    GLStateCache::instance().framebufferDeleted(m_framebufferId);
     f->glDeleteRenderbuffers(1, &m_depthBufferId);
-    m_colourBuffers.clear();
+    this->deleteColourBuffers();
+
+}
+
+void FrameBuffer::deleteColourBuffers()
+{
+    //The textures are owned by the framebuffer, the Texture objects do not delete them
+    for (size_t k = 0; k < m_colourBuffers.size(); ++k)
+    {
+        GLuint textureId = m_colourBuffers[k].getTextureId();
+        f->glDeleteTextures(1, &textureId);
+        GLStateCache::instance().textureDeleted(textureId);
+    }
 
+    m_colourBuffers.clear();
 }
 
 
@@ -77,14 +92,15 @@ bool FrameBuffer::load_8UC3()
     if (f->glIsFramebuffer(m_framebufferId) == GL_TRUE)
     {
         f->glDeleteFramebuffers(1, &m_framebufferId);
-        m_colourBuffers.clear(); //Empty colour buffers
+        GLStateCache::instance().framebufferDeleted(m_framebufferId);
+        this->deleteColourBuffers();
     }
 
     //Generate ID
     f->glGenFramebuffers(1, &m_framebufferId);
 
     //Create renderbuffer with same width and height
-    f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebufferId);
+    GLStateCache::instance().bindFramebuffer(m_framebufferId);
 
     //Colorbuffer
     Texture colorBuffer = Texture(m_width, m_height, 3);
@@ -105,14 +121,15 @@ bool FrameBuffer::load_8UC3()
 
         //Clear the memory associated with the framebuffer, renderbuffer and color buffer
         f->glDeleteFramebuffers(1, &m_framebufferId);
+        GLStateCache::instance().framebufferDeleted(m_framebufferId);
         f->glDeleteRenderbuffers(1, &m_depthBufferId);
-        m_colourBuffers.clear();
+        this->deleteColourBuffers();
 
         return false;
     }
 
     //Stop working with it
-    f->glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLStateCache::instance().bindFramebuffer(0);
 
     return true;
 
@@ -124,14 +141,15 @@ bool FrameBuffer::load_32FC3()
     if (f->glIsFramebuffer(m_framebufferId) == GL_TRUE)
     {
         f->glDeleteFramebuffers(1, &m_framebufferId);
-        m_colourBuffers.clear(); //Empty colour buffers
+        GLStateCache::instance().framebufferDeleted(m_framebufferId);
+        this->deleteColourBuffers();
     }
 
     //Generate ID
     f->glGenFramebuffers(1, &m_framebufferId);
 
     //Create renderbuffer with same width and height
-    f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebufferId);
+    GLStateCache::instance().bindFramebuffer(m_framebufferId);
 
     //Colorbuffer
     Texture colorBuffer = Texture(m_width, m_height, 3);
@@ -156,19 +174,28 @@ bool FrameBuffer::load_32FC3()
 
         //Clear the memory associated with the framebuffer, renderbuffer and color buffer
         f->glDeleteFramebuffers(1, &m_framebufferId);
+        GLStateCache::instance().framebufferDeleted(m_framebufferId);
         f->glDeleteRenderbuffers(1, &m_depthBufferId);
-        m_colourBuffers.clear();
+        this->deleteColourBuffers();
 
         return false;
     }
 
     //Stop working with it
-    f->glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLStateCache::instance().bindFramebuffer(0);
 
     return true;
 
 }
 
+bool FrameBuffer::load(FrameBufferFormat format)
+{
+    if (format == FRAMEBUFFER_32FC3)
+        return this->load_32FC3();
+
+    return this->load_8UC3();
+}
+
 GLuint FrameBuffer::getFramebufferID() const
 {
     return m_framebufferId;
@@ -35,6 +35,15 @@
 
 #include <QApplication>
 
+/**
+ * Formats of the colour buffer of a framebuffer.
+ */
+enum FrameBufferFormat
+{
+    FRAMEBUFFER_8UC3,
+    FRAMEBUFFER_32FC3
+};
+
 class FrameBuffer
 {
 public:
@@ -58,6 +67,14 @@ public:
      */
     bool load_32FC3();
 
+    /**
+     * Load a framebuffer with a color buffer of the given format.
+     * @brief load
+     * @param format
+     * @return
+     */
+    bool load(FrameBufferFormat format);
+
     GLuint getFramebufferID() const;
     GLuint getColorBufferID(unsigned int index) const;
 
@@ -69,6 +86,12 @@ signals:
     public slots :
 
 private:
+    /**
+     * Deletes the textures of the colour buffers.
+     * @brief deleteColourBuffers
+     */
+    void deleteColourBuffers();
+
     GLuint m_framebufferId;
     int m_width;
     int m_height;
@@ -0,0 +1,145 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/framebufferpool.h"
+
+#include <QDebug>
+
+using namespace std;
+
+bool FrameBufferKey::operator==(const FrameBufferKey &key) const
+{
+    return width == key.width && height == key.height && format == key.format && samples == key.samples;
+}
+
+FrameBufferPool::FrameBufferPool() : m_entries(), m_numberOfAllocations(0), m_memory(0), m_highWaterMark(0)
+{
+}
+
+QSharedPointer<FrameBuffer> FrameBufferPool::acquire(const FrameBufferKey &key)
+{
+    for (int e = 0; e < m_entries.size(); ++e)
+    {
+        if (m_entries[e].idle && m_entries[e].key == key)
+        {
+            m_entries[e].idle = false;
+            return m_entries[e].framebuffer;
+        }
+    }
+
+    QSharedPointer<FrameBuffer> framebuffer = QSharedPointer<FrameBuffer>(new FrameBuffer(key.width, key.height));
+    if (!framebuffer->load(key.format))
+    {
+        cerr << "Could not create a framebuffer of " << key.width << "x" << key.height << endl;
+        return QSharedPointer<FrameBuffer>();
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.framebuffer = framebuffer;
+    entry.idle = false;
+    m_entries.push_back(entry);
+
+    ++m_numberOfAllocations;
+    m_memory += FrameBufferPool::getMemory(key);
+    m_highWaterMark = qMax(m_highWaterMark, m_memory);
+
+    qDebug() << "Framebuffer pool :" << key.width << "x" << key.height << "framebuffer created," << m_memory << "bytes";
+
+    return framebuffer;
+}
+
+void FrameBufferPool::release(const QSharedPointer<FrameBuffer> &framebuffer)
+{
+    for (int e = 0; e < m_entries.size(); ++e)
+    {
+        if (m_entries[e].framebuffer == framebuffer)
+            m_entries[e].idle = true;
+    }
+}
+
+void FrameBufferPool::trim(const QVector<FrameBufferKey> &keys)
+{
+    QVector<FrameBufferKey> remainingKeys = keys;
+
+    int numberOfEntries = 0;
+    for (int e = 0; e < m_entries.size(); ++e)
+    {
+        if (m_entries[e].idle)
+        {
+            int k = remainingKeys.indexOf(m_entries[e].key);
+            if (k < 0)
+            {
+                m_memory -= FrameBufferPool::getMemory(m_entries[e].key);
+                continue;
+            }
+
+            remainingKeys.remove(k);
+        }
+
+        m_entries[numberOfEntries++] = m_entries[e];
+    }
+
+    m_entries.resize(numberOfEntries);
+}
+
+int FrameBufferPool::getNumberOfFramebuffers() const
+{
+    return m_entries.size();
+}
+
+int FrameBufferPool::getNumberOfIdleFramebuffers() const
+{
+    int numberOfIdleFramebuffers = 0;
+    for (int e = 0; e < m_entries.size(); ++e)
+    {
+        if (m_entries[e].idle)
+            ++numberOfIdleFramebuffers;
+    }
+
+    return numberOfIdleFramebuffers;
+}
+
+quint64 FrameBufferPool::getNumberOfAllocations() const
+{
+    return m_numberOfAllocations;
+}
+
+qint64 FrameBufferPool::getMemory() const
+{
+    return m_memory;
+}
+
+qint64 FrameBufferPool::getHighWaterMark() const
+{
+    return m_highWaterMark;
+}
+
+qint64 FrameBufferPool::getMemory(const FrameBufferKey &key)
+{
+    //RGB colour buffer and 24 bits depth, 8 bits stencil buffer
+    int colourSize = (key.format == FRAMEBUFFER_32FC3) ? 3 * sizeof(float) : 3;
+    return (qint64)key.width * key.height * qMax(key.samples, 1) * (colourSize + 4);
+}
@@ -0,0 +1,120 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef FRAMEBUFFERPOOL_H
+#define FRAMEBUFFERPOOL_H
+
+#include "opengl/framebuffer.h"
+
+#include <QSharedPointer>
+#include <QVector>
+
+/**
+ * Properties that make two framebuffers interchangeable.
+ */
+struct FrameBufferKey
+{
+    int width;
+    int height;
+    FrameBufferFormat format;
+
+    //Samples per pixel, the framebuffers are single sampled for now
+    int samples;
+
+    bool operator==(const FrameBufferKey &key) const;
+};
+
+/**
+ * Framebuffers recycled by key : a released framebuffer is handed back by the next acquire of the same key
+ * instead of being deleted and created again, e.g. when the render graph is allocated again after a link.
+ * The idle framebuffers are deleted by trim. The memory of the framebuffers and its high-water mark are tracked.
+ * The OpenGL context must be current.
+ * @brief The FrameBufferPool class
+ */
+class FrameBufferPool
+{
+public:
+    FrameBufferPool();
+
+    /**
+     * Idle framebuffer of the key, or a new one.
+     * @brief acquire
+     * @param key
+     * @return null if the framebuffer cannot be created
+     */
+    QSharedPointer<FrameBuffer> acquire(const FrameBufferKey &key);
+
+    /**
+     * The framebuffer becomes idle, it must have been acquired from the pool.
+     * @brief release
+     * @param framebuffer
+     */
+    void release(const QSharedPointer<FrameBuffer> &framebuffer);
+
+    /**
+     * Deletes the idle framebuffers, except one per key that is about to be acquired : the memory of the framebuffers
+     * that are replaced is freed before the new ones are created.
+     * @brief trim
+     * @param keys
+     */
+    void trim(const QVector<FrameBufferKey> &keys = QVector<FrameBufferKey>());
+
+    int getNumberOfFramebuffers() const;
+    int getNumberOfIdleFramebuffers() const;
+
+    /**
+     * Framebuffers created since the pool was created : the others were recycled.
+     * @brief getNumberOfAllocations
+     * @return
+     */
+    quint64 getNumberOfAllocations() const;
+
+    /**
+     * Bytes of the colour and depth stencil buffers of the framebuffers of the pool, and the highest value reached.
+     * @brief getMemory
+     * @return
+     */
+    qint64 getMemory() const;
+    qint64 getHighWaterMark() const;
+
+    static qint64 getMemory(const FrameBufferKey &key);
+
+private:
+    struct Entry
+    {
+        FrameBufferKey key;
+        QSharedPointer<FrameBuffer> framebuffer;
+        bool idle;
+    };
+
+    //A few framebuffers : searched linearly
+    QVector<Entry> m_entries;
+
+    quint64 m_numberOfAllocations;
+    qint64 m_memory;
+    qint64 m_highWaterMark;
+};
+
+#endif // FRAMEBUFFERPOOL_H
@@ -0,0 +1,574 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/geometryarena.h"
+#include "opengl/glstatecache.h"
+#include "opengl/instancebuffer.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QOpenGLFunctions_4_3_Core>
+
+using namespace std;
+
+FreeList::FreeList(int size) : m_size(size), m_numberOfFreeElements(size), m_freeRanges()
+{
+    if (size > 0)
+        m_freeRanges.insert(0, size);
+}
+
+int FreeList::allocate(int size)
+{
+    for (QMap<int, int>::iterator range = m_freeRanges.begin(); range != m_freeRanges.end(); ++range)
+    {
+        if (range.value() < size)
+            continue;
+
+        int offset = range.key();
+        int remainingSize = range.value() - size;
+
+        m_freeRanges.erase(range);
+        if (remainingSize > 0)
+            m_freeRanges.insert(offset + size, remainingSize);
+
+        m_numberOfFreeElements -= size;
+        return offset;
+    }
+
+    return -1;
+}
+
+void FreeList::free(int offset, int size)
+{
+    if (size <= 0)
+        return;
+
+    m_numberOfFreeElements += size;
+
+    //Merge with the next free range
+    QMap<int, int>::iterator next = m_freeRanges.find(offset + size);
+    if (next != m_freeRanges.end())
+    {
+        size += next.value();
+        m_freeRanges.erase(next);
+    }
+
+    //Merge with the previous free range
+    QMap<int, int>::iterator previous = m_freeRanges.lowerBound(offset);
+    if (previous != m_freeRanges.begin())
+    {
+        --previous;
+        if (previous.key() + previous.value() == offset)
+        {
+            previous.value() += size;
+            return;
+        }
+    }
+
+    m_freeRanges.insert(offset, size);
+}
+
+int FreeList::getSize() const
+{
+    return m_size;
+}
+
+int FreeList::getNumberOfFreeElements() const
+{
+    return m_numberOfFreeElements;
+}
+
+GeometryAllocation::GeometryAllocation() : page(-1)
+{
+    vertices.offset = 0;
+    vertices.size = 0;
+    indices.offset = 0;
+    indices.size = 0;
+}
+
+bool GeometryAllocation::isValid() const
+{
+    return page >= 0;
+}
+
+GeometryArena::GeometryArena() : m_pages(), m_mutex(), m_drawData(), m_numberOfDrawData(0), m_commands(),
+m_drawDataBuffer(QOpenGLBuffer::VertexBuffer), m_indirectBuffer(QOpenGLBuffer::VertexBuffer), m_functions43(0), m_indirectDrawsChecked(false)
+{
+
+}
+
+GeometryArena::~GeometryArena()
+{
+
+}
+
+GeometryAllocation GeometryArena::allocate(const MeshEncoding &encoding, int numberOfVertices, const QByteArray &vertexData,
+                                           const QByteArray &indexData)
+{
+    GeometryAllocation allocation;
+
+    GLenum indexType = encoding.getIndexType();
+    int indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+    int numberOfIndices = indexData.size() / indexSize;
+
+    //The reference to the page stays valid : no page can be added while the mutex is locked
+    QMutexLocker locker(&m_mutex);
+
+    //First page of the format with enough room for the vertices and the indices
+    for (int p = 0; p < m_pages.size() && !allocation.isValid(); ++p)
+    {
+        Page &page = m_pages[p];
+        if (!page.isAlive || page.indexType != indexType || page.textureCoordinatesType != encoding.getTextureCoordinatesType())
+            continue;
+
+        int firstVertex = page.vertices.allocate(numberOfVertices);
+        if (firstVertex < 0)
+            continue;
+
+        int firstIndex = page.indices.allocate(numberOfIndices);
+        if (firstIndex < 0)
+        {
+            page.vertices.free(firstVertex, numberOfVertices);
+            continue;
+        }
+
+        allocation.page = p;
+        allocation.vertices.offset = firstVertex;
+        allocation.indices.offset = firstIndex;
+    }
+
+    if (!allocation.isValid())
+    {
+        int p = this->createPage(indexType, encoding.getTextureCoordinatesType(), numberOfVertices, numberOfIndices);
+        if (p < 0)
+            return allocation;
+
+        allocation.page = p;
+        allocation.vertices.offset = m_pages[p].vertices.allocate(numberOfVertices);
+        allocation.indices.offset = m_pages[p].indices.allocate(numberOfIndices);
+    }
+
+    allocation.vertices.size = numberOfVertices;
+    allocation.indices.size = numberOfIndices;
+
+    Page &page = m_pages[allocation.page];
+    ++page.numberOfAllocations;
+
+    //Each attribute is copied to its region of the planar vertex buffer, the missing texture coordinates are left undefined
+    const int positionSize = ENCODED_POSITION_SIZE * sizeof(GLushort);
+    const int textureCoordinatesSize = ENCODED_TEXTURE_COORDINATES_SIZE * sizeof(GLushort);
+
+    int capacity = page.vertices.getSize();
+    int firstVertex = allocation.vertices.offset;
+    int numberOfTextureCoordinates = qMin((encoding.getNormalsOffset() - encoding.getTextureCoordinatesOffset()) / textureCoordinatesSize,
+                                          numberOfVertices);
+
+    page.vertexBuffer.bind();
+    page.vertexBuffer.write(firstVertex * positionSize, vertexData.constData(), numberOfVertices * positionSize);
+    page.vertexBuffer.write(capacity * positionSize + firstVertex * textureCoordinatesSize,
+                            vertexData.constData() + encoding.getTextureCoordinatesOffset(), numberOfTextureCoordinates * textureCoordinatesSize);
+    page.vertexBuffer.write(capacity * (positionSize + textureCoordinatesSize) + firstVertex * sizeof(GLuint),
+                            vertexData.constData() + encoding.getNormalsOffset(), numberOfVertices * sizeof(GLuint));
+    page.vertexBuffer.write(capacity * (positionSize + textureCoordinatesSize + sizeof(GLuint)) + firstVertex * sizeof(GLuint),
+                            vertexData.constData() + encoding.getTangentsOffset(), numberOfVertices * sizeof(GLuint));
+    page.vertexBuffer.release();
+
+    //The indices are rebased on the first vertex of the mesh in the page
+    QByteArray rebasedIndices(indexData);
+    if (indexType == GL_UNSIGNED_SHORT)
+    {
+        GLushort *indices = (GLushort *)rebasedIndices.data();
+        for (int k = 0; k < numberOfIndices; ++k)
+            indices[k] += firstVertex;
+    }
+    else
+    {
+        GLuint *indices = (GLuint *)rebasedIndices.data();
+        for (int k = 0; k < numberOfIndices; ++k)
+            indices[k] += firstVertex;
+    }
+
+    //The index buffer is bound to the element array of the VAO
+    GLStateCache::instance().bindVertexArray(page.vertexArray->objectId());
+    page.indexBuffer.bind();
+    page.indexBuffer.write(allocation.indices.offset * indexSize, rebasedIndices.constData(), rebasedIndices.size());
+    GLStateCache::instance().bindVertexArray(0);
+
+    return allocation;
+}
+
+void GeometryArena::free(const GeometryAllocation &allocation)
+{
+    if (!allocation.isValid())
+        return;
+
+    QMutexLocker locker(&m_mutex);
+
+    //The pages are gone after release
+    if (allocation.page >= m_pages.size() || !m_pages[allocation.page].isAlive)
+        return;
+
+    Page &page = m_pages[allocation.page];
+    page.vertices.free(allocation.vertices.offset, allocation.vertices.size);
+    page.indices.free(allocation.indices.offset, allocation.indices.size);
+    --page.numberOfAllocations;
+}
+
+void GeometryArena::releaseEmptyPages()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (int p = 0; p < m_pages.size(); ++p)
+    {
+        Page &page = m_pages[p];
+        if (!page.isAlive || page.numberOfAllocations > 0)
+            continue;
+
+        GeometryArena::destroyPage(page);
+        page.isAlive = false;
+        page.vertices = FreeList();
+        page.indices = FreeList();
+
+        qDebug() << "Geometry arena page" << p << "released";
+    }
+}
+
+int GeometryArena::createPage(GLenum indexType, GLenum textureCoordinatesType, int numberOfVertices, int numberOfIndices)
+{
+    Page page;
+    page.isAlive = true;
+    page.indexType = indexType;
+    page.textureCoordinatesType = textureCoordinatesType;
+    page.numberOfAllocations = 0;
+
+    int vertexCapacity = (indexType == GL_UNSIGNED_SHORT) ? GEOMETRY_ARENA_SHORT_PAGE_VERTICES : qMax(numberOfVertices, GEOMETRY_ARENA_PAGE_VERTICES);
+    int indexCapacity = qMax(numberOfIndices, GEOMETRY_ARENA_INDICES_PER_VERTEX * vertexCapacity);
+    int indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+
+    page.vertices = FreeList(vertexCapacity);
+    page.indices = FreeList(indexCapacity);
+
+    page.vertexBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    page.indexBuffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+    page.vertexArray = QSharedPointer<QOpenGLVertexArrayObject>(new QOpenGLVertexArrayObject());
+
+    if (!page.vertexArray->create() || !page.vertexBuffer.create() || !page.indexBuffer.create())
+    {
+        cerr << "Could not create the buffers of a page of the geometry arena" << endl;
+        return -1;
+    }
+
+    page.vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    page.vertexBuffer.bind();
+    page.vertexBuffer.allocate(vertexCapacity * ENCODED_VERTEX_SIZE);
+    page.vertexBuffer.release();
+
+    //In a core profile, the index buffer can only be bound with a VAO
+    page.vertexArray->bind();
+    page.indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    page.indexBuffer.bind();
+    page.indexBuffer.allocate(indexCapacity * indexSize);
+    page.vertexArray->release();
+    GLStateCache::instance().vertexArrayReleased();
+
+    //Slot of a deleted page, otherwise a new one
+    int p = 0;
+    while (p < m_pages.size() && m_pages[p].isAlive)
+        ++p;
+
+    if (p < m_pages.size())
+        m_pages[p] = page;
+    else
+        m_pages.push_back(page);
+
+    page.vertexArray->bind();
+    this->setVertexAttributes(p);
+    page.vertexArray->release();
+    GLStateCache::instance().vertexArrayReleased();
+
+    qDebug() << "Geometry arena page" << p << ":" << vertexCapacity << "vertices," << indexCapacity << "indices";
+
+    return p;
+}
+
+GLuint GeometryArena::getVertexArrayObject(int page) const
+{
+    return m_pages[page].vertexArray->objectId();
+}
+
+void GeometryArena::setVertexAttributes(int p)
+{
+    Page &page = m_pages[p];
+    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+
+    int capacity = page.vertices.getSize();
+    const int positionSize = ENCODED_POSITION_SIZE * sizeof(GLushort);
+    const int textureCoordinatesSize = ENCODED_TEXTURE_COORDINATES_SIZE * sizeof(GLushort);
+
+    page.vertexBuffer.bind();
+    page.indexBuffer.bind();
+
+    f->glEnableVertexAttribArray(POSITION_ATTRIBUTE_LOCATION);
+    f->glEnableVertexAttribArray(TEXTURE_COORDINATES_ATTRIBUTE_LOCATION);
+    f->glEnableVertexAttribArray(NORMAL_ATTRIBUTE_LOCATION);
+    f->glEnableVertexAttribArray(TANGENT_ATTRIBUTE_LOCATION);
+
+    f->glVertexAttribPointer(POSITION_ATTRIBUTE_LOCATION, ENCODED_POSITION_SIZE, ENCODED_POSITION_TYPE, GL_TRUE, 0, (const void *)0);
+    f->glVertexAttribPointer(TEXTURE_COORDINATES_ATTRIBUTE_LOCATION, ENCODED_TEXTURE_COORDINATES_SIZE, page.textureCoordinatesType,
+                             GL_TRUE, 0, (const void *)(size_t)(capacity * positionSize));
+    f->glVertexAttribPointer(NORMAL_ATTRIBUTE_LOCATION, ENCODED_NORMAL_SIZE, ENCODED_NORMAL_TYPE, GL_TRUE, 0,
+                             (const void *)(size_t)(capacity * (positionSize + textureCoordinatesSize)));
+    f->glVertexAttribPointer(TANGENT_ATTRIBUTE_LOCATION, ENCODED_TANGENT_SIZE, ENCODED_TANGENT_TYPE, GL_TRUE, 0,
+                             (const void *)(size_t)(capacity * (positionSize + textureCoordinatesSize + sizeof(GLuint))));
+}
+
+bool GeometryArena::supportsIndirectDraws()
+{
+    if (!m_indirectDrawsChecked)
+    {
+        m_indirectDrawsChecked = true;
+
+        QOpenGLContext *context = QOpenGLContext::currentContext();
+        int majorVersion = context->format().majorVersion();
+        int minorVersion = context->format().minorVersion();
+
+        if (majorVersion > 4 || (majorVersion == 4 && minorVersion >= 3))
+            m_functions43 = context->versionFunctions<QOpenGLFunctions_4_3_Core>();
+
+        if (m_functions43 && !m_functions43->initializeOpenGLFunctions())
+            m_functions43 = 0;
+    }
+
+    return m_functions43 != 0;
+}
+
+void GeometryArena::clearDraws()
+{
+    //The arrays keep their capacity : no allocation per frame
+    m_numberOfDrawData = 0;
+    for (int p = 0; p < m_pages.size(); ++p)
+        m_pages[p].commands.resize(0);
+}
+
+int GeometryArena::addDrawData(const QMatrix4x4 &encodedModelMatrix, const QMatrix3x3 &normalMatrix)
+{
+    int neededSize = (m_numberOfDrawData + 1) * sizeof(EncodedInstance);
+    if (m_drawData.size() < neededSize)
+        m_drawData.resize(2 * neededSize);
+
+    EncodedInstance *drawData = (EncodedInstance *)m_drawData.data();
+    InstanceBuffer::encodeInstance(drawData[m_numberOfDrawData], encodedModelMatrix, normalMatrix, DEFAULT_INSTANCE_COLOR);
+
+    return m_numberOfDrawData++;
+}
+
+void GeometryArena::addDraw(int page, int firstIndex, int numberOfIndices, int drawData)
+{
+    DrawElementsIndirectCommand command;
+    command.count = numberOfIndices;
+    command.instanceCount = 1;
+    command.firstIndex = firstIndex;
+    command.baseVertex = 0;
+    command.baseInstance = drawData;
+
+    m_pages[page].commands.push_back(command);
+}
+
+int GeometryArena::submitDraws()
+{
+    if (!this->supportsIndirectDraws() || m_numberOfDrawData == 0)
+        return 0;
+
+    //The commands of all the pages in one buffer
+    m_commands.resize(0);
+    for (int p = 0; p < m_pages.size(); ++p)
+        m_commands += m_pages[p].commands;
+
+    if (m_commands.isEmpty())
+        return 0;
+
+    if (!m_drawDataBuffer.isCreated())
+    {
+        m_drawDataBuffer.create();
+        m_drawDataBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+        m_indirectBuffer.create();
+        m_indirectBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+    }
+
+    //Reallocated every frame : the driver does not wait for the draws of the previous frame
+    m_drawDataBuffer.bind();
+    m_drawDataBuffer.allocate(m_drawData.constData(), m_numberOfDrawData * sizeof(EncodedInstance));
+    m_drawDataBuffer.release();
+
+    m_indirectBuffer.bind();
+    m_indirectBuffer.allocate(m_commands.constData(), m_commands.size() * sizeof(DrawElementsIndirectCommand));
+    m_indirectBuffer.release();
+
+    m_functions43->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer.bufferId());
+
+    int numberOfCalls = 0;
+    int firstCommand = 0;
+    for (int p = 0; p < m_pages.size(); ++p)
+    {
+        Page &page = m_pages[p];
+        if (page.commands.isEmpty())
+            continue;
+
+        if (page.indirectVertexArray.isNull())
+            this->buildIndirectVertexArray(p);
+
+        GLStateCache::instance().bindVertexArray(page.indirectVertexArray->objectId());
+        m_functions43->glMultiDrawElementsIndirect(GL_TRIANGLES, page.indexType,
+                                                   (const void *)((size_t)firstCommand * sizeof(DrawElementsIndirectCommand)),
+                                                   page.commands.size(), 0);
+
+        firstCommand += page.commands.size();
+        ++numberOfCalls;
+    }
+
+    //The last VAO stays bound (see GLStateCache)
+    m_functions43->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    return numberOfCalls;
+}
+
+void GeometryArena::buildIndirectVertexArray(int p)
+{
+    Page &page = m_pages[p];
+    page.indirectVertexArray = QSharedPointer<QOpenGLVertexArrayObject>(new QOpenGLVertexArrayObject());
+    page.indirectVertexArray->create();
+    page.indirectVertexArray->bind();
+
+    this->setVertexAttributes(p);
+
+    //The baseInstance of a command selects its entry of the per draw data
+    m_drawDataBuffer.bind();
+    InstanceBuffer::setInstanceAttributes();
+    m_drawDataBuffer.release();
+
+    page.indirectVertexArray->release();
+    GLStateCache::instance().vertexArrayReleased();
+}
+
+void GeometryArena::release()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (int p = 0; p < m_pages.size(); ++p)
+        GeometryArena::destroyPage(m_pages[p]);
+    m_pages.clear();
+
+    m_drawDataBuffer.destroy();
+    m_indirectBuffer.destroy();
+    m_commands.clear();
+    m_drawData.clear();
+    m_numberOfDrawData = 0;
+}
+
+void GeometryArena::destroyPage(Page &page)
+{
+    page.vertexBuffer.destroy();
+    page.indexBuffer.destroy();
+
+    //The vertex array objects are deleted with the last reference
+    if (!page.vertexArray.isNull())
+        page.vertexArray->destroy();
+    if (!page.indirectVertexArray.isNull())
+        page.indirectVertexArray->destroy();
+    page.vertexArray.clear();
+    page.indirectVertexArray.clear();
+
+    GLStateCache::instance().vertexArrayReleased();
+    page.commands.clear();
+}
+
+int GeometryArena::getNumberOfPages() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    int numberOfPages = 0;
+    for (int p = 0; p < m_pages.size(); ++p)
+    {
+        if (m_pages[p].isAlive)
+            ++numberOfPages;
+    }
+
+    return numberOfPages;
+}
+
+int GeometryArena::getNumberOfAllocations() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    int numberOfAllocations = 0;
+    for (int p = 0; p < m_pages.size(); ++p)
+        numberOfAllocations += m_pages[p].numberOfAllocations;
+
+    return numberOfAllocations;
+}
+
+qint64 GeometryArena::getNumberOfUsedVertices() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 numberOfVertices = 0;
+    for (int p = 0; p < m_pages.size(); ++p)
+        numberOfVertices += m_pages[p].vertices.getSize() - m_pages[p].vertices.getNumberOfFreeElements();
+
+    return numberOfVertices;
+}
+
+qint64 GeometryArena::getVertexCapacity() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 capacity = 0;
+    for (int p = 0; p < m_pages.size(); ++p)
+        capacity += m_pages[p].vertices.getSize();
+
+    return capacity;
+}
+
+qint64 GeometryArena::getNumberOfUsedIndices() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 numberOfIndices = 0;
+    for (int p = 0; p < m_pages.size(); ++p)
+        numberOfIndices += m_pages[p].indices.getSize() - m_pages[p].indices.getNumberOfFreeElements();
+
+    return numberOfIndices;
+}
+
+qint64 GeometryArena::getIndexCapacity() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 capacity = 0;
+    for (int p = 0; p < m_pages.size(); ++p)
+        capacity += m_pages[p].indices.getSize();
+
+    return capacity;
+}
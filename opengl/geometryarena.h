@@ -0,0 +1,299 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef GEOMETRYARENA_H
+#define GEOMETRYARENA_H
+
+#include "opengl/meshencoding.h"
+
+#include <QByteArray>
+#include <QMap>
+#include <QMatrix4x4>
+#include <QMutex>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QSharedPointer>
+#include <QVector>
+
+class QOpenGLFunctions_4_3_Core;
+
+//Vertices of a page of 32 bit indices, and of a page of 16 bit indices (every vertex of the page can be addressed)
+#define GEOMETRY_ARENA_PAGE_VERTICES (1 << 18)
+#define GEOMETRY_ARENA_SHORT_PAGE_VERTICES 65536
+
+//Indices of a page per vertex of its capacity : a closed triangle mesh has about 2 triangles per vertex
+#define GEOMETRY_ARENA_INDICES_PER_VERTEX 6
+
+//Bytes per vertex : positions, texture coordinates, normals and tangents (see MeshEncoding)
+#define ENCODED_VERTEX_SIZE 20
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+/**
+ * Range of a free list : offset of the first element and number of elements.
+ */
+struct GeometryRange
+{
+    int offset;
+    int size;
+};
+
+/**
+ * First fit allocator of ranges of elements in a buffer. The free ranges are kept sorted by offset
+ * and merged with their neighbours when a range is freed.
+ * @brief The FreeList class
+ */
+class FreeList
+{
+public:
+    FreeList(int size = 0);
+
+    /**
+     * Allocates a range of elements.
+     * @brief allocate
+     * @param size
+     * @return offset of the range, -1 if there is no free range large enough
+     */
+    int allocate(int size);
+
+    void free(int offset, int size);
+
+    int getSize() const;
+    int getNumberOfFreeElements() const;
+
+private:
+    int m_size;
+    int m_numberOfFreeElements;
+
+    //Offset -> size of the free ranges
+    QMap<int, int> m_freeRanges;
+};
+
+/**
+ * Place of a mesh in the geometry arena : its page, its vertices and its indices.
+ */
+struct GeometryAllocation
+{
+    GeometryAllocation();
+    bool isValid() const;
+
+    int page;
+    GeometryRange vertices;
+    GeometryRange indices;
+};
+
+/**
+ * Command of glMultiDrawElementsIndirect, as laid out in the GL_DRAW_INDIRECT_BUFFER.
+ */
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+/**
+ * Sub-allocates the vertices and indices of the meshes from a few large buffers (pages), so that the meshes of a page
+ * share a vertex array object and can be drawn together.
+ *
+ * A page holds the meshes of one vertex format and one index type. Its vertex buffer is planar like the buffers of MeshEncoding,
+ * each attribute has a region sized for the capacity of the page. The indices of a mesh are rebased on its first vertex when they
+ * are uploaded : a mesh is drawn with plain glDrawElements from the VAO of its page, the offset of its indices in the page added.
+ * Pages of 16 bit indices are limited to 65536 vertices for that reason. A mesh larger than a page gets a page of its own.
+ * The index capacity of a page follows its vertex capacity. A page whose meshes are all freed is deleted by releaseEmptyPages
+ * and its slot is reused by the next page created.
+ *
+ * The arena is shared with the loader threads : the pages are protected by a mutex.
+ *
+ * On OpenGL 4.3, the draws of the frame can be collected and submitted with one glMultiDrawElementsIndirect per page.
+ * The per draw data (model matrix, normal matrix and colour) is in a buffer read through the instance attributes of InstanceBuffer,
+ * the baseInstance of each command selecting its entry.
+ * @brief The GeometryArena class
+ */
+class GeometryArena
+{
+public:
+    GeometryArena();
+    ~GeometryArena();
+
+    /**
+     * Allocates and uploads the vertices and indices of an encoded mesh. The OpenGL context must be current.
+     * @brief allocate
+     * @param encoding
+     * @param numberOfVertices
+     * @param vertexData
+     * @param indexData
+     * @return invalid if the buffers could not be created
+     */
+    GeometryAllocation allocate(const MeshEncoding &encoding, int numberOfVertices, const QByteArray &vertexData, const QByteArray &indexData);
+
+    /**
+     * Gives the vertices and indices of a mesh back to their page. Only the free lists are updated : no OpenGL call,
+     * the pages keep their buffers until releaseEmptyPages. Thread safe.
+     * @brief free
+     * @param allocation
+     */
+    void free(const GeometryAllocation &allocation);
+
+    /**
+     * Deletes the buffers of the pages that no longer hold any mesh. The OpenGL context must be current.
+     * @brief releaseEmptyPages
+     */
+    void releaseEmptyPages();
+
+    /**
+     * Vertex array object of a page, with the mesh attributes.
+     * @brief getVertexArrayObject
+     * @param page
+     * @return
+     */
+    GLuint getVertexArrayObject(int page) const;
+
+    /**
+     * Binds the buffers of a page and specifies the attributes of the meshes in the bound VAO.
+     * @brief setVertexAttributes
+     * @param page
+     */
+    void setVertexAttributes(int page);
+
+    /**
+     * True if glMultiDrawElementsIndirect is available (OpenGL 4.3). The OpenGL context must be current.
+     * @brief supportsIndirectDraws
+     * @return
+     */
+    bool supportsIndirectDraws();
+
+    /**
+     * Starts collecting the draws of a frame.
+     * @brief clearDraws
+     */
+    void clearDraws();
+
+    /**
+     * Adds the per draw data of an object.
+     * @brief addDrawData
+     * @param encodedModelMatrix model matrix applied to the encoded positions
+     * @param normalMatrix normal matrix of the model matrix
+     * @return index of the data, to give to addDraw
+     */
+    int addDrawData(const QMatrix4x4 &encodedModelMatrix, const QMatrix3x3 &normalMatrix);
+
+    /**
+     * Adds a range of indices of a page to draw with the data of addDrawData.
+     * @brief addDraw
+     * @param page
+     * @param firstIndex in the index buffer of the page
+     * @param numberOfIndices
+     * @param drawData
+     */
+    void addDraw(int page, int firstIndex, int numberOfIndices, int drawData);
+
+    /**
+     * Uploads the commands and the per draw data collected since clearDraws, and submits them with one glMultiDrawElementsIndirect
+     * per page. The shader program must be bound.
+     * @brief submitDraws
+     * @return number of glMultiDrawElementsIndirect calls
+     */
+    int submitDraws();
+
+    /**
+     * Deletes the buffers and vertex array objects of all the pages and of the indirect draws.
+     * The OpenGL context must be current, the meshes allocated from the arena must have been freed.
+     * @brief release
+     */
+    void release();
+
+    int getNumberOfPages() const;
+    int getNumberOfAllocations() const;
+    qint64 getNumberOfUsedVertices() const;
+    qint64 getVertexCapacity() const;
+    qint64 getNumberOfUsedIndices() const;
+    qint64 getIndexCapacity() const;
+
+private:
+    struct Page
+    {
+        //False once the buffers of the page are deleted
+        bool isAlive;
+
+        GLenum indexType;
+        GLenum textureCoordinatesType;
+        int numberOfAllocations;
+
+        FreeList vertices;
+        FreeList indices;
+
+        QOpenGLBuffer vertexBuffer;
+        QOpenGLBuffer indexBuffer;
+        QSharedPointer<QOpenGLVertexArrayObject> vertexArray;
+
+        //Also reads the per draw data, created for the first indirect draw
+        QSharedPointer<QOpenGLVertexArrayObject> indirectVertexArray;
+
+        QVector<DrawElementsIndirectCommand> commands;
+    };
+
+    /**
+     * Creates a page for a format, large enough for a mesh, in the slot of a deleted page if there is one.
+     * The OpenGL context must be current and m_mutex locked.
+     * @brief createPage
+     * @return index of the page, -1 if its buffers could not be created
+     */
+    int createPage(GLenum indexType, GLenum textureCoordinatesType, int numberOfVertices, int numberOfIndices);
+
+    /**
+     * Deletes the buffers and vertex array objects of a page. The OpenGL context must be current.
+     * @brief destroyPage
+     * @param page
+     */
+    static void destroyPage(Page &page);
+
+    /**
+     * Creates the VAO of a page that also reads the per draw data. The draw data buffer must be created.
+     * @brief buildIndirectVertexArray
+     * @param page
+     */
+    void buildIndirectVertexArray(int page);
+
+    QVector<Page> m_pages;
+    mutable QMutex m_mutex;
+
+    //Per draw data of the frame (see InstanceBuffer::encodeInstance) and commands of all the pages, in order
+    QByteArray m_drawData;
+    int m_numberOfDrawData;
+    QVector<DrawElementsIndirectCommand> m_commands;
+
+    QOpenGLBuffer m_drawDataBuffer;
+    QOpenGLBuffer m_indirectBuffer;
+
+    QOpenGLFunctions_4_3_Core *m_functions43;
+    bool m_indirectDrawsChecked;
+};
+
+#endif // GEOMETRYARENA_H
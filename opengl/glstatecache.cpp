@@ -0,0 +1,283 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/glstatecache.h"
+
+using namespace std;
+
+GLStateCache &GLStateCache::instance()
+{
+    static GLStateCache stateCache;
+    return stateCache;
+}
+
+GLStateCache::GLStateCache() : m_numberOfIssuedCalls(0), m_numberOfElidedCalls(0)
+{
+    this->invalidate();
+}
+
+void GLStateCache::invalidate()
+{
+    m_program = STATE_UNKNOWN;
+    m_vertexArray = STATE_UNKNOWN;
+
+    for (int unit = 0; unit < STATE_CACHE_TEXTURE_UNITS; ++unit)
+        m_textures[unit] = STATE_UNKNOWN;
+    m_activeTextureUnit = -1;
+
+    m_framebuffer = STATE_UNKNOWN;
+    for (int k = 0; k < 4; ++k)
+        m_viewport[k] = -1;
+
+    m_polygonMode = STATE_UNKNOWN;
+    m_cullFace = -1;
+    m_depthTest = -1;
+}
+
+QOpenGLExtraFunctions *GLStateCache::functions()
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context)
+    {
+        this->invalidate();
+        return 0;
+    }
+
+    return context->extraFunctions();
+}
+
+void GLStateCache::useProgram(GLuint program)
+{
+    if (program == m_program)
+    {
+        ++m_numberOfElidedCalls;
+        return;
+    }
+
+    QOpenGLExtraFunctions *f = this->functions();
+    if (!f)
+        return;
+
+    f->glUseProgram(program);
+    m_program = program;
+    ++m_numberOfIssuedCalls;
+}
+
+void GLStateCache::bindVertexArray(GLuint vertexArray)
+{
+    if (vertexArray == m_vertexArray)
+    {
+        ++m_numberOfElidedCalls;
+        return;
+    }
+
+    QOpenGLExtraFunctions *f = this->functions();
+    if (!f)
+        return;
+
+    f->glBindVertexArray(vertexArray);
+    m_vertexArray = vertexArray;
+    ++m_numberOfIssuedCalls;
+}
+
+void GLStateCache::activeTexture(QOpenGLExtraFunctions *f, int unit)
+{
+    if (unit == m_activeTextureUnit)
+    {
+        ++m_numberOfElidedCalls;
+        return;
+    }
+
+    f->glActiveTexture(GL_TEXTURE0 + unit);
+    m_activeTextureUnit = unit;
+    ++m_numberOfIssuedCalls;
+}
+
+void GLStateCache::bindTexture(int unit, GLuint texture)
+{
+    //The active unit only matters when the binding changes
+    if (unit < STATE_CACHE_TEXTURE_UNITS && m_textures[unit] == texture)
+    {
+        ++m_numberOfElidedCalls;
+        return;
+    }
+
+    QOpenGLExtraFunctions *f = this->functions();
+    if (!f)
+        return;
+
+    this->activeTexture(f, unit);
+    f->glBindTexture(GL_TEXTURE_2D, texture);
+    ++m_numberOfIssuedCalls;
+
+    if (unit < STATE_CACHE_TEXTURE_UNITS)
+        m_textures[unit] = texture;
+}
+
+void GLStateCache::bindTexture(GLuint texture)
+{
+    int unit = m_activeTextureUnit;
+    if (unit >= 0 && unit < STATE_CACHE_TEXTURE_UNITS && m_textures[unit] == texture)
+    {
+        ++m_numberOfElidedCalls;
+        return;
+    }
+
+    QOpenGLExtraFunctions *f = this->functions();
+    if (!f)
+        return;
+
+    f->glBindTexture(GL_TEXTURE_2D, texture);
+    ++m_numberOfIssuedCalls;
+
+    if (unit >= 0 && unit < STATE_CACHE_TEXTURE_UNITS)
+        m_textures[unit] = texture;
+}
+
+void GLStateCache::bindFramebuffer(GLuint framebuffer)
+{
+    if (framebuffer == m_framebuffer)
+    {
+        ++m_numberOfElidedCalls;
+        return;
+    }
+
+    QOpenGLExtraFunctions *f = this->functions();
+    if (!f)
+        return;
+
+    f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    m_framebuffer = framebuffer;
+    ++m_numberOfIssuedCalls;
+}
+
+void GLStateCache::setViewport(int x, int y, int width, int height)
+{
+    if (x == m_viewport[0] && y == m_viewport[1] && width == m_viewport[2] && height == m_viewport[3])
+    {
+        ++m_numberOfElidedCalls;
+        return;
+    }
+
+    QOpenGLExtraFunctions *f = this->functions();
+    if (!f)
+        return;
+
+    f->glViewport(x, y, width, height);
+    m_viewport[0] = x;
+    m_viewport[1] = y;
+    m_viewport[2] = width;
+    m_viewport[3] = height;
+    ++m_numberOfIssuedCalls;
+}
+
+void GLStateCache::setPolygonMode(GLenum mode)
+{
+    if (mode == m_polygonMode)
+    {
+        ++m_numberOfElidedCalls;
+        return;
+    }
+
+    if (!this->functions())
+        return;
+
+    //Desktop OpenGL only, as the wireframe rendering
+    glPolygonMode(GL_FRONT_AND_BACK, mode);
+    m_polygonMode = mode;
+    ++m_numberOfIssuedCalls;
+}
+
+void GLStateCache::setCullFace(bool enabled)
+{
+    if ((int)enabled == m_cullFace)
+    {
+        ++m_numberOfElidedCalls;
+        return;
+    }
+
+    QOpenGLExtraFunctions *f = this->functions();
+    if (!f)
+        return;
+
+    if (enabled)
+        f->glEnable(GL_CULL_FACE);
+    else
+        f->glDisable(GL_CULL_FACE);
+    m_cullFace = enabled;
+    ++m_numberOfIssuedCalls;
+}
+
+void GLStateCache::setDepthTest(bool enabled)
+{
+    if ((int)enabled == m_depthTest)
+    {
+        ++m_numberOfElidedCalls;
+        return;
+    }
+
+    QOpenGLExtraFunctions *f = this->functions();
+    if (!f)
+        return;
+
+    if (enabled)
+        f->glEnable(GL_DEPTH_TEST);
+    else
+        f->glDisable(GL_DEPTH_TEST);
+    m_depthTest = enabled;
+    ++m_numberOfIssuedCalls;
+}
+
+void GLStateCache::textureDeleted(GLuint texture)
+{
+    //A deleted texture is unbound from every unit
+    for (int unit = 0; unit < STATE_CACHE_TEXTURE_UNITS; ++unit)
+    {
+        if (m_textures[unit] == texture)
+            m_textures[unit] = 0;
+    }
+}
+
+void GLStateCache::framebufferDeleted(GLuint framebuffer)
+{
+    //Deleting the bound framebuffer binds the default one
+    if (m_framebuffer == framebuffer)
+        m_framebuffer = 0;
+}
+
+void GLStateCache::vertexArrayReleased()
+{
+    m_vertexArray = 0;
+}
+
+quint64 GLStateCache::getNumberOfIssuedCalls() const
+{
+    return m_numberOfIssuedCalls;
+}
+
+quint64 GLStateCache::getNumberOfElidedCalls() const
+{
+    return m_numberOfElidedCalls;
+}
@@ -0,0 +1,137 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef GLSTATECACHE_H
+#define GLSTATECACHE_H
+
+#include "opengl/openglheaders.h"
+
+//Texture units whose bindings are tracked, the bindings of the other units are always issued
+#define STATE_CACHE_TEXTURE_UNITS 32
+
+//Name of an object whose binding is unknown
+#define STATE_UNKNOWN 0xFFFFFFFFu
+
+/**
+ * Shadow copy of the OpenGL state changed by the application : program, VAO, 2D textures per unit, draw framebuffer,
+ * viewport, polygon mode, face culling and depth test. A call that would set the current value is skipped.
+ * The state is unknown after invalidate, so the next call of each kind is issued : it must be invalidated whenever
+ * something else changes the state (Qt before paintGL, QPainter), and a deleted object must be reported
+ * as its name can be reused. The calls are skipped as well when no context is current.
+ * There is a single cache : the application draws with the context of the GL widget only.
+ * @brief The GLStateCache class
+ */
+class GLStateCache
+{
+public:
+    static GLStateCache &instance();
+
+    /**
+     * Forgets the whole state.
+     * @brief invalidate
+     */
+    void invalidate();
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+
+    /**
+     * Binds a 2D texture to a texture unit, which becomes the active unit.
+     * @brief bindTexture
+     * @param unit
+     * @param texture
+     */
+    void bindTexture(int unit, GLuint texture);
+
+    /**
+     * Binds a 2D texture to the active texture unit.
+     * @brief bindTexture
+     * @param texture
+     */
+    void bindTexture(GLuint texture);
+
+    void bindFramebuffer(GLuint framebuffer);
+    void setViewport(int x, int y, int width, int height);
+
+    /**
+     * Polygon mode of the front and back faces.
+     * @brief setPolygonMode
+     * @param mode GL_FILL or GL_LINE
+     */
+    void setPolygonMode(GLenum mode);
+
+    void setCullFace(bool enabled);
+    void setDepthTest(bool enabled);
+
+    /**
+     * Forgets the bindings of a deleted object.
+     * @brief textureDeleted
+     * @param texture
+     */
+    void textureDeleted(GLuint texture);
+    void framebufferDeleted(GLuint framebuffer);
+
+    /**
+     * A QOpenGLVertexArrayObject was bound and released outside the cache, the VAO 0 is bound.
+     * @brief vertexArrayReleased
+     */
+    void vertexArrayReleased();
+
+    /**
+     * State changes sent to OpenGL and skipped because the state was already set, since the start.
+     * @brief getNumberOfIssuedCalls
+     * @return
+     */
+    quint64 getNumberOfIssuedCalls() const;
+    quint64 getNumberOfElidedCalls() const;
+
+private:
+    GLStateCache();
+
+    /**
+     * Functions of the current context, null if there is none (the state is then invalidated).
+     * @brief functions
+     * @return
+     */
+    QOpenGLExtraFunctions *functions();
+
+    void activeTexture(QOpenGLExtraFunctions *f, int unit);
+
+    //An unknown binding is STATE_UNKNOWN, an unknown integer or flag is -1
+    GLuint m_program;
+    GLuint m_vertexArray;
+    GLuint m_textures[STATE_CACHE_TEXTURE_UNITS];
+    int m_activeTextureUnit;
+    GLuint m_framebuffer;
+    int m_viewport[4];
+    GLenum m_polygonMode;
+    int m_cullFace;
+    int m_depthTest;
+
+    quint64 m_numberOfIssuedCalls;
+    quint64 m_numberOfElidedCalls;
+};
+
+#endif // GLSTATECACHE_H
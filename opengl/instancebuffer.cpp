@@ -0,0 +1,209 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/instancebuffer.h"
+#include "opengl/glstatecache.h"
+
+#include <QDebug>
+
+#include <cstddef>
+#include <cstring>
+
+using namespace std;
+
+InstanceBuffer::InstanceBuffer() : m_numberOfInstances(0), m_transforms(), m_boundingSphereCenter(0.0, 0.0, 0.0), m_boundingSphereRadius(0.0),
+m_maximumScale(1.0), m_instanceData(), m_buffer(QOpenGLBuffer::VertexBuffer), m_vertexArray()
+{
+
+}
+
+void InstanceBuffer::setInstances(const QVector<QMatrix4x4> &transforms, const QVector<QVector4D> &colors, const MeshAsset &asset)
+{
+    m_numberOfInstances = transforms.size();
+    m_transforms = transforms;
+    m_instanceData.resize(m_numberOfInstances * sizeof(EncodedInstance));
+    EncodedInstance *instances = (EncodedInstance *)m_instanceData.data();
+
+    //The positions of the vertex buffer are quantized : the transforms are applied between the dequantization and its inverse
+    QMatrix4x4 dequantizationMatrix = asset.encoding.getDequantizationMatrix();
+    QMatrix4x4 quantizationMatrix = dequantizationMatrix.inverted();
+
+    QVector3D minimum, maximum;
+    m_maximumScale = 0.0;
+
+    for (int k = 0; k < m_numberOfInstances; ++k)
+    {
+        const QMatrix4x4 &transform = transforms[k];
+
+        QMatrix4x4 encodedTransform = quantizationMatrix * transform * dequantizationMatrix;
+        QVector4D color = (k < colors.size()) ? colors[k] : DEFAULT_INSTANCE_COLOR;
+        encodeInstance(instances[k], encodedTransform, transform.normalMatrix(), color);
+
+        float scale = qMax(transform.column(0).toVector3D().length(),
+                           qMax(transform.column(1).toVector3D().length(), transform.column(2).toVector3D().length()));
+        m_maximumScale = qMax(m_maximumScale, scale);
+
+        QVector3D center = transform.map(asset.boundingSphereCenter);
+        if (k == 0)
+        {
+            minimum = center;
+            maximum = center;
+        }
+
+        for (int c = 0; c < 3; ++c)
+        {
+            minimum[c] = qMin(minimum[c], center[c]);
+            maximum[c] = qMax(maximum[c], center[c]);
+        }
+    }
+
+    m_boundingSphereCenter = 0.5 * (minimum + maximum);
+    m_boundingSphereRadius = 0.5 * (maximum - minimum).length() + m_maximumScale * asset.boundingSphereRadius;
+}
+
+void InstanceBuffer::upload(MeshAsset &asset)
+{
+    if (isUploaded())
+        return;
+
+    if (m_vertexArray.isNull())
+        m_vertexArray = QSharedPointer<QOpenGLVertexArrayObject>(new QOpenGLVertexArrayObject());
+
+    if (!m_vertexArray->create())
+    {
+        cerr << "Could not create the VAO of the instances of " << asset.mesh.getFileName() << endl;
+        return;
+    }
+
+    m_vertexArray->bind();
+
+    //Attributes of the mesh, then of the instances
+    asset.setVertexAttributes();
+
+    m_buffer.create();
+    m_buffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    m_buffer.bind();
+    m_buffer.allocate(m_instanceData.constData(), m_instanceData.size());
+
+    InstanceBuffer::setInstanceAttributes();
+
+    m_vertexArray->release();
+    GLStateCache::instance().vertexArrayReleased();
+
+    qDebug() << "Instance buffer of" << m_numberOfInstances << "instances :" << m_buffer.size() << "bytes";
+
+    //The data is on the GPU
+    m_instanceData.clear();
+}
+
+bool InstanceBuffer::isUploaded() const
+{
+    return m_buffer.isCreated();
+}
+
+int InstanceBuffer::getNumberOfInstances() const
+{
+    return m_numberOfInstances;
+}
+
+GLuint InstanceBuffer::getVertexArrayObject() const
+{
+    return m_vertexArray.isNull() ? 0 : m_vertexArray->objectId();
+}
+
+const QVector<QMatrix4x4> &InstanceBuffer::getTransforms() const
+{
+    return m_transforms;
+}
+
+QVector3D InstanceBuffer::getBoundingSphereCenter() const
+{
+    return m_boundingSphereCenter;
+}
+
+float InstanceBuffer::getBoundingSphereRadius() const
+{
+    return m_boundingSphereRadius;
+}
+
+float InstanceBuffer::getMaximumScale() const
+{
+    return m_maximumScale;
+}
+
+void InstanceBuffer::encodeInstance(EncodedInstance &instance, const QMatrix4x4 &matrix, const QMatrix3x3 &normalMatrix,
+                                    const QVector4D &color)
+{
+    memcpy(instance.matrix, matrix.constData(), sizeof(instance.matrix));
+    memcpy(instance.normalMatrix, normalMatrix.constData(), sizeof(instance.normalMatrix));
+
+    for (int c = 0; c < 4; ++c)
+        instance.color[c] = (GLubyte)(qBound(0.0f, color[c], 1.0f) * 255.0f + 0.5f);
+}
+
+void InstanceBuffer::setInstanceAttributes()
+{
+    QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+
+    for (int column = 0; column < 4; ++column)
+    {
+        GLuint location = INSTANCE_MATRIX_ATTRIBUTE_LOCATION + column;
+        f->glEnableVertexAttribArray(location);
+        f->glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(EncodedInstance),
+                                 (const void *)(offsetof(EncodedInstance, matrix) + column * 4 * sizeof(GLfloat)));
+        f->glVertexAttribDivisor(location, 1);
+    }
+
+    for (int column = 0; column < 3; ++column)
+    {
+        GLuint location = INSTANCE_NORMAL_MATRIX_ATTRIBUTE_LOCATION + column;
+        f->glEnableVertexAttribArray(location);
+        f->glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(EncodedInstance),
+                                 (const void *)(offsetof(EncodedInstance, normalMatrix) + column * 3 * sizeof(GLfloat)));
+        f->glVertexAttribDivisor(location, 1);
+    }
+
+    f->glEnableVertexAttribArray(INSTANCE_COLOR_ATTRIBUTE_LOCATION);
+    f->glVertexAttribPointer(INSTANCE_COLOR_ATTRIBUTE_LOCATION, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(EncodedInstance),
+                             (const void *)offsetof(EncodedInstance, color));
+    f->glVertexAttribDivisor(INSTANCE_COLOR_ATTRIBUTE_LOCATION, 1);
+}
+
+void InstanceBuffer::setDefaultAttributes()
+{
+    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+
+    f->glVertexAttrib4f(INSTANCE_MATRIX_ATTRIBUTE_LOCATION, 1.0, 0.0, 0.0, 0.0);
+    f->glVertexAttrib4f(INSTANCE_MATRIX_ATTRIBUTE_LOCATION + 1, 0.0, 1.0, 0.0, 0.0);
+    f->glVertexAttrib4f(INSTANCE_MATRIX_ATTRIBUTE_LOCATION + 2, 0.0, 0.0, 1.0, 0.0);
+    f->glVertexAttrib4f(INSTANCE_MATRIX_ATTRIBUTE_LOCATION + 3, 0.0, 0.0, 0.0, 1.0);
+
+    f->glVertexAttrib3f(INSTANCE_NORMAL_MATRIX_ATTRIBUTE_LOCATION, 1.0, 0.0, 0.0);
+    f->glVertexAttrib3f(INSTANCE_NORMAL_MATRIX_ATTRIBUTE_LOCATION + 1, 0.0, 1.0, 0.0);
+    f->glVertexAttrib3f(INSTANCE_NORMAL_MATRIX_ATTRIBUTE_LOCATION + 2, 0.0, 0.0, 1.0);
+
+    QVector4D color = DEFAULT_INSTANCE_COLOR;
+    f->glVertexAttrib4f(INSTANCE_COLOR_ATTRIBUTE_LOCATION, color.x(), color.y(), color.z(), color.w());
+}
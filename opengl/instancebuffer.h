@@ -0,0 +1,149 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef INSTANCEBUFFER_H
+#define INSTANCEBUFFER_H
+
+#include "opengl/meshasset.h"
+
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QSharedPointer>
+#include <QVector>
+#include <QVector3D>
+#include <QVector4D>
+
+//Locations of the per instance attributes : a mat4 and a mat3 take one location per column
+#define INSTANCE_MATRIX_ATTRIBUTE_LOCATION 4
+#define INSTANCE_NORMAL_MATRIX_ATTRIBUTE_LOCATION 8
+#define INSTANCE_COLOR_ATTRIBUTE_LOCATION 11
+
+//Colour of the objects that are not instanced and of the instances without a colour (red, as in the default shaders)
+#define DEFAULT_INSTANCE_COLOR QVector4D(1.0, 0.0, 0.0, 1.0)
+
+/**
+ * Layout of an instance in an instance buffer (104 bytes).
+ */
+struct EncodedInstance
+{
+    GLfloat matrix[16];
+    GLfloat normalMatrix[9];
+    GLubyte color[4];
+};
+
+/**
+ * Per instance data of an object drawn with glDrawElementsInstanced : a transform and a colour per copy of the mesh,
+ * read by the vertex shader from the instanceMatrix, instanceNormalMatrix and instanceColor attributes (divisor 1).
+ * The instance matrices apply to the encoded positions (they are conjugated by the dequantization matrix),
+ * so the shaders compute mvMatrix * instanceMatrix * vertex and normalMatrix * instanceNormalMatrix * normal.
+ * The instance buffer has its own VAO, that also binds the buffers of the mesh.
+ * @brief The InstanceBuffer class
+ */
+class InstanceBuffer
+{
+public:
+    InstanceBuffer();
+
+    /**
+     * Encodes the instances of a mesh.
+     * @brief setInstances
+     * @param transforms model matrices of the copies, relative to the model matrix of the object
+     * @param colors colours of the copies, DEFAULT_INSTANCE_COLOR if empty
+     * @param asset mesh drawn
+     */
+    void setInstances(const QVector<QMatrix4x4> &transforms, const QVector<QVector4D> &colors, const MeshAsset &asset);
+
+    /**
+     * Creates the instance buffer and the VAO, once. The buffers of the mesh must be uploaded and the OpenGL context current.
+     * @brief upload
+     * @param asset
+     */
+    void upload(MeshAsset &asset);
+    bool isUploaded() const;
+
+    int getNumberOfInstances() const;
+    GLuint getVertexArrayObject() const;
+
+    /**
+     * Model matrices of the copies, relative to the model matrix of the object (see setInstances).
+     * @brief getTransforms
+     * @return
+     */
+    const QVector<QMatrix4x4> &getTransforms() const;
+
+    /**
+     * Sphere enclosing all the copies of the mesh, in the space of the object.
+     * @brief getBoundingSphereCenter
+     * @return
+     */
+    QVector3D getBoundingSphereCenter() const;
+    float getBoundingSphereRadius() const;
+
+    /**
+     * Largest scaling of the instance transforms, to select the level of detail of the copies.
+     * @brief getMaximumScale
+     * @return
+     */
+    float getMaximumScale() const;
+
+    /**
+     * Writes an instance in the layout of the instance buffers.
+     * @brief encodeInstance
+     * @param instance
+     * @param matrix transform of the encoded positions
+     * @param normalMatrix
+     * @param color
+     */
+    static void encodeInstance(EncodedInstance &instance, const QMatrix4x4 &matrix, const QMatrix3x3 &normalMatrix, const QVector4D &color);
+
+    /**
+     * Specifies the instance attributes (divisor 1) read from the bound vertex buffer of EncodedInstance in the bound VAO.
+     * @brief setInstanceAttributes
+     */
+    static void setInstanceAttributes();
+
+    /**
+     * Sets the values of the instance attributes used when they are not read from a buffer, i.e. for the objects that are
+     * not instanced : identity matrices and DEFAULT_INSTANCE_COLOR.
+     * @brief setDefaultAttributes
+     */
+    static void setDefaultAttributes();
+
+private:
+    int m_numberOfInstances;
+    QVector<QMatrix4x4> m_transforms;
+    QVector3D m_boundingSphereCenter;
+    float m_boundingSphereRadius;
+    float m_maximumScale;
+
+    //Encoded instances waiting for upload
+    QByteArray m_instanceData;
+
+    QOpenGLBuffer m_buffer;
+    QSharedPointer<QOpenGLVertexArrayObject> m_vertexArray;
+};
+
+#endif // INSTANCEBUFFER_H
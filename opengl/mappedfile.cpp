@@ -0,0 +1,77 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/mappedfile.h"
+
+using namespace std;
+
+//Returned for empty files which cannot be mapped
+static const char emptyFile[1] = { '\0' };
+
+MappedFile::MappedFile(const string &fileName) : m_file(QString::fromStdString(fileName)), m_data(0), m_size(0), m_isOpen(false)
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+        return;
+
+    m_size = m_file.size();
+
+    if (m_size > 0)
+    {
+        m_data = m_file.map(0, m_size);
+        m_isOpen = (m_data != 0);
+    }
+    else
+    {
+        m_isOpen = true;
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+        m_file.unmap(m_data);
+
+    m_file.close();
+}
+
+bool MappedFile::isOpen() const
+{
+    return m_isOpen;
+}
+
+const char *MappedFile::begin() const
+{
+    return m_data ? (const char *)m_data : emptyFile;
+}
+
+const char *MappedFile::end() const
+{
+    return begin() + m_size;
+}
+
+qint64 MappedFile::size() const
+{
+    return m_size;
+}
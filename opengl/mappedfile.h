@@ -0,0 +1,64 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QFile>
+
+#include <string>
+
+/**
+ * Read-only view of a whole file mapped in memory.
+ * The mapping is released when the object is destroyed.
+ */
+class MappedFile
+{
+public:
+    MappedFile(const std::string &fileName);
+    ~MappedFile();
+
+    /**
+     * Returns true if the file could be opened and mapped.
+     * @brief isOpen
+     * @return
+     */
+    bool isOpen() const;
+
+    const char *begin() const;
+    const char *end() const;
+    qint64 size() const;
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    QFile m_file;
+    uchar *m_data;
+    qint64 m_size;
+    bool m_isOpen;
+};
+
+#endif // MAPPEDFILE_H
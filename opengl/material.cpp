@@ -39,41 +39,54 @@ Material::Material(QColor ambient, QColor diffuseColor, QColor specularColor, fl
 
 }
 
-QColor Material::getAmbientColor()
+QColor Material::getAmbientColor() const
 {
     return m_ambientColor;
 }
 
-QColor Material::getDiffuseColor()
+QColor Material::getDiffuseColor() const
 {
     return m_diffuseColor;
 }
 
-QColor Material::getSpecularColor()
+QColor Material::getSpecularColor() const
 {
     return m_specularColor;
 }
 
-float Material::getAmbientCoefficient()
+float Material::getAmbientCoefficient() const
 {
     return m_ambientCoefficient;
 }
 
-float Material::getDiffuseCoefficient()
+float Material::getDiffuseCoefficient() const
 {
     return m_diffuseCoefficient;
 }
 
-float Material::getSpecularCoefficient()
+float Material::getSpecularCoefficient() const
 {
     return m_specularCoefficient;
 }
 
-float Material::getShininess()
+float Material::getShininess() const
 {
     return m_shininess;
 }
 
+bool Material::operator==(const Material &material) const
+{
+    return m_ambientColor == material.m_ambientColor && m_diffuseColor == material.m_diffuseColor
+            && m_specularColor == material.m_specularColor && m_ambientCoefficient == material.m_ambientCoefficient
+            && m_diffuseCoefficient == material.m_diffuseCoefficient && m_specularCoefficient == material.m_specularCoefficient
+            && m_shininess == material.m_shininess;
+}
+
+bool Material::operator!=(const Material &material) const
+{
+    return !(*this == material);
+}
+
 
 void Material::setAmbientColor(QColor color)
 {
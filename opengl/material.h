@@ -36,13 +36,16 @@ public:
     Material();
     Material(QColor ambientColor, QColor diffuseColor, QColor specularColor, float ambientCoefficient, float diffuseCoefficient, float specularCoefficient, float shininess);
 
-    QColor getAmbientColor();
-    QColor getDiffuseColor();
-    QColor getSpecularColor();
-    float getAmbientCoefficient();
-    float getDiffuseCoefficient();
-    float getSpecularCoefficient();
-    float getShininess();
+    QColor getAmbientColor() const;
+    QColor getDiffuseColor() const;
+    QColor getSpecularColor() const;
+    float getAmbientCoefficient() const;
+    float getDiffuseCoefficient() const;
+    float getSpecularCoefficient() const;
+    float getShininess() const;
+
+    bool operator==(const Material &material) const;
+    bool operator!=(const Material &material) const;
 
     void setAmbientColor(QColor color);
     void setDiffuseColor(QColor color);
@@ -24,372 +24,1531 @@
 ****************************************************************************/
 
 #include "opengl/mesh.h"
+#include "opengl/mappedfile.h"
+#include "opengl/meshkernels.h"
+#include "opengl/meshsimplifier.h"
+#include "opengl/meshtokenizer.h"
+#include "opengl/parallel.h"
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <vector>
 
 using namespace std;
 
 Mesh::Mesh() : m_fileName(string()), m_vertices(QVector<QVector3D>()), m_indices(QVector<QVector3D>()),
 m_indicesArray(QVector<GLuint>()), m_triangleNormals(QVector<QVector3D>()),
-m_vertexNormals(QVector<QVector3D>()), m_textureCoordinates(QVector<QVector2D>())
+m_vertexNormals(QVector<QVector3D>()), m_textureCoordinates(QVector<QVector2D>()), m_tangents(QVector<QVector4D>())
+{
+
+}
+
+
+Mesh::Mesh(const string& fileName) : m_fileName(fileName), m_vertices(QVector<QVector3D>()), m_indices(QVector<QVector3D>()),
+m_indicesArray(QVector<GLuint>()), m_triangleNormals(QVector<QVector3D>()),
+m_vertexNormals(QVector<QVector3D>()), m_textureCoordinates(QVector<QVector2D>()), m_tangents(QVector<QVector4D>())
+{
+
+}
+
+Mesh::~Mesh()
+{
+
+}
+
+/**
+ * Reports the position of a reader in the file every PROGRESS_INTERVAL records.
+ * Returns false if the read is cancelled.
+ */
+static bool reportReadProgress(const LoadProgress &progress, long long record, const char *position, const MappedFile &file)
+{
+    if (record % PROGRESS_INTERVAL != 0)
+        return true;
+
+    return reportProgress(progress, (int)(100 * (position - file.begin()) / max(1LL, (long long)file.size())));
+}
+
+bool Mesh::offReader(const LoadProgress &progress)
+{
+    MappedFile file(m_fileName);
+
+    if (!file.isOpen())
+    {
+        cerr << "Could not open the file : " << m_fileName << endl;
+        return false;
+    }
+
+    MeshTokenizer tokenizer(file.begin(), file.end());
+
+    //Header : OFF then the number of vertices, faces and edges
+    tokenizer.skipBlankAndCommentLines();
+    if (tokenizer.peek() == 'O' || tokenizer.peek() == 'N' || tokenizer.peek() == 'C')
+    {
+        tokenizer.skipToken();
+    }
+
+    int numberOfVertices = 0, numberOfFaces = 0, numberOfEdges = 0;
+    tokenizer.skipBlankAndCommentLines();
+    if (!tokenizer.readInt(numberOfVertices) || !tokenizer.readInt(numberOfFaces) || numberOfVertices < 0 || numberOfFaces < 0)
+    {
+        cerr << "Invalid OFF header in : " << m_fileName << endl;
+        return false;
+    }
+    tokenizer.readInt(numberOfEdges);
+    tokenizer.skipLine();
+
+    //Faces are usually triangles : reserve for that and grow for larger polygons
+    m_vertices.resize(numberOfVertices);
+    m_indices.reserve(numberOfFaces);
+    m_indicesArray.reserve(3 * numberOfFaces);
+
+    //Vertices
+    for (int i = 0; i < numberOfVertices; i++)
+    {
+        if (!reportReadProgress(progress, i, tokenizer.position(), file))
+            return false;
+
+        tokenizer.skipBlankAndCommentLines();
+
+        float x = 0.0, y = 0.0, z = 0.0;
+        tokenizer.readFloat(x);
+        tokenizer.readFloat(y);
+        tokenizer.readFloat(z);
+        m_vertices[i] = QVector3D(x, y, z);
+
+        //Ignore any additional value (e.g. colours)
+        tokenizer.skipLine();
+    }
+
+    //Faces : number of indices followed by the indices. Polygons are split in a triangle fan.
+    int numberOfInvalidFaces = 0;
+    for (int i = 0; i < numberOfFaces && !tokenizer.atEnd(); i++)
+    {
+        if (!reportReadProgress(progress, i, tokenizer.position(), file))
+            return false;
+
+        tokenizer.skipBlankAndCommentLines();
+
+        int numberOfIndices = 0, index1 = 0, index2 = 0, index3 = 0;
+        bool isValid = tokenizer.readInt(numberOfIndices) && numberOfIndices >= 3
+            && tokenizer.readInt(index1) && tokenizer.readInt(index2);
+
+        for (int k = 2; isValid && k < numberOfIndices; ++k)
+        {
+            if (!tokenizer.readInt(index3))
+            {
+                isValid = false;
+                break;
+            }
+
+            if (index1 < 0 || index2 < 0 || index3 < 0 ||
+                index1 >= numberOfVertices || index2 >= numberOfVertices || index3 >= numberOfVertices)
+            {
+                isValid = false;
+                break;
+            }
+
+            //Indices for each triangle
+            m_indices.push_back(QVector3D(index1, index2, index3));
+
+            //List of indices for OpenGL rendering
+            m_indicesArray.push_back(index1);
+            m_indicesArray.push_back(index2);
+            m_indicesArray.push_back(index3);
+
+            index2 = index3;
+        }
+
+        if (!isValid)
+            ++numberOfInvalidFaces;
+
+        tokenizer.skipLine();
+    }
+
+    if (numberOfInvalidFaces > 0)
+    {
+        cerr << numberOfInvalidFaces << " invalid faces ignored in : " << m_fileName << endl;
+    }
+
+    //Normals for each triangle and each vertex
+    this->computeVertexNormals();
+
+    return true;
+}
+
+/**
+ * Converts an OBJ index (starting at 1, negative values are relative to the end of the list read so far) to a 0-based index.
+ * Positive indices are not checked here as they may refer to elements declared later in the file.
+ * Returns -1 if the index is missing or invalid.
+ */
+static int objIndex(int index, int listSize)
+{
+    if (index > 0)
+        return index - 1;
+    if (index < 0 && -index <= listSize)
+        return listSize + index;
+    return -1;
+}
+
+enum ObjRecordType { OBJ_OTHER, OBJ_VERTEX, OBJ_NORMAL, OBJ_TEXTURE_COORDINATE, OBJ_FACE };
+
+/**
+ * Returns the type of the OBJ record starting at line (leading spaces are skipped).
+ * Used by both the prescan and the parser so that they always agree on the number of records.
+ */
+static ObjRecordType objRecordType(const char *line, const char *end)
+{
+    while (line < end && (*line == ' ' || *line == '\t'))
+        ++line;
+
+    char recordType = (line < end) ? line[0] : '\0';
+    char nextCharacter = (line + 1 < end) ? line[1] : '\0';
+
+    if (recordType == 'v' && (nextCharacter == ' ' || nextCharacter == '\t'))
+        return OBJ_VERTEX;
+    if (recordType == 'v' && nextCharacter == 'n')
+        return OBJ_NORMAL;
+    if (recordType == 'v' && nextCharacter == 't')
+        return OBJ_TEXTURE_COORDINATE;
+    if (recordType == 'f' && (nextCharacter == ' ' || nextCharacter == '\t'))
+        return OBJ_FACE;
+    return OBJ_OTHER;
+}
+
+/**
+ * Open addressing hash table giving an index to each distinct tuple of 3 integers, in order of first insertion.
+ * Used to weld the corners of the faces into unique vertices.
+ */
+class TupleIndexer
+{
+public:
+    /**
+     * The table is sized for the expected number of distinct tuples and grows if there are more.
+     * @brief TupleIndexer
+     * @param expectedNumberOfTuples
+     */
+    TupleIndexer(int expectedNumberOfTuples) : m_mask(0)
+    {
+        int capacity = 1024;
+        while (capacity < 2 * (qint64)expectedNumberOfTuples && capacity < (1 << 30))
+            capacity *= 2;
+        m_table.fill(-1, capacity);
+        m_mask = capacity - 1;
+        m_tuples.reserve(3 * expectedNumberOfTuples);
+    }
+
+    /**
+     * Returns the index of the tuple (a, b, c), a new tuple gets the next index.
+     * @brief index
+     */
+    int index(int a, int b, int c)
+    {
+        unsigned int slot = hash(a, b, c) & m_mask;
+        while (m_table[slot] >= 0)
+        {
+            const int *tuple = m_tuples.constData() + 3 * m_table[slot];
+            if (tuple[0] == a && tuple[1] == b && tuple[2] == c)
+                return m_table[slot];
+            slot = (slot + 1) & m_mask;
+        }
+
+        int newIndex = size();
+        m_table[slot] = newIndex;
+        m_tuples.push_back(a);
+        m_tuples.push_back(b);
+        m_tuples.push_back(c);
+
+        //Keep the load factor under 1/2
+        if (2 * size() > m_table.size())
+            grow();
+
+        return newIndex;
+    }
+
+    /**
+     * Returns the index of the tuple (a, b, c), or -1 if it has not been inserted.
+     * @brief find
+     */
+    int find(int a, int b, int c) const
+    {
+        unsigned int slot = hash(a, b, c) & m_mask;
+        while (m_table[slot] >= 0)
+        {
+            const int *tuple = m_tuples.constData() + 3 * m_table[slot];
+            if (tuple[0] == a && tuple[1] == b && tuple[2] == c)
+                return m_table[slot];
+            slot = (slot + 1) & m_mask;
+        }
+        return -1;
+    }
+
+    int size() const
+    {
+        return m_tuples.size() / 3;
+    }
+
+    /**
+     * The tuples in order of index.
+     * @brief tuples
+     */
+    const int *tuples() const
+    {
+        return m_tuples.constData();
+    }
+
+private:
+    static unsigned int hash(int a, int b, int c)
+    {
+        return ((unsigned int)a * 73856093u) ^ ((unsigned int)b * 19349663u) ^ ((unsigned int)c * 83492791u);
+    }
+
+    void grow()
+    {
+        m_table.fill(-1, 2 * m_table.size());
+        m_mask = m_table.size() - 1;
+        for (int k = 0; k < size(); ++k)
+        {
+            const int *tuple = m_tuples.constData() + 3 * k;
+            unsigned int slot = hash(tuple[0], tuple[1], tuple[2]) & m_mask;
+            while (m_table[slot] >= 0)
+                slot = (slot + 1) & m_mask;
+            m_table[slot] = k;
+        }
+    }
+
+    QVector<int> m_table;
+    QVector<int> m_tuples;
+    unsigned int m_mask;
+};
+
+/**
+ * Part of an OBJ file made of whole lines, parsed independently of the other chunks.
+ * The vertices, normals and texture coordinates are written directly at their final position
+ * (first* = number of records of this type in the previous chunks), the corners of the triangles are kept in the chunk until the merge.
+ */
+struct ObjChunk
+{
+    const char *begin;
+    const char *end;
+
+    int numberOfVertices;
+    int numberOfNormals;
+    int numberOfTextureCoordinates;
+    int numberOfTriangles;
+
+    int firstVertex;
+    int firstNormal;
+    int firstTextureCoordinate;
+
+    //(v, vt, vn) for each corner of each triangle, 0-based, -1 if missing
+    QVector<int> corners;
+    int numberOfCornersWithoutNormal;
+    int numberOfInvalidFaces;
+};
+
+//Files smaller than this are read by a single thread
+static const long long OBJ_MINIMUM_CHUNK_SIZE = 1 << 20;
+
+
+/**
+ * Counts the records of a chunk. Only an upper bound is needed for the triangles.
+ * The bytes counted are added to the progress, the count stops if the read is cancelled.
+ */
+static void objCountRecords(ObjChunk &chunk, ParallelProgress &progress)
+{
+    chunk.numberOfVertices = chunk.numberOfNormals = chunk.numberOfTextureCoordinates = chunk.numberOfTriangles = 0;
+
+    const char *reported = chunk.begin;
+    long long numberOfLines = 0;
+    for (const char *line = chunk.begin; line < chunk.end; ++numberOfLines)
+    {
+        if (numberOfLines % PROGRESS_INTERVAL == 0)
+        {
+            if (!progress.add(line - reported))
+                return;
+            reported = line;
+        }
+
+        const char *endOfLine = (const char *)memchr(line, '\n', chunk.end - line);
+        if (!endOfLine)
+            endOfLine = chunk.end;
+
+        switch (objRecordType(line, endOfLine))
+        {
+        case OBJ_VERTEX:
+            ++chunk.numberOfVertices;
+            break;
+        case OBJ_NORMAL:
+            ++chunk.numberOfNormals;
+            break;
+        case OBJ_TEXTURE_COORDINATE:
+            ++chunk.numberOfTextureCoordinates;
+            break;
+        case OBJ_FACE:
+        {
+            //A polygon with n corners gives n-2 triangles
+            int numberOfCorners = 0;
+            for (const char *c = line + 1; c < endOfLine; ++c)
+            {
+                if ((c[-1] == ' ' || c[-1] == '\t') && c[0] != ' ' && c[0] != '\t' && c[0] != '\r')
+                    ++numberOfCorners;
+            }
+            if (numberOfCorners >= 3)
+                chunk.numberOfTriangles += numberOfCorners - 2;
+            break;
+        }
+        default:
+            break;
+        }
+
+        line = endOfLine + 1;
+    }
+
+    progress.add(chunk.end - reported);
+}
+
+
+/**
+ * Parses a chunk. The total number of records of the file is known from the prescan,
+ * hence the triangles referring to vertices that do not exist are removed here.
+ * The bytes parsed are added to the progress, the parse stops if the read is cancelled.
+ */
+static void objParseChunk(ObjChunk &chunk, QVector3D *vertices, QVector3D *normals, QVector2D *textureCoordinates,
+                          int totalNumberOfVertices, int totalNumberOfNormals, int totalNumberOfTextureCoordinates,
+                          ParallelProgress &progress)
+{
+    chunk.corners.reserve(9 * chunk.numberOfTriangles);
+    chunk.numberOfCornersWithoutNormal = 0;
+    chunk.numberOfInvalidFaces = 0;
+
+    //Number of elements of each type read so far in the whole file (for relative indices)
+    int vertexCount = chunk.firstVertex;
+    int normalCount = chunk.firstNormal;
+    int textureCoordinateCount = chunk.firstTextureCoordinate;
+
+    //(v, vt, vn) of each corner of the current face
+    QVector<int> faceCorners;
+
+    MeshTokenizer tokenizer(chunk.begin, chunk.end);
+
+    const char *reported = chunk.begin;
+    long long numberOfLines = 0;
+    for (; !tokenizer.atEnd(); ++numberOfLines)
+    {
+        if (numberOfLines % PROGRESS_INTERVAL == 0)
+        {
+            if (!progress.add(tokenizer.position() - reported))
+                return;
+            reported = tokenizer.position();
+        }
+
+        ObjRecordType recordType = objRecordType(tokenizer.position(), chunk.end);
+        tokenizer.skipSpaces();
+
+        if (recordType == OBJ_VERTEX)
+        {
+            tokenizer.consume('v');
+            float x = 0.0, y = 0.0, z = 0.0;
+            tokenizer.readFloat(x);
+            tokenizer.readFloat(y);
+            tokenizer.readFloat(z);
+            vertices[vertexCount++] = QVector3D(x, y, z);
+        }
+        else if (recordType == OBJ_NORMAL)
+        {
+            tokenizer.consume('v');
+            tokenizer.consume('n');
+            float x = 0.0, y = 0.0, z = 0.0;
+            tokenizer.readFloat(x);
+            tokenizer.readFloat(y);
+            tokenizer.readFloat(z);
+            QVector3D normal(x, y, z);
+            normal.normalize(); //The normal might not be normalized!
+            normals[normalCount++] = normal;
+        }
+        else if (recordType == OBJ_TEXTURE_COORDINATE)
+        {
+            tokenizer.consume('v');
+            tokenizer.consume('t');
+            //The third coordinate, if any, is ignored
+            float u = 0.0, v = 0.0;
+            tokenizer.readFloat(u);
+            tokenizer.readFloat(v);
+            //U,V can be above 1.0 : use GL_REPEAT for the texture
+            textureCoordinates[textureCoordinateCount++] = QVector2D(u, v);
+        }
+        else if (recordType == OBJ_FACE)
+        {
+            tokenizer.consume('f');
+            faceCorners.clear();
+
+            //Read v, v/vt, v//vn or v/vt/vn for each corner
+            bool isValid = true;
+            while (!tokenizer.atEndOfLine())
+            {
+                int vertexIndex = 0, textureIndex = 0, normalIndex = 0;
+                if (!tokenizer.readInt(vertexIndex))
+                {
+                    isValid = false;
+                    break;
+                }
+                if (tokenizer.consume('/'))
+                {
+                    tokenizer.readInt(textureIndex);
+                    if (tokenizer.consume('/'))
+                        tokenizer.readInt(normalIndex);
+                }
+
+                //Relative indices refer to the elements read so far
+                vertexIndex = objIndex(vertexIndex, vertexCount);
+                textureIndex = objIndex(textureIndex, textureCoordinateCount);
+                normalIndex = objIndex(normalIndex, normalCount);
+                if (vertexIndex < 0)
+                {
+                    isValid = false;
+                    break;
+                }
+
+                //A missing texture coordinate or normal is ignored
+                faceCorners.push_back(vertexIndex);
+                faceCorners.push_back(textureIndex < totalNumberOfTextureCoordinates ? textureIndex : -1);
+                faceCorners.push_back(normalIndex < totalNumberOfNormals ? normalIndex : -1);
+            }
+
+            const int numberOfFaceCorners = faceCorners.size() / 3;
+            if (!isValid || numberOfFaceCorners < 3)
+            {
+                ++chunk.numberOfInvalidFaces;
+                tokenizer.skipLine();
+                continue;
+            }
+
+            //Split the polygon into a triangle fan
+            // 1---4 == Two triangles : 123 and 134
+            // 2---3
+            //Triangles referring to vertices that do not exist are removed
+            const int *corner1 = faceCorners.constData();
+            for (int k = 1; k + 1 < numberOfFaceCorners; ++k)
+            {
+                const int *corner2 = corner1 + 3 * k;
+                const int *corner3 = corner2 + 3;
+                if (corner1[0] >= totalNumberOfVertices || corner2[0] >= totalNumberOfVertices || corner3[0] >= totalNumberOfVertices)
+                {
+                    ++chunk.numberOfInvalidFaces;
+                    continue;
+                }
+
+                const int *triangle[3] = { corner1, corner2, corner3 };
+                for (int c = 0; c < 3; ++c)
+                {
+                    chunk.corners.push_back(triangle[c][0]);
+                    chunk.corners.push_back(triangle[c][1]);
+                    chunk.corners.push_back(triangle[c][2]);
+                    if (triangle[c][2] < 0)
+                        ++chunk.numberOfCornersWithoutNormal;
+                }
+            }
+        }
+
+        tokenizer.skipLine();
+    }
+
+    progress.add(chunk.end - reported);
+}
+
+bool Mesh::objReader(const LoadProgress &progress)
 {
+    //Records can come in any order :
+    //# comment
+    //v x y z =  vertex
+    //vn x y z =  normal
+    //vt u v [w] = texture coordinate
+    //f v1/vt1/vn1 v2/vt2/vn2 v3/vt3/vn3 ... = polygon, split in a triangle fan
+    //f v1//vn1 ... or f v1/vt1 ... or f v1 ... are accepted too
+    //Any other record (g, o, s, usemtl, mtllib ...) is ignored
+    // !!! Indices in f v1/vt1/vn1 start at 1 and not 0! Negative indices are relative to the last element.
+    //Each distinct (v, vt, vn) tuple used by a face becomes one vertex of the mesh :
+    //a position shared by faces with different texture coordinates or normals (a seam) is duplicated.
+
+    MappedFile file(m_fileName);
+
+    if (!file.isOpen())
+    {
+        cerr << "Could not open the file : " << m_fileName << endl;
+        return false;
+    }
+
+    //Split the file in chunks of whole lines, one per core for large files
+    //A small file is a single chunk : the serial reader is the same code
+    long long fileSize = file.size();
+    int numberOfChunks = (int)max(1LL, min((long long)numberOfWorkerThreads(), fileSize / OBJ_MINIMUM_CHUNK_SIZE));
+
+    QVector<ObjChunk> chunks(numberOfChunks);
+    const char *chunkBegin = file.begin();
+    for (int k = 0; k < numberOfChunks; ++k)
+    {
+        const char *chunkEnd = file.end();
+        if (k + 1 < numberOfChunks)
+        {
+            chunkEnd = max(chunkBegin, file.begin() + fileSize * (k + 1) / numberOfChunks);
+            const char *endOfLine = (const char *)memchr(chunkEnd, '\n', file.end() - chunkEnd);
+            chunkEnd = endOfLine ? endOfLine + 1 : file.end();
+        }
+        chunks[k].begin = chunkBegin;
+        chunks[k].end = chunkEnd;
+        chunkBegin = chunkEnd;
+    }
+
+    ObjChunk *chunkData = chunks.data();
+
+    //The file is scanned twice
+    ParallelProgress readProgress(progress, 2 * fileSize);
+    ParallelProgress *readProgressData = &readProgress;
+
+    //Prescan : count the records to allocate the memory only once
+    parallelFor(numberOfChunks, [=](int begin, int end)
+    {
+        for (int k = begin; k < end; ++k)
+            objCountRecords(chunkData[k], *readProgressData);
+    }, 1);
+
+    if (readProgress.isCancelled())
+        return false;
+
+    //Prefix sums : position of the first record of each chunk in the whole file
+    int numberOfPositions = 0, numberOfNormals = 0, numberOfTextureCoordinates = 0, maximumNumberOfTriangles = 0;
+    for (int k = 0; k < numberOfChunks; ++k)
+    {
+        chunks[k].firstVertex = numberOfPositions;
+        chunks[k].firstNormal = numberOfNormals;
+        chunks[k].firstTextureCoordinate = numberOfTextureCoordinates;
+        numberOfPositions += chunks[k].numberOfVertices;
+        numberOfNormals += chunks[k].numberOfNormals;
+        numberOfTextureCoordinates += chunks[k].numberOfTextureCoordinates;
+        maximumNumberOfTriangles += chunks[k].numberOfTriangles;
+    }
+
+    //Lists of the file, indexed by the faces
+    QVector<QVector3D> positions(numberOfPositions);
+    QVector<QVector3D> normals(numberOfNormals);
+    QVector<QVector2D> textureCoordinates(numberOfTextureCoordinates);
+
+    QVector3D *positionsData = positions.data();
+    QVector3D *normalsData = normals.data();
+    QVector2D *textureCoordinatesData = textureCoordinates.data();
+
+    parallelFor(numberOfChunks, [=](int begin, int end)
+    {
+        for (int k = begin; k < end; ++k)
+            objParseChunk(chunkData[k], positionsData, normalsData, textureCoordinatesData,
+                          numberOfPositions, numberOfNormals, numberOfTextureCoordinates, *readProgressData);
+    }, 1);
+
+    if (readProgress.isCancelled())
+        return false;
+
+    int numberOfCorners = 0, numberOfInvalidFaces = 0, numberOfCornersWithoutNormal = 0;
+    for (int k = 0; k < numberOfChunks; ++k)
+    {
+        numberOfCorners += chunks[k].corners.size() / 3;
+        numberOfInvalidFaces += chunks[k].numberOfInvalidFaces;
+        numberOfCornersWithoutNormal += chunks[k].numberOfCornersWithoutNormal;
+    }
+
+    if (numberOfInvalidFaces > 0)
+    {
+        cerr << numberOfInvalidFaces << " invalid faces ignored in : " << m_fileName << endl;
+    }
 
+    //Normals of the file are used only if every corner has one
+    const bool useFileNormals = (numberOfCornersWithoutNormal == 0);
+
+    //Weld the corners in one pass, in file order : a closed mesh has about half as many vertices as triangles
+    TupleIndexer indexer(maximumNumberOfTriangles / 2);
+    QVector<GLuint> positionIndices(numberOfCorners);
+    m_indicesArray.resize(numberOfCorners);
+
+    int corner = 0;
+    for (int k = 0; k < numberOfChunks; ++k)
+    {
+        const int *chunkCorners = chunks[k].corners.constData();
+        const int numberOfChunkCorners = chunks[k].corners.size() / 3;
+        for (int c = 0; c < numberOfChunkCorners; ++c, ++corner)
+        {
+            const int *tuple = chunkCorners + 3 * c;
+            //Attributes that are not used are not part of the key
+            m_indicesArray[corner] = indexer.index(tuple[0], numberOfTextureCoordinates > 0 ? tuple[1] : -1,
+                                                   useFileNormals ? tuple[2] : -1);
+            positionIndices[corner] = tuple[0];
+        }
+        chunks[k].corners.clear();
+    }
+
+    const int numberOfVertices = indexer.size();
+    const int numberOfTriangles = numberOfCorners / 3;
+    m_vertices.resize(numberOfVertices);
+    m_vertexNormals.resize(numberOfVertices);
+    if (numberOfTextureCoordinates > 0)
+        m_textureCoordinates.resize(numberOfVertices);
+    m_indices.resize(numberOfTriangles);
+
+    //The file does not contain a normal for each corner : compute them from the triangles on the positions,
+    //a seam of texture coordinates must not split the normals
+    QVector<QVector3D> positionNormals;
+    if (!useFileNormals)
+    {
+        Mesh::computeVertexNormals(positions, positionIndices, positionNormals, m_triangleNormals);
+    }
+
+    const int *tuples = indexer.tuples();
+    const QVector3D *vertexNormalsSource = useFileNormals ? normals.constData() : positionNormals.constData();
+    QVector3D *vertices = m_vertices.data();
+    QVector3D *vertexNormals = m_vertexNormals.data();
+    QVector2D *vertexTextureCoordinates = m_textureCoordinates.data();
+
+    parallelFor(numberOfVertices, [=](int begin, int end)
+    {
+        for (int k = begin; k < end; ++k)
+        {
+            const int *tuple = tuples + 3 * k;
+            vertices[k] = positionsData[tuple[0]];
+            vertexNormals[k] = vertexNormalsSource[useFileNormals ? tuple[2] : tuple[0]];
+            if (numberOfTextureCoordinates > 0)
+                vertexTextureCoordinates[k] = (tuple[1] >= 0) ? textureCoordinatesData[tuple[1]] : QVector2D(0.0, 0.0);
+        }
+    });
+
+    const GLuint *indicesArray = m_indicesArray.constData();
+    QVector3D *indices = m_indices.data();
+
+    parallelFor(numberOfTriangles, [=](int begin, int end)
+    {
+        for (int t = begin; t < end; ++t)
+        {
+            indices[t] = QVector3D(indicesArray[3 * t], indicesArray[3 * t + 1], indicesArray[3 * t + 2]);
+        }
+    });
+
+    return true;
+}
+
+enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+struct PlyProperty
+{
+    string name;
+    PlyType type;
+    PlyType countType; //Type of the number of values for a list property
+    bool isList;
+};
+
+struct PlyElement
+{
+    string name;
+    int count;
+    vector<PlyProperty> properties;
+};
+
+static PlyType plyType(const string &name)
+{
+    if (name == "char" || name == "int8") return PLY_INT8;
+    if (name == "uchar" || name == "uint8") return PLY_UINT8;
+    if (name == "short" || name == "int16") return PLY_INT16;
+    if (name == "ushort" || name == "uint16") return PLY_UINT16;
+    if (name == "int" || name == "int32") return PLY_INT32;
+    if (name == "uint" || name == "uint32") return PLY_UINT32;
+    if (name == "float" || name == "float32") return PLY_FLOAT32;
+    if (name == "double" || name == "float64") return PLY_FLOAT64;
+    return PLY_INVALID;
 }
 
+static int plyTypeSize(PlyType type)
+{
+    static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+    return sizes[type];
+}
+
+/**
+ * Reads a little endian value of the given type.
+ */
+static double plyValue(const char *data, PlyType type)
+{
+    const uchar *bytes = (const uchar *)data;
+    switch (type)
+    {
+    case PLY_INT8:
+        return (qint8)bytes[0];
+    case PLY_UINT8:
+        return bytes[0];
+    case PLY_INT16:
+        return (qint16)qFromLittleEndian<quint16>(bytes);
+    case PLY_UINT16:
+        return qFromLittleEndian<quint16>(bytes);
+    case PLY_INT32:
+        return (qint32)qFromLittleEndian<quint32>(bytes);
+    case PLY_UINT32:
+        return qFromLittleEndian<quint32>(bytes);
+    case PLY_FLOAT32:
+    {
+        quint32 bits = qFromLittleEndian<quint32>(bytes);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    case PLY_FLOAT64:
+    {
+        quint64 bits = qFromLittleEndian<quint64>(bytes);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    default:
+        return 0.0;
+    }
+}
+
+static float littleEndianFloat(const char *data)
+{
+    quint32 bits = qFromLittleEndian<quint32>((const uchar *)data);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+bool Mesh::plyReader(const LoadProgress &progress)
+{
+    //ply
+    //format binary_little_endian 1.0
+    //element vertex N
+    //property float x ... (y, z, nx, ny, nz, u, v are used, any other property is skipped)
+    //element face M
+    //property list uchar int vertex_indices
+    //end_header
+    //followed by the binary records of each element, in the order of the header
+
+    MappedFile file(m_fileName);
+
+    if (!file.isOpen())
+    {
+        cerr << "Could not open the file : " << m_fileName << endl;
+        return false;
+    }
+
+    //The header is the only text part of the file
+    const char *endOfFile = file.end();
+    const char *data = 0;
+    static const char endHeader[] = "end_header";
+    for (const char *line = file.begin(); line < endOfFile; )
+    {
+        const char *endOfLine = (const char *)memchr(line, '\n', endOfFile - line);
+        if (!endOfLine)
+            break;
+        if (endOfLine - line >= (int)strlen(endHeader) && strncmp(line, endHeader, strlen(endHeader)) == 0)
+        {
+            data = endOfLine + 1;
+            break;
+        }
+        line = endOfLine + 1;
+    }
+
+    if (file.size() < 3 || strncmp(file.begin(), "ply", 3) != 0 || !data)
+    {
+        cerr << "Invalid PLY header in : " << m_fileName << endl;
+        return false;
+    }
+
+    istringstream header(string(file.begin(), data - file.begin()));
+    vector<PlyElement> elements;
+    string line, format;
+
+    while (getline(header, line))
+    {
+        istringstream words(line);
+        string keyword;
+        words >> keyword;
+
+        if (keyword == "format")
+        {
+            words >> format;
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            element.count = -1;
+            words >> element.name >> element.count;
+            if (element.count < 0)
+            {
+                cerr << "Invalid PLY element count in : " << m_fileName << endl;
+                return false;
+            }
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PlyProperty property;
+            string type;
+            words >> type;
+            property.isList = (type == "list");
+            property.countType = PLY_INVALID;
+            if (property.isList)
+            {
+                string countType;
+                words >> countType >> type;
+                property.countType = plyType(countType);
+            }
+            property.type = plyType(type);
+            words >> property.name;
+
+            if (property.type == PLY_INVALID || (property.isList && property.countType == PLY_INVALID))
+            {
+                cerr << "Unknown PLY property type in : " << m_fileName << endl;
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    if (format != "binary_little_endian")
+    {
+        cerr << "Only binary little endian PLY files are supported : " << m_fileName << endl;
+        return false;
+    }
+
+    bool hasNormals = false;
+    int numberOfInvalidFaces = 0;
+
+    for (unsigned int e = 0; e < elements.size(); ++e)
+    {
+        const PlyElement &element = elements[e];
+        const vector<PlyProperty> &properties = element.properties;
+
+        if (element.name == "vertex")
+        {
+            //Position of each property in a vertex record (vertex properties are never lists)
+            int recordSize = 0;
+            int x = -1, y = -1, z = -1, nx = -1, ny = -1, nz = -1, u = -1, v = -1;
+            vector<int> offsets(properties.size());
+            for (unsigned int p = 0; p < properties.size(); ++p)
+            {
+                const string &name = properties[p].name;
+                offsets[p] = recordSize;
+                recordSize += plyTypeSize(properties[p].type);
+
+                if (name == "x") x = p;
+                else if (name == "y") y = p;
+                else if (name == "z") z = p;
+                else if (name == "nx") nx = p;
+                else if (name == "ny") ny = p;
+                else if (name == "nz") nz = p;
+                else if (name == "u" || name == "s" || name == "texture_u") u = p;
+                else if (name == "v" || name == "t" || name == "texture_v") v = p;
+
+                if (properties[p].isList)
+                {
+                    cerr << "List properties of vertices are not supported : " << m_fileName << endl;
+                    return false;
+                }
+            }
+
+            if (x < 0 || y < 0 || z < 0 || (qint64)element.count * recordSize > endOfFile - data)
+            {
+                cerr << "Invalid PLY vertices in : " << m_fileName << endl;
+                return false;
+            }
+
+            hasNormals = (nx >= 0 && ny >= 0 && nz >= 0);
+            bool hasTextureCoordinates = (u >= 0 && v >= 0);
+
+            m_vertices.resize(element.count);
+            if (hasNormals)
+                m_vertexNormals.resize(element.count);
+            if (hasTextureCoordinates)
+                m_textureCoordinates.resize(element.count);
+
+            for (int i = 0; i < element.count; ++i, data += recordSize)
+            {
+                if (!reportReadProgress(progress, i, data, file))
+                    return false;
+
+                m_vertices[i] = QVector3D(plyValue(data + offsets[x], properties[x].type),
+                                          plyValue(data + offsets[y], properties[y].type),
+                                          plyValue(data + offsets[z], properties[z].type));
+                if (hasNormals)
+                {
+                    QVector3D normal(plyValue(data + offsets[nx], properties[nx].type),
+                                     plyValue(data + offsets[ny], properties[ny].type),
+                                     plyValue(data + offsets[nz], properties[nz].type));
+                    normal.normalize();
+                    m_vertexNormals[i] = normal;
+                }
+                if (hasTextureCoordinates)
+                {
+                    m_textureCoordinates[i] = QVector2D(plyValue(data + offsets[u], properties[u].type),
+                                                        plyValue(data + offsets[v], properties[v].type));
+                }
+            }
+        }
+        else
+        {
+            //Faces are split in triangle fans, any other element is skipped
+            bool isFace = (element.name == "face");
+
+            //Smallest size of a record (empty lists) : checked before reserving for a count read from the header
+            int minimumRecordSize = 0;
+            for (unsigned int p = 0; p < properties.size(); ++p)
+                minimumRecordSize += plyTypeSize(properties[p].isList ? properties[p].countType : properties[p].type);
+            if ((qint64)element.count * minimumRecordSize > endOfFile - data)
+            {
+                cerr << "Truncated PLY file : " << m_fileName << endl;
+                return false;
+            }
+
+            if (isFace)
+            {
+                m_indices.reserve(m_indices.size() + element.count);
+                m_indicesArray.reserve(m_indicesArray.size() + 3 * element.count);
+            }
+
+            const int numberOfVertices = m_vertices.size();
+            for (int i = 0; i < element.count; ++i)
+            {
+                if (!reportReadProgress(progress, i, data, file))
+                    return false;
+
+                for (unsigned int p = 0; p < properties.size(); ++p)
+                {
+                    const PlyProperty &property = properties[p];
+                    const int valueSize = plyTypeSize(property.type);
+
+                    if (!property.isList)
+                    {
+                        if (valueSize > endOfFile - data)
+                        {
+                            cerr << "Truncated PLY file : " << m_fileName << endl;
+                            return false;
+                        }
+                        data += valueSize;
+                        continue;
+                    }
+
+                    const int countSize = plyTypeSize(property.countType);
+                    if (countSize > endOfFile - data)
+                    {
+                        cerr << "Truncated PLY file : " << m_fileName << endl;
+                        return false;
+                    }
+
+                    int count = (int)plyValue(data, property.countType);
+                    data += countSize;
+                    if (count < 0 || (qint64)count * valueSize > endOfFile - data)
+                    {
+                        cerr << "Truncated PLY file : " << m_fileName << endl;
+                        return false;
+                    }
+
+                    if (isFace && (property.name == "vertex_indices" || property.name == "vertex_index"))
+                    {
+                        bool isValid = (count >= 3);
+                        for (int k = 0; k < count && isValid; ++k)
+                        {
+                            double index = plyValue(data + k * valueSize, property.type);
+                            isValid = (index >= 0 && index < numberOfVertices);
+                        }
+
+                        if (isValid)
+                        {
+                            GLuint index1 = (GLuint)plyValue(data, property.type);
+                            for (int k = 1; k + 1 < count; ++k)
+                            {
+                                GLuint index2 = (GLuint)plyValue(data + k * valueSize, property.type);
+                                GLuint index3 = (GLuint)plyValue(data + (k + 1) * valueSize, property.type);
+                                m_indices.push_back(QVector3D(index1, index2, index3));
+                                m_indicesArray.push_back(index1);
+                                m_indicesArray.push_back(index2);
+                                m_indicesArray.push_back(index3);
+                            }
+                        }
+                        else
+                        {
+                            ++numberOfInvalidFaces;
+                        }
+                    }
 
-Mesh::Mesh(const string& fileName) : m_fileName(fileName), m_vertices(QVector<QVector3D>()), m_indices(QVector<QVector3D>()),
-m_indicesArray(QVector<GLuint>()), m_triangleNormals(QVector<QVector3D>()),
-m_vertexNormals(QVector<QVector3D>()), m_textureCoordinates(QVector<QVector2D>())
-{
+                    data += count * valueSize;
+                }
+            }
+        }
+    }
 
-}
+    if (numberOfInvalidFaces > 0)
+    {
+        cerr << numberOfInvalidFaces << " invalid faces ignored in : " << m_fileName << endl;
+    }
 
-Mesh::~Mesh()
-{
+    if (!hasNormals)
+    {
+        this->computeVertexNormals();
+    }
 
+    return true;
 }
 
-void Mesh::offReader()
+//Two STL vertices closer than this fraction of the size of the model are merged
+static const float STL_WELD_TOLERANCE = 1e-6f;
+
+bool Mesh::stlReader(const LoadProgress &progress)
 {
-    ifstream file(m_fileName.c_str(), ios::in);
+    //80 bytes header
+    //uint32 number of triangles
+    //for each triangle (50 bytes) : float normal[3], float vertex1[3], float vertex2[3], float vertex3[3], uint16 attribute
 
-    if (!file)
+    MappedFile file(m_fileName);
+
+    if (!file.isOpen())
     {
         cerr << "Could not open the file : " << m_fileName << endl;
-        exit(-1);
+        return false;
     }
 
-    string fileType;
-    string numberOfVertices, numberOfTriangles, numberOfEdges;
-    string data;
-    string xVertex, yVertex, zVertex;
-    string vertex1, vertex2, vertex3;
-    int index1 = 0, index2 = 0, index3 = 0;
-    string numberOfIndices;
-
-    file >> fileType;
-    //Add and exception
-
-
-    file >> numberOfVertices >> numberOfTriangles >> numberOfEdges;
-    m_vertices.resize(atoi(numberOfVertices.c_str()));
-    m_indices.resize(atoi(numberOfTriangles.c_str()));
-
-    //Blank line
-    getline(file, data);
+    const int headerSize = 84, triangleSize = 50;
+    if (file.size() < headerSize)
+    {
+        cerr << "Invalid STL file : " << m_fileName << endl;
+        return false;
+    }
 
-    //Vertices
-    for (int i = 0; i < atoi(numberOfVertices.c_str()); i++)
+    const quint32 numberOfTriangles = qFromLittleEndian<quint32>((const uchar *)file.begin() + 80);
+    if (file.size() != headerSize + (qint64)triangleSize * numberOfTriangles)
     {
-        file >> xVertex >> yVertex >> zVertex;
-        m_vertices[i] = QVector3D(atof(xVertex.c_str()), atof(yVertex.c_str()), atof(zVertex.c_str()));
+        cerr << "Only binary STL files are supported : " << m_fileName << endl;
+        return false;
     }
 
-    //Indices and normals for each triangle
-    QVector3D crossProduct;
-    for (int i = 0; i < atoi(numberOfTriangles.c_str()); i++)
+    const char *triangles = file.begin() + headerSize;
+
+    //Bounding box : the welding tolerance is relative to the size of the model
+    QVector3D minimum(0.0, 0.0, 0.0), maximum(0.0, 0.0, 0.0);
+    for (quint32 t = 0; t < numberOfTriangles; ++t)
     {
-        file >> numberOfIndices >> vertex1 >> vertex2 >> vertex3;
-        index1 = atoi(vertex1.c_str());
-        index2 = atoi(vertex2.c_str());
-        index3 = atoi(vertex3.c_str());
+        for (int c = 0; c < 3; ++c)
+        {
+            const char *corner = triangles + t * triangleSize + 12 * (c + 1);
+            QVector3D position(littleEndianFloat(corner), littleEndianFloat(corner + 4), littleEndianFloat(corner + 8));
+            if (t == 0 && c == 0)
+            {
+                minimum = maximum = position;
+                continue;
+            }
+            minimum = QVector3D(min(minimum.x(), position.x()), min(minimum.y(), position.y()), min(minimum.z(), position.z()));
+            maximum = QVector3D(max(maximum.x(), position.x()), max(maximum.y(), position.y()), max(maximum.z(), position.z()));
+        }
+    }
 
-        //Indices for each triangle
-        m_indices[i] = QVector3D(index1, index2, index3);
+    float cellSize = STL_WELD_TOLERANCE * (maximum - minimum).length();
+    if (!(cellSize > 0.0))
+        cellSize = 1.0;
 
-        //List of indices for OpenGL rendering
-        m_indicesArray.push_back(index1);
-        m_indicesArray.push_back(index2);
-        m_indicesArray.push_back(index3);
+    //Spatial hash : the vertices are chained by cell of the welding grid.
+    //A closed mesh has about half as many vertices as triangles.
+    TupleIndexer cells(numberOfTriangles / 2);
+    QVector<int> firstVertexOfCell;
+    QVector<int> nextVertexInCell;
+    firstVertexOfCell.reserve(numberOfTriangles / 2 + 3);
+    nextVertexInCell.reserve(numberOfTriangles / 2 + 3);
 
-        //Compute the normal NORMALIZED
-        /*   v3
-         * v1__v2
-         * normal = (v2-v1)^(v3-v1)
-         */
-        crossProduct = QVector3D::crossProduct(m_vertices[index1] - m_vertices[index2], m_vertices[index1] - m_vertices[index3]);
-        crossProduct.normalize();
-        m_triangleNormals.push_back(crossProduct);
-    }
+    m_vertices.reserve(numberOfTriangles / 2 + 3);
+    m_indices.reserve(numberOfTriangles);
+    m_indicesArray.reserve(3 * numberOfTriangles);
 
-    m_vertexNormals.resize(m_vertices.size());
-    QVector3D vector1;
-    QVector3D vector2;
+    int numberOfDegenerateTriangles = 0;
+    const float squaredTolerance = cellSize * cellSize;
 
-    //Compute the normals for each vertex
-    for (int k = 0; k < m_vertices.size(); k++)
+    for (quint32 t = 0; t < numberOfTriangles; ++t)
     {
-        m_vertexNormals[k] = QVector3D(0.0, 0.0, 0.0);
-        for (int i = 0; i < m_indices.size(); i++)
+        if (!reportReadProgress(progress, t, triangles + (qint64)t * triangleSize, file))
+            return false;
+
+        GLuint indices[3];
+
+        for (int c = 0; c < 3; ++c)
         {
-            //If the vertex k belongs to triangle i
-            if (m_indices[i].x() == k)
-            {
-                /*   z
-                 * kx__y
-                 * angle = acos(kxy.kxz)
-                 */
-                vector1 = m_vertices[m_indices[i].y()] - m_vertices[k];
-                vector2 = m_vertices[m_indices[i].z()] - m_vertices[k];
-                vector1.normalize();
-                vector2.normalize();
-                m_vertexNormals[k] += acos(QVector3D::dotProduct(vector1, vector2))*m_triangleNormals[i];
-            }
-            else if (m_indices[i].y() == k)
+            const char *corner = triangles + t * triangleSize + 12 * (c + 1);
+            QVector3D position(littleEndianFloat(corner), littleEndianFloat(corner + 4), littleEndianFloat(corner + 8));
+
+            //Cell of the welding grid containing the vertex
+            int cellX = (int)floor((position.x() - minimum.x()) / cellSize);
+            int cellY = (int)floor((position.y() - minimum.y()) / cellSize);
+            int cellZ = (int)floor((position.z() - minimum.z()) / cellSize);
+
+            //A vertex closer than cellSize is in this cell or one of its neighbours.
+            //The cell of the corner is searched first : shared corners are usually bit-identical.
+            int weldedVertex = -1;
+            for (int n = 0; n < 27 && weldedVertex < 0; ++n)
             {
-                /*   z
-                 * x__ky
-                 * angle = acos(kxy.kxz)
-                 */
-                vector1 = m_vertices[m_indices[i].z()] - m_vertices[k];
-                vector2 = m_vertices[m_indices[i].x()] - m_vertices[k];
-                vector1.normalize();
-                vector2.normalize();
-                m_vertexNormals[k] += acos(QVector3D::dotProduct(vector1, vector2))*m_triangleNormals[i];
+                int offsetX = (n % 3 + 1) % 3 - 1;
+                int offsetY = (n / 3 % 3 + 1) % 3 - 1;
+                int offsetZ = (n / 9 + 1) % 3 - 1;
+                int cell = cells.find(cellX + offsetX, cellY + offsetY, cellZ + offsetZ);
+                if (cell < 0)
+                    continue;
+                for (int v = firstVertexOfCell[cell]; v >= 0; v = nextVertexInCell[v])
+                {
+                    if ((m_vertices[v] - position).lengthSquared() <= squaredTolerance)
+                    {
+                        weldedVertex = v;
+                        break;
+                    }
+                }
             }
-            else if (m_indices[i].z() == k)
+
+            if (weldedVertex < 0)
             {
-                /*   kz
-                 * x__y
-                 * angle = acos(kxy.kxz)
-                 */
-                vector1 = m_vertices[m_indices[i].x()] - m_vertices[k];
-                vector2 = m_vertices[m_indices[i].y()] - m_vertices[k];
-                vector1.normalize();
-                vector2.normalize();
-                m_vertexNormals[k] += acos(QVector3D::dotProduct(vector1, vector2))*m_triangleNormals[i];
+                int cell = cells.index(cellX, cellY, cellZ);
+                if (cell == firstVertexOfCell.size())
+                    firstVertexOfCell.push_back(-1);
+                weldedVertex = m_vertices.size();
+                m_vertices.push_back(position);
+                nextVertexInCell.push_back(firstVertexOfCell[cell]);
+                firstVertexOfCell[cell] = weldedVertex;
             }
+
+            indices[c] = weldedVertex;
+        }
+
+        //Triangles smaller than the welding tolerance disappear
+        if (indices[0] == indices[1] || indices[1] == indices[2] || indices[0] == indices[2])
+        {
+            ++numberOfDegenerateTriangles;
+            continue;
         }
-        m_vertexNormals[k].normalize();
+
+        m_indices.push_back(QVector3D(indices[0], indices[1], indices[2]));
+        m_indicesArray.push_back(indices[0]);
+        m_indicesArray.push_back(indices[1]);
+        m_indicesArray.push_back(indices[2]);
+    }
+
+    if (numberOfDegenerateTriangles > 0)
+    {
+        cerr << numberOfDegenerateTriangles << " degenerate triangles ignored in : " << m_fileName << endl;
     }
 
-    file.close();
+    //The normals of the file are per triangle : compute smooth normals on the welded mesh
+    this->computeVertexNormals();
+
+    return true;
 }
 
-void Mesh::objReader()
+/**
+ * Angle between the edges (v2-v1) and (v3-v1) at the corner v1 of a triangle.
+ */
+static float cornerAngle(const QVector3D &v1, const QVector3D &v2, const QVector3D &v3)
 {
-    //Assumes vertices first, then normals, then texture coordinates
-    //# comments
-    //Empty line
-    //v x y z =  vertex
-    //# number vertices
-    //Empty line
-    //vn x y z =  normal
-    //# number normals
-    //Empty line
-    //vt x y 0.0 = texture coordinate
-    //# number texture coordinates
-    //Empty line
-    //g Teapot
-    //f v1/vn1/vt1 v2/vn2/vt2 v3/vn3/vt3 v4/vn4/vt4 Quad face indices //BOTH quads and triangles !!
-    //f v1/vn1/vt1 v2/vn2/vt2 v3/vn3/vt3 Triangle face indices
-    //# number faces
-    //Empty line
-    // !!! Indices in f v1/vn1/vt1 start at 1 and not 0!
-
-    ifstream file(m_fileName.c_str(), ios::in);
-
-    if (!file)
-    {
-        cerr << "Could not open the file : " << m_fileName << endl;
-        exit(-1);
-    }
-    else
-    {
-        string comments;
-        string dataType;
+    QVector3D vector1 = v2 - v1;
+    QVector3D vector2 = v3 - v1;
+    vector1.normalize();
+    vector2.normalize();
+    return acos(QVector3D::dotProduct(vector1, vector2));
+}
 
-        //Skip the comments
-        getline(file, comments);
-        while ((comments.size() > 0) && (comments[0] == '#'))
-        {
-            getline(file, comments);
-        }
+void Mesh::computeVertexNormals()
+{
+    Mesh::computeVertexNormals(m_vertices, m_indicesArray, m_vertexNormals, m_triangleNormals);
+}
 
-        //Empty line is in the last string comments
-        //Now starts the vertices
-        string xVertex, yVertex, zVertex;
-        do
-        {
-            file >> dataType;
-            if (dataType == "v")
-            {
-                file >> xVertex >> yVertex >> zVertex;
-                m_vertices.push_back(QVector3D(atof(xVertex.c_str()), atof(yVertex.c_str()), atof(zVertex.c_str())));
-            }
-        } while (dataType[0] != '#' && dataType.size() > 0);;
+void Mesh::computeVertexNormals(const QVector<QVector3D> &vertexList, const QVector<GLuint> &indicesArray,
+                                QVector<QVector3D> &vertexNormalList, QVector<QVector3D> &triangleNormalList)
+{
+    const int numberOfTriangles = indicesArray.size() / 3;
+    const int numberOfVertices = vertexList.size();
 
-        //Resize the texture coordinates vector
-        m_textureCoordinates.resize(m_vertices.size());
+    triangleNormalList.resize(numberOfTriangles);
+    vertexNormalList.resize(numberOfVertices);
 
-        //Skip the comment line and blank line
-        getline(file, comments);
-        getline(file, comments);
+    //Contribution of each corner of each triangle : angle at the corner * normal of the triangle
+    //A corner that repeats a vertex of the same triangle does not contribute (degenerate triangle)
+    QVector<QVector3D> cornerNormals(3 * numberOfTriangles);
+    QVector<char> cornerIsValid(3 * numberOfTriangles);
 
-        //Now starts the normals
-        string xNormal, yNormal, zNormal;
-        int normalIndex = 0;
-        do
+    const GLuint *indices = indicesArray.constData();
+    const QVector3D *vertices = vertexList.constData();
+    QVector3D *triangleNormals = triangleNormalList.data();
+    QVector3D *corners = cornerNormals.data();
+    char *valid = cornerIsValid.data();
+
+    parallelFor(numberOfTriangles, [=](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
         {
+            GLuint index1 = indices[3 * i];
+            GLuint index2 = indices[3 * i + 1];
+            GLuint index3 = indices[3 * i + 2];
 
-            file >> dataType;
-            if (dataType == "vn")
+            if (index1 >= (GLuint)numberOfVertices || index2 >= (GLuint)numberOfVertices || index3 >= (GLuint)numberOfVertices)
             {
-                file >> xNormal >> yNormal >> zNormal;
-                m_vertexNormals.push_back(QVector3D(atof(xNormal.c_str()), atof(yNormal.c_str()), atof(zNormal.c_str())));
-                m_vertexNormals[normalIndex].normalize(); //The normal might not be normalized!
+                triangleNormals[i] = QVector3D(0.0, 0.0, 0.0);
+                valid[3 * i] = valid[3 * i + 1] = valid[3 * i + 2] = 0;
+                continue;
             }
-            ++normalIndex;
-        } while (dataType[0] != '#' && dataType.size() > 0);
 
-        //Skip the comment line and blank line
-        getline(file, comments);
-        getline(file, comments);
+            const QVector3D &v1 = vertices[index1];
+            const QVector3D &v2 = vertices[index2];
+            const QVector3D &v3 = vertices[index3];
+
+            //Compute the normal NORMALIZED
+            /*   v3
+             * v1__v2
+             * normal = (v2-v1)^(v3-v1)
+             */
+            QVector3D crossProduct = QVector3D::crossProduct(v1 - v2, v1 - v3);
+            crossProduct.normalize();
+            triangleNormals[i] = crossProduct;
+
+            /*   v3
+             * v1__v2
+             * angle at v1 = acos(v1v2.v1v3), at v2 = acos(v2v3.v2v1), at v3 = acos(v3v1.v3v2)
+             */
+            corners[3 * i] = cornerAngle(v1, v2, v3) * crossProduct;
+            corners[3 * i + 1] = cornerAngle(v2, v3, v1) * crossProduct;
+            corners[3 * i + 2] = cornerAngle(v3, v1, v2) * crossProduct;
+
+            valid[3 * i] = 1;
+            valid[3 * i + 1] = (index2 != index1);
+            valid[3 * i + 2] = (index3 != index1 && index3 != index2);
+        }
+    });
+
+    //Group the corners by vertex (counting sort). The corners of a vertex stay in triangle order
+    //so the sums below are accumulated in the same order as a loop over the triangles.
+    QVector<int> firstCorner(numberOfVertices + 1, 0);
+    for (int c = 0; c < 3 * numberOfTriangles; ++c)
+    {
+        if (valid[c])
+            ++firstCorner[indices[c] + 1];
+    }
+
+    for (int k = 0; k < numberOfVertices; ++k)
+    {
+        firstCorner[k + 1] += firstCorner[k];
+    }
+
+    QVector<int> cornersOfVertex(firstCorner[numberOfVertices]);
+    QVector<int> insertPosition = firstCorner;
+    for (int c = 0; c < 3 * numberOfTriangles; ++c)
+    {
+        if (valid[c])
+            cornersOfVertex[insertPosition[indices[c]]++] = c;
+    }
+
+    //Sum and normalize the contributions of each vertex
+    const int *vertexCorners = cornersOfVertex.constData();
+    const int *vertexFirstCorner = firstCorner.constData();
+    QVector3D *vertexNormals = vertexNormalList.data();
 
-        //Now starts the texture coordinates
-        string xTexture, yTexture, zTexture;
-        QVector<QVector2D> textureCoordinates;
-        do
+    parallelFor(numberOfVertices, [=](int begin, int end)
+    {
+        for (int k = begin; k < end; ++k)
         {
-            file >> dataType;
-            if (dataType == "vt")
+            QVector3D normal(0.0, 0.0, 0.0);
+            for (int c = vertexFirstCorner[k]; c < vertexFirstCorner[k + 1]; ++c)
             {
-                file >> xTexture >> yTexture >> zTexture;
-                //zTexture is always 0.0
-                float u = atof(xTexture.c_str());
-                float v = atof(yTexture.c_str());
-                //U,V can be above 1.0 : use GL_REPEAT for the texture
-                textureCoordinates.push_back(QVector2D(u, v));
+                normal += corners[vertexCorners[c]];
             }
-        } while (dataType[0] != '#' && dataType.size() > 0);
+            vertexNormals[k] = normal;
+        }
+
+        MeshKernels::normalize(vertexNormals + begin, end - begin);
+    });
+}
+
+/**
+ * Unit vector orthogonal to a unit normal.
+ */
+static QVector3D orthogonalTangent(const QVector3D &normal)
+{
+    QVector3D axis = (fabs(normal.x()) < 0.9f) ? QVector3D(1.0, 0.0, 0.0) : QVector3D(0.0, 1.0, 0.0);
+    return QVector3D::crossProduct(QVector3D::crossProduct(normal, axis), normal).normalized();
+}
 
-        //Skip the comment line the blank line and the g teapot line
-        getline(file, comments);
-        getline(file, comments);
-        getline(file, comments);
+/**
+ * Component of a vector in the plane orthogonal to a unit normal, normalized.
+ */
+static QVector3D projectOnPlane(const QVector3D &vector, const QVector3D &normal)
+{
+    return (vector - QVector3D::dotProduct(vector, normal) * normal).normalized();
+}
+
+void Mesh::computeTangents()
+{
+    const int numberOfTriangles = m_indicesArray.size() / 3;
+    int numberOfVertices = m_vertices.size();
 
-        //Now starts the faces
-        //These are stored as a quad and as triangles
-        // 1---4 == Two triangles : 123 and 134
-        // 2---3
-        string faceLine, vertexInfo[4];
+    m_tangents.resize(numberOfVertices);
 
-        do
+    if (m_textureCoordinates.size() != numberOfVertices || m_vertexNormals.size() != numberOfVertices)
+    {
+        for (int v = 0; v < numberOfVertices; ++v)
         {
+            QVector3D normal = (v < m_vertexNormals.size()) ? m_vertexNormals[v] : QVector3D(0.0, 0.0, 1.0);
+            m_tangents[v] = QVector4D(orthogonalTangent(normal), 1.0);
+        }
+        return;
+    }
 
-            //Initialise
-            for (unsigned int k = 0; k < 4; ++k)
-            {
-                vertexInfo[k] = string("");
-            }
+    //Tangent of each triangle (direction of increasing u) and orientation of its UVs :
+    //1 if they preserve the orientation of the triangle, 0 if they are mirrored, -1 if the triangle has no tangent
+    QVector<QVector3D> triangleTangentList(numberOfTriangles);
+    QVector<char> triangleOrientationList(numberOfTriangles);
 
-            //read the line
-            getline(file, faceLine);
+    const GLuint *indices = m_indicesArray.constData();
+    const QVector3D *vertices = m_vertices.constData();
+    const QVector2D *textureCoordinates = m_textureCoordinates.constData();
+    QVector3D *triangleTangents = triangleTangentList.data();
+    char *triangleOrientations = triangleOrientationList.data();
 
-            //Parse the line to store separately the information of the primitive
-            //The primitive can be a Quad (4 vertices) or a triangle (3 vertices)
-            if (faceLine.size() > 0 && faceLine[0] == 'f')
-            {
-                int index = 0;
-                //Parse the string
-                //Start from the first integer at position 2
-                for (unsigned int k = 2; k < faceLine.size(); ++k)
-                {
-                    if (faceLine[k] == ' ')
-                    {
-                        ++index;
-                    }
-                    else
-                    {
-                        //The line might end with a ' ' producing a buffer overflow
-                        //Check index to avoid that
-                        if (index < 4)
-                        {
-                            vertexInfo[index] += faceLine[k];
-                        }
-                    }
-                }
+    parallelFor(numberOfTriangles, [=](int begin, int end)
+    {
+        for (int t = begin; t < end; ++t)
+        {
+            GLuint index1 = indices[3 * t], index2 = indices[3 * t + 1], index3 = indices[3 * t + 2];
+            triangleOrientations[t] = -1;
 
-                //If the last vertex has a size>1 then it is a quad otherwise it is a triangle
-                //The line might end with a ' ' hence size>1
-                if (vertexInfo[3].size() > 1)
-                {
-                    //[0] = vertex number ; [1] = texture coordinate number ; [2] = normal number at vertex
-                    int faceValues1[3], faceValues2[3], faceValues3[3], faceValues4[3];
-                    vertexInfo[0] += "/"; //Add a final delimiter
-                    parseString(vertexInfo[0], '/', faceValues1, 3);
-
-                    vertexInfo[1] += "/"; //Add a final delimiter
-                    parseString(vertexInfo[1], '/', faceValues2, 3);
-
-                    vertexInfo[2] += "/"; //Add a final delimiter
-                    parseString(vertexInfo[2], '/', faceValues3, 3);
-
-                    vertexInfo[3] += "/"; //Add a final delimiter
-                    parseString(vertexInfo[3], '/', faceValues4, 3);
-
-                    //Divide the quad into two triangles
-                    //Push the indices of the two triangles
-                    m_indices.push_back(QVector3D(faceValues1[0] - 1, faceValues2[0] - 1, faceValues3[0] - 1));
-                    m_indices.push_back(QVector3D(faceValues1[0] - 1, faceValues3[0] - 1, faceValues4[0] - 1));
-                    m_indicesArray.push_back(faceValues1[0] - 1); m_indicesArray.push_back(faceValues2[0] - 1); m_indicesArray.push_back(faceValues3[0] - 1);
-                    m_indicesArray.push_back(faceValues1[0] - 1); m_indicesArray.push_back(faceValues3[0] - 1); m_indicesArray.push_back(faceValues4[0] - 1);
-
-                    //Associate the texture coordinates
-                    m_textureCoordinates[faceValues1[0] - 1] = textureCoordinates[faceValues1[1] - 1];
-                    m_textureCoordinates[faceValues2[0] - 1] = (textureCoordinates[faceValues2[1] - 1]);
-                    m_textureCoordinates[faceValues3[0] - 1] = (textureCoordinates[faceValues3[1] - 1]);
-                    m_textureCoordinates[faceValues4[0] - 1] = (textureCoordinates[faceValues4[1] - 1]);
-                }
-                else
-                {
-                    //[0] = vertex number ; [1] = texture coordinate number ; [2] = normal number at vertex
-                    int faceValues1[3], faceValues2[3], faceValues3[3];
-                    vertexInfo[0] += "/"; //Add a final delimiter
-                    parseString(vertexInfo[0], '/', faceValues1, 3);
+            if (index1 >= (GLuint)numberOfVertices || index2 >= (GLuint)numberOfVertices || index3 >= (GLuint)numberOfVertices)
+                continue;
+
+            QVector3D edge1 = vertices[index2] - vertices[index1];
+            QVector3D edge2 = vertices[index3] - vertices[index1];
+            QVector2D uvEdge1 = textureCoordinates[index2] - textureCoordinates[index1];
+            QVector2D uvEdge2 = textureCoordinates[index3] - textureCoordinates[index1];
 
-                    vertexInfo[1] += "/"; //Add a final delimiter
-                    parseString(vertexInfo[1], '/', faceValues2, 3);
+            //Twice the signed area of the triangle in the UV space
+            float signedArea = uvEdge1.x() * uvEdge2.y() - uvEdge1.y() * uvEdge2.x();
+            QVector3D tangent = uvEdge2.y() * edge1 - uvEdge1.y() * edge2;
 
-                    vertexInfo[2] += "/"; //Add a final delimiter
-                    parseString(vertexInfo[2], '/', faceValues3, 3);
+            if (signedArea == 0.0f || tangent.isNull())
+                continue;
 
-                    //Divide the quad into two triangles
-                    //Push the indices of the two triangles
-                    m_indices.push_back(QVector3D(faceValues1[0] - 1, faceValues2[0] - 1, faceValues3[0] - 1));
-                    m_indicesArray.push_back(faceValues1[0] - 1); m_indicesArray.push_back(faceValues2[0] - 1); m_indicesArray.push_back(faceValues3[0] - 1);
+            triangleTangents[t] = (signedArea > 0.0f ? 1.0f : -1.0f) * tangent.normalized();
+            triangleOrientations[t] = (signedArea > 0.0f) ? 1 : 0;
+        }
+    });
 
+    //Corners of each vertex (counting sort)
+    QVector<int> firstCorner(numberOfVertices + 1, 0);
+    for (int c = 0; c < 3 * numberOfTriangles; ++c)
+    {
+        if (triangleOrientations[c / 3] >= 0)
+            ++firstCorner[indices[c] + 1];
+    }
 
-                    //Associate the texture coordinates
-                    m_textureCoordinates[faceValues1[0] - 1] = textureCoordinates[faceValues1[1] - 1];
-                    m_textureCoordinates[faceValues2[0] - 1] = (textureCoordinates[faceValues2[1] - 1]);
-                    m_textureCoordinates[faceValues3[0] - 1] = (textureCoordinates[faceValues3[1] - 1]);
-                }
-            }
-        } while (faceLine[0] != '#' && faceLine.size() > 0);
+    for (int v = 0; v < numberOfVertices; ++v)
+    {
+        firstCorner[v + 1] += firstCorner[v];
     }
-}
 
-void Mesh::parseString(string input, char delimiter, int values[], int numberOfValues)
-{
-    int k = 0;
+    QVector<int> cornersOfVertex(firstCorner[numberOfVertices]);
+    QVector<int> insertPosition = firstCorner;
+    for (int c = 0; c < 3 * numberOfTriangles; ++c)
+    {
+        if (triangleOrientations[c / 3] >= 0)
+            cornersOfVertex[insertPosition[indices[c]]++] = c;
+    }
 
-    string temp("");
-    for (unsigned int i = 0; i < input.size(); ++i)
+    //The mirrored corners of a vertex shared by both orientations move to a copy of the vertex
+    QVector<int> mirroredVertex(numberOfVertices, -1);
+    for (int v = 0; v < numberOfVertices; ++v)
     {
-        if (input[i] == delimiter)
+        bool preserved = false, mirrored = false;
+        for (int c = firstCorner[v]; c < firstCorner[v + 1]; ++c)
         {
-            if (k < numberOfValues)
-            {
-                values[k] = atoi(temp.c_str());
-                ++k;
-                temp = "";
-            }
+            if (triangleOrientations[cornersOfVertex[c] / 3] == 1)
+                preserved = true;
+            else
+                mirrored = true;
         }
-        else
+
+        if (preserved && mirrored)
+        {
+            mirroredVertex[v] = m_vertices.size();
+            m_vertices.push_back(m_vertices[v]);
+            m_vertexNormals.push_back(m_vertexNormals[v]);
+            m_textureCoordinates.push_back(m_textureCoordinates[v]);
+        }
+    }
+
+    if (m_vertices.size() > numberOfVertices)
+    {
+        qDebug() << m_vertices.size() - numberOfVertices << "vertices with mirrored texture coordinates duplicated in"
+                 << QString::fromStdString(m_fileName);
+
+        for (int c = 0; c < 3 * numberOfTriangles; ++c)
         {
-            temp += input[i];
+            GLuint index = m_indicesArray[c];
+            if (index < (GLuint)numberOfVertices && mirroredVertex[index] >= 0 && triangleOrientations[c / 3] == 0)
+                m_indicesArray[c] = mirroredVertex[index];
         }
 
+        m_indices.resize(numberOfTriangles);
+        for (int t = 0; t < numberOfTriangles; ++t)
+        {
+            m_indices[t] = QVector3D(m_indicesArray[3 * t], m_indicesArray[3 * t + 1], m_indicesArray[3 * t + 2]);
+        }
+
+        indices = m_indicesArray.constData();
+        m_tangents.resize(m_vertices.size());
     }
+
+    //Sum of the tangents of the corners projected on the plane of the normal, weighted by the angle of the corner
+    vertices = m_vertices.constData();
+    const QVector3D *vertexNormals = m_vertexNormals.constData();
+    const int *vertexFirstCorner = firstCorner.constData();
+    const int *vertexCorners = cornersOfVertex.constData();
+    const int *vertexCopies = mirroredVertex.constData();
+    QVector4D *tangents = m_tangents.data();
+
+    parallelFor(numberOfVertices, [=](int begin, int end)
+    {
+        for (int v = begin; v < end; ++v)
+        {
+            QVector3D sum[2] = { QVector3D(0.0, 0.0, 0.0), QVector3D(0.0, 0.0, 0.0) };
+            bool hasOrientation[2] = { false, false };
+            const QVector3D &normal = vertexNormals[v];
+
+            for (int c = vertexFirstCorner[v]; c < vertexFirstCorner[v + 1]; ++c)
+            {
+                int corner = vertexCorners[c];
+                int t = corner / 3;
+                int orientation = triangleOrientations[t];
+
+                //Edges of the corner in the plane of the normal
+                const QVector3D &p = vertices[v];
+                QVector3D next = projectOnPlane(vertices[indices[3 * t + (corner + 1) % 3]] - p, normal);
+                QVector3D previous = projectOnPlane(vertices[indices[3 * t + (corner + 2) % 3]] - p, normal);
+                float angle = acos(min(max(QVector3D::dotProduct(next, previous), -1.0f), 1.0f));
+
+                sum[orientation] += angle * projectOnPlane(triangleTangents[t], normal);
+                hasOrientation[orientation] = true;
+            }
+
+            //Vertex and its mirrored copy (if any)
+            int vertexOfOrientation[2] = { vertexCopies[v] >= 0 ? vertexCopies[v] : v, v };
+            for (int orientation = 0; orientation < 2; ++orientation)
+            {
+                if (!hasOrientation[orientation])
+                    continue;
+
+                QVector3D tangent = sum[orientation].isNull() ? orthogonalTangent(normal) : sum[orientation].normalized();
+                tangents[vertexOfOrientation[orientation]] = QVector4D(tangent, orientation == 1 ? 1.0 : -1.0);
+            }
+
+            //Vertex of degenerate triangles only
+            if (!hasOrientation[0] && !hasOrientation[1])
+                tangents[v] = QVector4D(orthogonalTangent(normal), 1.0);
+        }
+    });
 }
 
 void Mesh::setTextureCoordinates()
@@ -416,176 +1575,343 @@ void Mesh::setTextureCoordinates()
     m_textureCoordinates.push_back(QVector2D(1.0, 0.0));
 }
 
-void Mesh::centerMesh()
+void Mesh::setData(const QVector3D *vertices, const QVector3D *vertexNormals, int numberOfVertices,
+                   const QVector2D *textureCoordinates, int numberOfTextureCoordinates,
+                   const GLuint *indices, int numberOfIndices)
 {
-    //Calculate the center of mass and subtract it
-    QVector3D centerOfMass;
+    m_vertices.resize(numberOfVertices);
+    m_vertexNormals.resize(numberOfVertices);
+    m_textureCoordinates.resize(numberOfTextureCoordinates);
+    m_indicesArray.resize(numberOfIndices);
+    m_indices.resize(numberOfIndices / 3);
+    m_triangleNormals.clear();
+    m_tangents.clear();
+    m_levelsOfDetail.clear();
+    m_levelOfDetailIndices.clear();
+    m_meshlets.clear();
+
+    copy(vertices, vertices + numberOfVertices, m_vertices.begin());
+    copy(vertexNormals, vertexNormals + numberOfVertices, m_vertexNormals.begin());
+    copy(textureCoordinates, textureCoordinates + numberOfTextureCoordinates, m_textureCoordinates.begin());
+    copy(indices, indices + numberOfIndices, m_indicesArray.begin());
+
+    for (int k = 0; k < m_indices.size(); ++k)
+    {
+        m_indices[k] = QVector3D(indices[3 * k], indices[3 * k + 1], indices[3 * k + 2]);
+    }
+}
+
+/**
+ * Reorders an array with one element per vertex : element v moves to newIndex[v].
+ */
+template <typename T>
+static void remapVertexArray(QVector<T> &array, const QVector<int> &newIndex)
+{
+    if (array.size() != newIndex.size())
+        return;
 
-    for (int i = 0; i < m_vertices.size(); ++i)
+    QVector<T> remapped(array.size());
+    for (int v = 0; v < array.size(); ++v)
     {
-        centerOfMass += m_vertices[i];
+        remapped[newIndex[v]] = array[v];
     }
+    array = remapped;
+}
 
-    centerOfMass /= (float)m_vertices.size();
+void Mesh::remapVerticesInOrderOfFirstUse()
+{
+    const int numberOfVertices = m_vertices.size();
 
-    for (int i = 0; i < m_vertices.size(); ++i)
+    QVector<int> newIndex = MeshOptimizer::optimizeVertexFetch(m_indicesArray, numberOfVertices);
+    for (int k = 0; k < m_indicesArray.size(); ++k)
     {
-        m_vertices[i] -= centerOfMass;
+        if (m_indicesArray[k] < (GLuint)numberOfVertices)
+            m_indicesArray[k] = newIndex[m_indicesArray[k]];
     }
 
+    remapVertexArray(m_vertices, newIndex);
+    remapVertexArray(m_vertexNormals, newIndex);
+    remapVertexArray(m_textureCoordinates, newIndex);
+    remapVertexArray(m_tangents, newIndex);
+
+    //The levels of detail share the vertices
+    for (int k = 0; k < m_levelOfDetailIndices.size(); ++k)
+    {
+        if (m_levelOfDetailIndices[k] < (GLuint)numberOfVertices)
+            m_levelOfDetailIndices[k] = newIndex[m_levelOfDetailIndices[k]];
+    }
 }
 
-void Mesh::obj_rotate90X()
+bool Mesh::optimize(float overdrawCacheThreshold, const LoadProgress &progress)
 {
-    //Assumes vertices first, then normals, then texture coordinates
-    //# comments
-    //Empty line
-    //v x y z =  vertex
-    //# number vertices
-    //Empty line
-    //vn x y z =  normal
-    //# number normals
-    //Empty line
-    //vt x y 0.0 = texture coordinate
-    //# number texture coordinates
-    //Empty line
-    //g Teapot
-    //f v1/vn1/vt1 v2/vn2/vt2 v3/vn3/vt3 v4/vn4/vt4 Quad face indices //BOTH quads and triangles !!
-    //f v1/vn1/vt1 v2/vn2/vt2 v3/vn3/vt3 Triangle face indices
-    //# number faces
-    //Empty line
-    // !!! Indices in f v1/vn1/vt1 start at 1 and not 0!
-
-    ifstream file(m_fileName.c_str(), ios::in);
-    ofstream rotatedObject(QDir::currentPath().toStdString() + "\\obj\\teapot-lowR90.obj", ios::out | ios::trunc);
-
-    if (!file || !rotatedObject)
+    const int numberOfVertices = m_vertices.size();
+    const int numberOfTriangles = m_indicesArray.size() / 3;
+
+    float acmrBefore = MeshOptimizer::averageCacheMissRatio(m_indicesArray, numberOfVertices);
+    float atvrBefore = MeshOptimizer::averageTransformToVertexRatio(m_indicesArray, numberOfVertices);
+    float overdrawBefore = MeshOptimizer::analyzeOverdraw(m_indicesArray, m_vertices);
+
+    if (!reportProgress(progress, 10))
+        return false;
+
+    //Triangles in the order of the vertex cache optimizer
+    QVector<int> triangleOrder = MeshOptimizer::optimizeVertexCache(m_indicesArray, numberOfVertices, stepProgress(progress, 10, 60));
+
+    //The order is incomplete if the optimization was cancelled
+    if (!reportProgress(progress, 60))
+        return false;
+
+    //Then clusters of these triangles in the order of the overdraw optimizer
+    if (overdrawCacheThreshold > 1.0f)
     {
-        cerr << "Could not open the file : " << m_fileName << endl;
-        exit(-1);
+        QVector<GLuint> cacheOrderedIndices(3 * numberOfTriangles);
+        for (int t = 0; t < numberOfTriangles; ++t)
+        {
+            int triangle = triangleOrder[t];
+            cacheOrderedIndices[3 * t] = m_indicesArray[3 * triangle];
+            cacheOrderedIndices[3 * t + 1] = m_indicesArray[3 * triangle + 1];
+            cacheOrderedIndices[3 * t + 2] = m_indicesArray[3 * triangle + 2];
+        }
+
+        QVector<int> clusterOrder = MeshOptimizer::optimizeOverdraw(cacheOrderedIndices, m_vertices, overdrawCacheThreshold);
+        QVector<int> composedOrder(numberOfTriangles);
+        for (int t = 0; t < numberOfTriangles; ++t)
+        {
+            composedOrder[t] = triangleOrder[clusterOrder[t]];
+        }
+        triangleOrder = composedOrder;
+
+        if (!reportProgress(progress, 80))
+            return false;
+    }
+
+    QVector<GLuint> indicesArray(3 * numberOfTriangles);
+    bool hasTriangleNormals = (m_triangleNormals.size() == numberOfTriangles);
+    QVector<QVector3D> triangleNormals(hasTriangleNormals ? numberOfTriangles : 0);
+
+    for (int t = 0; t < numberOfTriangles; ++t)
+    {
+        int triangle = triangleOrder[t];
+        indicesArray[3 * t] = m_indicesArray[3 * triangle];
+        indicesArray[3 * t + 1] = m_indicesArray[3 * triangle + 1];
+        indicesArray[3 * t + 2] = m_indicesArray[3 * triangle + 2];
+        if (hasTriangleNormals)
+            triangleNormals[t] = m_triangleNormals[triangle];
+    }
+
+    m_indicesArray = indicesArray;
+    if (hasTriangleNormals)
+        m_triangleNormals = triangleNormals;
+
+    //Vertices in order of first use
+    this->remapVerticesInOrderOfFirstUse();
+
+    //The meshlets follow the order of the triangles
+    m_meshlets.clear();
+
+    m_indices.resize(numberOfTriangles);
+    for (int t = 0; t < numberOfTriangles; ++t)
+    {
+        m_indices[t] = QVector3D(m_indicesArray[3 * t], m_indicesArray[3 * t + 1], m_indicesArray[3 * t + 2]);
     }
-    else
+
+    float acmrAfter = MeshOptimizer::averageCacheMissRatio(m_indicesArray, numberOfVertices);
+    float atvrAfter = MeshOptimizer::averageTransformToVertexRatio(m_indicesArray, numberOfVertices);
+    float overdrawAfter = MeshOptimizer::analyzeOverdraw(m_indicesArray, m_vertices);
+
+    qDebug() << "Vertex cache optimization of" << QString::fromStdString(m_fileName)
+             << ": ACMR" << acmrBefore << "->" << acmrAfter << ", ATVR" << atvrBefore << "->" << atvrAfter
+             << ", overdraw" << overdrawBefore << "->" << overdrawAfter;
+
+    return reportProgress(progress, 100);
+}
+
+bool Mesh::buildLevelsOfDetail(const LoadProgress &progress)
+{
+    m_levelsOfDetail.clear();
+    m_levelOfDetailIndices.clear();
+
+    QVector<GLuint> indices = m_indicesArray;
+    float error = 0.0f;
+
+    while (m_levelsOfDetail.size() + 1 < LOD_MAXIMUM_LEVELS)
     {
-        string comments;
-        string dataType;
+        int targetNumberOfIndices = 3 * (int)(indices.size() / 3 * LOD_TRIANGLE_RATIO);
+        if (targetNumberOfIndices < 3 * LOD_MINIMUM_TRIANGLES)
+            break;
 
-        //Copy the comments
-        getline(file, comments);
-        while ((comments.size() > 0) && (comments[0] == '#'))
+        //Each level is simplified from the previous one : the errors add up
+        int levelPercent = 100 * m_levelsOfDetail.size() / (LOD_MAXIMUM_LEVELS - 1);
+        int nextLevelPercent = 100 * (m_levelsOfDetail.size() + 1) / (LOD_MAXIMUM_LEVELS - 1);
+        float levelError = 0.0f;
+        QVector<GLuint> simplified = MeshSimplifier::simplify(indices, m_vertices, targetNumberOfIndices, levelError,
+                                                              stepProgress(progress, levelPercent, nextLevelPercent));
+
+        //The simplification is incomplete if it was cancelled
+        if (!reportProgress(progress, nextLevelPercent))
+            return false;
+
+        //Stop when the borders and seams prevent any significant simplification
+        if (simplified.size() > 0.9 * indices.size())
+            break;
+
+        error += levelError;
+
+        QVector<int> triangleOrder = MeshOptimizer::optimizeVertexCache(simplified, m_vertices.size());
+        LevelOfDetail level = { m_indicesArray.size() + m_levelOfDetailIndices.size(), simplified.size(), error };
+        m_levelsOfDetail.push_back(level);
+
+        for (int t = 0; t < triangleOrder.size(); ++t)
         {
-            rotatedObject << comments << endl;
-            getline(file, comments);
+            int triangle = triangleOrder[t];
+            m_levelOfDetailIndices.push_back(simplified[3 * triangle]);
+            m_levelOfDetailIndices.push_back(simplified[3 * triangle + 1]);
+            m_levelOfDetailIndices.push_back(simplified[3 * triangle + 2]);
         }
 
-        //Empty line is in the last string comments
-        //Copy it
+        indices = simplified;
+    }
 
-        rotatedObject << comments << endl;
-        //Now starts the vertices
-        string xVertex, yVertex, zVertex;
-        do
-        {
-            file >> dataType;
-            if (dataType == "v")
-            {
-                file >> xVertex >> yVertex >> zVertex;
-                //Copy each rotated vertex by -90 degrees
-                float yValueVertex = atof(yVertex.c_str());
-                if (yValueVertex > 0)
-                    rotatedObject << dataType << "  " << xVertex << " " << zVertex << " -" << yVertex << '\n';
-                else if (yValueVertex == 0.0)
-                    rotatedObject << dataType << "  " << xVertex << " " << zVertex << " " << yVertex << '\n';
-                else
-                    rotatedObject << dataType << "  " << xVertex << " " << zVertex << " " << yVertex.substr(1, yVertex.size() - 1) << '\n';
-            }
-        } while (dataType[0] != '#' && dataType.size() > 0);;
+    QDebug levels = qDebug();
+    levels << "Levels of detail of" << QString::fromStdString(m_fileName) << ":" << m_indicesArray.size() / 3 << "triangles";
+    for (int k = 0; k < m_levelsOfDetail.size(); ++k)
+        levels << "," << m_levelsOfDetail[k].numberOfIndices / 3 << "(error" << m_levelsOfDetail[k].error << ")";
 
-        //Add the #
-        rotatedObject << dataType[0];
-        //Skip the comment line and blank line
-        getline(file, comments);
-        rotatedObject << comments << endl;
-        getline(file, comments);
-        rotatedObject << comments << endl;
+    return reportProgress(progress, 100);
+}
 
-        //Now starts the normals
-        string xNormal, yNormal, zNormal;
-        int normalIndex = 0;
+void Mesh::setLevelsOfDetail(const LevelOfDetail *levels, int numberOfLevels, const GLuint *indices, int numberOfIndices)
+{
+    m_levelsOfDetail.resize(numberOfLevels);
+    m_levelOfDetailIndices.resize(numberOfIndices);
 
-        do
-        {
+    copy(levels, levels + numberOfLevels, m_levelsOfDetail.begin());
+    copy(indices, indices + numberOfIndices, m_levelOfDetailIndices.begin());
+}
 
-            file >> dataType;
-            if (dataType == "vn")
-            {
-                file >> xNormal >> yNormal >> zNormal;
-                //Copy each rotated normal by -90 degrees
-                float yValueNormal = atof(yNormal.c_str());
-
-                if (yValueNormal > 0)
-                    rotatedObject << dataType << " " << xNormal << " " << zNormal << " -" << yValueNormal << endl;
-                else if (yValueNormal == 0.0)
-                    rotatedObject << dataType << " " << xNormal << " " << zNormal << " " << yValueNormal << endl;
-                else
-                    rotatedObject << dataType << " " << xNormal << " " << zNormal << " " << yNormal.substr(1, yNormal.size() - 1) << endl;
-            }
-            ++normalIndex;
-        } while (dataType[0] != '#' && dataType.size() > 0);
+void Mesh::buildMeshlets()
+{
+    const int numberOfTriangles = m_indicesArray.size() / 3;
 
-        //Add the #
-        rotatedObject << dataType[0];
+    QVector<int> triangleOrder;
+    m_meshlets = MeshletBuilder::buildMeshlets(m_indicesArray, m_vertices, triangleOrder);
 
-        //Skip the comment line and blank line
-        getline(file, comments);
-        rotatedObject << comments << endl;
-        getline(file, comments);
-        rotatedObject << comments << endl;
+    //Vertex cache order inside each meshlet, on indices local to the meshlet
+    QVector<int> localIndex(m_vertices.size(), -1);
+    for (int m = 0; m < m_meshlets.size(); ++m)
+    {
+        int firstTriangle = m_meshlets[m].firstIndex / 3;
+        int numberOfMeshletTriangles = m_meshlets[m].numberOfIndices / 3;
 
-        //Now starts the texture coordinates
-        string xTexture, yTexture, zTexture;
-        QVector<QVector2D> textureCoordinates;
-        do
+        QVector<GLuint> localIndices(3 * numberOfMeshletTriangles);
+        QVector<GLuint> meshletVertices;
+        for (int k = 0; k < localIndices.size(); ++k)
         {
-            file >> dataType;
-            if (dataType == "vt")
+            GLuint v = m_indicesArray[3 * triangleOrder[firstTriangle + k / 3] + k % 3];
+            if (v >= (GLuint)m_vertices.size())
+            {
+                localIndices[k] = v;
+                continue;
+            }
+
+            if (localIndex[v] < 0)
             {
-                file >> xTexture >> yTexture >> zTexture;
-                rotatedObject << dataType << " " << xTexture << " " << yTexture << " " << zTexture << endl;
-                //zTexture is always 0.0
-                float u = atof(xTexture.c_str());
-                float v = atof(yTexture.c_str());
-                //U,V can be above 1.0 : use GL_REPEAT for the texture
-                textureCoordinates.push_back(QVector2D(u, v));
+                localIndex[v] = meshletVertices.size();
+                meshletVertices.push_back(v);
             }
-        } while (dataType[0] != '#' && dataType.size() > 0);
+            localIndices[k] = localIndex[v];
+        }
+
+        QVector<int> localOrder = MeshOptimizer::optimizeVertexCache(localIndices, meshletVertices.size());
+        QVector<int> meshletTriangles = triangleOrder.mid(firstTriangle, numberOfMeshletTriangles);
+        for (int t = 0; t < numberOfMeshletTriangles; ++t)
+            triangleOrder[firstTriangle + t] = meshletTriangles[localOrder[t]];
 
+        for (int v = 0; v < meshletVertices.size(); ++v)
+            localIndex[meshletVertices[v]] = -1;
+    }
 
-        //Add the #
-        rotatedObject << dataType[0];
-        //Skip the comment line the blank line and the g teapot line
-        getline(file, comments);
-        rotatedObject << comments << endl;
-        getline(file, comments);
-        rotatedObject << comments << endl;
-        getline(file, comments);
-        rotatedObject << comments << endl;
+    //The triangles of each meshlet are made contiguous
+    QVector<GLuint> indicesArray(3 * numberOfTriangles);
+    bool hasTriangleNormals = (m_triangleNormals.size() == numberOfTriangles);
+    QVector<QVector3D> triangleNormals(hasTriangleNormals ? numberOfTriangles : 0);
 
-        string faceLine;
-        do
-        {
-            //read the line and copy it
-            getline(file, faceLine);
-            rotatedObject << faceLine << endl;
-        } while (faceLine[0] != '#' && faceLine.size() > 0);
+    for (int t = 0; t < numberOfTriangles; ++t)
+    {
+        int triangle = triangleOrder[t];
+        indicesArray[3 * t] = m_indicesArray[3 * triangle];
+        indicesArray[3 * t + 1] = m_indicesArray[3 * triangle + 1];
+        indicesArray[3 * t + 2] = m_indicesArray[3 * triangle + 2];
+        if (hasTriangleNormals)
+            triangleNormals[t] = m_triangleNormals[triangle];
+    }
+
+    m_indicesArray = indicesArray;
+    if (hasTriangleNormals)
+        m_triangleNormals = triangleNormals;
+
+    //The meshlet order changes the first use of the vertices
+    this->remapVerticesInOrderOfFirstUse();
+
+    m_indices.resize(numberOfTriangles);
+    for (int t = 0; t < numberOfTriangles; ++t)
+    {
+        m_indices[t] = QVector3D(m_indicesArray[3 * t], m_indicesArray[3 * t + 1], m_indicesArray[3 * t + 2]);
     }
+
+    qDebug() << "Meshlets of" << QString::fromStdString(m_fileName) << ":" << m_meshlets.size()
+             << "meshlets, ACMR" << MeshOptimizer::averageCacheMissRatio(m_indicesArray, m_vertices.size())
+             << ", ATVR" << MeshOptimizer::averageTransformToVertexRatio(m_indicesArray, m_vertices.size())
+             << ", overdraw" << MeshOptimizer::analyzeOverdraw(m_indicesArray, m_vertices);
+}
+
+void Mesh::setTangents(const QVector4D *tangents, int numberOfTangents)
+{
+    m_tangents.resize(numberOfTangents);
+    copy(tangents, tangents + numberOfTangents, m_tangents.begin());
+}
+
+void Mesh::setMeshlets(const Meshlet *meshlets, int numberOfMeshlets)
+{
+    m_meshlets.resize(numberOfMeshlets);
+    copy(meshlets, meshlets + numberOfMeshlets, m_meshlets.begin());
+}
+
+void Mesh::centerMesh()
+{
+    //Calculate the center of mass and subtract it
+    QVector3D centerOfMass = MeshKernels::computeCentroid(m_vertices.constData(), m_vertices.size());
+
+    QMatrix4x4 translation;
+    translation.translate(-centerOfMass);
+    MeshKernels::transformPositions(m_vertices.data(), m_vertices.size(), translation);
 }
 
+void Mesh::transform(const QMatrix4x4 &matrix)
+{
+    MeshKernels::transformPositions(m_vertices.data(), m_vertices.size(), matrix);
+    MeshKernels::transformNormals(m_vertexNormals.data(), m_vertexNormals.size(), matrix);
+    MeshKernels::transformNormals(m_triangleNormals.data(), m_triangleNormals.size(), matrix);
+
+    //Tangents follow the surface like the edges, a mirroring transform flips the bitangents
+    float handedness = (matrix.determinant() < 0.0f) ? -1.0f : 1.0f;
+    for (int t = 0; t < m_tangents.size(); ++t)
+    {
+        QVector3D tangent = matrix.mapVector(m_tangents[t].toVector3D()).normalized();
+        m_tangents[t] = QVector4D(tangent, handedness * m_tangents[t].w());
+    }
+}
 
 void Mesh::setTextureCoordinates(QVector<QVector2D> &textureCoordinates)
 {
     m_textureCoordinates = textureCoordinates;
 }
 
+string Mesh::getFileName() const
+{
+    return m_fileName;
+}
+
 QVector<QVector3D> Mesh::getVertices() const
 {
     return m_vertices;
@@ -602,6 +1928,11 @@ QVector<GLuint> Mesh::getIndicesArray() const
     return m_indicesArray;
 }
 
+QVector<QVector4D> Mesh::getTangents() const
+{
+    return m_tangents;
+}
+
 QVector<QVector3D> Mesh::getVertexNormals() const
 {
     return m_vertexNormals;
@@ -611,3 +1942,23 @@ QVector<QVector2D> Mesh::getTextureCoordinates() const
 {
     return m_textureCoordinates;
 }
+
+QVector<LevelOfDetail> Mesh::getLevelsOfDetail() const
+{
+    LevelOfDetail fullResolution = { 0, m_indicesArray.size(), 0.0f };
+
+    QVector<LevelOfDetail> levels;
+    levels.push_back(fullResolution);
+    levels += m_levelsOfDetail;
+    return levels;
+}
+
+QVector<GLuint> Mesh::getLevelOfDetailIndices() const
+{
+    return m_levelOfDetailIndices;
+}
+
+QVector<Meshlet> Mesh::getMeshlets() const
+{
+    return m_meshlets;
+}
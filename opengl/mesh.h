@@ -27,11 +27,16 @@
 #define MESH_H
 
 #include "opengl/openglheaders.h"
+#include "opengl/meshlet.h"
+#include "opengl/meshoptimizer.h"
+#include "opengl/parallel.h"
 
 #include <QVector>
 
 #include <QVector2D>
 #include <QVector3D>
+#include <QVector4D>
+#include <QMatrix4x4>
 #include <QDir>
 
 #include <iostream>
@@ -39,6 +44,19 @@
 #include <string>
 #include <cmath>
 
+/**
+ * Range of the index buffer of an Object that draws one level of detail of its mesh.
+ * The indices of all the levels refer to the same vertices.
+ */
+struct LevelOfDetail
+{
+    int firstIndex;
+    int numberOfIndices;
+
+    //Estimated distance to the full resolution surface (in the units of the mesh)
+    float error;
+};
+
 class Mesh
 {
 public:
@@ -49,16 +67,68 @@ public:
     /**
      * Reads off file.
      * @brief offReader
+     * @param progress
+     * @return false if the file cannot be opened or is invalid, or if the read is cancelled
      */
-    void offReader();
+    bool offReader(const LoadProgress &progress = LoadProgress());
 
     /**
      * Reads obj file.
+     * Large files are split in chunks of whole lines parsed by one thread each,
+     * the result is identical to a serial read.
+     * Each distinct (v, vt, vn) combination used by the faces becomes one vertex.
      * @brief objReader
-     * @param fileName
+     * @param progress
+     * @return false if the file cannot be opened, or if the read is cancelled
+     */
+    bool objReader(const LoadProgress &progress = LoadProgress());
+
+    /**
+     * Reads a binary little endian ply file (vertices with optional normals and UV coordinates, polygonal faces).
+     * @brief plyReader
+     * @param progress
+     * @return false if the file cannot be opened or is invalid, or if the read is cancelled
+     */
+    bool plyReader(const LoadProgress &progress = LoadProgress());
+
+    /**
+     * Reads a binary stl file. The three corners of each triangle are stored separately in the file :
+     * identical vertices are merged while reading with a spatial hash.
+     * @brief stlReader
+     * @param progress
+     * @return false if the file cannot be opened or is invalid, or if the read is cancelled
      */
-    void objReader();
+    bool stlReader(const LoadProgress &progress = LoadProgress());
 
+    /**
+     * Computes angle-weighted vertex normals from m_indicesArray.
+     * Each triangle is visited once and its contribution is scattered to its three vertices,
+     * the work is split across the available cores.
+     * @brief computeVertexNormals
+     */
+    void computeVertexNormals();
+
+    /**
+     * Computes angle-weighted vertex normals and the triangle normals of the given triangles.
+     * @brief computeVertexNormals
+     * @param vertexList
+     * @param indicesArray
+     * @param vertexNormalList
+     * @param triangleNormalList
+     */
+    static void computeVertexNormals(const QVector<QVector3D> &vertexList, const QVector<GLuint> &indicesArray,
+                                     QVector<QVector3D> &vertexNormalList, QVector<QVector3D> &triangleNormalList);
+
+    /**
+     * Computes a tangent frame per vertex the way MikkTSpace does, so that the normal maps of the baking tools are read correctly :
+     * the tangents of the triangles (direction of increasing u) are projected on the plane of the vertex normal,
+     * normalized and averaged with the angles of the corners as weights. w is the sign of the bitangent,
+     * which is w * cross(normal, tangent). A vertex shared by triangles of both UV orientations (mirrored UVs) is duplicated.
+     * Without one texture coordinate per vertex, the tangents are any vector orthogonal to the normal.
+     * The triangles are split across the available cores. Must be called before optimize.
+     * @brief computeTangents
+     */
+    void computeTangents();
 
     /**
      * Sets the UV texture coordinates.
@@ -74,6 +144,69 @@ public:
      */
     void setTextureCoordinates(QVector<QVector2D> &textureCoordinates);
 
+    /**
+     * Replaces the content of the mesh with the given arrays (e.g. read from the mesh cache).
+     * There must be one normal per vertex.
+     * @brief setData
+     */
+    void setData(const QVector3D *vertices, const QVector3D *vertexNormals, int numberOfVertices,
+                 const QVector2D *textureCoordinates, int numberOfTextureCoordinates,
+                 const GLuint *indices, int numberOfIndices);
+
+    /**
+     * Reorders the triangles for the post-transform vertex cache, then clusters of triangles to reduce overdraw
+     * and finally the vertices in order of first use.
+     * The ACMR, ATVR and overdraw before and after are printed.
+     * @brief optimize
+     * @param overdrawCacheThreshold maximum increase of the ACMR allowed to reduce overdraw (1 disables it)
+     * @param progress
+     * @return false if the optimization is cancelled
+     */
+    bool optimize(float overdrawCacheThreshold = OVERDRAW_CACHE_THRESHOLD, const LoadProgress &progress = LoadProgress());
+
+    /**
+     * Builds a chain of simplified versions of the mesh (see MeshSimplifier), each with about half the triangles
+     * of the previous one. The vertices are shared, the triangles of each level are reordered for the vertex cache.
+     * @brief buildLevelsOfDetail
+     * @param progress
+     * @return false if it is cancelled, the chain is then incomplete
+     */
+    bool buildLevelsOfDetail(const LoadProgress &progress = LoadProgress());
+
+    /**
+     * Replaces the levels of detail (e.g. read from the mesh cache).
+     * @brief setLevelsOfDetail
+     * @param levels the levels after the full resolution one
+     * @param numberOfLevels
+     * @param indices the indices of these levels
+     * @param numberOfIndices
+     */
+    void setLevelsOfDetail(const LevelOfDetail *levels, int numberOfLevels, const GLuint *indices, int numberOfIndices);
+
+    /**
+     * Splits the full resolution triangles in meshlets (see MeshletBuilder) and reorders them so that
+     * each meshlet is a contiguous range of the indices array, then renumbers the vertices in order of first use again.
+     * To be called after optimize.
+     * @brief buildMeshlets
+     */
+    void buildMeshlets();
+
+    /**
+     * Replaces the meshlets (e.g. read from the mesh cache).
+     * @brief setMeshlets
+     * @param meshlets
+     * @param numberOfMeshlets
+     */
+    void setMeshlets(const Meshlet *meshlets, int numberOfMeshlets);
+
+    /**
+     * Replaces the tangents (e.g. read from the mesh cache).
+     * @brief setTangents
+     * @param tangents
+     * @param numberOfTangents
+     */
+    void setTangents(const QVector4D *tangents, int numberOfTangents);
+
     /**
      * Centers the mesh so that its center of mass is at the origin of the world coordinate system.
      * @brief centerMesh
@@ -81,28 +214,38 @@ public:
     void centerMesh();
 
     /**
-     * Reads an obj file, rotate the object and normal by 90 degrees around the x axis and saves it.
-     * @brief obj_rotate90X
+     * Bakes an affine transform in the mesh : positions, normals (inverse transpose) and tangents.
+     * To be applied at load time, before the levels of detail and the meshlets are built.
+     * @brief transform
+     * @param matrix
      */
-    void obj_rotate90X();
+    void transform(const QMatrix4x4 &matrix);
 
+    std::string getFileName() const;
     QVector<QVector3D> getVertices() const;
     QVector<QVector3D> getIndices() const;
     QVector<GLuint> getIndicesArray() const;
     QVector<QVector3D> getVertexNormals() const;
     QVector<QVector2D> getTextureCoordinates() const;
+    QVector<QVector4D> getTangents() const;
+
+    /**
+     * Levels of detail from the full resolution mesh (level 0) to the coarsest one.
+     * The ranges index the indices array followed by the level of detail indices.
+     * @brief getLevelsOfDetail
+     * @return
+     */
+    QVector<LevelOfDetail> getLevelsOfDetail() const;
+    QVector<GLuint> getLevelOfDetailIndices() const;
+    QVector<Meshlet> getMeshlets() const;
 
 private:
     /**
-     * Parse a string in the form a/b/c/d/... where a,b,c,d are integers
-     * Store the values of a,b,c,d in values[]. This is necessary for the obj reader.
-     * @brief parseString
-     * @param input
-     * @param delimiter
-     * @param values
-     * @param numberOfValues
+     * Renumbers the vertices in order of first use in m_indicesArray (see MeshOptimizer::optimizeVertexFetch)
+     * and remaps the per-vertex arrays and the indices of the levels of detail.
+     * @brief remapVerticesInOrderOfFirstUse
      */
-    void parseString(std::string input, char delimiter, int values[], int numberOfValues);
+    void remapVerticesInOrderOfFirstUse();
 
     std::string m_fileName;
     QVector<QVector3D> m_vertices;
@@ -123,6 +266,16 @@ private:
     QVector<QVector3D> m_triangleNormals;
     QVector<QVector3D> m_vertexNormals;
     QVector<QVector2D> m_textureCoordinates;
+    QVector<QVector4D> m_tangents;
+
+    /**
+     * Levels of detail after the full resolution one, and their indices
+     * @brief m_levelsOfDetail
+     */
+    QVector<LevelOfDetail> m_levelsOfDetail;
+    QVector<GLuint> m_levelOfDetailIndices;
+
+    QVector<Meshlet> m_meshlets;
 };
 
 #endif // MESH_H
@@ -0,0 +1,285 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/meshasset.h"
+#include "opengl/glstatecache.h"
+#include "opengl/instancebuffer.h"
+#include "opengl/meshcache.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+using namespace std;
+
+MeshAsset::MeshAsset() : mesh(), encoding(), bvh(), boundingSphereCenter(0.0, 0.0, 0.0), boundingSphereRadius(0.0),
+vertexData(), indexData(), meshCache(), arena(), allocation(), vertexBuffer(QOpenGLBuffer::VertexBuffer), indexBuffer(QOpenGLBuffer::IndexBuffer),
+vertexArray()
+{
+
+}
+
+MeshAsset::~MeshAsset()
+{
+    if (!arena.isNull())
+        arena->free(allocation);
+}
+
+void MeshAsset::uploadBuffers()
+{
+    if (isUploaded())
+        return;
+
+    if (!arena.isNull())
+    {
+        allocation = arena->allocate(encoding, mesh.getVertices().size(), vertexData, indexData);
+
+        if (allocation.isValid())
+        {
+            //The data is on the GPU
+            vertexData.clear();
+            indexData.clear();
+            meshCache.clear();
+            return;
+        }
+
+        cerr << "Could not allocate " << mesh.getFileName() << " in the geometry arena" << endl;
+    }
+
+    //In a core profile, the index buffer can only be bound with a VAO
+    if (vertexArray.isNull())
+        vertexArray = QSharedPointer<QOpenGLVertexArrayObject>(new QOpenGLVertexArrayObject());
+
+    if (vertexArray->create())
+        vertexArray->bind();
+    else
+        cerr << "Could not create the VAO of " << mesh.getFileName() << endl;
+
+    if (vertexBuffer.create()) qDebug() << "Success creating vertex position buffer";
+    vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+
+    if (vertexBuffer.bind()) qDebug() << "Success biding vertex position buffer";
+
+    vertexBuffer.allocate(vertexData.constData(), vertexData.size());
+
+    if (indexBuffer.create())
+        qDebug() << "Success creating the index buffer";
+    indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+
+    if (indexBuffer.bind())
+        qDebug() << "Success biding the index buffer";
+
+    //Send the indices data
+    indexBuffer.allocate(indexData.constData(), indexData.size());
+
+    qDebug() << "VBO buffer size " << vertexBuffer.size();
+    qDebug() << "Index buffer buffer size " << indexBuffer.size();
+
+    //The data is on the GPU
+    vertexData.clear();
+    indexData.clear();
+    meshCache.clear();
+
+    vertexArray->release();
+    GLStateCache::instance().vertexArrayReleased();
+    this->buildVertexArray();
+}
+
+bool MeshAsset::isUploaded() const
+{
+    return allocation.isValid() || vertexBuffer.isCreated();
+}
+
+GLuint MeshAsset::getVertexArrayObject() const
+{
+    if (allocation.isValid())
+        return arena->getVertexArrayObject(allocation.page);
+
+    return vertexArray.isNull() ? 0 : vertexArray->objectId();
+}
+
+int MeshAsset::getFirstIndex() const
+{
+    return allocation.indices.offset;
+}
+
+int MeshAsset::getGeometryPage() const
+{
+    return allocation.page;
+}
+
+void MeshAsset::buildVertexArray()
+{
+    //The VAO of a page of the arena does not depend on the mesh
+    if (allocation.isValid() || vertexArray.isNull() || !vertexArray->isCreated())
+        return;
+
+    vertexArray->bind();
+    this->setVertexAttributes();
+    vertexArray->release();
+    GLStateCache::instance().vertexArrayReleased();
+}
+
+void MeshAsset::setVertexAttributes()
+{
+    if (allocation.isValid())
+    {
+        arena->setVertexAttributes(allocation.page);
+        return;
+    }
+
+    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+
+    //The VAO records the index buffer and the attribute formats, the integer formats are normalized
+    vertexBuffer.bind();
+    indexBuffer.bind();
+
+    f->glEnableVertexAttribArray(POSITION_ATTRIBUTE_LOCATION);
+    f->glEnableVertexAttribArray(TEXTURE_COORDINATES_ATTRIBUTE_LOCATION);
+    f->glEnableVertexAttribArray(NORMAL_ATTRIBUTE_LOCATION);
+    f->glEnableVertexAttribArray(TANGENT_ATTRIBUTE_LOCATION);
+
+    f->glVertexAttribPointer(POSITION_ATTRIBUTE_LOCATION, ENCODED_POSITION_SIZE, ENCODED_POSITION_TYPE, GL_TRUE, 0, (const void *)0);
+    f->glVertexAttribPointer(TEXTURE_COORDINATES_ATTRIBUTE_LOCATION, ENCODED_TEXTURE_COORDINATES_SIZE, encoding.getTextureCoordinatesType(),
+                             GL_TRUE, 0, (const void *)(size_t)encoding.getTextureCoordinatesOffset());
+    f->glVertexAttribPointer(NORMAL_ATTRIBUTE_LOCATION, ENCODED_NORMAL_SIZE, ENCODED_NORMAL_TYPE, GL_TRUE, 0,
+                             (const void *)(size_t)encoding.getNormalsOffset());
+    f->glVertexAttribPointer(TANGENT_ATTRIBUTE_LOCATION, ENCODED_TANGENT_SIZE, ENCODED_TANGENT_TYPE, GL_TRUE, 0,
+                             (const void *)(size_t)encoding.getTangentsOffset());
+}
+
+void MeshAsset::bindAttributeLocations(QGLShaderProgram *program)
+{
+    program->bindAttributeLocation("vertex_worldSpace", POSITION_ATTRIBUTE_LOCATION);
+    program->bindAttributeLocation("textureCoordinate_input", TEXTURE_COORDINATES_ATTRIBUTE_LOCATION);
+    program->bindAttributeLocation("normal_worldSpace", NORMAL_ATTRIBUTE_LOCATION);
+    program->bindAttributeLocation("tangent_worldSpace", TANGENT_ATTRIBUTE_LOCATION);
+    program->bindAttributeLocation("instanceMatrix", INSTANCE_MATRIX_ATTRIBUTE_LOCATION);
+    program->bindAttributeLocation("instanceNormalMatrix", INSTANCE_NORMAL_MATRIX_ATTRIBUTE_LOCATION);
+    program->bindAttributeLocation("instanceColor", INSTANCE_COLOR_ATTRIBUTE_LOCATION);
+}
+
+MeshAssetCache::MeshAssetCache() : m_mutex(), m_assets(), m_numberOfHits(0), m_numberOfMisses(0), m_geometryArena(new GeometryArena())
+{
+
+}
+
+QSharedPointer<MeshAsset> MeshAssetCache::find(const string &objectPath, bool optimizeMesh, const QMatrix4x4 &bakeTransform)
+{
+    QString assetKey = key(objectPath, optimizeMesh, bakeTransform);
+
+    QMutexLocker locker(&m_mutex);
+
+    QSharedPointer<MeshAsset> asset = m_assets.value(assetKey).toStrongRef();
+
+    if (asset.isNull())
+        ++m_numberOfMisses;
+    else
+        ++m_numberOfHits;
+
+    return asset;
+}
+
+QSharedPointer<MeshAsset> MeshAssetCache::insert(const string &objectPath, bool optimizeMesh, const QMatrix4x4 &bakeTransform,
+                                                 const QSharedPointer<MeshAsset> &asset)
+{
+    QString assetKey = key(objectPath, optimizeMesh, bakeTransform);
+
+    QMutexLocker locker(&m_mutex);
+
+    QSharedPointer<MeshAsset> existingAsset = m_assets.value(assetKey).toStrongRef();
+    if (!existingAsset.isNull())
+        return existingAsset;
+
+    m_assets.insert(assetKey, asset.toWeakRef());
+    return asset;
+}
+
+int MeshAssetCache::getNumberOfAssets()
+{
+    QMutexLocker locker(&m_mutex);
+
+    //The entries of the assets that are no longer used are removed
+    QHash<QString, QWeakPointer<MeshAsset> >::iterator entry = m_assets.begin();
+    while (entry != m_assets.end())
+    {
+        if (entry.value().isNull())
+            entry = m_assets.erase(entry);
+        else
+            ++entry;
+    }
+
+    return m_assets.size();
+}
+
+int MeshAssetCache::getNumberOfHits()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_numberOfHits;
+}
+
+int MeshAssetCache::getNumberOfMisses()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_numberOfMisses;
+}
+
+QSharedPointer<GeometryArena> MeshAssetCache::getGeometryArena() const
+{
+    return m_geometryArena;
+}
+
+void MeshAssetCache::release()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_assets.clear();
+    }
+
+    m_geometryArena->release();
+}
+
+QString MeshAssetCache::key(const string &objectPath, bool optimizeMesh, const QMatrix4x4 &bakeTransform)
+{
+    //The same file may be reached through different paths (relative paths, symbolic links)
+    QFileInfo fileInfo(QString::fromStdString(objectPath));
+    QString resolvedPath = fileInfo.exists() ? fileInfo.canonicalFilePath() : fileInfo.absoluteFilePath();
+
+    //An edited file is another mesh, like in MeshCache
+    QString assetKey = resolvedPath + "|" + QString::number(fileInfo.size())
+            + "|" + QString::number(fileInfo.lastModified().toMSecsSinceEpoch()) + (optimizeMesh ? "|optimized" : "");
+
+    //The same file loaded with another baked transform is another mesh
+    if (!bakeTransform.isIdentity())
+    {
+        const float *values = bakeTransform.constData();
+        assetKey += "|transform";
+        for (int k = 0; k < 16; ++k)
+            assetKey += " " + QString::number(values[k]);
+    }
+
+    return assetKey;
+}
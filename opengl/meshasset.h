@@ -0,0 +1,206 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MESHASSET_H
+#define MESHASSET_H
+
+#include "opengl/mesh.h"
+#include "opengl/geometryarena.h"
+#include "opengl/meshencoding.h"
+#include "opengl/meshbvh.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QMatrix4x4>
+#include <QMutex>
+#include <QGLShaderProgram>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector3D>
+#include <QWeakPointer>
+
+#include <string>
+
+class MeshCache;
+
+/**
+ * Geometry shared by the objects loaded from the same mesh file : the mesh, its BVH and bounding sphere on the CPU,
+ * the encoded vertex and index buffers and their vertex array object on the GPU. Objects hold it through a QSharedPointer,
+ * the buffers are deleted, or given back to the geometry arena, with the last object using them.
+ */
+struct MeshAsset
+{
+    MeshAsset();
+    ~MeshAsset();
+    Q_DISABLE_COPY(MeshAsset)
+
+    /**
+     * Uploads the encoded data, once : to the geometry arena if the asset has one,
+     * otherwise to vertex and index buffers of its own with their vertex array object. The OpenGL context must be current.
+     * @brief uploadBuffers
+     */
+    void uploadBuffers();
+    bool isUploaded() const;
+
+    /**
+     * Vertex array object binding the buffers of the mesh : the one of its page of the geometry arena or its own.
+     * @brief getVertexArrayObject
+     * @return 0 if the buffers are not uploaded
+     */
+    GLuint getVertexArrayObject() const;
+
+    /**
+     * Offset of the indices of the mesh in the index buffer of its vertex array object, to add to the first index of the draws.
+     * @brief getFirstIndex
+     * @return
+     */
+    int getFirstIndex() const;
+
+    /**
+     * Page of the geometry arena holding the mesh, -1 if it has buffers of its own.
+     * @brief getGeometryPage
+     * @return
+     */
+    int getGeometryPage() const;
+
+    /**
+     * (Re)builds the vertex array object binding the buffers to the attribute locations, e.g. when the encoding changes.
+     * The OpenGL context must be current.
+     * @brief buildVertexArray
+     */
+    void buildVertexArray();
+
+    /**
+     * Binds the buffers and specifies the attributes of the mesh in the bound VAO.
+     * @brief setVertexAttributes
+     */
+    void setVertexAttributes();
+
+    /**
+     * Binds the vertex attributes of the shaders to the locations used by the vertex array objects
+     * (POSITION_ATTRIBUTE_LOCATION..., and the instance attributes of InstanceBuffer) :
+     * the vertex array objects do not depend on the shader program.
+     * Takes effect at the next link of the program.
+     * @brief bindAttributeLocations
+     * @param program
+     */
+    static void bindAttributeLocations(QGLShaderProgram *program);
+
+    Mesh mesh;
+    MeshEncoding encoding;
+    QSharedPointer<MeshBVH> bvh;
+
+    QVector3D boundingSphereCenter;
+    float boundingSphereRadius;
+
+    //Encoded buffers waiting for uploadBuffers
+    QByteArray vertexData;
+    QByteArray indexData;
+
+    //Cache file the encoded buffers point to when the mesh was read from it, kept mapped until they are uploaded
+    QSharedPointer<MeshCache> meshCache;
+
+    //Arena the buffers are allocated from, can be null
+    QSharedPointer<GeometryArena> arena;
+    GeometryAllocation allocation;
+
+    //Buffers of the asset when it is not in an arena
+    QOpenGLBuffer vertexBuffer;
+    QOpenGLBuffer indexBuffer;
+    QSharedPointer<QOpenGLVertexArrayObject> vertexArray;
+};
+
+/**
+ * Mesh assets in use, keyed by the resolved path, the size and the modification time of their mesh file,
+ * by the optimization of the mesh and by the transform baked in it : an edited file is loaded again.
+ * The cache only holds weak references : an asset stays in the cache as long as an object uses it,
+ * e.g. while a scene is rebuilt from the objects of the previous one. The functions are thread safe.
+ * @brief The MeshAssetCache class
+ */
+class MeshAssetCache
+{
+public:
+    MeshAssetCache();
+
+    /**
+     * Returns the asset of a mesh file if an object still uses it, otherwise a null pointer.
+     * Counts a hit or a miss.
+     * @brief find
+     * @param objectPath
+     * @param optimizeMesh
+     * @param bakeTransform transform baked in the mesh at load time (see Mesh::transform)
+     * @return
+     */
+    QSharedPointer<MeshAsset> find(const std::string &objectPath, bool optimizeMesh, const QMatrix4x4 &bakeTransform);
+
+    /**
+     * Adds a loaded asset. If another thread added the same asset in the meantime, that one is returned instead.
+     * @brief insert
+     * @param objectPath
+     * @param optimizeMesh
+     * @param bakeTransform
+     * @param asset
+     * @return the asset to use
+     */
+    QSharedPointer<MeshAsset> insert(const std::string &objectPath, bool optimizeMesh, const QMatrix4x4 &bakeTransform,
+                                     const QSharedPointer<MeshAsset> &asset);
+
+    /**
+     * Number of assets still used by an object.
+     * @brief getNumberOfAssets
+     * @return
+     */
+    int getNumberOfAssets();
+    int getNumberOfHits();
+    int getNumberOfMisses();
+
+    /**
+     * Arena the buffers of the assets are allocated from.
+     * @brief getGeometryArena
+     * @return
+     */
+    QSharedPointer<GeometryArena> getGeometryArena() const;
+
+    /**
+     * Forgets the assets and deletes the buffers of the geometry arena, e.g. before the OpenGL context is destroyed.
+     * The OpenGL context must be current and the objects using the assets must have been deleted.
+     * @brief release
+     */
+    void release();
+
+private:
+    static QString key(const std::string &objectPath, bool optimizeMesh, const QMatrix4x4 &bakeTransform);
+
+    QMutex m_mutex;
+    QHash<QString, QWeakPointer<MeshAsset> > m_assets;
+    int m_numberOfHits;
+    int m_numberOfMisses;
+
+    QSharedPointer<GeometryArena> m_geometryArena;
+};
+
+#endif // MESHASSET_H
@@ -0,0 +1,486 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/meshbvh.h"
+
+#include <algorithm>
+#include <cmath>
+
+//SSE is part of every x86-64 target, the other targets (e.g. ARM) use the scalar ray-box test
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MESHBVH_SSE
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+
+/**
+ * Surface area of a box, the cost of the nodes in the surface area heuristic is proportional to it.
+ */
+static float surfaceArea(const QVector3D &minimum, const QVector3D &maximum)
+{
+    QVector3D extent = maximum - minimum;
+    return 2.0f * (extent.x() * extent.y() + extent.y() * extent.z() + extent.z() * extent.x());
+}
+
+static QVector3D componentMinimum(const QVector3D &a, const QVector3D &b)
+{
+    return QVector3D(min(a.x(), b.x()), min(a.y(), b.y()), min(a.z(), b.z()));
+}
+
+static QVector3D componentMaximum(const QVector3D &a, const QVector3D &b)
+{
+    return QVector3D(max(a.x(), b.x()), max(a.y(), b.y()), max(a.z(), b.z()));
+}
+
+/**
+ * Bounds of a triangle during the build, partitioned with the triangles so that they are read sequentially.
+ */
+struct MeshBVHBuildTriangle
+{
+    QVector3D minimum;
+    QVector3D maximum;
+    QVector3D centroid;
+    int triangle;
+};
+
+/**
+ * Ray in the form used by the ray-box test.
+ */
+struct BVHRay
+{
+#ifdef MESHBVH_SSE
+    __m128 origin;
+    __m128 inverseDirection;
+#else
+    float origin[3];
+    float inverseDirection[3];
+#endif
+};
+
+/**
+ * Slab test of a ray with the box of a node. Returns true if the ray enters the box before maximumDistance,
+ * entry is then the parameter at which it enters the box.
+ */
+static inline bool intersectBox(const MeshBVHNode &node, const BVHRay &ray, float maximumDistance, float &entry)
+{
+#ifdef MESHBVH_SSE
+    //The fourth lanes hold the offset and the number of triangles : they are ignored
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minimum), ray.origin), ray.inverseDirection);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maximum), ray.origin), ray.inverseDirection);
+    __m128 near = _mm_min_ps(t1, t2);
+    __m128 far = _mm_max_ps(t1, t2);
+
+    __m128 entry4 = _mm_max_ss(_mm_max_ss(near, _mm_shuffle_ps(near, near, _MM_SHUFFLE(1, 1, 1, 1))),
+                               _mm_shuffle_ps(near, near, _MM_SHUFFLE(2, 2, 2, 2)));
+    __m128 exit4 = _mm_min_ss(_mm_min_ss(far, _mm_shuffle_ps(far, far, _MM_SHUFFLE(1, 1, 1, 1))),
+                              _mm_shuffle_ps(far, far, _MM_SHUFFLE(2, 2, 2, 2)));
+
+    entry4 = _mm_max_ss(entry4, _mm_setzero_ps());
+    exit4 = _mm_min_ss(exit4, _mm_set_ss(maximumDistance));
+
+    entry = _mm_cvtss_f32(entry4);
+    return _mm_comile_ss(entry4, exit4) != 0;
+#else
+    float entryDistance = 0.0f, exitDistance = maximumDistance;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float t1 = (node.minimum[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+        float t2 = (node.maximum[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+        entryDistance = max(entryDistance, min(t1, t2));
+        exitDistance = min(exitDistance, max(t1, t2));
+    }
+
+    entry = entryDistance;
+    return entryDistance <= exitDistance;
+#endif
+}
+
+/**
+ * Moller-Trumbore ray-triangle test, for both faces of the triangle.
+ */
+static inline bool intersectTriangle(const QVector3D *triangle, const QVector3D &origin, const QVector3D &direction,
+                                     float maximumDistance, float &distance, float &u, float &v)
+{
+    QVector3D edge1 = triangle[1] - triangle[0];
+    QVector3D edge2 = triangle[2] - triangle[0];
+    QVector3D p = QVector3D::crossProduct(direction, edge2);
+
+    float determinant = QVector3D::dotProduct(edge1, p);
+    if (determinant == 0.0f)
+        return false;
+
+    float inverseDeterminant = 1.0f / determinant;
+    QVector3D s = origin - triangle[0];
+
+    u = QVector3D::dotProduct(s, p) * inverseDeterminant;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+
+    QVector3D q = QVector3D::crossProduct(s, edge1);
+    v = QVector3D::dotProduct(direction, q) * inverseDeterminant;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+
+    distance = QVector3D::dotProduct(edge2, q) * inverseDeterminant;
+    return distance >= 0.0f && distance < maximumDistance;
+}
+
+MeshBVH::MeshBVH() : m_nodes(), m_triangles(), m_triangleVertices(), m_depth(0)
+{
+
+}
+
+void MeshBVH::build(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices)
+{
+    const int numberOfVertices = vertices.size();
+    const int numberOfTriangles = indices.size() / 3;
+
+    m_nodes.clear();
+    m_triangles.clear();
+    m_triangleVertices.clear();
+    m_depth = 0;
+
+    //Bounds and centroid of each triangle
+    QVector<MeshBVHBuildTriangle> triangles;
+    triangles.reserve(numberOfTriangles);
+
+    for (int t = 0; t < numberOfTriangles; ++t)
+    {
+        GLuint a = indices[3 * t], b = indices[3 * t + 1], c = indices[3 * t + 2];
+        if (a >= (GLuint)numberOfVertices || b >= (GLuint)numberOfVertices || c >= (GLuint)numberOfVertices)
+            continue;
+
+        MeshBVHBuildTriangle triangle;
+        triangle.minimum = componentMinimum(vertices[a], componentMinimum(vertices[b], vertices[c]));
+        triangle.maximum = componentMaximum(vertices[a], componentMaximum(vertices[b], vertices[c]));
+        triangle.centroid = 0.5f * (triangle.minimum + triangle.maximum);
+        triangle.triangle = t;
+        triangles.push_back(triangle);
+    }
+
+    if (triangles.isEmpty())
+        return;
+
+    m_nodes.reserve(2 * triangles.size() / BVH_MAXIMUM_LEAF_TRIANGLES + 1);
+    buildNode(triangles.data(), 0, triangles.size(), 1);
+    m_nodes.squeeze();
+
+    m_triangles.resize(triangles.size());
+    for (int k = 0; k < triangles.size(); ++k)
+        m_triangles[k] = triangles[k].triangle;
+
+    //The vertices of the leaves are read contiguously during the traversal
+    m_triangleVertices.resize(3 * m_triangles.size());
+    for (int k = 0; k < m_triangles.size(); ++k)
+    {
+        for (int c = 0; c < 3; ++c)
+            m_triangleVertices[3 * k + c] = vertices[indices[3 * m_triangles[k] + c]];
+    }
+}
+
+int MeshBVH::buildNode(MeshBVHBuildTriangle *triangles, int begin, int end, int depth)
+{
+    const int numberOfTriangles = end - begin;
+    m_depth = max(m_depth, depth);
+
+    //Bounds of the triangles and of their centroids
+    QVector3D minimum = triangles[begin].minimum, maximum = triangles[begin].maximum;
+    QVector3D centroidMinimum = triangles[begin].centroid, centroidMaximum = centroidMinimum;
+    for (int k = begin + 1; k < end; ++k)
+    {
+        minimum = componentMinimum(minimum, triangles[k].minimum);
+        maximum = componentMaximum(maximum, triangles[k].maximum);
+        centroidMinimum = componentMinimum(centroidMinimum, triangles[k].centroid);
+        centroidMaximum = componentMaximum(centroidMaximum, triangles[k].centroid);
+    }
+
+    int nodeIndex = m_nodes.size();
+    MeshBVHNode node;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        node.minimum[axis] = minimum[axis];
+        node.maximum[axis] = maximum[axis];
+    }
+    node.offset = begin;
+    node.numberOfTriangles = numberOfTriangles;
+    m_nodes.push_back(node);
+
+    if (numberOfTriangles <= BVH_MAXIMUM_LEAF_TRIANGLES || depth >= BVH_MAXIMUM_DEPTH)
+        return nodeIndex;
+
+    //Binned surface area heuristic : the cost of a split is the area of each side times its number of triangles
+    int bestAxis = -1, bestBin = 0;
+    float bestCost = 0.0f;
+
+    //The triangles are binned along the three axes in a single pass
+    float binScale[3];
+    int binCount[3][BVH_BINS] = { { 0 } };
+    QVector3D binMinimum[3][BVH_BINS], binMaximum[3][BVH_BINS];
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float extent = centroidMaximum[axis] - centroidMinimum[axis];
+        binScale[axis] = (extent > 0.0f) ? BVH_BINS / extent : 0.0f;
+    }
+
+    for (int k = begin; k < end; ++k)
+    {
+        const MeshBVHBuildTriangle &triangle = triangles[k];
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            int bin = min((int)((triangle.centroid[axis] - centroidMinimum[axis]) * binScale[axis]), BVH_BINS - 1);
+            if (binCount[axis][bin] == 0)
+            {
+                binMinimum[axis][bin] = triangle.minimum;
+                binMaximum[axis][bin] = triangle.maximum;
+            }
+            else
+            {
+                binMinimum[axis][bin] = componentMinimum(binMinimum[axis][bin], triangle.minimum);
+                binMaximum[axis][bin] = componentMaximum(binMaximum[axis][bin], triangle.maximum);
+            }
+            ++binCount[axis][bin];
+        }
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (binScale[axis] == 0.0f)
+            continue;
+
+        //Area times number of triangles on the right of each split, then sweep from the left
+        float rightCost[BVH_BINS];
+        int rightCount = 0;
+        QVector3D rightMinimum, rightMaximum;
+        for (int bin = BVH_BINS - 1; bin > 0; --bin)
+        {
+            if (binCount[axis][bin] > 0)
+            {
+                rightMinimum = (rightCount == 0) ? binMinimum[axis][bin] : componentMinimum(rightMinimum, binMinimum[axis][bin]);
+                rightMaximum = (rightCount == 0) ? binMaximum[axis][bin] : componentMaximum(rightMaximum, binMaximum[axis][bin]);
+                rightCount += binCount[axis][bin];
+            }
+            rightCost[bin - 1] = (rightCount == 0) ? -1.0f : rightCount * surfaceArea(rightMinimum, rightMaximum);
+        }
+
+        int leftCount = 0;
+        QVector3D leftMinimum, leftMaximum;
+        for (int bin = 0; bin < BVH_BINS - 1; ++bin)
+        {
+            if (binCount[axis][bin] > 0)
+            {
+                leftMinimum = (leftCount == 0) ? binMinimum[axis][bin] : componentMinimum(leftMinimum, binMinimum[axis][bin]);
+                leftMaximum = (leftCount == 0) ? binMaximum[axis][bin] : componentMaximum(leftMaximum, binMaximum[axis][bin]);
+                leftCount += binCount[axis][bin];
+            }
+
+            if (leftCount == 0 || rightCost[bin] < 0.0f)
+                continue;
+
+            float cost = leftCount * surfaceArea(leftMinimum, leftMaximum) + rightCost[bin];
+            if (bestAxis < 0 || cost < bestCost)
+            {
+                bestAxis = axis;
+                bestBin = bin;
+                bestCost = cost;
+            }
+        }
+    }
+
+    int middle;
+    if (bestAxis >= 0)
+    {
+        float splitScale = binScale[bestAxis];
+        float centroidStart = centroidMinimum[bestAxis];
+        middle = partition(triangles + begin, triangles + end, [&](const MeshBVHBuildTriangle &triangle)
+        {
+            return min((int)((triangle.centroid[bestAxis] - centroidStart) * splitScale), BVH_BINS - 1) <= bestBin;
+        }) - triangles;
+    }
+    else
+    {
+        //All the centroids are at the same point : split the range in two halves
+        middle = begin + numberOfTriangles / 2;
+    }
+
+    buildNode(triangles, begin, middle, depth + 1);
+    int secondChild = buildNode(triangles, middle, end, depth + 1);
+
+    m_nodes[nodeIndex].offset = secondChild;
+    m_nodes[nodeIndex].numberOfTriangles = 0;
+
+    return nodeIndex;
+}
+
+bool MeshBVH::intersect(const QVector3D &origin, const QVector3D &direction, RayHit &hit, float maximumDistance) const
+{
+    if (m_nodes.isEmpty())
+        return false;
+
+    //Division by zero gives infinite slabs, as needed
+    BVHRay ray;
+#ifdef MESHBVH_SSE
+    ray.origin = _mm_setr_ps(origin.x(), origin.y(), origin.z(), 0.0f);
+    ray.inverseDirection = _mm_setr_ps(1.0f / direction.x(), 1.0f / direction.y(), 1.0f / direction.z(), 0.0f);
+#else
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        ray.origin[axis] = origin[axis];
+        ray.inverseDirection[axis] = 1.0f / direction[axis];
+    }
+#endif
+
+    const MeshBVHNode *nodes = m_nodes.constData();
+    const QVector3D *triangleVertices = m_triangleVertices.constData();
+
+    float closestDistance = maximumDistance;
+    int closestTriangle = -1;
+    float closestU = 0.0f, closestV = 0.0f;
+
+    //Nodes to visit, with the distance at which the ray enters them
+    int stack[BVH_MAXIMUM_DEPTH + 1];
+    float stackEntry[BVH_MAXIMUM_DEPTH + 1];
+    int stackSize = 0;
+
+    float entry = 0.0f;
+    int nodeIndex = 0;
+    if (!intersectBox(nodes[0], ray, closestDistance, entry))
+        return false;
+
+    while (true)
+    {
+        const MeshBVHNode &node = nodes[nodeIndex];
+
+        if (node.numberOfTriangles > 0)
+        {
+            for (int k = node.offset; k < node.offset + node.numberOfTriangles; ++k)
+            {
+                float distance, u, v;
+                if (intersectTriangle(triangleVertices + 3 * k, origin, direction, closestDistance, distance, u, v))
+                {
+                    closestDistance = distance;
+                    closestTriangle = k;
+                    closestU = u;
+                    closestV = v;
+                }
+            }
+        }
+        else
+        {
+            //Visit the nearest child first
+            int first = nodeIndex + 1, second = node.offset;
+            float firstEntry = 0.0f, secondEntry = 0.0f;
+            bool hitFirst = intersectBox(nodes[first], ray, closestDistance, firstEntry);
+            bool hitSecond = intersectBox(nodes[second], ray, closestDistance, secondEntry);
+
+            if (hitFirst && hitSecond)
+            {
+                if (secondEntry < firstEntry)
+                {
+                    swap(first, second);
+                    swap(firstEntry, secondEntry);
+                }
+
+                stack[stackSize] = second;
+                stackEntry[stackSize] = secondEntry;
+                ++stackSize;
+                nodeIndex = first;
+                continue;
+            }
+            else if (hitFirst || hitSecond)
+            {
+                nodeIndex = hitFirst ? first : second;
+                continue;
+            }
+        }
+
+        //Next node that the ray enters before the closest hit
+        while (stackSize > 0 && stackEntry[stackSize - 1] > closestDistance)
+            --stackSize;
+
+        if (stackSize == 0)
+            break;
+
+        --stackSize;
+        nodeIndex = stack[stackSize];
+    }
+
+    if (closestTriangle < 0)
+        return false;
+
+    const QVector3D *triangle = triangleVertices + 3 * closestTriangle;
+    hit.triangle = m_triangles[closestTriangle];
+    hit.distance = closestDistance;
+    hit.u = closestU;
+    hit.v = closestV;
+    hit.position = (1.0f - closestU - closestV) * triangle[0] + closestU * triangle[1] + closestV * triangle[2];
+    hit.normal = QVector3D::crossProduct(triangle[1] - triangle[0], triangle[2] - triangle[0]).normalized();
+
+    return true;
+}
+
+void MeshBVH::setData(const MeshBVHNode *nodes, int numberOfNodes, const int *triangles, const QVector3D *triangleVertices,
+                      int numberOfTriangles, int depth)
+{
+    m_nodes.resize(numberOfNodes);
+    m_triangles.resize(numberOfTriangles);
+    m_triangleVertices.resize(3 * numberOfTriangles);
+    m_depth = depth;
+
+    copy(nodes, nodes + numberOfNodes, m_nodes.begin());
+    copy(triangles, triangles + numberOfTriangles, m_triangles.begin());
+    copy(triangleVertices, triangleVertices + 3 * numberOfTriangles, m_triangleVertices.begin());
+}
+
+const QVector<MeshBVHNode> &MeshBVH::getNodes() const
+{
+    return m_nodes;
+}
+
+const QVector<int> &MeshBVH::getTriangles() const
+{
+    return m_triangles;
+}
+
+const QVector<QVector3D> &MeshBVH::getTriangleVertices() const
+{
+    return m_triangleVertices;
+}
+
+int MeshBVH::getNumberOfNodes() const
+{
+    return m_nodes.size();
+}
+
+int MeshBVH::getNumberOfTriangles() const
+{
+    return m_triangles.size();
+}
+
+int MeshBVH::getDepth() const
+{
+    return m_depth;
+}
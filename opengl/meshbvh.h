@@ -0,0 +1,143 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include "opengl/openglheaders.h"
+
+#include <QVector>
+#include <QVector3D>
+
+//Number of bins of the surface area heuristic along each axis
+#define BVH_BINS 16
+
+//Leaves hold at most this number of triangles, unless they cannot be split
+#define BVH_MAXIMUM_LEAF_TRIANGLES 4
+
+//Deeper nodes are made leaves : it bounds the traversal stack
+#define BVH_MAXIMUM_DEPTH 64
+
+/**
+ * Node of a flattened BVH (32 bytes, two nodes per cache line).
+ * The first child of an inner node follows it in the array, the second one is at offset.
+ */
+struct MeshBVHNode
+{
+    float minimum[3];
+    int offset; //Second child of an inner node or first triangle of a leaf
+    float maximum[3];
+    int numberOfTriangles; //0 for an inner node
+};
+
+/**
+ * Closest intersection of a ray with a mesh.
+ */
+struct RayHit
+{
+    //Triangle number in the indices array of the mesh
+    int triangle;
+
+    //Ray parameter : the hit point is origin + distance * direction
+    float distance;
+
+    //Barycentric coordinates of the hit point with respect to the second and third vertices of the triangle
+    float u;
+    float v;
+
+    //Hit point and unit geometric normal of the triangle
+    QVector3D position;
+    QVector3D normal;
+
+    //Copy of an instanced object hit, -1 if the object is not instanced (set by Object::intersect)
+    int instance;
+};
+
+struct MeshBVHBuildTriangle;
+
+/**
+ * Bounding volume hierarchy over the triangles of a mesh, built with the binned surface area heuristic,
+ * to intersect rays with the mesh on the CPU (e.g. mouse picking).
+ */
+class MeshBVH
+{
+public:
+    MeshBVH();
+
+    /**
+     * Builds the hierarchy. The vertices of the triangles are copied in the order of the leaves.
+     * Triangles with an index out of range are ignored.
+     * @brief build
+     * @param indices
+     * @param vertices
+     */
+    void build(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices);
+
+    /**
+     * Sets a hierarchy built before, e.g. read from the mesh cache (see getNodes, getTriangles and getTriangleVertices).
+     * @brief setData
+     * @param nodes
+     * @param numberOfNodes
+     * @param triangles
+     * @param triangleVertices 3 vertices per triangle
+     * @param numberOfTriangles
+     * @param depth
+     */
+    void setData(const MeshBVHNode *nodes, int numberOfNodes, const int *triangles, const QVector3D *triangleVertices,
+                 int numberOfTriangles, int depth);
+
+    /**
+     * Finds the closest triangle (front or back facing) hit by the ray with a parameter in [0, maximumDistance].
+     * The direction does not need to be normalized.
+     * @brief intersect
+     * @param origin
+     * @param direction
+     * @param hit
+     * @param maximumDistance
+     * @return true if a triangle is hit
+     */
+    bool intersect(const QVector3D &origin, const QVector3D &direction, RayHit &hit, float maximumDistance = 1e30f) const;
+
+    const QVector<MeshBVHNode> &getNodes() const;
+    const QVector<int> &getTriangles() const;
+    const QVector<QVector3D> &getTriangleVertices() const;
+
+    int getNumberOfNodes() const;
+    int getNumberOfTriangles() const;
+    int getDepth() const;
+
+private:
+    int buildNode(MeshBVHBuildTriangle *triangles, int begin, int end, int depth);
+
+    QVector<MeshBVHNode> m_nodes;
+
+    //Triangle numbers and vertices in the order of the leaves
+    QVector<int> m_triangles;
+    QVector<QVector3D> m_triangleVertices;
+
+    int m_depth;
+};
+
+#endif // MESHBVH_H
@@ -0,0 +1,284 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/meshcache.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+static const char meshCacheMagic[8] = { 'S', 'L', 'M', 'E', 'S', 'H', '\0', '\0' };
+
+/**
+ * Size of the header followed by the source path, padded to 4 bytes.
+ */
+static qint64 meshCacheHeaderSize(quint32 sourcePathLength)
+{
+    return (sizeof(MeshCacheHeader) + sourcePathLength + 3) & ~(qint64)3;
+}
+
+/**
+ * Size of the encoded indices, padded to 4 bytes to keep the BVH aligned.
+ */
+static qint64 meshCacheIndexDataSize(quint32 indexDataSize)
+{
+    return ((qint64)indexDataSize + 3) & ~(qint64)3;
+}
+
+static qint64 meshCacheDataSize(const MeshCacheHeader *header)
+{
+    return (qint64)header->numberOfVertices * (2 * sizeof(QVector3D) + sizeof(QVector4D)) + (qint64)header->numberOfTextureCoordinates * sizeof(QVector2D)
+            + (qint64)header->numberOfIndices * sizeof(GLuint) + (qint64)header->numberOfLevelsOfDetail * sizeof(LevelOfDetail)
+            + (qint64)header->numberOfLevelOfDetailIndices * sizeof(GLuint) + (qint64)header->numberOfMeshlets * sizeof(Meshlet)
+            + header->vertexDataSize + meshCacheIndexDataSize(header->indexDataSize)
+            + (qint64)header->numberOfBVHNodes * sizeof(MeshBVHNode) + (qint64)header->numberOfBVHTriangles * (sizeof(int) + 3 * sizeof(QVector3D));
+}
+
+MeshCache::MeshCache(const string &sourceFileName, bool optimized, const QMatrix4x4 &bakeTransform) :
+m_file(cacheFileName(sourceFileName, optimized, bakeTransform)), m_header(0)
+{
+    if (!m_file.isOpen() || m_file.size() < (qint64)sizeof(MeshCacheHeader))
+        return;
+
+    const MeshCacheHeader *header = (const MeshCacheHeader *)m_file.begin();
+
+    if (memcmp(header->magic, meshCacheMagic, sizeof(meshCacheMagic)) != 0 || header->version != MESH_CACHE_VERSION)
+        return;
+
+    if (header->headerSize != meshCacheHeaderSize(header->sourcePathLength)
+            || m_file.size() != header->headerSize + meshCacheDataSize(header))
+        return;
+
+    //The source file must be the same and must not have changed since the cache was written
+    QFileInfo sourceInfo(QString::fromStdString(sourceFileName));
+    string sourcePath = sourceInfo.absoluteFilePath().toStdString();
+
+    if (header->sourcePathLength != sourcePath.size()
+            || memcmp(m_file.begin() + sizeof(MeshCacheHeader), sourcePath.data(), sourcePath.size()) != 0)
+        return;
+
+    if (header->sourceSize != sourceInfo.size() || header->sourceModificationTime != sourceInfo.lastModified().toMSecsSinceEpoch())
+        return;
+
+    m_header = header;
+}
+
+bool MeshCache::isValid() const
+{
+    return m_header != 0;
+}
+
+int MeshCache::getNumberOfVertices() const
+{
+    return m_header ? m_header->numberOfVertices : 0;
+}
+
+int MeshCache::getNumberOfTextureCoordinates() const
+{
+    return m_header ? m_header->numberOfTextureCoordinates : 0;
+}
+
+int MeshCache::getNumberOfIndices() const
+{
+    return m_header ? m_header->numberOfIndices : 0;
+}
+
+void MeshCache::copyToMesh(Mesh &mesh) const
+{
+    if (!m_header)
+        return;
+
+    const QVector3D *vertices = (const QVector3D *)(m_file.begin() + m_header->headerSize);
+    const QVector2D *textureCoordinates = (const QVector2D *)(vertices + getNumberOfVertices());
+    const QVector3D *normals = (const QVector3D *)(textureCoordinates + getNumberOfTextureCoordinates());
+    const QVector4D *tangents = (const QVector4D *)(normals + getNumberOfVertices());
+    const GLuint *indices = (const GLuint *)(tangents + getNumberOfVertices());
+
+    mesh.setData(vertices, normals, getNumberOfVertices(), textureCoordinates, getNumberOfTextureCoordinates(),
+                 indices, getNumberOfIndices());
+    mesh.setTangents(tangents, getNumberOfVertices());
+
+    const LevelOfDetail *levels = (const LevelOfDetail *)(indices + getNumberOfIndices());
+    const GLuint *levelIndices = (const GLuint *)(levels + m_header->numberOfLevelsOfDetail);
+    mesh.setLevelsOfDetail(levels, m_header->numberOfLevelsOfDetail, levelIndices, m_header->numberOfLevelOfDetailIndices);
+
+    const Meshlet *meshlets = (const Meshlet *)(levelIndices + m_header->numberOfLevelOfDetailIndices);
+    mesh.setMeshlets(meshlets, m_header->numberOfMeshlets);
+}
+
+void MeshCache::copyToAsset(MeshAsset &asset) const
+{
+    if (!m_header)
+        return;
+
+    this->copyToMesh(asset.mesh);
+
+    //The encoded buffers and the BVH follow the arrays of the mesh
+    const char *vertexData = m_file.end() - m_header->numberOfBVHTriangles * (sizeof(int) + 3 * sizeof(QVector3D))
+            - m_header->numberOfBVHNodes * sizeof(MeshBVHNode) - meshCacheIndexDataSize(m_header->indexDataSize) - m_header->vertexDataSize;
+    const char *indexData = vertexData + m_header->vertexDataSize;
+    const MeshBVHNode *nodes = (const MeshBVHNode *)(indexData + meshCacheIndexDataSize(m_header->indexDataSize));
+    const int *triangles = (const int *)(nodes + m_header->numberOfBVHNodes);
+    const QVector3D *triangleVertices = (const QVector3D *)(triangles + m_header->numberOfBVHTriangles);
+
+    asset.vertexData = QByteArray::fromRawData(vertexData, m_header->vertexDataSize);
+    asset.indexData = QByteArray::fromRawData(indexData, m_header->indexDataSize);
+
+    QMatrix4x4 dequantizationMatrix;
+    memcpy(dequantizationMatrix.data(), m_header->dequantizationMatrix, sizeof(m_header->dequantizationMatrix));
+    asset.encoding.setFormats(m_header->indexType, m_header->textureCoordinatesType, m_header->textureCoordinatesOffset,
+                              m_header->normalsOffset, m_header->tangentsOffset, dequantizationMatrix);
+
+    asset.boundingSphereCenter = QVector3D(m_header->boundingSphereCenter[0], m_header->boundingSphereCenter[1], m_header->boundingSphereCenter[2]);
+    asset.boundingSphereRadius = m_header->boundingSphereRadius;
+
+    QSharedPointer<MeshBVH> bvh(new MeshBVH());
+    bvh->setData(nodes, m_header->numberOfBVHNodes, triangles, triangleVertices, m_header->numberOfBVHTriangles, m_header->bvhDepth);
+    asset.bvh = bvh;
+}
+
+bool MeshCache::save(const string &sourceFileName, const MeshAsset &asset, bool optimized, const QMatrix4x4 &bakeTransform)
+{
+    QFileInfo sourceInfo(QString::fromStdString(sourceFileName));
+    string sourcePath = sourceInfo.absoluteFilePath().toStdString();
+
+    const Mesh &mesh = asset.mesh;
+    MeshBVH emptyBVH;
+    const MeshBVH &bvh = asset.bvh.isNull() ? emptyBVH : *asset.bvh;
+
+    QVector<QVector3D> vertices = mesh.getVertices();
+    QVector<QVector2D> textureCoordinates = mesh.getTextureCoordinates();
+    QVector<QVector3D> normals = mesh.getVertexNormals();
+    QVector<QVector4D> tangents = mesh.getTangents();
+    QVector<GLuint> indices = mesh.getIndicesArray();
+    QVector<LevelOfDetail> levels = mesh.getLevelsOfDetail();
+    QVector<GLuint> levelIndices = mesh.getLevelOfDetailIndices();
+    QVector<Meshlet> meshlets = mesh.getMeshlets();
+
+    //The full resolution level is implicit
+    levels.remove(0);
+
+    //The vertex buffer holds exactly one normal per vertex
+    normals.resize(vertices.size());
+    tangents.resize(vertices.size());
+
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, meshCacheMagic, sizeof(meshCacheMagic));
+    header.version = MESH_CACHE_VERSION;
+    header.sourcePathLength = sourcePath.size();
+    header.headerSize = meshCacheHeaderSize(header.sourcePathLength);
+    header.sourceSize = sourceInfo.size();
+    header.sourceModificationTime = sourceInfo.lastModified().toMSecsSinceEpoch();
+    header.numberOfVertices = vertices.size();
+    header.numberOfTextureCoordinates = textureCoordinates.size();
+    header.numberOfIndices = indices.size();
+    header.numberOfLevelsOfDetail = levels.size();
+    header.numberOfLevelOfDetailIndices = levelIndices.size();
+    header.numberOfMeshlets = meshlets.size();
+
+    const MeshEncoding &encoding = asset.encoding;
+    header.vertexDataSize = asset.vertexData.size();
+    header.indexDataSize = asset.indexData.size();
+    header.indexType = encoding.getIndexType();
+    header.textureCoordinatesType = encoding.getTextureCoordinatesType();
+    header.textureCoordinatesOffset = encoding.getTextureCoordinatesOffset();
+    header.normalsOffset = encoding.getNormalsOffset();
+    header.tangentsOffset = encoding.getTangentsOffset();
+    memcpy(header.dequantizationMatrix, encoding.getDequantizationMatrix().constData(), sizeof(header.dequantizationMatrix));
+
+    header.boundingSphereCenter[0] = asset.boundingSphereCenter.x();
+    header.boundingSphereCenter[1] = asset.boundingSphereCenter.y();
+    header.boundingSphereCenter[2] = asset.boundingSphereCenter.z();
+    header.boundingSphereRadius = asset.boundingSphereRadius;
+    header.numberOfBVHNodes = bvh.getNumberOfNodes();
+    header.numberOfBVHTriangles = bvh.getNumberOfTriangles();
+    header.bvhDepth = bvh.getDepth();
+
+    QString fileName = QString::fromStdString(cacheFileName(sourceFileName, optimized, bakeTransform));
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    //QSaveFile writes to a temporary file : a reader never sees a partially written cache
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        cerr << "Could not write the mesh cache : " << fileName.toStdString() << endl;
+        return false;
+    }
+
+    vector<char> padding(header.headerSize - sizeof(MeshCacheHeader) - sourcePath.size(), 0);
+    vector<char> indexPadding(meshCacheIndexDataSize(header.indexDataSize) - header.indexDataSize, 0);
+
+    file.write((const char *)&header, sizeof(header));
+    file.write(sourcePath.data(), sourcePath.size());
+    file.write(padding.data(), padding.size());
+    file.write((const char *)vertices.constData(), vertices.size() * sizeof(QVector3D));
+    file.write((const char *)textureCoordinates.constData(), textureCoordinates.size() * sizeof(QVector2D));
+    file.write((const char *)normals.constData(), normals.size() * sizeof(QVector3D));
+    file.write((const char *)tangents.constData(), tangents.size() * sizeof(QVector4D));
+    file.write((const char *)indices.constData(), indices.size() * sizeof(GLuint));
+    file.write((const char *)levels.constData(), levels.size() * sizeof(LevelOfDetail));
+    file.write((const char *)levelIndices.constData(), levelIndices.size() * sizeof(GLuint));
+    file.write((const char *)meshlets.constData(), meshlets.size() * sizeof(Meshlet));
+    file.write(asset.vertexData.constData(), asset.vertexData.size());
+    file.write(asset.indexData.constData(), asset.indexData.size());
+    file.write(indexPadding.data(), indexPadding.size());
+    file.write((const char *)bvh.getNodes().constData(), bvh.getNodes().size() * sizeof(MeshBVHNode));
+    file.write((const char *)bvh.getTriangles().constData(), bvh.getTriangles().size() * sizeof(int));
+    file.write((const char *)bvh.getTriangleVertices().constData(), bvh.getTriangleVertices().size() * sizeof(QVector3D));
+
+    if (!file.commit())
+    {
+        cerr << "Could not write the mesh cache : " << fileName.toStdString() << endl;
+        return false;
+    }
+
+    return true;
+}
+
+string MeshCache::cacheFileName(const string &sourceFileName, bool optimized, const QMatrix4x4 &bakeTransform)
+{
+    QString sourcePath = QFileInfo(QString::fromStdString(sourceFileName)).absoluteFilePath();
+
+    //A baked transform gives another cache file, the meshes loaded without one keep theirs
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(sourcePath.toUtf8());
+    if (!bakeTransform.isIdentity())
+        hash.addData((const char *)bakeTransform.constData(), 16 * sizeof(float));
+    QByteArray key = hash.result().toHex();
+
+    QString cacheDirectory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/meshes/";
+    QString suffix = optimized ? "-optimized.slmesh" : ".slmesh";
+    return (cacheDirectory + QString::fromLatin1(key) + suffix).toStdString();
+}
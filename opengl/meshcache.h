@@ -0,0 +1,160 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "opengl/mesh.h"
+#include "opengl/meshasset.h"
+#include "opengl/mappedfile.h"
+
+#include <QMatrix4x4>
+#include <QtGlobal>
+
+#include <string>
+
+#define MESH_CACHE_VERSION 9
+
+/**
+ * Header of a .slmesh file. It is followed by the path of the source file (padded to 4 bytes),
+ * then by the arrays of the mesh :
+ * positions (numberOfVertices QVector3D), texture coordinates (numberOfTextureCoordinates QVector2D),
+ * normals (numberOfVertices QVector3D), tangents (numberOfVertices QVector4D) and the indices (numberOfIndices GLuint),
+ * followed by the levels of detail (numberOfLevelsOfDetail LevelOfDetail), their indices (numberOfLevelOfDetailIndices GLuint)
+ * and the meshlets (numberOfMeshlets Meshlet).
+ * They are followed by what is computed from the mesh after it is loaded : the encoded vertex and index buffers
+ * (vertexDataSize and indexDataSize bytes, the indices are padded to 4 bytes, see MeshEncoding)
+ * and the flattened BVH (numberOfBVHNodes MeshBVHNode, numberOfBVHTriangles int and 3 QVector3D per triangle, see MeshBVH).
+ * The values are stored in the byte order of the machine : the cache is not meant to be shared.
+ */
+struct MeshCacheHeader
+{
+    char magic[8];
+    quint32 version;
+    quint32 headerSize;
+    qint64 sourceSize;
+    qint64 sourceModificationTime;
+    quint32 sourcePathLength;
+    quint32 numberOfVertices;
+    quint32 numberOfTextureCoordinates;
+    quint32 numberOfIndices;
+    quint32 numberOfLevelsOfDetail;
+    quint32 numberOfLevelOfDetailIndices;
+    quint32 numberOfMeshlets;
+
+    //Formats of the encoded buffers (see MeshEncoding)
+    quint32 vertexDataSize;
+    quint32 indexDataSize;
+    quint32 indexType;
+    quint32 textureCoordinatesType;
+    quint32 textureCoordinatesOffset;
+    quint32 normalsOffset;
+    quint32 tangentsOffset;
+    float dequantizationMatrix[16];
+
+    //Bounding sphere and BVH of the mesh
+    float boundingSphereCenter[3];
+    float boundingSphereRadius;
+    quint32 numberOfBVHNodes;
+    quint32 numberOfBVHTriangles;
+    quint32 bvhDepth;
+};
+
+/**
+ * Binary cache of the meshes read from text files (.slmesh).
+ * A cache file is keyed by the path, the size and the modification time of the source file and by the transform baked in the mesh
+ * and is memory-mapped so that its arrays are copied to the mesh without any parsing
+ * and its encoded buffers are uploaded without being encoded again.
+ */
+class MeshCache
+{
+public:
+    /**
+     * Maps the cache file of the source file if it exists and is up to date.
+     * Optimized and unoptimized meshes (see Mesh::optimize) are cached separately, as are the meshes baked with different transforms.
+     * @brief MeshCache
+     * @param sourceFileName
+     * @param optimized
+     * @param bakeTransform transform baked in the mesh at load time (see Mesh::transform)
+     */
+    MeshCache(const std::string &sourceFileName, bool optimized, const QMatrix4x4 &bakeTransform);
+
+    /**
+     * Returns true if the cache file matches the source file.
+     * @brief isValid
+     * @return
+     */
+    bool isValid() const;
+
+    int getNumberOfVertices() const;
+    int getNumberOfTextureCoordinates() const;
+    int getNumberOfIndices() const;
+
+    /**
+     * Copies the cached arrays to the mesh.
+     * @brief copyToMesh
+     * @param mesh
+     */
+    void copyToMesh(Mesh &mesh) const;
+
+    /**
+     * Copies the mesh, its bounding sphere, its BVH and its encoding to the asset.
+     * The encoded buffers of the asset are not copied : they point to the mapping of the cache file,
+     * so the asset must keep the cache until its buffers are uploaded (see MeshAsset::meshCache).
+     * @brief copyToAsset
+     * @param asset
+     */
+    void copyToAsset(MeshAsset &asset) const;
+
+    /**
+     * Writes the cache file of an asset whose mesh was read from sourceFileName, once its BVH is built and its buffers are encoded.
+     * @brief save
+     * @param sourceFileName
+     * @param asset
+     * @param optimized
+     * @param bakeTransform
+     * @return true on success
+     */
+    static bool save(const std::string &sourceFileName, const MeshAsset &asset, bool optimized, const QMatrix4x4 &bakeTransform);
+
+    /**
+     * Path of the cache file of a source file, in the cache location of the application.
+     * @brief cacheFileName
+     * @param sourceFileName
+     * @param optimized
+     * @param bakeTransform
+     * @return
+     */
+    static std::string cacheFileName(const std::string &sourceFileName, bool optimized, const QMatrix4x4 &bakeTransform);
+
+private:
+    MeshCache(const MeshCache &);
+    MeshCache &operator=(const MeshCache &);
+
+    MappedFile m_file;
+    const MeshCacheHeader *m_header;
+};
+
+#endif // MESHCACHE_H
@@ -0,0 +1,227 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/meshencoding.h"
+#include "opengl/mesh.h"
+#include "opengl/meshkernels.h"
+#include "opengl/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+/**
+ * Rounds a value between 0 and 1 to 16 bits.
+ */
+static GLushort unorm16(float value)
+{
+    return (GLushort)(min(max(value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+}
+
+/**
+ * Rounds a value between -1 and 1 to a 10 bit two's complement integer.
+ */
+static GLuint snorm10(float value)
+{
+    int quantized = (int)floor(min(max(value, -1.0f), 1.0f) * 511.0f + 0.5f);
+    return (GLuint)quantized & 0x3ff;
+}
+
+/**
+ * Converts a float to a half float (rounded to nearest, denormals are flushed to 0).
+ */
+static GLushort halfFloat(float value)
+{
+    GLuint bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    GLushort sign = (GLushort)((bits >> 16) & 0x8000);
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    GLuint mantissa = bits & 0x7fffff;
+
+    //NaN
+    if (((bits >> 23) & 0xff) == 0xff && mantissa != 0)
+        return sign | 0x7e00;
+
+    if (exponent <= 0)
+        return sign;
+
+    //Round the mantissa to 10 bits, which may carry into the exponent
+    GLuint half = ((GLuint)exponent << 10) + (mantissa >> 13) + ((mantissa >> 12) & 1);
+
+    //Too large : infinity
+    if (half >= 0x7c00)
+        return sign | 0x7c00;
+
+    return sign | (GLushort)half;
+}
+
+MeshEncoding::MeshEncoding() : m_indexType(GL_UNSIGNED_INT), m_textureCoordinatesType(GL_FLOAT),
+m_textureCoordinatesOffset(0), m_normalsOffset(0), m_tangentsOffset(0), m_dequantizationMatrix(QMatrix4x4())
+{
+
+}
+
+void MeshEncoding::encode(const Mesh &mesh, QByteArray &vertexData, QByteArray &indexData)
+{
+    const QVector<QVector3D> &vertices = mesh.getVertices();
+    const QVector<QVector3D> &normals = mesh.getVertexNormals();
+    const QVector<QVector2D> &textureCoordinates = mesh.getTextureCoordinates();
+    const QVector<QVector4D> &tangents = mesh.getTangents();
+    //All the levels of detail are in the same index buffer
+    const QVector<GLuint> indices = mesh.getIndicesArray() + mesh.getLevelOfDetailIndices();
+
+    const int numberOfVertices = vertices.size();
+    const int numberOfNormals = min(normals.size(), numberOfVertices);
+    const int numberOfTangents = min(tangents.size(), numberOfVertices);
+    const int numberOfTextureCoordinates = textureCoordinates.size();
+
+    //Bounding box of the positions
+    QVector3D minimum, maximum;
+    MeshKernels::computeBounds(vertices.constData(), numberOfVertices, minimum, maximum);
+
+    //A flat box keeps a unit extent in that dimension to avoid dividing by 0
+    QVector3D extent = maximum - minimum;
+    extent = QVector3D(extent.x() > 0.0f ? extent.x() : 1.0f, extent.y() > 0.0f ? extent.y() : 1.0f,
+                       extent.z() > 0.0f ? extent.z() : 1.0f);
+
+    const QVector3D inverseExtent(1.0f / extent.x(), 1.0f / extent.y(), 1.0f / extent.z());
+
+    m_dequantizationMatrix.setToIdentity();
+    m_dequantizationMatrix.translate(minimum);
+    m_dequantizationMatrix.scale(extent);
+
+    //Texture coordinates in the unit square are stored as unorm16, the others (e.g. repeated textures) as half floats
+    bool unitTextureCoordinates = true;
+    for (int t = 0; t < numberOfTextureCoordinates && unitTextureCoordinates; ++t)
+    {
+        const QVector2D &uv = textureCoordinates[t];
+        unitTextureCoordinates = (uv.x() >= 0.0f && uv.x() <= 1.0f && uv.y() >= 0.0f && uv.y() <= 1.0f);
+    }
+    m_textureCoordinatesType = unitTextureCoordinates ? GL_UNSIGNED_SHORT : GL_HALF_FLOAT;
+
+    const int positionsSize = numberOfVertices * ENCODED_POSITION_SIZE * sizeof(GLushort);
+    const int textureCoordinatesSize = numberOfTextureCoordinates * ENCODED_TEXTURE_COORDINATES_SIZE * sizeof(GLushort);
+    const int normalsSize = numberOfVertices * sizeof(GLuint);
+    const int tangentsSize = numberOfVertices * sizeof(GLuint);
+
+    m_textureCoordinatesOffset = positionsSize;
+    m_normalsOffset = m_textureCoordinatesOffset + textureCoordinatesSize;
+    m_tangentsOffset = m_normalsOffset + normalsSize;
+
+    vertexData.resize(positionsSize + textureCoordinatesSize + normalsSize + tangentsSize);
+    GLushort *positionData = (GLushort *)vertexData.data();
+    GLushort *textureCoordinatesData = (GLushort *)(vertexData.data() + m_textureCoordinatesOffset);
+    GLuint *normalData = (GLuint *)(vertexData.data() + m_normalsOffset);
+    GLuint *tangentData = (GLuint *)(vertexData.data() + m_tangentsOffset);
+
+    parallelFor(max(numberOfVertices, numberOfTextureCoordinates), [&](int begin, int end)
+    {
+        for (int v = begin; v < end; ++v)
+        {
+            if (v < numberOfVertices)
+            {
+                QVector3D p = (vertices[v] - minimum) * inverseExtent;
+                positionData[4 * v] = unorm16(p.x());
+                positionData[4 * v + 1] = unorm16(p.y());
+                positionData[4 * v + 2] = unorm16(p.z());
+                positionData[4 * v + 3] = 65535;
+
+                QVector3D n = (v < numberOfNormals) ? normals[v] : QVector3D(0.0, 0.0, 0.0);
+                normalData[v] = snorm10(n.x()) | (snorm10(n.y()) << 10) | (snorm10(n.z()) << 20);
+
+                //The sign is 1 (01) or -2 (10) in the 2 bit component : both read as +/-1 with the normalization of OpenGL 4.2
+                //(max(c, -1)) and with the older one ((2c + 1) / 3), under which -1 (11) would read as -1/3
+                QVector4D t = (v < numberOfTangents) ? tangents[v] : QVector4D(0.0, 0.0, 0.0, 1.0);
+                tangentData[v] = snorm10(t.x()) | (snorm10(t.y()) << 10) | (snorm10(t.z()) << 20) | ((t.w() < 0.0f ? 2u : 1u) << 30);
+            }
+
+            if (v < numberOfTextureCoordinates)
+            {
+                const QVector2D &uv = textureCoordinates[v];
+                textureCoordinatesData[2 * v] = unitTextureCoordinates ? unorm16(uv.x()) : halfFloat(uv.x());
+                textureCoordinatesData[2 * v + 1] = unitTextureCoordinates ? unorm16(uv.y()) : halfFloat(uv.y());
+            }
+        }
+    });
+
+    //16 bit indices if every vertex can be addressed
+    if (numberOfVertices <= 65536)
+    {
+        m_indexType = GL_UNSIGNED_SHORT;
+        indexData.resize(indices.size() * sizeof(GLushort));
+        GLushort *indexArray = (GLushort *)indexData.data();
+        for (int k = 0; k < indices.size(); ++k)
+            indexArray[k] = (GLushort)indices[k];
+    }
+    else
+    {
+        m_indexType = GL_UNSIGNED_INT;
+        indexData = QByteArray((const char *)indices.constData(), indices.size() * sizeof(GLuint));
+    }
+}
+
+void MeshEncoding::setFormats(GLenum indexType, GLenum textureCoordinatesType, int textureCoordinatesOffset, int normalsOffset,
+                              int tangentsOffset, const QMatrix4x4 &dequantizationMatrix)
+{
+    m_indexType = indexType;
+    m_textureCoordinatesType = textureCoordinatesType;
+    m_textureCoordinatesOffset = textureCoordinatesOffset;
+    m_normalsOffset = normalsOffset;
+    m_tangentsOffset = tangentsOffset;
+    m_dequantizationMatrix = dequantizationMatrix;
+}
+
+GLenum MeshEncoding::getIndexType() const
+{
+    return m_indexType;
+}
+
+GLenum MeshEncoding::getTextureCoordinatesType() const
+{
+    return m_textureCoordinatesType;
+}
+
+int MeshEncoding::getTextureCoordinatesOffset() const
+{
+    return m_textureCoordinatesOffset;
+}
+
+int MeshEncoding::getNormalsOffset() const
+{
+    return m_normalsOffset;
+}
+
+int MeshEncoding::getTangentsOffset() const
+{
+    return m_tangentsOffset;
+}
+
+QMatrix4x4 MeshEncoding::getDequantizationMatrix() const
+{
+    return m_dequantizationMatrix;
+}
@@ -0,0 +1,134 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MESHENCODING_H
+#define MESHENCODING_H
+
+#include "opengl/openglheaders.h"
+
+#include <QByteArray>
+#include <QMatrix4x4>
+
+class Mesh;
+
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+
+#ifndef GL_INT_2_10_10_10_REV
+#define GL_INT_2_10_10_10_REV 0x8D9F
+#endif
+
+//Positions : 4 unorm16 components (x, y, z relative to the bounding box of the mesh, w = 1)
+#define ENCODED_POSITION_TYPE GL_UNSIGNED_SHORT
+#define ENCODED_POSITION_SIZE 4
+
+//Normals : 3 snorm10 components packed in 32 bits
+#define ENCODED_NORMAL_TYPE GL_INT_2_10_10_10_REV
+#define ENCODED_NORMAL_SIZE 4
+
+//Texture coordinates : 2 unorm16 or half float components
+#define ENCODED_TEXTURE_COORDINATES_SIZE 2
+
+//Tangents : 3 snorm10 components and the sign of the bitangent (snorm2) packed in 32 bits
+#define ENCODED_TANGENT_TYPE GL_INT_2_10_10_10_REV
+#define ENCODED_TANGENT_SIZE 4
+
+//Locations of the vertex attributes, bound before the shader programs are linked (see MeshAsset::bindAttributeLocations)
+#define POSITION_ATTRIBUTE_LOCATION 0
+#define TEXTURE_COORDINATES_ATTRIBUTE_LOCATION 1
+#define NORMAL_ATTRIBUTE_LOCATION 2
+#define TANGENT_ATTRIBUTE_LOCATION 3
+
+/**
+ * Compact encoding of the vertex and index buffers of a mesh :
+ * 20 bytes per vertex instead of 48 and 16 bit indices when there are less than 65536 vertices.
+ * The integer attributes are normalized by OpenGL, so the shaders still read vec3 positions and normals, vec2 texture coordinates
+ * and vec4 tangents.
+ * The positions are read between 0 and 1 and must be transformed by the dequantization matrix (before the model matrix).
+ * The buffers are planar : positions, texture coordinates, normals then tangents.
+ */
+class MeshEncoding
+{
+public:
+    MeshEncoding();
+
+    /**
+     * Chooses the formats for the mesh and encodes its vertices and indices.
+     * @brief encode
+     * @param mesh
+     * @param vertexData
+     * @param indexData
+     */
+    void encode(const Mesh &mesh, QByteArray &vertexData, QByteArray &indexData);
+
+    /**
+     * Sets the formats chosen by a previous encode, e.g. for buffers read from the mesh cache.
+     * @brief setFormats
+     * @param indexType
+     * @param textureCoordinatesType
+     * @param textureCoordinatesOffset
+     * @param normalsOffset
+     * @param tangentsOffset
+     * @param dequantizationMatrix
+     */
+    void setFormats(GLenum indexType, GLenum textureCoordinatesType, int textureCoordinatesOffset, int normalsOffset, int tangentsOffset,
+                    const QMatrix4x4 &dequantizationMatrix);
+
+    /**
+     * GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, to give to glDrawElements.
+     * @brief getIndexType
+     * @return
+     */
+    GLenum getIndexType() const;
+
+    /**
+     * GL_UNSIGNED_SHORT if the texture coordinates are between 0 and 1, GL_HALF_FLOAT otherwise.
+     * @brief getTextureCoordinatesType
+     * @return
+     */
+    GLenum getTextureCoordinatesType() const;
+
+    int getTextureCoordinatesOffset() const;
+    int getNormalsOffset() const;
+    int getTangentsOffset() const;
+
+    /**
+     * Transforms the encoded positions (between 0 and 1) to the positions of the mesh.
+     * @brief getDequantizationMatrix
+     * @return
+     */
+    QMatrix4x4 getDequantizationMatrix() const;
+
+private:
+    GLenum m_indexType;
+    GLenum m_textureCoordinatesType;
+    int m_textureCoordinatesOffset;
+    int m_normalsOffset;
+    int m_tangentsOffset;
+    QMatrix4x4 m_dequantizationMatrix;
+};
+
+#endif // MESHENCODING_H
@@ -0,0 +1,696 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/meshkernels.h"
+
+#include <QElapsedTimer>
+#include <QVector>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+//SSE2 is part of every x86-64 target, the other targets (e.g. ARM) only have the scalar kernels
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESHKERNELS_SSE2
+#include <emmintrin.h>
+
+//GCC and Clang compile the AVX2 kernels for any x86 target and select them at runtime,
+//MSVC only when the whole program targets AVX2 (/arch:AVX2)
+#if defined(__GNUC__)
+#define MESHKERNELS_AVX2
+#define MESHKERNELS_AVX2_FUNCTION __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(__AVX2__)
+#define MESHKERNELS_AVX2
+#define MESHKERNELS_AVX2_FUNCTION
+#include <immintrin.h>
+#endif
+#endif
+
+//The centroid is accumulated in floats over blocks of points, then in doubles
+#define MESH_KERNELS_CENTROID_BLOCK 4096
+
+using namespace std;
+
+static MeshKernels::InstructionSet s_instructionSet = MeshKernels::bestInstructionSet();
+
+/**
+ * Rows of the affine part of a matrix : x' = m[0] x + m[1] y + m[2] z + m[3], then y' and z'.
+ */
+static void affineRows(const QMatrix4x4 &matrix, float *rows)
+{
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            rows[4 * r + c] = matrix(r, c);
+        }
+    }
+}
+
+/*
+ * Scalar kernels, one vector per iteration.
+ */
+
+static void computeBoundsScalar(const float *p, int numberOfPoints, float *minimum, float *maximum)
+{
+    for (int i = 0; i < numberOfPoints; ++i, p += 3)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            minimum[c] = min(minimum[c], p[c]);
+            maximum[c] = max(maximum[c], p[c]);
+        }
+    }
+}
+
+static void sumScalar(const float *p, int numberOfPoints, double *sum)
+{
+    for (int i = 0; i < numberOfPoints; ++i, p += 3)
+    {
+        sum[0] += p[0];
+        sum[1] += p[1];
+        sum[2] += p[2];
+    }
+}
+
+/**
+ * Multiplies the vectors by the rows (if any), adds the translation and normalizes the results.
+ */
+static void transformScalar(float *p, int numberOfPoints, const float *rows, bool translate, bool normalize)
+{
+    for (int i = 0; i < numberOfPoints; ++i, p += 3)
+    {
+        float x = p[0], y = p[1], z = p[2];
+
+        if (rows)
+        {
+            x = rows[0] * p[0] + rows[1] * p[1] + rows[2] * p[2];
+            y = rows[4] * p[0] + rows[5] * p[1] + rows[6] * p[2];
+            z = rows[8] * p[0] + rows[9] * p[1] + rows[10] * p[2];
+
+            if (translate)
+            {
+                x += rows[3];
+                y += rows[7];
+                z += rows[11];
+            }
+        }
+
+        if (normalize)
+        {
+            float squaredLength = x * x + y * y + z * z;
+            float inverseLength = squaredLength > 0.0f ? 1.0f / sqrt(squaredLength) : 0.0f;
+            x *= inverseLength;
+            y *= inverseLength;
+            z *= inverseLength;
+        }
+
+        p[0] = x;
+        p[1] = y;
+        p[2] = z;
+    }
+}
+
+#ifdef MESHKERNELS_SSE2
+
+/*
+ * SSE2 kernels, four vectors per iteration. The 12 floats x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+ * are loaded in three registers and shuffled to x0 x1 x2 x3, y0 y1 y2 y3 and z0 z1 z2 z3.
+ */
+
+static inline void loadPointsSSE2(const float *p, __m128 &x, __m128 &y, __m128 &z)
+{
+    __m128 a = _mm_loadu_ps(p);
+    __m128 b = _mm_loadu_ps(p + 4);
+    __m128 c = _mm_loadu_ps(p + 8);
+
+    x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)), _MM_SHUFFLE(3, 0, 3, 0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static inline void storePointsSSE2(float *p, __m128 x, __m128 y, __m128 z)
+{
+    __m128 a = _mm_shuffle_ps(_mm_unpacklo_ps(x, y), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+    __m128 b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_unpackhi_ps(x, y), _MM_SHUFFLE(1, 0, 2, 0));
+    __m128 c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+
+    _mm_storeu_ps(p, a);
+    _mm_storeu_ps(p + 4, b);
+    _mm_storeu_ps(p + 8, c);
+}
+
+static inline float horizontalMinimumSSE2(__m128 v)
+{
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline float horizontalMaximumSSE2(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static inline float horizontalSumSSE2(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+static int computeBoundsSSE2(const float *p, int numberOfPoints, float *minimum, float *maximum)
+{
+    __m128 minimumX = _mm_set1_ps(minimum[0]), minimumY = _mm_set1_ps(minimum[1]), minimumZ = _mm_set1_ps(minimum[2]);
+    __m128 maximumX = _mm_set1_ps(maximum[0]), maximumY = _mm_set1_ps(maximum[1]), maximumZ = _mm_set1_ps(maximum[2]);
+
+    int i = 0;
+    for (; i + 4 <= numberOfPoints; i += 4, p += 12)
+    {
+        __m128 x, y, z;
+        loadPointsSSE2(p, x, y, z);
+        minimumX = _mm_min_ps(minimumX, x);
+        minimumY = _mm_min_ps(minimumY, y);
+        minimumZ = _mm_min_ps(minimumZ, z);
+        maximumX = _mm_max_ps(maximumX, x);
+        maximumY = _mm_max_ps(maximumY, y);
+        maximumZ = _mm_max_ps(maximumZ, z);
+    }
+
+    minimum[0] = horizontalMinimumSSE2(minimumX);
+    minimum[1] = horizontalMinimumSSE2(minimumY);
+    minimum[2] = horizontalMinimumSSE2(minimumZ);
+    maximum[0] = horizontalMaximumSSE2(maximumX);
+    maximum[1] = horizontalMaximumSSE2(maximumY);
+    maximum[2] = horizontalMaximumSSE2(maximumZ);
+
+    //Number of points processed, the caller finishes the others
+    return i;
+}
+
+static int sumSSE2(const float *p, int numberOfPoints, double *sum)
+{
+    int i = 0;
+    while (i + 4 <= numberOfPoints)
+    {
+        __m128 sumX = _mm_setzero_ps(), sumY = _mm_setzero_ps(), sumZ = _mm_setzero_ps();
+
+        int blockEnd = min(numberOfPoints, i + MESH_KERNELS_CENTROID_BLOCK);
+        for (; i + 4 <= blockEnd; i += 4, p += 12)
+        {
+            __m128 x, y, z;
+            loadPointsSSE2(p, x, y, z);
+            sumX = _mm_add_ps(sumX, x);
+            sumY = _mm_add_ps(sumY, y);
+            sumZ = _mm_add_ps(sumZ, z);
+        }
+
+        sum[0] += horizontalSumSSE2(sumX);
+        sum[1] += horizontalSumSSE2(sumY);
+        sum[2] += horizontalSumSSE2(sumZ);
+    }
+
+    return i;
+}
+
+static int transformSSE2(float *p, int numberOfPoints, const float *rows, bool translate, bool normalize)
+{
+    __m128 m[12];
+    for (int k = 0; k < 12; ++k)
+    {
+        m[k] = _mm_set1_ps(rows ? rows[k] : 0.0f);
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i + 4 <= numberOfPoints; i += 4, p += 12)
+    {
+        __m128 x, y, z;
+        loadPointsSSE2(p, x, y, z);
+
+        if (rows)
+        {
+            __m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], x), _mm_mul_ps(m[1], y)), _mm_mul_ps(m[2], z));
+            __m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[4], x), _mm_mul_ps(m[5], y)), _mm_mul_ps(m[6], z));
+            __m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[8], x), _mm_mul_ps(m[9], y)), _mm_mul_ps(m[10], z));
+
+            if (translate)
+            {
+                tx = _mm_add_ps(tx, m[3]);
+                ty = _mm_add_ps(ty, m[7]);
+                tz = _mm_add_ps(tz, m[11]);
+            }
+
+            x = tx;
+            y = ty;
+            z = tz;
+        }
+
+        if (normalize)
+        {
+            //Null vectors give 0 * inf = NaN, the mask sets them back to 0
+            __m128 squaredLength = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+            __m128 inverseLength = _mm_and_ps(_mm_div_ps(one, _mm_sqrt_ps(squaredLength)), _mm_cmpgt_ps(squaredLength, zero));
+            x = _mm_mul_ps(x, inverseLength);
+            y = _mm_mul_ps(y, inverseLength);
+            z = _mm_mul_ps(z, inverseLength);
+        }
+
+        storePointsSSE2(p, x, y, z);
+    }
+
+    return i;
+}
+
+#endif
+
+#ifdef MESHKERNELS_AVX2
+
+/*
+ * AVX2 kernels, eight vectors per iteration. The shuffles only work inside 128-bit lanes : the 24 floats
+ * are first permuted so that each lane holds four vectors in the same layout as the SSE2 kernels.
+ */
+
+MESHKERNELS_AVX2_FUNCTION
+static inline void loadPointsAVX2(const float *p, __m256 &x, __m256 &y, __m256 &z)
+{
+    __m256 m0 = _mm256_loadu_ps(p);
+    __m256 m1 = _mm256_loadu_ps(p + 8);
+    __m256 m2 = _mm256_loadu_ps(p + 16);
+
+    __m256 a = _mm256_permute2f128_ps(m0, m1, 0x30);
+    __m256 b = _mm256_permute2f128_ps(m0, m2, 0x21);
+    __m256 c = _mm256_permute2f128_ps(m1, m2, 0x30);
+
+    x = _mm256_shuffle_ps(a, _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)), _MM_SHUFFLE(3, 0, 3, 0));
+    y = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+MESHKERNELS_AVX2_FUNCTION
+static inline void storePointsAVX2(float *p, __m256 x, __m256 y, __m256 z)
+{
+    __m256 a = _mm256_shuffle_ps(_mm256_unpacklo_ps(x, y), _mm256_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+    __m256 b = _mm256_shuffle_ps(_mm256_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_unpackhi_ps(x, y), _MM_SHUFFLE(1, 0, 2, 0));
+    __m256 c = _mm256_shuffle_ps(_mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+
+    _mm256_storeu_ps(p, _mm256_permute2f128_ps(a, b, 0x20));
+    _mm256_storeu_ps(p + 8, _mm256_permute2f128_ps(c, a, 0x30));
+    _mm256_storeu_ps(p + 16, _mm256_permute2f128_ps(b, c, 0x31));
+}
+
+MESHKERNELS_AVX2_FUNCTION
+static int computeBoundsAVX2(const float *p, int numberOfPoints, float *minimum, float *maximum)
+{
+    __m256 minimumX = _mm256_set1_ps(minimum[0]), minimumY = _mm256_set1_ps(minimum[1]), minimumZ = _mm256_set1_ps(minimum[2]);
+    __m256 maximumX = _mm256_set1_ps(maximum[0]), maximumY = _mm256_set1_ps(maximum[1]), maximumZ = _mm256_set1_ps(maximum[2]);
+
+    int i = 0;
+    for (; i + 8 <= numberOfPoints; i += 8, p += 24)
+    {
+        __m256 x, y, z;
+        loadPointsAVX2(p, x, y, z);
+        minimumX = _mm256_min_ps(minimumX, x);
+        minimumY = _mm256_min_ps(minimumY, y);
+        minimumZ = _mm256_min_ps(minimumZ, z);
+        maximumX = _mm256_max_ps(maximumX, x);
+        maximumY = _mm256_max_ps(maximumY, y);
+        maximumZ = _mm256_max_ps(maximumZ, z);
+    }
+
+    minimum[0] = horizontalMinimumSSE2(_mm_min_ps(_mm256_castps256_ps128(minimumX), _mm256_extractf128_ps(minimumX, 1)));
+    minimum[1] = horizontalMinimumSSE2(_mm_min_ps(_mm256_castps256_ps128(minimumY), _mm256_extractf128_ps(minimumY, 1)));
+    minimum[2] = horizontalMinimumSSE2(_mm_min_ps(_mm256_castps256_ps128(minimumZ), _mm256_extractf128_ps(minimumZ, 1)));
+    maximum[0] = horizontalMaximumSSE2(_mm_max_ps(_mm256_castps256_ps128(maximumX), _mm256_extractf128_ps(maximumX, 1)));
+    maximum[1] = horizontalMaximumSSE2(_mm_max_ps(_mm256_castps256_ps128(maximumY), _mm256_extractf128_ps(maximumY, 1)));
+    maximum[2] = horizontalMaximumSSE2(_mm_max_ps(_mm256_castps256_ps128(maximumZ), _mm256_extractf128_ps(maximumZ, 1)));
+
+    _mm256_zeroupper();
+    return i;
+}
+
+MESHKERNELS_AVX2_FUNCTION
+static int sumAVX2(const float *p, int numberOfPoints, double *sum)
+{
+    int i = 0;
+    while (i + 8 <= numberOfPoints)
+    {
+        __m256 sumX = _mm256_setzero_ps(), sumY = _mm256_setzero_ps(), sumZ = _mm256_setzero_ps();
+
+        int blockEnd = min(numberOfPoints, i + MESH_KERNELS_CENTROID_BLOCK);
+        for (; i + 8 <= blockEnd; i += 8, p += 24)
+        {
+            __m256 x, y, z;
+            loadPointsAVX2(p, x, y, z);
+            sumX = _mm256_add_ps(sumX, x);
+            sumY = _mm256_add_ps(sumY, y);
+            sumZ = _mm256_add_ps(sumZ, z);
+        }
+
+        sum[0] += horizontalSumSSE2(_mm_add_ps(_mm256_castps256_ps128(sumX), _mm256_extractf128_ps(sumX, 1)));
+        sum[1] += horizontalSumSSE2(_mm_add_ps(_mm256_castps256_ps128(sumY), _mm256_extractf128_ps(sumY, 1)));
+        sum[2] += horizontalSumSSE2(_mm_add_ps(_mm256_castps256_ps128(sumZ), _mm256_extractf128_ps(sumZ, 1)));
+    }
+
+    _mm256_zeroupper();
+    return i;
+}
+
+MESHKERNELS_AVX2_FUNCTION
+static int transformAVX2(float *p, int numberOfPoints, const float *rows, bool translate, bool normalize)
+{
+    __m256 m[12];
+    for (int k = 0; k < 12; ++k)
+    {
+        m[k] = _mm256_set1_ps(rows ? rows[k] : 0.0f);
+    }
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i + 8 <= numberOfPoints; i += 8, p += 24)
+    {
+        __m256 x, y, z;
+        loadPointsAVX2(p, x, y, z);
+
+        if (rows)
+        {
+            __m256 tx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], x), _mm256_mul_ps(m[1], y)), _mm256_mul_ps(m[2], z));
+            __m256 ty = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[4], x), _mm256_mul_ps(m[5], y)), _mm256_mul_ps(m[6], z));
+            __m256 tz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[8], x), _mm256_mul_ps(m[9], y)), _mm256_mul_ps(m[10], z));
+
+            if (translate)
+            {
+                tx = _mm256_add_ps(tx, m[3]);
+                ty = _mm256_add_ps(ty, m[7]);
+                tz = _mm256_add_ps(tz, m[11]);
+            }
+
+            x = tx;
+            y = ty;
+            z = tz;
+        }
+
+        if (normalize)
+        {
+            __m256 squaredLength = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+            __m256 inverseLength = _mm256_and_ps(_mm256_div_ps(one, _mm256_sqrt_ps(squaredLength)),
+                                                 _mm256_cmp_ps(squaredLength, zero, _CMP_GT_OQ));
+            x = _mm256_mul_ps(x, inverseLength);
+            y = _mm256_mul_ps(y, inverseLength);
+            z = _mm256_mul_ps(z, inverseLength);
+        }
+
+        storePointsAVX2(p, x, y, z);
+    }
+
+    _mm256_zeroupper();
+    return i;
+}
+
+#endif
+
+/*
+ * Dispatch : the vectorized kernels process the largest multiple of their width, the scalar ones the rest.
+ */
+
+static void transform(QVector3D *points, int numberOfPoints, const float *rows, bool translate, bool normalize)
+{
+    float *p = (float *)points;
+    int done = 0;
+
+#ifdef MESHKERNELS_AVX2
+    if (s_instructionSet == MeshKernels::AVX2)
+        done = transformAVX2(p, numberOfPoints, rows, translate, normalize);
+#endif
+#ifdef MESHKERNELS_SSE2
+    if (s_instructionSet == MeshKernels::SSE2)
+        done = transformSSE2(p, numberOfPoints, rows, translate, normalize);
+#endif
+
+    transformScalar(p + 3 * done, numberOfPoints - done, rows, translate, normalize);
+}
+
+MeshKernels::InstructionSet MeshKernels::bestInstructionSet()
+{
+#if defined(MESHKERNELS_AVX2) && defined(__GNUC__)
+    //May run before the static constructors, where the CPU features are not initialized yet
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return AVX2;
+#elif defined(MESHKERNELS_AVX2)
+    return AVX2;
+#endif
+
+#ifdef MESHKERNELS_SSE2
+    return SSE2;
+#else
+    return Scalar;
+#endif
+}
+
+void MeshKernels::setInstructionSet(InstructionSet instructionSet)
+{
+    s_instructionSet = (instructionSet <= bestInstructionSet()) ? instructionSet : bestInstructionSet();
+}
+
+MeshKernels::InstructionSet MeshKernels::getInstructionSet()
+{
+    return s_instructionSet;
+}
+
+const char *MeshKernels::instructionSetName(InstructionSet instructionSet)
+{
+    switch (instructionSet)
+    {
+    case AVX2:
+        return "AVX2";
+    case SSE2:
+        return "SSE2";
+    default:
+        return "scalar";
+    }
+}
+
+void MeshKernels::computeBounds(const QVector3D *points, int numberOfPoints, QVector3D &minimum, QVector3D &maximum)
+{
+    if (numberOfPoints <= 0)
+    {
+        minimum = QVector3D(0.0, 0.0, 0.0);
+        maximum = QVector3D(0.0, 0.0, 0.0);
+        return;
+    }
+
+    const float *p = (const float *)points;
+    float minimumCoordinates[3] = { p[0], p[1], p[2] };
+    float maximumCoordinates[3] = { p[0], p[1], p[2] };
+    int done = 0;
+
+#ifdef MESHKERNELS_AVX2
+    if (s_instructionSet == AVX2)
+        done = computeBoundsAVX2(p, numberOfPoints, minimumCoordinates, maximumCoordinates);
+#endif
+#ifdef MESHKERNELS_SSE2
+    if (s_instructionSet == SSE2)
+        done = computeBoundsSSE2(p, numberOfPoints, minimumCoordinates, maximumCoordinates);
+#endif
+
+    computeBoundsScalar(p + 3 * done, numberOfPoints - done, minimumCoordinates, maximumCoordinates);
+
+    minimum = QVector3D(minimumCoordinates[0], minimumCoordinates[1], minimumCoordinates[2]);
+    maximum = QVector3D(maximumCoordinates[0], maximumCoordinates[1], maximumCoordinates[2]);
+}
+
+QVector3D MeshKernels::computeCentroid(const QVector3D *points, int numberOfPoints)
+{
+    if (numberOfPoints <= 0)
+        return QVector3D(0.0, 0.0, 0.0);
+
+    const float *p = (const float *)points;
+    double sum[3] = { 0.0, 0.0, 0.0 };
+    int done = 0;
+
+#ifdef MESHKERNELS_AVX2
+    if (s_instructionSet == AVX2)
+        done = sumAVX2(p, numberOfPoints, sum);
+#endif
+#ifdef MESHKERNELS_SSE2
+    if (s_instructionSet == SSE2)
+        done = sumSSE2(p, numberOfPoints, sum);
+#endif
+
+    sumScalar(p + 3 * done, numberOfPoints - done, sum);
+
+    return QVector3D(sum[0] / numberOfPoints, sum[1] / numberOfPoints, sum[2] / numberOfPoints);
+}
+
+void MeshKernels::transformPositions(QVector3D *points, int numberOfPoints, const QMatrix4x4 &matrix)
+{
+    float rows[12];
+    affineRows(matrix, rows);
+    transform(points, numberOfPoints, rows, true, false);
+}
+
+void MeshKernels::transformNormals(QVector3D *normals, int numberOfNormals, const QMatrix4x4 &matrix)
+{
+    //The normal matrix is the inverse transpose of the linear part, the translation does not apply
+    QMatrix3x3 normalMatrix = matrix.normalMatrix();
+
+    float rows[12];
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            rows[4 * r + c] = normalMatrix(r, c);
+        }
+        rows[4 * r + 3] = 0.0f;
+    }
+
+    transform(normals, numberOfNormals, rows, false, true);
+}
+
+void MeshKernels::normalize(QVector3D *vectors, int numberOfVectors)
+{
+    transform(vectors, numberOfVectors, 0, false, true);
+}
+
+/**
+ * Largest difference between the coordinates of two arrays of vectors.
+ */
+static float maximumDifference(const QVector<QVector3D> &a, const QVector<QVector3D> &b)
+{
+    float difference = 0.0f;
+    for (int i = 0; i < a.size(); ++i)
+    {
+        QVector3D d = a[i] - b[i];
+        difference = max(difference, max(qAbs(d.x()), max(qAbs(d.y()), qAbs(d.z()))));
+    }
+    return difference;
+}
+
+void MeshKernels::benchmark(int numberOfPoints)
+{
+    const int numberOfRuns = 10;
+    const char *kernelNames[5] = { "computeBounds", "computeCentroid", "transformPositions", "transformNormals", "normalize" };
+    const InstructionSet previousInstructionSet = s_instructionSet;
+
+    //Random points in a box, the normals are the same points
+    mt19937 generator(1);
+    uniform_real_distribution<float> distribution(-10.0f, 10.0f);
+    QVector<QVector3D> points(numberOfPoints);
+    for (int i = 0; i < numberOfPoints; ++i)
+    {
+        points[i] = QVector3D(distribution(generator), distribution(generator), distribution(generator));
+    }
+
+    QMatrix4x4 matrix;
+    matrix.translate(1.0, -2.0, 3.0);
+    matrix.rotate(30.0, QVector3D(1.0, 1.0, 0.0));
+    matrix.scale(2.0, 0.5, 1.5);
+
+    cout << "Mesh kernels on " << numberOfPoints << " points, best time of " << numberOfRuns << " runs" << endl;
+    cout << left << setw(20) << "kernel" << right;
+    for (int s = Scalar; s <= bestInstructionSet(); ++s)
+    {
+        cout << setw(12) << instructionSetName((InstructionSet)s) << setw(10) << "speedup" << setw(12) << "error";
+    }
+    cout << endl;
+
+    for (int kernel = 0; kernel < 5; ++kernel)
+    {
+        cout << left << setw(20) << kernelNames[kernel] << right << fixed;
+
+        double scalarTime = 0.0;
+        QVector<QVector3D> scalarResult;
+
+        for (int s = Scalar; s <= bestInstructionSet(); ++s)
+        {
+            setInstructionSet((InstructionSet)s);
+
+            double bestTime = 1e30;
+            QVector<QVector3D> result;
+            for (int run = 0; run < numberOfRuns; ++run)
+            {
+                //The transforms work in place on a fresh copy, the copy is not timed
+                QVector<QVector3D> data = points;
+                data.detach();
+                result.clear();
+
+                QElapsedTimer timer;
+                timer.start();
+
+                if (kernel == 0)
+                {
+                    QVector3D minimum, maximum;
+                    computeBounds(data.constData(), numberOfPoints, minimum, maximum);
+                    result << minimum << maximum;
+                }
+                else if (kernel == 1)
+                {
+                    result << computeCentroid(data.constData(), numberOfPoints);
+                }
+                else if (kernel == 2)
+                {
+                    transformPositions(data.data(), numberOfPoints, matrix);
+                }
+                else if (kernel == 3)
+                {
+                    transformNormals(data.data(), numberOfPoints, matrix);
+                }
+                else
+                {
+                    normalize(data.data(), numberOfPoints);
+                }
+
+                bestTime = min(bestTime, timer.nsecsElapsed() * 1e-6);
+
+                if (kernel >= 2)
+                    result = data;
+            }
+
+            if (s == Scalar)
+            {
+                scalarTime = bestTime;
+                scalarResult = result;
+            }
+
+            cout << setw(9) << setprecision(3) << bestTime << " ms" << setw(9) << setprecision(2) << scalarTime / bestTime << "x"
+                 << setw(12) << scientific << setprecision(1) << maximumDifference(result, scalarResult) << fixed;
+        }
+
+        cout << endl;
+    }
+
+    s_instructionSet = previousInstructionSet;
+}
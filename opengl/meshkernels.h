@@ -0,0 +1,121 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MESHKERNELS_H
+#define MESHKERNELS_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+
+//Number of points of the microbenchmark (about 12 MB of positions, more than the caches)
+#define MESH_KERNELS_BENCHMARK_POINTS 1000000
+
+/**
+ * Vectorized kernels on arrays of QVector3D (three packed floats) : bounding box and centroid
+ * reductions, affine transform of positions and normals, batch normalization.
+ * Each kernel has a scalar, an SSE2 and an AVX2 version processing 1, 4 and 8 vectors per iteration.
+ * The fastest version supported by the CPU is used unless another one is selected.
+ * @brief The MeshKernels class
+ */
+class MeshKernels
+{
+public:
+    enum InstructionSet
+    {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    /**
+     * Returns the fastest instruction set supported by the build and the CPU.
+     * @brief bestInstructionSet
+     * @return
+     */
+    static InstructionSet bestInstructionSet();
+
+    /**
+     * Selects the version of the kernels, falls back to the best one if the instruction set is not supported.
+     * @brief setInstructionSet
+     * @param instructionSet
+     */
+    static void setInstructionSet(InstructionSet instructionSet);
+    static InstructionSet getInstructionSet();
+    static const char *instructionSetName(InstructionSet instructionSet);
+
+    /**
+     * Axis aligned bounding box of the points. Both corners are (0, 0, 0) if there is no point.
+     * @brief computeBounds
+     * @param points
+     * @param numberOfPoints
+     * @param minimum
+     * @param maximum
+     */
+    static void computeBounds(const QVector3D *points, int numberOfPoints, QVector3D &minimum, QVector3D &maximum);
+
+    /**
+     * Average of the points, (0, 0, 0) if there is no point.
+     * @brief computeCentroid
+     * @param points
+     * @param numberOfPoints
+     * @return
+     */
+    static QVector3D computeCentroid(const QVector3D *points, int numberOfPoints);
+
+    /**
+     * Applies an affine transform to positions, in place. The projective row of the matrix is ignored.
+     * @brief transformPositions
+     * @param points
+     * @param numberOfPoints
+     * @param matrix
+     */
+    static void transformPositions(QVector3D *points, int numberOfPoints, const QMatrix4x4 &matrix);
+
+    /**
+     * Transforms normals by the inverse transpose of the upper 3x3 block of the matrix and normalizes them, in place.
+     * @brief transformNormals
+     * @param normals
+     * @param numberOfNormals
+     * @param matrix the transform of the positions
+     */
+    static void transformNormals(QVector3D *normals, int numberOfNormals, const QMatrix4x4 &matrix);
+
+    /**
+     * Normalizes vectors in place. Null vectors stay null.
+     * @brief normalize
+     * @param vectors
+     * @param numberOfVectors
+     */
+    static void normalize(QVector3D *vectors, int numberOfVectors);
+
+    /**
+     * Times every kernel with each supported instruction set on random points and prints the results.
+     * @brief benchmark
+     * @param numberOfPoints
+     */
+    static void benchmark(int numberOfPoints = MESH_KERNELS_BENCHMARK_POINTS);
+};
+
+#endif // MESHKERNELS_H
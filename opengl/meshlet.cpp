@@ -0,0 +1,266 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+//Weight of the normal deviation relative to the distance when choosing the next triangle of a meshlet
+#define MESHLET_CONE_WEIGHT 1.0f
+
+QVector<Meshlet> MeshletBuilder::buildMeshlets(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices,
+                                              QVector<int> &triangleOrder)
+{
+    const int numberOfVertices = vertices.size();
+    const int numberOfTriangles = indices.size() / 3;
+
+    //Unit normal and centroid of each triangle
+    QVector<QVector3D> triangleNormals(numberOfTriangles), triangleCentroids(numberOfTriangles);
+    QVector<bool> validTriangle(numberOfTriangles);
+    double edgeLengthSum = 0.0;
+
+    for (int t = 0; t < numberOfTriangles; ++t)
+    {
+        GLuint a = indices[3 * t], b = indices[3 * t + 1], c = indices[3 * t + 2];
+        validTriangle[t] = (a < (GLuint)numberOfVertices && b < (GLuint)numberOfVertices && c < (GLuint)numberOfVertices);
+        if (!validTriangle[t])
+            continue;
+
+        triangleNormals[t] = QVector3D::crossProduct(vertices[b] - vertices[a], vertices[c] - vertices[a]).normalized();
+        triangleCentroids[t] = (vertices[a] + vertices[b] + vertices[c]) / 3.0f;
+        edgeLengthSum += (vertices[b] - vertices[a]).length();
+    }
+
+    //Distances are measured relative to the expected radius of a meshlet
+    float edgeLength = (numberOfTriangles > 0) ? edgeLengthSum / numberOfTriangles : 1.0;
+    float meshletRadius = 0.5f * edgeLength * sqrt((float)MESHLET_MAXIMUM_TRIANGLES);
+    float distanceScale = (meshletRadius > 0.0f) ? 1.0f / meshletRadius : 1.0f;
+
+    //Triangles around each vertex
+    QVector<int> triangleOffsets(numberOfVertices + 1, 0);
+    for (int k = 0; k < 3 * numberOfTriangles; ++k)
+    {
+        if (validTriangle[k / 3])
+            ++triangleOffsets[indices[k] + 1];
+    }
+    for (int v = 0; v < numberOfVertices; ++v)
+        triangleOffsets[v + 1] += triangleOffsets[v];
+
+    QVector<int> vertexTriangles(triangleOffsets[numberOfVertices]);
+    QVector<int> insertion = triangleOffsets;
+    for (int k = 0; k < 3 * numberOfTriangles; ++k)
+    {
+        if (validTriangle[k / 3])
+            vertexTriangles[insertion[indices[k]]++] = k / 3;
+    }
+
+    QVector<bool> assigned(numberOfTriangles, false);
+    QVector<bool> inMeshlet(numberOfVertices, false);
+    QVector<GLuint> meshletVertices;
+    QVector<int> meshletTriangles;
+    QVector<int> candidates;
+    QVector<Meshlet> meshlets;
+
+    triangleOrder.clear();
+    triangleOrder.reserve(numberOfTriangles);
+
+    for (int seed = 0; seed < numberOfTriangles; ++seed)
+    {
+        if (assigned[seed])
+            continue;
+
+        meshletVertices.clear();
+        meshletTriangles.clear();
+        candidates.clear();
+        QVector3D normalSum(0.0, 0.0, 0.0), centroidSum(0.0, 0.0, 0.0);
+        int numberOfValidTriangles = 0;
+
+        int next = seed;
+        while (next >= 0)
+        {
+            assigned[next] = true;
+            meshletTriangles.push_back(next);
+
+            if (validTriangle[next])
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    GLuint v = indices[3 * next + c];
+                    if (inMeshlet[v])
+                        continue;
+
+                    inMeshlet[v] = true;
+                    meshletVertices.push_back(v);
+
+                    //The triangles around the new vertex become candidates
+                    for (int n = triangleOffsets[v]; n < triangleOffsets[v + 1]; ++n)
+                    {
+                        if (!assigned[vertexTriangles[n]])
+                            candidates.push_back(vertexTriangles[n]);
+                    }
+                }
+
+                normalSum += triangleNormals[next];
+                centroidSum += triangleCentroids[next];
+                ++numberOfValidTriangles;
+            }
+
+            if (meshletTriangles.size() >= MESHLET_MAXIMUM_TRIANGLES || numberOfValidTriangles == 0)
+                break;
+
+            QVector3D coneAxis = normalSum.normalized();
+            QVector3D center = centroidSum / numberOfValidTriangles;
+
+            //Next triangle : fewest new vertices first, then closest to the cone and to the center of the meshlet
+            next = -1;
+            int bestNewVertices = 3;
+            float bestScore = 0.0f;
+
+            for (int k = 0; k < candidates.size(); ++k)
+            {
+                int t = candidates[k];
+                if (assigned[t])
+                {
+                    candidates[k--] = candidates.last();
+                    candidates.removeLast();
+                    continue;
+                }
+
+                GLuint a = indices[3 * t], b = indices[3 * t + 1], c = indices[3 * t + 2];
+                int newVertices = !inMeshlet[a] + (!inMeshlet[b] && b != a) + (!inMeshlet[c] && c != a && c != b);
+                if (meshletVertices.size() + newVertices > MESHLET_MAXIMUM_VERTICES || newVertices > bestNewVertices)
+                    continue;
+
+                float score = (triangleCentroids[t] - center).length() * distanceScale
+                        + MESHLET_CONE_WEIGHT * (1.0f - QVector3D::dotProduct(triangleNormals[t], coneAxis));
+
+                if (newVertices < bestNewVertices || score < bestScore)
+                {
+                    next = t;
+                    bestNewVertices = newVertices;
+                    bestScore = score;
+                }
+            }
+        }
+
+        for (int v = 0; v < meshletVertices.size(); ++v)
+            inMeshlet[meshletVertices[v]] = false;
+
+        //The triangles of the meshlet keep their relative order
+        sort(meshletTriangles.begin(), meshletTriangles.end());
+
+        Meshlet meshlet;
+        meshlet.firstIndex = 3 * triangleOrder.size();
+        meshlet.numberOfIndices = 3 * meshletTriangles.size();
+        meshlets.push_back(meshlet);
+
+        triangleOrder += meshletTriangles;
+    }
+
+    //Bounds in the new order of the triangles
+    QVector<GLuint> orderedIndices(3 * numberOfTriangles);
+    for (int k = 0; k < numberOfTriangles; ++k)
+    {
+        orderedIndices[3 * k] = indices[3 * triangleOrder[k]];
+        orderedIndices[3 * k + 1] = indices[3 * triangleOrder[k] + 1];
+        orderedIndices[3 * k + 2] = indices[3 * triangleOrder[k] + 2];
+    }
+
+    for (int m = 0; m < meshlets.size(); ++m)
+        computeBounds(meshlets[m], orderedIndices, vertices);
+
+    return meshlets;
+}
+
+void MeshletBuilder::computeBounds(Meshlet &meshlet, const QVector<GLuint> &indices, const QVector<QVector3D> &vertices)
+{
+    const int numberOfVertices = vertices.size();
+    const int firstIndex = meshlet.firstIndex, lastIndex = meshlet.firstIndex + meshlet.numberOfIndices;
+
+    //Bounding sphere : center of the bounding box and farthest vertex
+    bool empty = true;
+    QVector3D minimum(0.0, 0.0, 0.0), maximum(0.0, 0.0, 0.0);
+    for (int k = firstIndex; k < lastIndex; ++k)
+    {
+        if (indices[k] >= (GLuint)numberOfVertices)
+            continue;
+
+        const QVector3D &p = vertices[indices[k]];
+        if (empty)
+        {
+            minimum = p;
+            maximum = p;
+            empty = false;
+        }
+        minimum = QVector3D(min(minimum.x(), p.x()), min(minimum.y(), p.y()), min(minimum.z(), p.z()));
+        maximum = QVector3D(max(maximum.x(), p.x()), max(maximum.y(), p.y()), max(maximum.z(), p.z()));
+    }
+
+    meshlet.center = 0.5 * (minimum + maximum);
+    meshlet.radius = 0.0f;
+    for (int k = firstIndex; k < lastIndex; ++k)
+    {
+        if (indices[k] < (GLuint)numberOfVertices)
+            meshlet.radius = max(meshlet.radius, (vertices[indices[k]] - meshlet.center).length());
+    }
+
+    //Normal cone : average of the unit triangle normals, and the largest angle between a triangle normal and it
+    QVector3D axis(0.0, 0.0, 0.0);
+    for (int t = firstIndex; t + 2 < lastIndex; t += 3)
+    {
+        GLuint a = indices[t], b = indices[t + 1], c = indices[t + 2];
+        if (a >= (GLuint)numberOfVertices || b >= (GLuint)numberOfVertices || c >= (GLuint)numberOfVertices)
+            continue;
+
+        axis += QVector3D::crossProduct(vertices[b] - vertices[a], vertices[c] - vertices[a]).normalized();
+    }
+
+    meshlet.coneAxis = axis.normalized();
+    meshlet.coneCutoff = 1.0f;
+
+    if (meshlet.coneAxis.isNull())
+        return;
+
+    float minimumCosine = 1.0f;
+    for (int t = firstIndex; t + 2 < lastIndex; t += 3)
+    {
+        GLuint a = indices[t], b = indices[t + 1], c = indices[t + 2];
+        if (a >= (GLuint)numberOfVertices || b >= (GLuint)numberOfVertices || c >= (GLuint)numberOfVertices)
+            continue;
+
+        QVector3D normal = QVector3D::crossProduct(vertices[b] - vertices[a], vertices[c] - vertices[a]);
+        if (normal.isNull())
+            continue;
+
+        minimumCosine = min(minimumCosine, QVector3D::dotProduct(normal.normalized(), meshlet.coneAxis));
+    }
+
+    //The triangles face away from the viewer when the view direction is within 90 degrees minus the cone angle of the axis
+    if (minimumCosine > MESHLET_MINIMUM_CONE_COSINE)
+        meshlet.coneCutoff = sqrt(1.0f - minimumCosine * minimumCosine);
+}
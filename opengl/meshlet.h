@@ -0,0 +1,92 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include "opengl/openglheaders.h"
+
+#include <QVector>
+#include <QVector3D>
+
+//Size limits of a meshlet
+#define MESHLET_MAXIMUM_VERTICES 64
+#define MESHLET_MAXIMUM_TRIANGLES 124
+
+//Cones wider than this (minimum cosine between a triangle normal and the axis) are not used for culling
+#define MESHLET_MINIMUM_CONE_COSINE 0.1f
+
+/**
+ * Cluster of consecutive triangles of the index buffer, with the bounds used to cull it on the CPU.
+ */
+struct Meshlet
+{
+    //Range of the index buffer
+    int firstIndex;
+    int numberOfIndices;
+
+    //Bounding sphere of the vertices
+    QVector3D center;
+    float radius;
+
+    //Normal cone : all the triangles face away from a viewer at p when
+    //dot(center - p, coneAxis) >= coneCutoff * |center - p| + radius (coneCutoff = 1 disables the test)
+    QVector3D coneAxis;
+    float coneCutoff;
+};
+
+/**
+ * Splits the triangles of a mesh into meshlets.
+ */
+class MeshletBuilder
+{
+public:
+    /**
+     * Grows each meshlet from the first triangle that is not in a meshlet yet, in the order of the index buffer,
+     * by adding the neighbouring triangle that uses the fewest new vertices and whose normal is the closest to the normal cone
+     * of the meshlet, so that the meshlets are compact and can be culled with their cones.
+     * The triangles must be reordered as given by triangleOrder (triangleOrder[k] is the triangle drawn in k-th position),
+     * the meshlets are then consecutive ranges of the index buffer.
+     * Inside a meshlet the triangles keep their relative order (e.g. the order of the vertex cache optimizer).
+     * @brief buildMeshlets
+     * @param indices
+     * @param vertices
+     * @param triangleOrder
+     * @return
+     */
+    static QVector<Meshlet> buildMeshlets(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices,
+                                          QVector<int> &triangleOrder);
+
+    /**
+     * Computes the bounding sphere and the normal cone of a meshlet from its range of the index buffer.
+     * @brief computeBounds
+     * @param meshlet
+     * @param indices
+     * @param vertices
+     */
+    static void computeBounds(Meshlet &meshlet, const QVector<GLuint> &indices, const QVector<QVector3D> &vertices);
+};
+
+#endif // MESHLET_H
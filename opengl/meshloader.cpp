@@ -0,0 +1,84 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/meshloader.h"
+
+using namespace std;
+
+MeshLoader::MeshLoader(const string &objectName, bool optimizeMesh, MeshAssetCache *meshAssets, QObject *parent) : QThread(parent),
+m_objectName(objectName), m_optimizeMesh(optimizeMesh), m_meshAssets(meshAssets), m_cancelled(0), m_progress(0), m_loaded(false), m_object()
+{
+
+}
+
+void MeshLoader::cancel()
+{
+    m_cancelled.storeRelease(1);
+}
+
+bool MeshLoader::isCancelled() const
+{
+    return m_cancelled.loadAcquire() != 0;
+}
+
+bool MeshLoader::isLoaded() const
+{
+    return m_loaded && !isCancelled();
+}
+
+int MeshLoader::getProgress() const
+{
+    return m_progress.loadAcquire();
+}
+
+Object MeshLoader::getObject() const
+{
+    return m_object;
+}
+
+string MeshLoader::getLoadError() const
+{
+    return isCancelled() ? string() : m_object.getLoadError();
+}
+
+string MeshLoader::getObjectName() const
+{
+    return m_objectName;
+}
+
+bool MeshLoader::isMeshOptimized() const
+{
+    return m_optimizeMesh;
+}
+
+void MeshLoader::run()
+{
+    //m_loaded is read by the GUI thread after finished(), which happens after run returns
+    m_loaded = m_object.load(m_objectName, m_optimizeMesh, m_meshAssets, [this](int percent)
+    {
+        m_progress.storeRelease(percent);
+        return !isCancelled();
+    });
+}
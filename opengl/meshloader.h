@@ -0,0 +1,103 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include "opengl/object.h"
+
+#include <QAtomicInt>
+#include <QThread>
+
+#include <string>
+
+/**
+ * Worker thread that loads, processes and encodes an object (see Object::load) without blocking the GUI thread.
+ * Once finished() is emitted, the object is taken on the OpenGL thread, which uploads its buffers.
+ * @brief The MeshLoader class
+ */
+class MeshLoader : public QThread
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief MeshLoader
+     * @param objectName
+     * @param optimizeMesh
+     * @param meshAssets can be null, must outlive the thread
+     * @param parent
+     */
+    MeshLoader(const std::string &objectName, bool optimizeMesh, MeshAssetCache *meshAssets, QObject *parent = 0);
+
+    /**
+     * Asks the thread to stop at its next progress report (the readers, the optimizer and the simplifier report
+     * every few thousand records), the object is then not loaded.
+     * @brief cancel
+     */
+    void cancel();
+    bool isCancelled() const;
+
+    /**
+     * True once the thread has finished without being cancelled.
+     * @brief isLoaded
+     * @return
+     */
+    bool isLoaded() const;
+
+    /**
+     * Progress of the load in percent.
+     * @brief getProgress
+     * @return
+     */
+    int getProgress() const;
+
+    Object getObject() const;
+
+    /**
+     * Reason of the failure of the load, empty if the object was loaded or the load cancelled.
+     * @brief getLoadError
+     * @return
+     */
+    std::string getLoadError() const;
+    std::string getObjectName() const;
+    bool isMeshOptimized() const;
+
+protected:
+    void run();
+
+private:
+    std::string m_objectName;
+    bool m_optimizeMesh;
+    MeshAssetCache *m_meshAssets;
+
+    QAtomicInt m_cancelled;
+    QAtomicInt m_progress;
+    bool m_loaded;
+
+    Object m_object;
+};
+
+#endif // MESHLOADER_H
@@ -0,0 +1,544 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/meshoptimizer.h"
+#include "opengl/meshkernels.h"
+#include "opengl/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+//Parameters of the scoring function of Forsyth's algorithm
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_MAXIMUM_VALENCE 32
+
+static const float cacheDecayPower = 1.5f;
+static const float lastTriangleScore = 0.75f;
+static const float valenceBoostScale = 2.0f;
+static const float valenceBoostPower = 0.5f;
+
+/**
+ * Score of a vertex depending on its position in the cache (-1 if not in the cache) and its number of triangles left.
+ */
+static float forsythVertexScore(int cachePosition, int remainingValence, const float *cacheScores, const float *valenceScores)
+{
+    //No triangle left : the vertex does not need to be in the cache
+    if (remainingValence == 0)
+        return -1.0f;
+
+    float score = (cachePosition >= 0) ? cacheScores[cachePosition] : 0.0f;
+
+    //Favour the vertices with few triangles left to get rid of them
+    score += valenceScores[min(remainingValence, FORSYTH_MAXIMUM_VALENCE)];
+    return score;
+}
+
+QVector<int> MeshOptimizer::optimizeVertexCache(const QVector<GLuint> &indices, int numberOfVertices, const LoadProgress &progress)
+{
+    const int numberOfTriangles = indices.size() / 3;
+    QVector<int> triangleOrder;
+    triangleOrder.reserve(numberOfTriangles);
+
+    //Tables of the scoring function
+    float cacheScores[FORSYTH_CACHE_SIZE];
+    for (int k = 0; k < FORSYTH_CACHE_SIZE; ++k)
+    {
+        //The vertices of the last triangle get a fixed score so that the next triangle is not always one of their neighbours
+        cacheScores[k] = (k < 3) ? lastTriangleScore
+                                 : pow(1.0f - (float)(k - 3) / (FORSYTH_CACHE_SIZE - 3), cacheDecayPower);
+    }
+
+    float valenceScores[FORSYTH_MAXIMUM_VALENCE + 1];
+    valenceScores[0] = 0.0f;
+    for (int k = 1; k <= FORSYTH_MAXIMUM_VALENCE; ++k)
+    {
+        valenceScores[k] = valenceBoostScale * pow((float)k, -valenceBoostPower);
+    }
+
+    //Triangles of each vertex (compressed lists)
+    QVector<int> firstTriangle(numberOfVertices + 1, 0);
+    for (int k = 0; k < 3 * numberOfTriangles; ++k)
+    {
+        if (indices[k] < (GLuint)numberOfVertices)
+            ++firstTriangle[indices[k] + 1];
+    }
+
+    for (int v = 0; v < numberOfVertices; ++v)
+    {
+        firstTriangle[v + 1] += firstTriangle[v];
+    }
+
+    QVector<int> trianglesOfVertex(firstTriangle[numberOfVertices]);
+    QVector<int> remainingValence(numberOfVertices, 0);
+    for (int k = 0; k < 3 * numberOfTriangles; ++k)
+    {
+        GLuint v = indices[k];
+        if (v < (GLuint)numberOfVertices)
+            trianglesOfVertex[firstTriangle[v] + remainingValence[v]++] = k / 3;
+    }
+
+    //Initial scores
+    QVector<float> vertexScore(numberOfVertices);
+    for (int v = 0; v < numberOfVertices; ++v)
+    {
+        vertexScore[v] = forsythVertexScore(-1, remainingValence[v], cacheScores, valenceScores);
+    }
+
+    QVector<float> triangleScore(numberOfTriangles, 0.0f);
+    QVector<char> isEmitted(numberOfTriangles, 0);
+    for (int t = 0; t < numberOfTriangles; ++t)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            GLuint v = indices[3 * t + c];
+            if (v < (GLuint)numberOfVertices)
+                triangleScore[t] += vertexScore[v];
+        }
+    }
+
+    //Cache of the algorithm : the vertices of the new triangle are pushed to the front, 3 extra slots hold the overflow
+    int cache[FORSYTH_CACHE_SIZE + 3];
+    int cacheSize = 0;
+
+    int bestTriangle = -1;
+    int nextTriangleToScan = 0;
+
+    while ((int)triangleOrder.size() < numberOfTriangles)
+    {
+        if (triangleOrder.size() % PROGRESS_INTERVAL == 0
+                && !reportProgress(progress, (int)(100LL * triangleOrder.size() / numberOfTriangles)))
+            break;
+
+        //No candidate in the cache : take the first triangle that is left (its score is usually as good as any)
+        if (bestTriangle < 0)
+        {
+            while (isEmitted[nextTriangleToScan])
+                ++nextTriangleToScan;
+            bestTriangle = nextTriangleToScan;
+        }
+
+        triangleOrder.push_back(bestTriangle);
+        isEmitted[bestTriangle] = 1;
+
+        //Move the vertices of the triangle to the front of the cache
+        int newCache[FORSYTH_CACHE_SIZE + 3];
+        int newCacheSize = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            GLuint v = indices[3 * bestTriangle + c];
+            if (v >= (GLuint)numberOfVertices)
+                continue;
+
+            bool isDuplicate = false;
+            for (int k = 0; k < newCacheSize; ++k)
+                isDuplicate = isDuplicate || (newCache[k] == (int)v);
+            if (isDuplicate)
+                continue;
+
+            newCache[newCacheSize++] = v;
+
+            //Remove the triangle from the list of triangles left for this vertex
+            int *triangles = trianglesOfVertex.data() + firstTriangle[v];
+            int &valence = remainingValence[v];
+            for (int k = 0; k < valence; ++k)
+            {
+                if (triangles[k] == bestTriangle)
+                {
+                    triangles[k] = triangles[valence - 1];
+                    --valence;
+                    break;
+                }
+            }
+        }
+
+        const int numberOfTriangleVertices = newCacheSize;
+        for (int k = 0; k < cacheSize; ++k)
+        {
+            int v = cache[k];
+            bool isInNewTriangle = false;
+            for (int j = 0; j < numberOfTriangleVertices; ++j)
+                isInNewTriangle = isInNewTriangle || (newCache[j] == v);
+            if (!isInNewTriangle)
+                newCache[newCacheSize++] = v;
+        }
+
+        //Update the scores of the vertices in the cache (and of those pushed out of it) and of their triangles
+        for (int k = 0; k < newCacheSize; ++k)
+        {
+            int v = newCache[k];
+            int position = (k < FORSYTH_CACHE_SIZE) ? k : -1;
+
+            float newScore = forsythVertexScore(position, remainingValence[v], cacheScores, valenceScores);
+            float scoreChange = newScore - vertexScore[v];
+            vertexScore[v] = newScore;
+
+            const int *triangles = trianglesOfVertex.constData() + firstTriangle[v];
+            for (int j = 0; j < remainingValence[v]; ++j)
+            {
+                triangleScore[triangles[j]] += scoreChange;
+            }
+        }
+
+        //The next triangle is the best one using a vertex of the cache
+        cacheSize = min(newCacheSize, FORSYTH_CACHE_SIZE);
+        bestTriangle = -1;
+        float bestScore = -1.0f;
+
+        for (int k = 0; k < cacheSize; ++k)
+        {
+            int v = newCache[k];
+            cache[k] = v;
+
+            const int *triangles = trianglesOfVertex.constData() + firstTriangle[v];
+            for (int j = 0; j < remainingValence[v]; ++j)
+            {
+                int t = triangles[j];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+
+    return triangleOrder;
+}
+
+/**
+ * Number of vertices of each triangle missing a FIFO cache, the cache is kept between calls.
+ */
+static int triangleCacheMisses(const GLuint *triangle, QVector<int> &insertionTime, int &numberOfMisses, int cacheSize)
+{
+    int triangleMisses = 0;
+    for (int c = 0; c < 3; ++c)
+    {
+        GLuint v = triangle[c];
+        if (v >= (GLuint)insertionTime.size())
+            continue;
+
+        if (numberOfMisses - insertionTime[v] > cacheSize)
+        {
+            insertionTime[v] = numberOfMisses;
+            ++numberOfMisses;
+            ++triangleMisses;
+        }
+    }
+    return triangleMisses;
+}
+
+QVector<int> MeshOptimizer::optimizeOverdraw(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices, float cacheThreshold)
+{
+    const int numberOfTriangles = indices.size() / 3;
+    const int numberOfVertices = vertices.size();
+    const GLuint *triangles = indices.constData();
+
+    //Hard boundaries : the vertex cache optimizer starts a new strip of triangles when the 3 vertices miss the cache
+    QVector<int> hardBoundaries;
+    {
+        QVector<int> insertionTime(numberOfVertices, -VERTEX_CACHE_SIZE - 1);
+        int numberOfMisses = 0;
+        for (int t = 0; t < numberOfTriangles; ++t)
+        {
+            if (triangleCacheMisses(triangles + 3 * t, insertionTime, numberOfMisses, VERTEX_CACHE_SIZE) == 3 || t == 0)
+                hardBoundaries.push_back(t);
+        }
+        hardBoundaries.push_back(numberOfTriangles);
+    }
+
+    //Soft boundaries : split a hard cluster as soon as the ACMR since the last split is low enough.
+    //The cache is emptied at each split, as the clusters will be drawn in any order,
+    //so that the ACMR of each cluster stays under cacheThreshold times the ACMR of its hard cluster.
+    //Advancing the miss counter by more than the cache size empties the cache.
+    QVector<int> clusterStart;
+    QVector<int> insertionTime(numberOfVertices, -VERTEX_CACHE_SIZE - 1);
+    int numberOfMisses = 0;
+    for (int h = 0; h + 1 < hardBoundaries.size(); ++h)
+    {
+        const int start = hardBoundaries[h], end = hardBoundaries[h + 1];
+
+        numberOfMisses += VERTEX_CACHE_SIZE + 1;
+        int hardMisses = 0;
+        for (int t = start; t < end; ++t)
+            hardMisses += triangleCacheMisses(triangles + 3 * t, insertionTime, numberOfMisses, VERTEX_CACHE_SIZE);
+
+        const float clusterThreshold = cacheThreshold * hardMisses / (end - start);
+
+        numberOfMisses += VERTEX_CACHE_SIZE + 1;
+        int softMisses = 0, softTriangles = 0;
+        clusterStart.push_back(start);
+        for (int t = start; t < end; ++t)
+        {
+            softMisses += triangleCacheMisses(triangles + 3 * t, insertionTime, numberOfMisses, VERTEX_CACHE_SIZE);
+            ++softTriangles;
+
+            if (t + 1 < end && (float)softMisses / softTriangles <= clusterThreshold)
+            {
+                clusterStart.push_back(t + 1);
+                numberOfMisses += VERTEX_CACHE_SIZE + 1;
+                softMisses = 0;
+                softTriangles = 0;
+            }
+        }
+    }
+    clusterStart.push_back(numberOfTriangles);
+
+    //Centroid of the mesh (weighted by the area of the triangles)
+    const int numberOfClusters = clusterStart.size() - 1;
+    QVector<QVector3D> clusterCentroid(numberOfClusters), clusterNormal(numberOfClusters);
+    QVector3D meshCentroid(0.0, 0.0, 0.0);
+    float meshArea = 0.0f;
+
+    for (int c = 0; c < numberOfClusters; ++c)
+    {
+        QVector3D centroid(0.0, 0.0, 0.0), normal(0.0, 0.0, 0.0);
+        float clusterArea = 0.0f;
+
+        for (int t = clusterStart[c]; t < clusterStart[c + 1]; ++t)
+        {
+            GLuint index1 = triangles[3 * t], index2 = triangles[3 * t + 1], index3 = triangles[3 * t + 2];
+            if (index1 >= (GLuint)numberOfVertices || index2 >= (GLuint)numberOfVertices || index3 >= (GLuint)numberOfVertices)
+                continue;
+
+            const QVector3D &v1 = vertices[index1], &v2 = vertices[index2], &v3 = vertices[index3];
+
+            //Length of the cross product = 2 * area of the triangle
+            QVector3D crossProduct = QVector3D::crossProduct(v2 - v1, v3 - v1);
+            float area = crossProduct.length();
+
+            centroid += area * (v1 + v2 + v3) / 3.0f;
+            normal += crossProduct;
+            clusterArea += area;
+        }
+
+        meshCentroid += centroid;
+        meshArea += clusterArea;
+
+        clusterCentroid[c] = (clusterArea > 0.0f) ? centroid / clusterArea : centroid;
+        clusterNormal[c] = normal.normalized();
+    }
+
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    //Sort the clusters : the most outward facing first
+    QVector<float> sortKey(numberOfClusters);
+    QVector<int> clusterOrder(numberOfClusters);
+    for (int c = 0; c < numberOfClusters; ++c)
+    {
+        sortKey[c] = QVector3D::dotProduct(clusterCentroid[c] - meshCentroid, clusterNormal[c]);
+        clusterOrder[c] = c;
+    }
+
+    const float *keys = sortKey.constData();
+    stable_sort(clusterOrder.begin(), clusterOrder.end(), [keys](int a, int b) { return keys[a] > keys[b]; });
+
+    QVector<int> triangleOrder;
+    triangleOrder.reserve(numberOfTriangles);
+    for (int k = 0; k < numberOfClusters; ++k)
+    {
+        int c = clusterOrder[k];
+        for (int t = clusterStart[c]; t < clusterStart[c + 1]; ++t)
+            triangleOrder.push_back(t);
+    }
+
+    return triangleOrder;
+}
+
+QVector<int> MeshOptimizer::optimizeVertexFetch(const QVector<GLuint> &indices, int numberOfVertices)
+{
+    QVector<int> newIndex(numberOfVertices, -1);
+    int nextIndex = 0;
+
+    for (int k = 0; k < indices.size(); ++k)
+    {
+        GLuint v = indices[k];
+        if (v < (GLuint)numberOfVertices && newIndex[v] < 0)
+            newIndex[v] = nextIndex++;
+    }
+
+    for (int v = 0; v < numberOfVertices; ++v)
+    {
+        if (newIndex[v] < 0)
+            newIndex[v] = nextIndex++;
+    }
+
+    return newIndex;
+}
+
+int MeshOptimizer::numberOfCacheMisses(const QVector<GLuint> &indices, int numberOfVertices, int cacheSize)
+{
+    //FIFO cache : timestamp of the insertion of each vertex in the cache
+    QVector<int> insertionTime(numberOfVertices, -cacheSize - 1);
+    int numberOfMisses = 0;
+
+    for (int k = 0; k < indices.size(); ++k)
+    {
+        GLuint v = indices[k];
+        if (v >= (GLuint)numberOfVertices)
+            continue;
+
+        if (numberOfMisses - insertionTime[v] > cacheSize)
+        {
+            insertionTime[v] = numberOfMisses;
+            ++numberOfMisses;
+        }
+    }
+
+    return numberOfMisses;
+}
+
+float MeshOptimizer::averageCacheMissRatio(const QVector<GLuint> &indices, int numberOfVertices, int cacheSize)
+{
+    int numberOfTriangles = indices.size() / 3;
+    if (numberOfTriangles == 0)
+        return 0.0f;
+
+    return (float)numberOfCacheMisses(indices, numberOfVertices, cacheSize) / numberOfTriangles;
+}
+
+float MeshOptimizer::averageTransformToVertexRatio(const QVector<GLuint> &indices, int numberOfVertices, int cacheSize)
+{
+    //Only the vertices used by the triangles count
+    QVector<char> isUsed(numberOfVertices, 0);
+    int numberOfUsedVertices = 0;
+    for (int k = 0; k < indices.size(); ++k)
+    {
+        GLuint v = indices[k];
+        if (v < (GLuint)numberOfVertices && !isUsed[v])
+        {
+            isUsed[v] = 1;
+            ++numberOfUsedVertices;
+        }
+    }
+
+    if (numberOfUsedVertices == 0)
+        return 0.0f;
+
+    return (float)numberOfCacheMisses(indices, numberOfVertices, cacheSize) / numberOfUsedVertices;
+}
+
+float MeshOptimizer::analyzeOverdraw(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices)
+{
+    const int numberOfTriangles = indices.size() / 3;
+    const int numberOfVertices = vertices.size();
+    const int size = OVERDRAW_VIEW_SIZE;
+
+    if (numberOfVertices == 0 || numberOfTriangles == 0)
+        return 0.0f;
+
+    //Bounding box : the views are orthographic projections of the box on the viewport
+    QVector3D minimum, maximum;
+    MeshKernels::computeBounds(vertices.constData(), numberOfVertices, minimum, maximum);
+
+    QVector3D extent = maximum - minimum;
+    float scale = max(extent.x(), max(extent.y(), extent.z()));
+    if (scale <= 0.0f)
+        return 0.0f;
+
+    //6 views : along each axis, in both directions. The views are rasterized in parallel.
+    long long numberOfShadedFragments[6] = { 0, 0, 0, 0, 0, 0 };
+    long long numberOfCoveredPixels[6] = { 0, 0, 0, 0, 0, 0 };
+
+    parallelFor(6, [&](int firstView, int lastView)
+    {
+        QVector<float> depthBuffer(size * size);
+        QVector<QVector3D> projected(numberOfVertices);
+
+        for (int view = firstView; view < lastView; ++view)
+        {
+            const int axis = view / 2;
+            const float direction = (view % 2 == 0) ? 1.0f : -1.0f;
+
+            for (int v = 0; v < numberOfVertices; ++v)
+            {
+                QVector3D p = (vertices[v] - minimum) / scale;
+                float coordinates[3] = { p.x(), p.y(), p.z() };
+                //Screen x, y and depth
+                projected[v] = QVector3D(coordinates[(axis + 1) % 3] * (size - 1), coordinates[(axis + 2) % 3] * (size - 1),
+                                         direction * coordinates[axis]);
+            }
+
+            depthBuffer.fill(numeric_limits<float>::max());
+
+            for (int t = 0; t < numberOfTriangles; ++t)
+            {
+                GLuint index1 = indices[3 * t], index2 = indices[3 * t + 1], index3 = indices[3 * t + 2];
+                if (index1 >= (GLuint)numberOfVertices || index2 >= (GLuint)numberOfVertices || index3 >= (GLuint)numberOfVertices)
+                    continue;
+
+                const QVector3D &a = projected[index1], &b = projected[index2], &c = projected[index3];
+
+                float area = (b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x());
+                if (area == 0.0f)
+                    continue;
+
+                int minimumX = max(0, (int)ceil(min(a.x(), min(b.x(), c.x()))));
+                int maximumX = min(size - 1, (int)floor(max(a.x(), max(b.x(), c.x()))));
+                int minimumY = max(0, (int)ceil(min(a.y(), min(b.y(), c.y()))));
+                int maximumY = min(size - 1, (int)floor(max(a.y(), max(b.y(), c.y()))));
+
+                //Pixel centers inside the triangle (both orientations : no backface culling)
+                for (int y = minimumY; y <= maximumY; ++y)
+                {
+                    for (int x = minimumX; x <= maximumX; ++x)
+                    {
+                        float w1 = ((c.x() - b.x()) * (y - b.y()) - (c.y() - b.y()) * (x - b.x())) / area;
+                        float w2 = ((a.x() - c.x()) * (y - c.y()) - (a.y() - c.y()) * (x - c.x())) / area;
+                        float w3 = 1.0f - w1 - w2;
+                        if (w1 < 0.0f || w2 < 0.0f || w3 < 0.0f)
+                            continue;
+
+                        float depth = w1 * a.z() + w2 * b.z() + w3 * c.z();
+                        float &storedDepth = depthBuffer[y * size + x];
+                        if (depth < storedDepth)
+                        {
+                            storedDepth = depth;
+                            ++numberOfShadedFragments[view];
+                        }
+                    }
+                }
+            }
+
+            for (int k = 0; k < size * size; ++k)
+            {
+                if (depthBuffer[k] != numeric_limits<float>::max())
+                    ++numberOfCoveredPixels[view];
+            }
+        }
+    }, 1);
+
+    long long totalShadedFragments = 0, totalCoveredPixels = 0;
+    for (int view = 0; view < 6; ++view)
+    {
+        totalShadedFragments += numberOfShadedFragments[view];
+        totalCoveredPixels += numberOfCoveredPixels[view];
+    }
+
+    return (totalCoveredPixels > 0) ? (float)totalShadedFragments / totalCoveredPixels : 0.0f;
+}
@@ -0,0 +1,125 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include "opengl/openglheaders.h"
+#include "opengl/parallel.h"
+
+#include <QVector>
+#include <QVector3D>
+
+//Size of the post-transform vertex cache simulated to measure ACMR and ATVR
+#define VERTEX_CACHE_SIZE 16
+
+//The overdraw optimizer may increase the ACMR of the vertex cache optimizer by this factor at most
+#define OVERDRAW_CACHE_THRESHOLD 1.05f
+
+//Resolution of the views rasterized to measure the overdraw
+#define OVERDRAW_VIEW_SIZE 256
+
+/**
+ * Reordering of the triangles and the vertices of an indexed triangle mesh for the GPU.
+ */
+class MeshOptimizer
+{
+public:
+    /**
+     * Returns a new order of the triangles that improves the reuse of the post-transform vertex cache
+     * (Tom Forsyth, Linear-Speed Vertex Cache Optimisation).
+     * triangleOrder[k] is the index of the triangle that must be drawn in k-th position.
+     * @brief optimizeVertexCache
+     * @param indices
+     * @param numberOfVertices
+     * @param progress
+     * @return the order is incomplete if the optimization is cancelled
+     */
+    static QVector<int> optimizeVertexCache(const QVector<GLuint> &indices, int numberOfVertices,
+                                            const LoadProgress &progress = LoadProgress());
+
+    /**
+     * Returns a new order of the triangles that reduces overdraw from any point of view
+     * (Sander et al., Fast Triangle Reordering for Vertex Locality and Reduced Overdraw).
+     * The triangles, which must already be in vertex cache order, are split in clusters wherever the ACMR
+     * stays under cacheThreshold times the ACMR of the input. The clusters facing away from the center of the mesh
+     * are drawn first as they are the most likely to hide the others.
+     * triangleOrder[k] is the index of the triangle that must be drawn in k-th position.
+     * @brief optimizeOverdraw
+     * @param indices
+     * @param vertices
+     * @param cacheThreshold
+     * @return
+     */
+    static QVector<int> optimizeOverdraw(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices,
+                                         float cacheThreshold = OVERDRAW_CACHE_THRESHOLD);
+
+    /**
+     * Returns the new index of each vertex so that the vertices are stored in the order in which they are first used.
+     * Vertices that are not used by any triangle are moved to the end.
+     * @brief optimizeVertexFetch
+     * @param indices
+     * @param numberOfVertices
+     * @return
+     */
+    static QVector<int> optimizeVertexFetch(const QVector<GLuint> &indices, int numberOfVertices);
+
+    /**
+     * Average cache miss ratio : number of vertices transformed per triangle with a FIFO cache of cacheSize vertices
+     * (between 0.5 and 3, lower is better).
+     * @brief averageCacheMissRatio
+     * @param indices
+     * @param numberOfVertices
+     * @param cacheSize
+     * @return
+     */
+    static float averageCacheMissRatio(const QVector<GLuint> &indices, int numberOfVertices, int cacheSize = VERTEX_CACHE_SIZE);
+
+    /**
+     * Average transform to vertex ratio : number of vertices transformed per vertex used by the mesh (1 is optimal).
+     * @brief averageTransformToVertexRatio
+     * @param indices
+     * @param numberOfVertices
+     * @param cacheSize
+     * @return
+     */
+    static float averageTransformToVertexRatio(const QVector<GLuint> &indices, int numberOfVertices, int cacheSize = VERTEX_CACHE_SIZE);
+
+    /**
+     * Average number of fragments shaded per covered pixel when the triangles are drawn in order with a depth test
+     * (early depth test : a fragment is shaded if it is in front of what was drawn before).
+     * The mesh is rasterized in software from the 6 axis directions, without backface culling (1 means no overdraw).
+     * @brief analyzeOverdraw
+     * @param indices
+     * @param vertices
+     * @return
+     */
+    static float analyzeOverdraw(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices);
+
+private:
+    static int numberOfCacheMisses(const QVector<GLuint> &indices, int numberOfVertices, int cacheSize);
+};
+
+#endif // MESHOPTIMIZER_H
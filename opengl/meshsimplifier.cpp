@@ -0,0 +1,362 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/meshsimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+//Maximum number of passes over the edges, each pass collapses edges that do not share a vertex
+#define SIMPLIFIER_MAXIMUM_PASSES 100
+
+/**
+ * Sum of the squared distances to a set of planes weighted by their area : p^T A p + 2 b.p + c.
+ */
+struct Quadric
+{
+    double a00, a11, a22, a10, a20, a21;
+    double b0, b1, b2;
+    double c;
+    double weight;
+};
+
+struct Collapse
+{
+    float cost;
+    int from;
+    int to;
+};
+
+static void quadricFromPlane(Quadric &quadric, double nx, double ny, double nz, double d, double weight)
+{
+    quadric.a00 = weight * nx * nx;
+    quadric.a11 = weight * ny * ny;
+    quadric.a22 = weight * nz * nz;
+    quadric.a10 = weight * ny * nx;
+    quadric.a20 = weight * nz * nx;
+    quadric.a21 = weight * nz * ny;
+    quadric.b0 = weight * nx * d;
+    quadric.b1 = weight * ny * d;
+    quadric.b2 = weight * nz * d;
+    quadric.c = weight * d * d;
+    quadric.weight = weight;
+}
+
+static void addQuadric(Quadric &quadric, const Quadric &other)
+{
+    quadric.a00 += other.a00;
+    quadric.a11 += other.a11;
+    quadric.a22 += other.a22;
+    quadric.a10 += other.a10;
+    quadric.a20 += other.a20;
+    quadric.a21 += other.a21;
+    quadric.b0 += other.b0;
+    quadric.b1 += other.b1;
+    quadric.b2 += other.b2;
+    quadric.c += other.c;
+    quadric.weight += other.weight;
+}
+
+/**
+ * Weighted sum of the squared distances of p to the planes of the quadric.
+ */
+static double quadricError(const Quadric &quadric, const QVector3D &p)
+{
+    double x = p.x(), y = p.y(), z = p.z();
+    double error = quadric.a00 * x * x + quadric.a11 * y * y + quadric.a22 * z * z
+            + 2.0 * (quadric.a10 * x * y + quadric.a20 * x * z + quadric.a21 * y * z)
+            + 2.0 * (quadric.b0 * x + quadric.b1 * y + quadric.b2 * z) + quadric.c;
+    return fabs(error);
+}
+
+/**
+ * Squared distance of the collapse of the two vertices at p, averaged over the area of their planes.
+ */
+static float collapseCost(const Quadric &from, const Quadric &to, const QVector3D &p)
+{
+    double weight = from.weight + to.weight;
+    return (float)((quadricError(from, p) + quadricError(to, p)) / (weight > 0.0 ? weight : 1.0));
+}
+
+/**
+ * Marks the vertices that must not move : the ones sharing their position with another vertex (seams)
+ * and the ones on an edge used by a single triangle (borders).
+ */
+static vector<bool> lockedVertices(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices)
+{
+    const int numberOfVertices = vertices.size();
+
+    //Vertices sorted by position give an identifier to each distinct position
+    vector<int> sortedVertices(numberOfVertices);
+    for (int v = 0; v < numberOfVertices; ++v)
+        sortedVertices[v] = v;
+
+    const QVector3D *positions = vertices.constData();
+    sort(sortedVertices.begin(), sortedVertices.end(), [positions](int a, int b)
+    {
+        const QVector3D &pa = positions[a], &pb = positions[b];
+        if (pa.x() != pb.x())
+            return pa.x() < pb.x();
+        if (pa.y() != pb.y())
+            return pa.y() < pb.y();
+        return pa.z() < pb.z();
+    });
+
+    vector<int> positionId(numberOfVertices);
+    vector<bool> lockedPosition;
+    for (int k = 0; k < numberOfVertices; ++k)
+    {
+        if (k == 0 || positions[sortedVertices[k]] != positions[sortedVertices[k - 1]])
+            lockedPosition.push_back(false);
+        else
+            lockedPosition.back() = true;
+
+        positionId[sortedVertices[k]] = lockedPosition.size() - 1;
+    }
+
+    //Directed edges between positions, an edge without its opposite is on a border
+    vector<unsigned long long> edges;
+    edges.reserve(indices.size());
+    for (int t = 0; t + 2 < indices.size(); t += 3)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            unsigned long long a = positionId[indices[t + c]], b = positionId[indices[t + (c + 1) % 3]];
+            edges.push_back((a << 32) | b);
+        }
+    }
+    sort(edges.begin(), edges.end());
+
+    for (size_t k = 0; k < edges.size(); ++k)
+    {
+        unsigned long long a = edges[k] >> 32, b = edges[k] & 0xffffffffULL;
+        if (!binary_search(edges.begin(), edges.end(), (b << 32) | a))
+        {
+            lockedPosition[a] = true;
+            lockedPosition[b] = true;
+        }
+    }
+
+    vector<bool> locked(numberOfVertices);
+    for (int v = 0; v < numberOfVertices; ++v)
+        locked[v] = lockedPosition[positionId[v]];
+
+    return locked;
+}
+
+QVector<GLuint> MeshSimplifier::simplify(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices,
+                                         int targetNumberOfIndices, float &error, const LoadProgress &progress)
+{
+    const int numberOfVertices = vertices.size();
+    const QVector3D *positions = vertices.constData();
+    double maximumCost = 0.0;
+
+    //Valid and non degenerate triangles only
+    QVector<GLuint> result;
+    result.reserve(indices.size());
+    for (int t = 0; t + 2 < indices.size(); t += 3)
+    {
+        GLuint a = indices[t], b = indices[t + 1], c = indices[t + 2];
+        if (a < (GLuint)numberOfVertices && b < (GLuint)numberOfVertices && c < (GLuint)numberOfVertices
+                && a != b && b != c && c != a)
+        {
+            result.push_back(a);
+            result.push_back(b);
+            result.push_back(c);
+        }
+    }
+
+    vector<bool> locked = lockedVertices(result, vertices);
+
+    //Quadric of each vertex : planes of its triangles weighted by their area
+    vector<Quadric> quadrics(numberOfVertices);
+    Quadric zero;
+    quadricFromPlane(zero, 0.0, 0.0, 0.0, 0.0, 0.0);
+    fill(quadrics.begin(), quadrics.end(), zero);
+
+    for (int t = 0; t < result.size(); t += 3)
+    {
+        const QVector3D &p0 = positions[result[t]], &p1 = positions[result[t + 1]], &p2 = positions[result[t + 2]];
+        QVector3D normal = QVector3D::crossProduct(p1 - p0, p2 - p0);
+        double length = normal.length();
+        if (length <= 0.0)
+            continue;
+
+        double nx = normal.x() / length, ny = normal.y() / length, nz = normal.z() / length;
+        double d = -(nx * p0.x() + ny * p0.y() + nz * p0.z());
+
+        Quadric plane;
+        quadricFromPlane(plane, nx, ny, nz, d, 0.5 * length);
+        for (int c = 0; c < 3; ++c)
+            addQuadric(quadrics[result[t + c]], plane);
+    }
+
+    vector<int> remap(numberOfVertices);
+    vector<bool> touched(numberOfVertices);
+    vector<int> triangleOffsets(numberOfVertices + 1);
+    vector<int> vertexTriangles;
+    vector<Collapse> collapses;
+
+    for (int pass = 0; pass < SIMPLIFIER_MAXIMUM_PASSES && result.size() > targetNumberOfIndices; ++pass)
+    {
+        if (!reportProgress(progress, 100 * pass / SIMPLIFIER_MAXIMUM_PASSES))
+            break;
+
+        const int numberOfTriangles = result.size() / 3;
+        const int targetNumberOfTriangles = targetNumberOfIndices / 3;
+
+        //Triangles around each vertex
+        fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (int k = 0; k < result.size(); ++k)
+            ++triangleOffsets[result[k] + 1];
+        for (int v = 0; v < numberOfVertices; ++v)
+            triangleOffsets[v + 1] += triangleOffsets[v];
+
+        vertexTriangles.resize(result.size());
+        vector<int> insertion(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for (int k = 0; k < result.size(); ++k)
+            vertexTriangles[insertion[result[k]]++] = k / 3;
+
+        //Candidate collapses along the edges, in both directions
+        collapses.clear();
+        for (int t = 0; t < result.size(); t += 3)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                int a = result[t + c], b = result[t + (c + 1) % 3];
+                if (!locked[a])
+                {
+                    Collapse collapse = { collapseCost(quadrics[a], quadrics[b], positions[b]), a, b };
+                    collapses.push_back(collapse);
+                }
+                if (!locked[b])
+                {
+                    Collapse collapse = { collapseCost(quadrics[b], quadrics[a], positions[a]), b, a };
+                    collapses.push_back(collapse);
+                }
+            }
+        }
+
+        if (collapses.empty())
+            break;
+
+        sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+        //A collapse removes about 2 triangles : the pass stops a bit after the cost of the collapse that would reach the target
+        //so that a single pass does not take expensive collapses while cheaper ones are blocked by their neighbours
+        size_t goal = min((size_t)max((numberOfTriangles - targetNumberOfTriangles) / 2, 0), collapses.size() - 1);
+        float costLimit = collapses[goal].cost * 1.5f;
+
+        for (int v = 0; v < numberOfVertices; ++v)
+        {
+            remap[v] = v;
+            touched[v] = false;
+        }
+
+        int numberOfRemovedTriangles = 0, numberOfCollapses = 0;
+        bool limited = true;
+        for (size_t k = 0; k < collapses.size(); ++k)
+        {
+            const Collapse &collapse = collapses[k];
+            if (numberOfTriangles - numberOfRemovedTriangles <= targetNumberOfTriangles)
+                break;
+
+            if (limited && collapse.cost > costLimit)
+            {
+                //Too little progress under the limit (the cheapest collapses would flip triangles) : take the next ones too
+                if (8 * numberOfRemovedTriangles < numberOfTriangles - targetNumberOfTriangles)
+                    limited = false;
+                else
+                    break;
+            }
+
+            const int from = collapse.from, to = collapse.to;
+            if (touched[from] || touched[to])
+                continue;
+
+            //The triangles around the collapsed vertex must not flip
+            bool flips = false;
+            int removedTriangles = 0;
+            for (int n = triangleOffsets[from]; n < triangleOffsets[from + 1] && !flips; ++n)
+            {
+                int t = vertexTriangles[n];
+                int corners[3] = { remap[result[3 * t]], remap[result[3 * t + 1]], remap[result[3 * t + 2]] };
+
+                if (corners[0] == to || corners[1] == to || corners[2] == to)
+                {
+                    ++removedTriangles;
+                    continue;
+                }
+
+                QVector3D before = QVector3D::crossProduct(positions[corners[1]] - positions[corners[0]],
+                                                           positions[corners[2]] - positions[corners[0]]);
+                for (int c = 0; c < 3; ++c)
+                {
+                    if (corners[c] == from)
+                        corners[c] = to;
+                }
+                QVector3D after = QVector3D::crossProduct(positions[corners[1]] - positions[corners[0]],
+                                                          positions[corners[2]] - positions[corners[0]]);
+
+                flips = (QVector3D::dotProduct(before, after) <= 0.0f);
+            }
+
+            if (flips)
+                continue;
+
+            remap[from] = to;
+            addQuadric(quadrics[to], quadrics[from]);
+            touched[from] = true;
+            touched[to] = true;
+
+            maximumCost = max(maximumCost, (double)collapse.cost);
+            numberOfRemovedTriangles += removedTriangles;
+            ++numberOfCollapses;
+        }
+
+        if (numberOfCollapses == 0)
+            break;
+
+        //Remove the triangles that became degenerate
+        int size = 0;
+        for (int t = 0; t < result.size(); t += 3)
+        {
+            int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+            if (a != b && b != c && c != a)
+            {
+                result[size++] = a;
+                result[size++] = b;
+                result[size++] = c;
+            }
+        }
+        result.resize(size);
+    }
+
+    error = (float)sqrt(maximumCost);
+    return result;
+}
@@ -0,0 +1,67 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include "opengl/openglheaders.h"
+#include "opengl/parallel.h"
+
+#include <QVector>
+#include <QVector3D>
+
+//Each level of detail has this fraction of the triangles of the previous one
+#define LOD_TRIANGLE_RATIO 0.5f
+
+//The chain stops at this number of triangles or levels
+#define LOD_MINIMUM_TRIANGLES 64
+#define LOD_MAXIMUM_LEVELS 8
+
+/**
+ * Simplification of indexed triangle meshes by edge collapses ordered by the quadric error metric
+ * (Garland and Heckbert, Surface Simplification Using Quadric Error Metrics).
+ * A vertex is collapsed onto one of its neighbours, so the simplified triangles index the original vertex buffer
+ * and all the levels of detail of a mesh can share it.
+ * The vertices on open borders and on attribute seams (several vertices at the same position) are never moved.
+ */
+class MeshSimplifier
+{
+public:
+    /**
+     * Returns the indices of the simplified triangles, with at most targetNumberOfIndices indices if the borders
+     * and the seams allow it. error is set to the largest distance to the input surface estimated by the quadrics.
+     * @brief simplify
+     * @param indices
+     * @param vertices
+     * @param targetNumberOfIndices
+     * @param error
+     * @param progress checked at each pass of the simplification
+     * @return the simplification is incomplete if it is cancelled
+     */
+    static QVector<GLuint> simplify(const QVector<GLuint> &indices, const QVector<QVector3D> &vertices,
+                                    int targetNumberOfIndices, float &error, const LoadProgress &progress = LoadProgress());
+};
+
+#endif // MESHSIMPLIFIER_H
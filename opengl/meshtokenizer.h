@@ -0,0 +1,325 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef MESHTOKENIZER_H
+#define MESHTOKENIZER_H
+
+#include <cmath>
+#include <cstring>
+
+/**
+ * Tokenizer for line based mesh files (OBJ, OFF) working directly on a character buffer,
+ * typically a memory-mapped file. Numbers are parsed in place : no string is built and nothing is allocated.
+ * The buffer does not need to be null terminated.
+ * The functions are called for every token of the file, hence they are defined inline in this header.
+ */
+class MeshTokenizer
+{
+public:
+    MeshTokenizer(const char *begin, const char *end);
+
+    bool atEnd() const;
+
+    /**
+     * Returns true if the current line has no more tokens (spaces are skipped).
+     * @brief atEndOfLine
+     * @return
+     */
+    bool atEndOfLine();
+
+    /**
+     * Skips spaces and tabs but stops at the end of the line.
+     * @brief skipSpaces
+     */
+    void skipSpaces();
+
+    /**
+     * Moves to the beginning of the next line.
+     * @brief skipLine
+     */
+    void skipLine();
+
+    /**
+     * Moves to the beginning of the next line which is neither blank nor a # comment.
+     * @brief skipBlankAndCommentLines
+     */
+    void skipBlankAndCommentLines();
+
+    /**
+     * Returns the current character without consuming it (0 at the end of the buffer).
+     * @brief peek
+     * @param offset
+     * @return
+     */
+    char peek(int offset = 0) const;
+
+    /**
+     * Consumes the current character if it is equal to c.
+     * @brief consume
+     * @param c
+     * @return
+     */
+    bool consume(char c);
+
+    /**
+     * Skips the current token (up to the next space or end of line).
+     * @brief skipToken
+     */
+    void skipToken();
+
+    /**
+     * Parses a floating point number (e.g. -1.5e-3). Leading spaces are skipped.
+     * Returns false and does not move if there is no number at the current position.
+     * @brief readFloat
+     * @param value
+     * @return
+     */
+    bool readFloat(float &value);
+
+    /**
+     * Parses a signed integer. Leading spaces are skipped.
+     * Returns false and does not move if there is no integer at the current position.
+     * @brief readInt
+     * @param value
+     * @return
+     */
+    bool readInt(int &value);
+
+    const char *position() const;
+    void setPosition(const char *position);
+
+private:
+    static bool isDigit(char c);
+
+    const char *m_current;
+    const char *m_end;
+};
+
+//Powers of 10 that are exactly representable as a double
+static const double meshTokenizerPowersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                          1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+inline bool MeshTokenizer::isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline MeshTokenizer::MeshTokenizer(const char *begin, const char *end) : m_current(begin), m_end(end)
+{
+
+}
+
+inline bool MeshTokenizer::atEnd() const
+{
+    return m_current >= m_end;
+}
+
+inline bool MeshTokenizer::atEndOfLine()
+{
+    skipSpaces();
+    return m_current >= m_end || *m_current == '\n' || *m_current == '\r';
+}
+
+inline void MeshTokenizer::skipSpaces()
+{
+    while (m_current < m_end && (*m_current == ' ' || *m_current == '\t'))
+        ++m_current;
+}
+
+inline void MeshTokenizer::skipLine()
+{
+    const char *endOfLine = (const char *)std::memchr(m_current, '\n', m_end - m_current);
+    m_current = endOfLine ? endOfLine + 1 : m_end;
+}
+
+inline void MeshTokenizer::skipBlankAndCommentLines()
+{
+    while (m_current < m_end)
+    {
+        char c = *m_current;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            ++m_current;
+        else if (c == '#')
+            skipLine();
+        else
+            break;
+    }
+}
+
+inline char MeshTokenizer::peek(int offset) const
+{
+    return (m_current + offset < m_end) ? m_current[offset] : '\0';
+}
+
+inline bool MeshTokenizer::consume(char c)
+{
+    if (m_current < m_end && *m_current == c)
+    {
+        ++m_current;
+        return true;
+    }
+    return false;
+}
+
+inline void MeshTokenizer::skipToken()
+{
+    skipSpaces();
+    while (m_current < m_end && *m_current != ' ' && *m_current != '\t' && *m_current != '\r' && *m_current != '\n')
+        ++m_current;
+}
+
+inline bool MeshTokenizer::readFloat(float &value)
+{
+    skipSpaces();
+
+    const char *p = m_current;
+    bool negative = false;
+
+    if (p < m_end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    //Keep the first 19 significant digits in an integer mantissa, the others only change the exponent
+    unsigned long long mantissa = 0;
+    int significantDigits = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+
+    while (p < m_end && isDigit(*p))
+    {
+        if (significantDigits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa > 0)
+                ++significantDigits;
+        }
+        else
+        {
+            ++exponent;
+        }
+        hasDigits = true;
+        ++p;
+    }
+
+    if (p < m_end && *p == '.')
+    {
+        ++p;
+        while (p < m_end && isDigit(*p))
+        {
+            if (significantDigits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa > 0)
+                    ++significantDigits;
+                --exponent;
+            }
+            hasDigits = true;
+            ++p;
+        }
+    }
+
+    if (!hasDigits)
+        return false;
+
+    if (p < m_end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool negativeExponent = false;
+        if (q < m_end && (*q == '-' || *q == '+'))
+        {
+            negativeExponent = (*q == '-');
+            ++q;
+        }
+
+        if (q < m_end && isDigit(*q))
+        {
+            int exponentValue = 0;
+            while (q < m_end && isDigit(*q))
+            {
+                if (exponentValue < 10000)
+                    exponentValue = exponentValue * 10 + (*q - '0');
+                ++q;
+            }
+            exponent += negativeExponent ? -exponentValue : exponentValue;
+            p = q;
+        }
+    }
+
+    double result = (double)mantissa;
+    if (exponent > 0)
+        result *= (exponent <= 22) ? meshTokenizerPowersOf10[exponent] : std::pow(10.0, exponent);
+    else if (exponent < 0)
+        result /= (exponent >= -22) ? meshTokenizerPowersOf10[-exponent] : std::pow(10.0, -exponent);
+
+    value = (float)(negative ? -result : result);
+    m_current = p;
+    return true;
+}
+
+inline bool MeshTokenizer::readInt(int &value)
+{
+    skipSpaces();
+
+    const char *p = m_current;
+    bool negative = false;
+
+    if (p < m_end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    if (p >= m_end || !isDigit(*p))
+        return false;
+
+    long long result = 0;
+    while (p < m_end && isDigit(*p))
+    {
+        if (result <= 0x7fffffff)
+            result = result * 10 + (*p - '0');
+        ++p;
+    }
+
+    if (result > 0x7fffffff)
+        result = 0x7fffffff;
+
+    value = (int)(negative ? -result : result);
+    m_current = p;
+    return true;
+}
+
+inline const char *MeshTokenizer::position() const
+{
+    return m_current;
+}
+
+inline void MeshTokenizer::setPosition(const char *position)
+{
+    m_current = position;
+}
+
+#endif // MESHTOKENIZER_H
@@ -24,83 +24,142 @@
 ****************************************************************************/
 
 #include "opengl/object.h"
+#include "opengl/meshcache.h"
+#include "opengl/meshkernels.h"
 #include <QDir>
+#include <QFileInfo>
+#include <QElapsedTimer>
 
 using namespace std;
 
-Object::Object() : m_objectName(), m_mesh(Mesh()), m_material(Material()),
-m_modelMatrix(QMatrix4x4()), m_rotationX(0), m_rotationY(0), m_rotationZ(0)
+Object::Object() : m_objectName(), m_material(Material()), m_asset(new MeshAsset()), m_instances(),
+m_modelMatrix(QMatrix4x4()), m_rotationX(0), m_rotationY(0), m_rotationZ(0), m_optimizeMesh(true), m_loadError()
 {
 
 }
 
-Object::Object(string objectName) : m_objectName(objectName), m_mesh(Mesh()), m_material(Material()),
-m_modelMatrix(QMatrix4x4()), m_rotationX(0), m_rotationY(0), m_rotationZ(0)
+Object::Object(string objectName, bool optimizeMesh, MeshAssetCache *meshAssets) : m_objectName(objectName), m_material(Material()),
+m_asset(new MeshAsset()), m_instances(), m_modelMatrix(QMatrix4x4()), m_rotationX(0), m_rotationY(0), m_rotationZ(0),
+m_optimizeMesh(optimizeMesh), m_loadError()
 {
-    string objectPath = loadPath(objectName);
-    m_mesh = Mesh(objectPath);
-    this->loadMesh();
-
-    m_modelMatrix = QMatrix4x4();
-    m_modelMatrix.setToIdentity();
-
-    m_material = Material(QColor(128, 0, 0), QColor(255, 0, 0), QColor(255, 255, 255), 1.0, 1.0, 1.0, 10.0);
-
-    if (m_QtVBO.create()) qDebug() << "Success creating vertex position buffer";
-    m_QtVBO.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    if (this->load(objectName, optimizeMesh, meshAssets))
+        this->uploadBuffers();
+    else
+        cerr << m_loadError << endl;
+}
 
-    if (m_QtVBO.bind()) qDebug() << "Success biding vertex position buffer";
+Object::~Object()
+{
 
-	//qDebug() << m_mesh.getVertices().size();
-	//qDebug() << m_mesh.getVertexNormals().size();
-	//qDebug() << m_mesh.getTextureCoordinates().size();
+}
 
-	int numVertices = m_mesh.getVertices().size();
+string Object::getLoadError() const
+{
+    return m_loadError;
+}
 
-    int sizeVertices = numVertices * sizeof(QVector3D);//m_mesh.getVertices().size() * sizeof(QVector3D);
-    int sizeTextureCoords = m_mesh.getTextureCoordinates().size() * sizeof(QVector2D);
-    int sizeNormals = numVertices * sizeof(QVector3D);//m_mesh.getVertexNormals().size() * sizeof(QVector3D);
+bool Object::load(const string &objectName, bool optimizeMesh, MeshAssetCache *meshAssets, const LoadProgress &progress)
+{
+    m_objectName = objectName;
+    m_optimizeMesh = optimizeMesh;
+    m_loadError.clear();
 
-    size_t VBOSize = sizeVertices + sizeTextureCoords + sizeNormals;
+    //The instances were encoded for the previous mesh
+    m_instances.clear();
 
-    m_vertexOffset = 0;
-    m_texturesCoordsOffset = sizeVertices;
-	m_normalsOffset = m_texturesCoordsOffset + sizeTextureCoords;
+    if (!reportProgress(progress, 0))
+        return false;
 
-    m_QtVBO.allocate(VBOSize);
+    string objectPath = loadPath(m_objectName);
+    if (objectPath.empty())
+    {
+        m_loadError = m_objectName + " does not exist";
+        return false;
+    }
 
-    //  send the vertice data to the vbo using allocate
-    m_QtVBO.write(m_vertexOffset, m_mesh.getVertices().constData(),  sizeVertices);
+    QMatrix4x4 bakeTransform = loadTransform(m_objectName);
 
-    //Send the texture coordinates data
-    m_QtVBO.write(m_texturesCoordsOffset, m_mesh.getTextureCoordinates().constData(), sizeTextureCoords);
+    QSharedPointer<MeshAsset> asset = meshAssets ? meshAssets->find(objectPath, m_optimizeMesh, bakeTransform) : QSharedPointer<MeshAsset>();
+    if (!asset.isNull())
+    {
+        m_asset = asset;
+    }
+    else
+    {
+        m_asset = QSharedPointer<MeshAsset>(new MeshAsset());
+        m_asset->mesh = Mesh(objectPath);
+        m_asset->arena = meshAssets ? meshAssets->getGeometryArena() : QSharedPointer<GeometryArena>();
+        QSharedPointer<MeshCache> meshCache(new MeshCache(objectPath, m_optimizeMesh, bakeTransform));
+        if (meshCache->isValid())
+        {
+            //Nothing is computed again : the encoded buffers are uploaded straight from the mapping of the cache file
+            meshCache->copyToAsset(*m_asset);
+            m_asset->meshCache = meshCache;
+        }
+        else
+        {
+            if (!this->loadMesh(bakeTransform, progress))
+                return false;
+
+            this->computeBoundingSphere();
+            this->buildBVH();
+
+            //A cancelled load does not write the cache
+            if (!reportProgress(progress, 95))
+                return false;
+
+            //Compact vertex and index formats (see MeshEncoding)
+            m_asset->encoding.encode(m_asset->mesh, m_asset->vertexData, m_asset->indexData);
+
+            MeshCache::save(objectPath, *m_asset, m_optimizeMesh, bakeTransform);
+        }
+
+        if (meshAssets)
+            m_asset = meshAssets->insert(objectPath, m_optimizeMesh, bakeTransform, m_asset);
+    }
 
-	//Send the normals data
-	m_QtVBO.write(m_normalsOffset, m_mesh.getVertexNormals().constData(), sizeNormals);
+    m_modelMatrix = QMatrix4x4();
+    m_modelMatrix.setToIdentity();
 
-	m_QtIndexBuffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+    m_material = Material(QColor(128, 0, 0), QColor(255, 0, 0), QColor(255, 255, 255), 1.0, 1.0, 1.0, 10.0);
 
-    if (m_QtIndexBuffer.create())
-        qDebug() << "Success creating the index buffer";
-    m_QtIndexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    m_vertexOffset = 0;
+    m_texturesCoordsOffset = m_asset->encoding.getTextureCoordinatesOffset();
+    m_normalsOffset = m_asset->encoding.getNormalsOffset();
+    m_tangentsOffset = m_asset->encoding.getTangentsOffset();
 
-    if (m_QtIndexBuffer.bind())
-        qDebug() << "Success biding the index buffer";
+    return reportProgress(progress, 100);
+}
 
-    //Send the indices data
-    m_QtIndexBuffer.allocate(m_mesh.getIndicesArray().size() * sizeof(GLuint));
+void Object::uploadBuffers()
+{
+    m_asset->uploadBuffers();
 
-    //Send the indices data
-    m_QtIndexBuffer.write(0, m_mesh.getIndicesArray().constData(), m_mesh.getIndicesArray().size() * sizeof(GLuint));
+    if (!m_instances.isNull())
+        m_instances->upload(*m_asset);
+}
 
-    qDebug() << "VBO buffer size " << m_QtVBO.size();
-    qDebug() << "Index buffer buffer size " << m_QtIndexBuffer.size();
+void Object::setInstances(const QVector<QMatrix4x4> &transforms, const QVector<QVector4D> &colors)
+{
+    //A new buffer : the copies of the object keep the previous instances
+    if (transforms.isEmpty())
+    {
+        m_instances.clear();
+        return;
+    }
 
+    m_instances = QSharedPointer<InstanceBuffer>(new InstanceBuffer());
+    m_instances->setInstances(transforms, colors, *m_asset);
 }
 
-Object::~Object()
+int Object::getNumberOfInstances() const
 {
+    return m_instances.isNull() ? 0 : m_instances->getNumberOfInstances();
+}
 
+QSharedPointer<InstanceBuffer> Object::getInstances() const
+{
+    return m_instances;
 }
 
 void Object::resetModelMatrix()
@@ -200,52 +259,211 @@ string Object::loadPath(string &objectName)
     else if (objectName == "teapot")
     {
 #ifdef _WIN32
-        objectPath = string(QDir::currentPath().toStdString() + "\\obj\\teapotR90.obj");
+        objectPath = string(QDir::currentPath().toStdString() + "\\obj\\teapot.obj");
 #endif
 
 #ifdef __gnu_linux__
-        objectPath = QDir::currentPath().toStdString() + string("/obj/teapotR90.obj");
+        objectPath = QDir::currentPath().toStdString() + string("/obj/teapot.obj");
 #endif
 
 #if defined(__APPLE__) && defined(__MACH__)
-        objectPath = QDir::currentPath().toStdString() + string("/../../../obj/teapotR90.obj");
+        objectPath = QDir::currentPath().toStdString() + string("/../../../obj/teapot.obj");
 #endif
     }
     else if (objectName == "teapot-low")
     {
 #ifdef _WIN32
-        objectPath = string(QDir::currentPath().toStdString() + "\\obj\\teapot-lowR90.obj");
+        objectPath = string(QDir::currentPath().toStdString() + "\\obj\\teapot-low.obj");
 #endif
 
 #ifdef __gnu_linux__
-        objectPath = QDir::currentPath().toStdString() + string("/obj/teapot-lowR90.obj");
+        objectPath = QDir::currentPath().toStdString() + string("/obj/teapot-low.obj");
 #endif
 
 #if defined(__APPLE__) && defined(__MACH__)
-        objectPath = QDir::currentPath().toStdString() + string("/../../../obj/teapot-lowR90.obj");
+        objectPath = QDir::currentPath().toStdString() + string("/../../../obj/teapot-low.obj");
 #endif
     }
+    else if (QFileInfo(QString::fromStdString(objectName)).isFile())
+    {
+        //Any other mesh file (.off, .obj, .ply or .stl)
+        objectPath = objectName;
+    }
     else
     {
-        cerr << objectName << ".off does not exist";
+        cerr << objectName << " does not exist" << endl;
     }
 
     return objectPath;
 }
 
-void Object::loadMesh()
+QMatrix4x4 Object::loadTransform(const string &objectName)
 {
-    if (m_objectName == "teapot" || m_objectName == "teapot-low")
+    QMatrix4x4 transform;
+
+    if (objectName == "teapot" || objectName == "teapot-low")
     {
-        m_mesh.objReader();
+        //Rotation by -90 degrees : (x, y, z) -> (x, z, -y)
+        transform.rotate(-90.0, 1.0, 0.0, 0.0);
+    }
+
+    return transform;
+}
+
+bool Object::loadMesh(const QMatrix4x4 &bakeTransform, const LoadProgress &progress)
+{
+    //The reader is chosen from the extension of the file
+    QString extension = QFileInfo(QString::fromStdString(m_asset->mesh.getFileName())).suffix().toLower();
+
+    LoadProgress readProgress = stepProgress(progress, 0, 30);
+    bool meshRead = true;
+    if (extension == "obj")
+    {
+        meshRead = m_asset->mesh.objReader(readProgress);
+    }
+    else if (extension == "ply")
+    {
+        meshRead = m_asset->mesh.plyReader(readProgress);
+    }
+    else if (extension == "stl")
+    {
+        meshRead = m_asset->mesh.stlReader(readProgress);
     }
     else
     {
-        m_mesh.offReader();
-        m_mesh.setTextureCoordinates();
+        meshRead = m_asset->mesh.offReader(readProgress);
+        if (meshRead)
+            m_asset->mesh.setTextureCoordinates();
     }
 
-    m_mesh.centerMesh();
+    //A cancelled read is not an error
+    if (!reportProgress(progress, 30))
+        return false;
+
+    //The caller keeps its current object (see GLDisplay::objectLoaded)
+    if (!meshRead)
+    {
+        m_loadError = "Could not read the mesh file : " + m_asset->mesh.getFileName();
+        return false;
+    }
+
+    if (!bakeTransform.isIdentity())
+        m_asset->mesh.transform(bakeTransform);
+
+    m_asset->mesh.computeTangents();
+    m_asset->mesh.centerMesh();
+
+    if (!reportProgress(progress, 40))
+        return false;
+
+    if (m_optimizeMesh)
+    {
+        if (!m_asset->mesh.optimize(OVERDRAW_CACHE_THRESHOLD, stepProgress(progress, 40, 55)))
+            return false;
+
+        m_asset->mesh.buildMeshlets();
+
+        if (!reportProgress(progress, 60))
+            return false;
+    }
+
+    if (!m_asset->mesh.buildLevelsOfDetail(stepProgress(progress, 60, 80)))
+        return false;
+
+    return reportProgress(progress, 80);
+}
+
+void Object::computeBoundingSphere()
+{
+    QVector<QVector3D> vertices = m_asset->mesh.getVertices();
+
+    //Center of the bounding box and farthest vertex from it
+    QVector3D minimum, maximum;
+    MeshKernels::computeBounds(vertices.constData(), vertices.size(), minimum, maximum);
+
+    QVector3D center = 0.5 * (minimum + maximum);
+    float radius = 0.0;
+    for (int v = 0; v < vertices.size(); ++v)
+    {
+        radius = qMax(radius, (vertices[v] - center).length());
+    }
+
+    m_asset->boundingSphereCenter = center;
+    m_asset->boundingSphereRadius = radius;
+}
+
+void Object::buildBVH()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QSharedPointer<MeshBVH> bvh(new MeshBVH());
+    bvh->build(m_asset->mesh.getIndicesArray(), m_asset->mesh.getVertices());
+    m_asset->bvh = bvh;
+
+    qDebug() << "BVH of" << QString::fromStdString(m_asset->mesh.getFileName()) << ":" << bvh->getNumberOfTriangles() << "triangles,"
+             << bvh->getNumberOfNodes() << "nodes, depth" << bvh->getDepth() << ", built in" << timer.elapsed() << "ms";
+}
+
+/**
+ * Returns true if the ray meets the sphere with a parameter in [0, maximumDistance].
+ */
+static bool intersectSphere(const QVector3D &origin, const QVector3D &direction, const QVector3D &center, float radius,
+                            float maximumDistance)
+{
+    //Closest point of the segment to the center of the sphere
+    float distance = QVector3D::dotProduct(center - origin, direction) / QVector3D::dotProduct(direction, direction);
+    distance = qMin(qMax(distance, 0.0f), maximumDistance);
+
+    return (origin + distance * direction - center).lengthSquared() <= radius * radius;
+}
+
+bool Object::intersect(const QVector3D &origin, const QVector3D &direction, RayHit &hit) const
+{
+    if (m_asset->bvh.isNull())
+        return false;
+
+    //The ray parameter is the same in the object space
+    QMatrix4x4 inverseModelMatrix = m_modelMatrix.inverted();
+    QVector3D objectOrigin = inverseModelMatrix.map(origin);
+    QVector3D objectDirection = inverseModelMatrix.mapVector(direction);
+
+    //An object that is not instanced is a single copy with the identity transform
+    QVector<QMatrix4x4> transforms = m_instances.isNull() ? QVector<QMatrix4x4>(1) : m_instances->getTransforms();
+
+    bool isHit = false;
+    for (int k = 0; k < transforms.size(); ++k)
+    {
+        const QMatrix4x4 &transform = transforms[k];
+        float maximumDistance = isHit ? hit.distance : 1e30f;
+
+        //Copies whose bounding sphere is missed, or is behind the closest hit so far, are skipped
+        float scale = qMax(transform.column(0).toVector3D().length(),
+                           qMax(transform.column(1).toVector3D().length(), transform.column(2).toVector3D().length()));
+        if (!intersectSphere(objectOrigin, objectDirection, transform.map(m_asset->boundingSphereCenter),
+                             scale * m_asset->boundingSphereRadius, maximumDistance))
+            continue;
+
+        //The ray is intersected with the mesh in the space of the copy, the ray parameter is the same there
+        QMatrix4x4 inverseTransform = transform.inverted();
+        RayHit instanceHit;
+        if (m_asset->bvh->intersect(inverseTransform.map(objectOrigin), inverseTransform.mapVector(objectDirection), instanceHit,
+                                    maximumDistance))
+        {
+            instanceHit.instance = m_instances.isNull() ? -1 : k;
+            hit = instanceHit;
+            isHit = true;
+        }
+    }
+
+    if (!isHit)
+        return false;
+
+    QMatrix4x4 instanceModelMatrix = m_modelMatrix * transforms[qMax(hit.instance, 0)];
+    hit.position = instanceModelMatrix.map(hit.position);
+    hit.normal = instanceModelMatrix.inverted().transposed().mapVector(hit.normal).normalized();
+
+    return true;
 }
 
 void Object::setModelMatrix(QMatrix4x4 modelMatrix)
@@ -253,7 +471,7 @@ void Object::setModelMatrix(QMatrix4x4 modelMatrix)
     m_modelMatrix = QMatrix4x4(modelMatrix);
 }
 
-Material Object::getMaterial() const
+const Material &Object::getMaterial() const
 {
     return m_material;
 }
@@ -263,20 +481,43 @@ void Object::setMaterial(Material material)
     m_material = material;
 }
 
-Mesh Object::getMesh() const
+const Mesh &Object::getMesh() const
 {
-    return m_mesh;
+    return m_asset->mesh;
 }
 
 
-QOpenGLBuffer Object::getQtVBO() const
+GLuint Object::getVertexArrayObject() const
 {
-    return m_QtVBO;
+    if (!m_instances.isNull())
+        return m_instances->getVertexArrayObject();
+
+    return m_asset->getVertexArrayObject();
 }
 
-QOpenGLBuffer Object::getIndexBuffer() const
+int Object::getFirstIndex() const
 {
-    return m_QtIndexBuffer;
+    return m_asset->getFirstIndex();
+}
+
+int Object::getGeometryPage() const
+{
+    return m_asset->getGeometryPage();
+}
+
+QVector3D Object::getBoundingSphereCenter() const
+{
+    return m_asset->boundingSphereCenter;
+}
+
+float Object::getBoundingSphereRadius() const
+{
+    return m_asset->boundingSphereRadius;
+}
+
+MeshEncoding Object::getEncoding() const
+{
+    return m_asset->encoding;
 }
 
 int Object::getVertexOffset() const
@@ -294,6 +535,11 @@ int Object::getNormalsOffset() const
     return m_normalsOffset;
 }
 
+int Object::getTangentsOffset() const
+{
+    return m_tangentsOffset;
+}
+
 QMatrix4x4 Object::getModelMatrix() const
 {
     return m_modelMatrix;
@@ -319,3 +565,8 @@ std::string Object::getObjectName() const
 {
     return m_objectName;
 }
+
+bool Object::isMeshOptimized() const
+{
+    return m_optimizeMesh;
+}
@@ -27,6 +27,10 @@
 #define OBJECT_H
 
 #include "opengl/mesh.h"
+#include "opengl/meshasset.h"
+#include "opengl/instancebuffer.h"
+#include "opengl/meshencoding.h"
+#include "opengl/meshbvh.h"
 #include "opengl/material.h"
 #include "opengl/texture.h"
 
@@ -35,7 +39,9 @@
 #include <QMatrix4x4>
 #include <QOpenGLBuffer>
 #include <QObject>
+#include <QSharedPointer>
 
+#include <functional>
 #include <string>
 #include <sstream>
 
@@ -45,14 +51,67 @@ public:
     Object();
 
     /**
-     * Loads an object just from its name.
+     * Loads an object just from its name and uploads its buffers. The OpenGL context must be current.
      * @brief Object::Object
      * @param objectName
+     * @param optimizeMesh reorder the triangles and vertices of the mesh for the GPU (see Mesh::optimize)
+     * @param meshAssets if not null, the geometry is shared with the other objects of the same mesh file
      */
-    Object(std::string objectName);
+    Object(std::string objectName, bool optimizeMesh = true, MeshAssetCache *meshAssets = 0);
 
     ~Object();
 
+    /**
+     * Reason of the failure of the last load, empty if it succeeded or was cancelled.
+     * @brief getLoadError
+     * @return
+     */
+    std::string getLoadError() const;
+
+    /**
+     * Loads, processes and encodes the mesh of an object without any OpenGL call : it can run on a worker thread.
+     * The progress is reported between the steps of the processing, which is where a load can be cancelled.
+     * When the mesh asset cache already holds the geometry of the mesh file, nothing is loaded.
+     * @brief load
+     * @param objectName
+     * @param optimizeMesh
+     * @param meshAssets can be null
+     * @param progress
+     * @return false if the load was cancelled or failed (see getLoadError)
+     */
+    bool load(const std::string &objectName, bool optimizeMesh, MeshAssetCache *meshAssets = 0,
+              const LoadProgress &progress = LoadProgress());
+
+    /**
+     * Creates the vertex and index buffers from the data encoded by load, unless the mesh asset already has them,
+     * and the instance buffer. The OpenGL context must be current.
+     * @brief uploadBuffers
+     */
+    void uploadBuffers();
+
+    /**
+     * Draws the object as several copies of its mesh in a single instanced draw call (see InstanceBuffer).
+     * The instance buffer is created by the next uploadBuffers.
+     * @brief setInstances
+     * @param transforms model matrices of the copies, relative to the model matrix of the object. Empty to draw the object once.
+     * @param colors colours of the copies, can be empty
+     */
+    void setInstances(const QVector<QMatrix4x4> &transforms, const QVector<QVector4D> &colors = QVector<QVector4D>());
+
+    /**
+     * Number of copies drawn with instancing, 0 if the object is not instanced.
+     * @brief getNumberOfInstances
+     * @return
+     */
+    int getNumberOfInstances() const;
+
+    /**
+     * Instances of the object, null if it is not instanced.
+     * @brief getInstances
+     * @return
+     */
+    QSharedPointer<InstanceBuffer> getInstances() const;
+
     void resetModelMatrix();
 
 
@@ -71,7 +130,8 @@ public:
     void scale(float scalingFactor);
 
     /**
-   * Function that returns the path of the .off file corresponding to the object.
+   * Function that returns the path of the mesh file corresponding to the object.
+   * The object name is either one of the predefined objects or the path of a .off, .obj, .ply or .stl file.
    * Also sets the texture coordinates
    * @brief loadPath
    * @param objectName
@@ -79,12 +139,48 @@ public:
    */
     std::string loadPath(std::string &objectName);
 
+    /**
+     * Transform baked in the mesh of the object when it is loaded : the teapots are modelled with the z axis up
+     * and are rotated by -90 degrees around the x axis so that they stand on the y axis.
+     * @brief loadTransform
+     * @param objectName
+     * @return the identity for the other objects
+     */
+    static QMatrix4x4 loadTransform(const std::string &objectName);
+
 
     /**
-     * Loads the mesh.
+     * Reads the source file of the mesh, computes its tangents, optimizes the mesh and splits it in meshlets if requested
+     * and builds its levels of detail. The mesh cache is written by load, once the buffers are encoded.
      * @brief loadMesh
+     * @param bakeTransform transform applied to the mesh read from the source file (see Mesh::transform)
+     * @param progress
+     * @return false if the load was cancelled or the source file could not be read (m_loadError is then set)
+     */
+    bool loadMesh(const QMatrix4x4 &bakeTransform, const LoadProgress &progress = LoadProgress());
+
+    /**
+     * Computes a sphere enclosing the mesh, used to select its level of detail.
+     * @brief computeBoundingSphere
+     */
+    void computeBoundingSphere();
+
+    /**
+     * Builds the BVH of the triangles of the mesh, used by intersect.
+     * @brief buildBVH
+     */
+    void buildBVH();
+
+    /**
+     * Intersects a ray in the world space with the triangles of the object, and of each of its instances if it is instanced.
+     * The position and the normal of the hit are in the world space and the distance is along the world space direction.
+     * @brief intersect
+     * @param origin
+     * @param direction
+     * @param hit
+     * @return true if the object is hit
      */
-    void loadMesh();
+    bool intersect(const QVector3D &origin, const QVector3D &direction, RayHit &hit) const;
 
     void setModelMatrix(QMatrix4x4 modelMatrix);
 
@@ -92,17 +188,48 @@ public:
     void rotateY(int angleY);
     void rotateZ(int angleZ);
 
-    Mesh getMesh() const;
-    Material getMaterial() const;
-    QOpenGLBuffer getQtVBO() const;
-    QOpenGLBuffer getIndexBuffer() const;
+    const Mesh &getMesh() const;
+    const Material &getMaterial() const;
+
+    /**
+     * Formats of the vertex and index buffers (see MeshEncoding).
+     * @brief getEncoding
+     * @return
+     */
+    MeshEncoding getEncoding() const;
+
+    QVector3D getBoundingSphereCenter() const;
+    float getBoundingSphereRadius() const;
 
     void setMaterial(Material material);
 
+    /**
+     * Vertex array object binding the buffers of the object to the attribute locations (see MeshAsset::buildVertexArray),
+     * the one of the instance buffer for an instanced object, 0 if the buffers are not uploaded.
+     * @brief getVertexArrayObject
+     * @return
+     */
+    GLuint getVertexArrayObject() const;
+
+    /**
+     * Offset of the indices of the mesh in the index buffer of the vertex array object (see MeshAsset::getFirstIndex).
+     * @brief getFirstIndex
+     * @return
+     */
+    int getFirstIndex() const;
+
+    /**
+     * Page of the geometry arena holding the mesh, -1 if the mesh has buffers of its own.
+     * @brief getGeometryPage
+     * @return
+     */
+    int getGeometryPage() const;
+
     int getVertexOffset() const;
     int getIndicesOffset() const;
     int getTextureCoordinatesOffset() const;
     int getNormalsOffset() const;
+    int getTangentsOffset() const;
 
     QMatrix4x4 getModelMatrix() const;
     int getRotationX() const;
@@ -110,23 +237,31 @@ public:
     int getRotationZ() const;
 
     std::string getObjectName() const;
+    bool isMeshOptimized() const;
 
 private:
     std::string m_objectName;
-    Mesh m_mesh;
     Material m_material;
-    QOpenGLBuffer m_QtVBO;
-    QOpenGLBuffer m_QtIndexBuffer;
+
+    //Mesh, BVH and buffers, shared by the copies of the object and the objects of the same mesh file
+    QSharedPointer<MeshAsset> m_asset;
+
+    //Per instance transforms and colours, shared by the copies of the object
+    QSharedPointer<InstanceBuffer> m_instances;
 
     int m_vertexOffset;
     int m_texturesCoordsOffset;
     int m_normalsOffset;
+    int m_tangentsOffset;
 
     QMatrix4x4 m_modelMatrix;
     int m_rotationX;
     int m_rotationY;
     int m_rotationZ;
 
+    bool m_optimizeMesh;
+
+    std::string m_loadError;
 };
 
 #endif // OBJECT_H
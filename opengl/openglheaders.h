@@ -29,5 +29,6 @@
 #include <QtOpenGL>
 #include <QOpenGLContext>
 #include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
 
 #endif // OPENGLHEADERS_H
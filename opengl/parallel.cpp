@@ -0,0 +1,103 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/parallel.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+int numberOfWorkerThreads()
+{
+    //hardware_concurrency may return 0 when the number of cores cannot be determined
+    static const int numberOfThreads = max(1, (int)thread::hardware_concurrency());
+    return numberOfThreads;
+}
+
+LoadProgress stepProgress(const LoadProgress &progress, int firstPercent, int lastPercent)
+{
+    if (!progress)
+        return LoadProgress();
+
+    return [=](int percent)
+    {
+        return progress(firstPercent + (lastPercent - firstPercent) * percent / 100);
+    };
+}
+
+ParallelProgress::ParallelProgress(const LoadProgress &progress, long long totalWork) : m_progress(progress),
+m_totalWork(max(1LL, totalWork)), m_work(0), m_cancelled(false)
+{
+
+}
+
+bool ParallelProgress::add(long long work)
+{
+    long long workDone = m_work.fetch_add(work) + work;
+
+    if (m_progress && !m_progress((int)(100 * min(workDone, m_totalWork) / m_totalWork)))
+        m_cancelled.store(true);
+
+    return !isCancelled();
+}
+
+bool ParallelProgress::isCancelled() const
+{
+    return m_cancelled.load();
+}
+
+void parallelFor(int count, const function<void(int, int)> &body, int minimumBlockSize)
+{
+    if (count <= 0)
+        return;
+
+    int numberOfBlocks = min(numberOfWorkerThreads(), max(1, count / max(1, minimumBlockSize)));
+
+    if (numberOfBlocks == 1)
+    {
+        body(0, count);
+        return;
+    }
+
+    //The calling thread processes the last block itself
+    vector<thread> workers;
+    workers.reserve(numberOfBlocks - 1);
+
+    for (int k = 0; k < numberOfBlocks - 1; ++k)
+    {
+        int begin = (int)((long long)count * k / numberOfBlocks);
+        int end = (int)((long long)count * (k + 1) / numberOfBlocks);
+        workers.push_back(thread(body, begin, end));
+    }
+
+    body((int)((long long)count * (numberOfBlocks - 1) / numberOfBlocks), count);
+
+    for (unsigned int k = 0; k < workers.size(); ++k)
+    {
+        workers[k].join();
+    }
+}
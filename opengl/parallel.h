@@ -0,0 +1,116 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <functional>
+
+//The long serial loops report their progress every this number of iterations
+#define PROGRESS_INTERVAL 65536
+
+/**
+ * Receives the progress of a long operation (e.g. a load) in percent. Returns false to cancel the operation.
+ * The operations split with parallelFor call it from their threads : it must be thread safe.
+ */
+typedef std::function<bool(int)> LoadProgress;
+
+/**
+ * Calls progress if it is set.
+ * @brief reportProgress
+ * @param progress
+ * @param percent
+ * @return false if the operation is cancelled
+ */
+inline bool reportProgress(const LoadProgress &progress, int percent)
+{
+    return !progress || progress(percent);
+}
+
+/**
+ * Progress of a step of an operation, that goes from firstPercent to lastPercent of the whole operation.
+ * @brief stepProgress
+ * @param progress
+ * @param firstPercent
+ * @param lastPercent
+ * @return an empty function if progress is empty
+ */
+LoadProgress stepProgress(const LoadProgress &progress, int firstPercent, int lastPercent);
+
+/**
+ * Progress of work shared between the blocks of parallelFor : each block adds the work it has done as it goes,
+ * the total is reported in percent. Once the operation is cancelled, every block sees it at its next call to add or isCancelled
+ * and can stop there.
+ * @brief The ParallelProgress class
+ */
+class ParallelProgress
+{
+public:
+    /**
+     * @brief ParallelProgress
+     * @param progress can be empty
+     * @param totalWork
+     */
+    ParallelProgress(const LoadProgress &progress, long long totalWork);
+
+    /**
+     * Adds work done and reports the progress.
+     * @brief add
+     * @param work
+     * @return false if the operation is cancelled
+     */
+    bool add(long long work);
+    bool isCancelled() const;
+
+private:
+    ParallelProgress(const ParallelProgress &);
+    ParallelProgress &operator=(const ParallelProgress &);
+
+    LoadProgress m_progress;
+    long long m_totalWork;
+    std::atomic<long long> m_work;
+    std::atomic<bool> m_cancelled;
+};
+
+/**
+ * Returns the number of threads used by parallelFor (at least 1).
+ * @brief numberOfWorkerThreads
+ * @return
+ */
+int numberOfWorkerThreads();
+
+/**
+ * Splits the range [0, count) into contiguous blocks and calls body(begin, end) for each block.
+ * The blocks are processed concurrently, one per core. Ranges smaller than minimumBlockSize
+ * are processed on the calling thread. The function returns once every block is done.
+ * @brief parallelFor
+ * @param count
+ * @param body
+ * @param minimumBlockSize
+ */
+void parallelFor(int count, const std::function<void(int, int)> &body, int minimumBlockSize = 4096);
+
+#endif // PARALLEL_H
@@ -0,0 +1,441 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/rendergraph.h"
+
+#include <QDomDocument>
+#include <QHash>
+#include <QtMath>
+
+using namespace std;
+
+static RenderPassInput makeInput(const QString &resource, const QString &sampler)
+{
+    RenderPassInput input;
+    input.resource = resource;
+    input.sampler = sampler;
+    input.textureUnit = -1;
+    input.framebuffer = -1;
+    return input;
+}
+
+static RenderPass makePass(const QString &name, RenderPassType type, const QString &output)
+{
+    RenderPass pass;
+    pass.name = name;
+    pass.type = type;
+    pass.output = output;
+    pass.format = FRAMEBUFFER_8UC3;
+    pass.scale = 1.0;
+    pass.userTextures = true;
+    pass.framebuffer = -1;
+    return pass;
+}
+
+RenderGraph::RenderGraph(FrameBufferPool *framebufferPool) : m_passes(), m_schedule(), m_slots(), m_framebuffers(),
+m_framebufferPool(framebufferPool), m_baseWidth(0), m_baseHeight(0), m_numberOfTransientTextures(0)
+{
+    QString error;
+    this->setPasses(RenderGraph::getDefaultPasses(), error);
+}
+
+QVector<RenderPass> RenderGraph::getDefaultPasses()
+{
+    QVector<RenderPass> passes;
+
+    passes.push_back(makePass("scene", RENDER_PASS_SCENE, "sceneColor"));
+
+    RenderPass postProcess = makePass("postprocess", RENDER_PASS_DISPLAY, "finalResult");
+    postProcess.inputs.push_back(makeInput("sceneColor", "textureRendered"));
+    passes.push_back(postProcess);
+
+    //Simplified pipeline for better speed
+    RenderPass present = makePass("present", RENDER_PASS_DISPLAY, RENDER_GRAPH_SCREEN);
+    present.inputs.push_back(makeInput("finalResult", "textureRendered"));
+    present.userTextures = false;
+    passes.push_back(present);
+
+    return passes;
+}
+
+bool RenderGraph::parse(const QString &xml, QVector<RenderPass> &passes, QString &error)
+{
+    QDomDocument dom;
+    QString message;
+    int line = 0;
+    if (!dom.setContent(xml, &message, &line))
+    {
+        error = QString("Render graph, line %1 : %2").arg(line).arg(message);
+        return false;
+    }
+
+    passes.clear();
+
+    QDomElement passElement = dom.documentElement().firstChildElement("pass");
+    while (!passElement.isNull())
+    {
+        RenderPass pass = makePass(passElement.attribute("name", QString("pass%1").arg(passes.size())), RENDER_PASS_DISPLAY, QString());
+
+        QString type = passElement.attribute("type", "display");
+        if (type == "scene")
+            pass.type = RENDER_PASS_SCENE;
+        else if (type != "display")
+        {
+            error = QString("Render graph : unknown type \"%1\" of the pass %2").arg(type, pass.name);
+            return false;
+        }
+
+        pass.userTextures = (passElement.attribute("textures", "true") != "false");
+
+        QDomElement inputElement = passElement.firstChildElement("input");
+        while (!inputElement.isNull())
+        {
+            pass.inputs.push_back(makeInput(inputElement.attribute("name"), inputElement.attribute("sampler", "textureRendered")));
+            inputElement = inputElement.nextSiblingElement("input");
+        }
+
+        QDomElement outputElement = passElement.firstChildElement("output");
+        if (outputElement.isNull() || outputElement.attribute("name").isEmpty())
+        {
+            error = QString("Render graph : the pass %1 has no output").arg(pass.name);
+            return false;
+        }
+
+        pass.output = outputElement.attribute("name");
+
+        QString format = outputElement.attribute("format", "8UC3");
+        if (format == "32FC3")
+            pass.format = FRAMEBUFFER_32FC3;
+        else if (format != "8UC3")
+        {
+            error = QString("Render graph : unknown format \"%1\" of the pass %2").arg(format, pass.name);
+            return false;
+        }
+
+        bool ok = true;
+        pass.scale = outputElement.attribute("scale", "1.0").toFloat(&ok);
+        if (!ok || pass.scale <= 0.0)
+        {
+            error = QString("Render graph : invalid scale of the pass %1").arg(pass.name);
+            return false;
+        }
+
+        passes.push_back(pass);
+        passElement = passElement.nextSiblingElement("pass");
+    }
+
+    return true;
+}
+
+bool RenderGraph::setPasses(const QVector<RenderPass> &declaredPasses, QString &error)
+{
+    QVector<RenderPass> passes = declaredPasses;
+    int numberOfPasses = passes.size();
+
+    //Producer of each transient texture
+    QHash<QString, int> producers;
+    bool hasScreenPass = false;
+    for (int p = 0; p < numberOfPasses; ++p)
+    {
+        if (passes[p].output == RENDER_GRAPH_SCREEN)
+        {
+            hasScreenPass = true;
+            continue;
+        }
+
+        if (producers.contains(passes[p].output))
+        {
+            error = QString("Render graph : %1 is written by several passes").arg(passes[p].output);
+            return false;
+        }
+        producers.insert(passes[p].output, p);
+    }
+
+    if (!hasScreenPass)
+    {
+        error = QString("Render graph : no pass writes to the %1").arg(RENDER_GRAPH_SCREEN);
+        return false;
+    }
+
+    //Dependencies : the producers of the inputs of each pass
+    QVector<QVector<int> > consumers(numberOfPasses);
+    QVector<int> numberOfDependencies(numberOfPasses, 0);
+    for (int p = 0; p < numberOfPasses; ++p)
+    {
+        for (int i = 0; i < passes[p].inputs.size(); ++i)
+        {
+            //One texture per sampler : the inputs without a sampler attribute all read textureRendered
+            for (int j = 0; j < i; ++j)
+            {
+                if (passes[p].inputs[j].sampler == passes[p].inputs[i].sampler)
+                {
+                    error = QString("Render graph : the pass %1 binds %2 and %3 to the same sampler %4")
+                            .arg(passes[p].name, passes[p].inputs[j].resource, passes[p].inputs[i].resource, passes[p].inputs[i].sampler);
+                    return false;
+                }
+            }
+
+            int producer = producers.value(passes[p].inputs[i].resource, -1);
+            if (producer < 0)
+            {
+                error = QString("Render graph : no pass writes %1, read by the pass %2").arg(passes[p].inputs[i].resource, passes[p].name);
+                return false;
+            }
+
+            consumers[producer].push_back(p);
+            ++numberOfDependencies[p];
+        }
+    }
+
+    //Culling : only the passes the screen depends on are executed
+    QVector<bool> alive(numberOfPasses, false);
+    QVector<int> stack;
+    for (int p = 0; p < numberOfPasses; ++p)
+    {
+        if (passes[p].output == RENDER_GRAPH_SCREEN)
+        {
+            alive[p] = true;
+            stack.push_back(p);
+        }
+    }
+
+    while (!stack.isEmpty())
+    {
+        int p = stack.back();
+        stack.pop_back();
+
+        for (int i = 0; i < passes[p].inputs.size(); ++i)
+        {
+            int producer = producers.value(passes[p].inputs[i].resource);
+            if (!alive[producer])
+            {
+                alive[producer] = true;
+                stack.push_back(producer);
+            }
+        }
+    }
+
+    //Topological sort (Kahn), in the order of declaration among the ready passes
+    QVector<int> order;
+    QVector<bool> scheduled(numberOfPasses, false);
+    while (order.size() < numberOfPasses)
+    {
+        int next = -1;
+        for (int p = 0; p < numberOfPasses && next < 0; ++p)
+        {
+            if (!scheduled[p] && numberOfDependencies[p] == 0)
+                next = p;
+        }
+
+        if (next < 0)
+        {
+            error = QString("Render graph : the passes have a cycle");
+            return false;
+        }
+
+        scheduled[next] = true;
+        order.push_back(next);
+        for (int c = 0; c < consumers[next].size(); ++c)
+            --numberOfDependencies[consumers[next][c]];
+    }
+
+    QVector<int> schedule;
+    QVector<int> position(numberOfPasses, -1);
+    for (int k = 0; k < order.size(); ++k)
+    {
+        if (alive[order[k]])
+        {
+            position[order[k]] = schedule.size();
+            schedule.push_back(order[k]);
+        }
+    }
+
+    //Lifetime of each transient texture : from its pass to the last pass that reads it
+    QVector<int> lastUse(numberOfPasses, -1);
+    for (int k = 0; k < schedule.size(); ++k)
+    {
+        const RenderPass &pass = passes[schedule[k]];
+        for (int i = 0; i < pass.inputs.size(); ++i)
+            lastUse[producers.value(pass.inputs[i].resource)] = k;
+    }
+
+    //Aliasing : a texture takes the framebuffer of a texture of the same size and format that is no longer read
+    QVector<Slot> framebufferSlots;
+    for (int k = 0; k < schedule.size(); ++k)
+    {
+        RenderPass &pass = passes[schedule[k]];
+        if (pass.output == RENDER_GRAPH_SCREEN)
+            continue;
+
+        int slot = -1;
+        for (int s = 0; s < framebufferSlots.size() && slot < 0; ++s)
+        {
+            if (framebufferSlots[s].lastUse < k && framebufferSlots[s].scale == pass.scale && framebufferSlots[s].format == pass.format)
+                slot = s;
+        }
+
+        if (slot < 0)
+        {
+            Slot newSlot;
+            newSlot.scale = pass.scale;
+            newSlot.format = pass.format;
+            framebufferSlots.push_back(newSlot);
+            slot = framebufferSlots.size() - 1;
+        }
+
+        framebufferSlots[slot].lastUse = lastUse[schedule[k]];
+        pass.framebuffer = slot;
+    }
+
+    for (int k = 0; k < schedule.size(); ++k)
+    {
+        RenderPass &pass = passes[schedule[k]];
+        for (int i = 0; i < pass.inputs.size(); ++i)
+            pass.inputs[i].framebuffer = passes[producers.value(pass.inputs[i].resource)].framebuffer;
+    }
+
+    m_passes = passes;
+    m_schedule = schedule;
+    m_slots = framebufferSlots;
+    m_numberOfTransientTextures = 0;
+    for (int k = 0; k < schedule.size(); ++k)
+    {
+        if (passes[schedule[k]].output != RENDER_GRAPH_SCREEN)
+            ++m_numberOfTransientTextures;
+    }
+
+    //The framebuffers of the previous graph do not match the slots anymore
+    this->release();
+
+    return true;
+}
+
+void RenderGraph::allocate(int baseWidth, int baseHeight)
+{
+    m_baseWidth = baseWidth;
+    m_baseHeight = baseHeight;
+
+    QVector<FrameBufferKey> keys;
+    for (int s = 0; s < m_slots.size(); ++s)
+        keys.push_back(this->getKey(s));
+
+    //The framebuffers of another size are deleted before the new ones are created
+    this->release();
+    m_framebufferPool->trim(keys);
+
+    for (int s = 0; s < keys.size(); ++s)
+        m_framebuffers.push_back(m_framebufferPool->acquire(keys[s]));
+}
+
+void RenderGraph::release()
+{
+    for (int f = 0; f < m_framebuffers.size(); ++f)
+    {
+        if (!m_framebuffers[f].isNull())
+            m_framebufferPool->release(m_framebuffers[f]);
+    }
+
+    m_framebuffers.clear();
+}
+
+FrameBufferKey RenderGraph::getKey(int slot) const
+{
+    FrameBufferKey key;
+    key.width = qMax(qRound(m_baseWidth * m_slots[slot].scale), 1);
+    key.height = qMax(qRound(m_baseHeight * m_slots[slot].scale), 1);
+    key.format = m_slots[slot].format;
+    key.samples = 1;
+    return key;
+}
+
+void RenderGraph::resolveSamplers(const UniformCache &uniforms)
+{
+    for (int p = 0; p < m_passes.size(); ++p)
+    {
+        for (int i = 0; i < m_passes[p].inputs.size(); ++i)
+        {
+            RenderPassInput &input = m_passes[p].inputs[i];
+            int uniform = uniforms.find(input.sampler);
+            input.textureUnit = (uniform >= 0) ? uniforms.getUniform(uniform).textureUnit : -1;
+        }
+    }
+}
+
+const QVector<int> &RenderGraph::getSchedule() const
+{
+    return m_schedule;
+}
+
+int RenderGraph::getNumberOfPasses() const
+{
+    return m_passes.size();
+}
+
+const RenderPass &RenderGraph::getPass(int index) const
+{
+    return m_passes[index];
+}
+
+FrameBuffer *RenderGraph::getFramebuffer(int index) const
+{
+    if (index < 0 || index >= m_framebuffers.size())
+        return 0;
+
+    return m_framebuffers[index].data();
+}
+
+int RenderGraph::getBaseWidth() const
+{
+    return m_baseWidth;
+}
+
+int RenderGraph::getBaseHeight() const
+{
+    return m_baseHeight;
+}
+
+int RenderGraph::getNumberOfCulledPasses() const
+{
+    return m_passes.size() - m_schedule.size();
+}
+
+int RenderGraph::getNumberOfTransientTextures() const
+{
+    return m_numberOfTransientTextures;
+}
+
+int RenderGraph::getNumberOfFramebuffers() const
+{
+    return m_slots.size();
+}
+
+qint64 RenderGraph::getFramebufferMemory() const
+{
+    qint64 memory = 0;
+    for (int f = 0; f < m_framebuffers.size(); ++f)
+        memory += FrameBufferPool::getMemory(this->getKey(f));
+
+    return memory;
+}
@@ -0,0 +1,211 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include "opengl/framebuffer.h"
+#include "opengl/framebufferpool.h"
+#include "opengl/uniformcache.h"
+
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+//Resource of the framebuffer of the widget
+#define RENDER_GRAPH_SCREEN "screen"
+
+/**
+ * Passes of a render graph : the scene drawn with the shader program, or a quad drawn with the display program.
+ */
+enum RenderPassType
+{
+    RENDER_PASS_SCENE,
+    RENDER_PASS_DISPLAY
+};
+
+/**
+ * Texture read by a pass, bound to a sampler of the display program.
+ */
+struct RenderPassInput
+{
+    QString resource;
+    QString sampler;
+
+    //Set by RenderGraph : texture unit of the sampler (-1 if the program does not use it) and framebuffer of the resource
+    int textureUnit;
+    int framebuffer;
+};
+
+/**
+ * Pass of a render graph. The output is the screen or a transient texture of the given format,
+ * whose size is the base resolution of the graph times the scale.
+ */
+struct RenderPass
+{
+    QString name;
+    RenderPassType type;
+    QVector<RenderPassInput> inputs;
+    QString output;
+    FrameBufferFormat format;
+    float scale;
+
+    //The textures of the texture tab are bound, a display pass only
+    bool userTextures;
+
+    //Set by RenderGraph : framebuffer of the output, -1 for the screen
+    int framebuffer;
+};
+
+/**
+ * Passes of a frame, declared in the pipeline XML :
+ *
+ * <graph>
+ *   <pass name="scene" type="scene"><output name="sceneColor" format="8UC3" scale="1.0"/></pass>
+ *   <pass name="postprocess" type="display"><input name="sceneColor" sampler="textureRendered"/><output name="finalResult"/></pass>
+ *   <pass name="present" type="display" textures="false"><input name="finalResult" sampler="textureRendered"/><output name="screen"/></pass>
+ * </graph>
+ *
+ * The graph is compiled at a base resolution : the passes are sorted so that every pass runs after the producers of its inputs,
+ * the passes that do not contribute to the screen are culled, and the transient textures whose lifetimes do not overlap
+ * share a framebuffer, so that chaining passes does not multiply the video memory.
+ * The framebuffers come from a pool : they are recycled when the graph is allocated again at the same resolution.
+ * @brief The RenderGraph class
+ */
+class RenderGraph
+{
+public:
+    RenderGraph(FrameBufferPool *framebufferPool);
+
+    /**
+     * Scene, post-process and presentation : the chain of the default pipeline.
+     * @brief getDefaultPasses
+     * @return
+     */
+    static QVector<RenderPass> getDefaultPasses();
+
+    /**
+     * Reads the passes of a <graph> element.
+     * @brief parse
+     * @param xml
+     * @param passes
+     * @param error set if the graph cannot be read
+     * @return
+     */
+    static bool parse(const QString &xml, QVector<RenderPass> &passes, QString &error);
+
+    /**
+     * Sorts the passes, culls the unused ones and assigns the framebuffers of the transient textures.
+     * Nothing is changed if the graph is invalid (missing producer, resource written twice, sampler bound twice in a pass,
+     * cycle, no pass to the screen).
+     * @brief setPasses
+     * @param passes
+     * @param error
+     * @return
+     */
+    bool setPasses(const QVector<RenderPass> &passes, QString &error);
+
+    /**
+     * Acquires the framebuffers at a base resolution from the pool, the previous ones are released.
+     * The OpenGL context must be current.
+     * @brief allocate
+     * @param baseWidth
+     * @param baseHeight
+     */
+    void allocate(int baseWidth, int baseHeight);
+
+    /**
+     * Texture units of the samplers read by the passes, after each link of the display program.
+     * @brief resolveSamplers
+     * @param uniforms
+     */
+    void resolveSamplers(const UniformCache &uniforms);
+
+    /**
+     * Passes to execute, in order (indices of getPass).
+     * @brief getSchedule
+     * @return
+     */
+    const QVector<int> &getSchedule() const;
+
+    int getNumberOfPasses() const;
+    const RenderPass &getPass(int index) const;
+
+    /**
+     * Framebuffer of a pass or of an input.
+     * @brief getFramebuffer
+     * @param index
+     * @return null for the screen
+     */
+    FrameBuffer *getFramebuffer(int index) const;
+
+    int getBaseWidth() const;
+    int getBaseHeight() const;
+
+    int getNumberOfCulledPasses() const;
+    int getNumberOfTransientTextures() const;
+    int getNumberOfFramebuffers() const;
+
+    /**
+     * Bytes of the colour and depth stencil buffers of the framebuffers.
+     * @brief getFramebufferMemory
+     * @return
+     */
+    qint64 getFramebufferMemory() const;
+
+    /**
+     * Gives the framebuffers back to the pool, e.g. before the OpenGL context is destroyed.
+     * They are acquired again by the next allocate.
+     * @brief release
+     */
+    void release();
+
+private:
+    FrameBufferKey getKey(int slot) const;
+
+    /**
+     * Framebuffer shared by transient textures.
+     */
+    struct Slot
+    {
+        float scale;
+        FrameBufferFormat format;
+
+        //Position in the schedule of the last pass that reads one of its textures
+        int lastUse;
+    };
+
+    QVector<RenderPass> m_passes;
+    QVector<int> m_schedule;
+    QVector<Slot> m_slots;
+    QVector<QSharedPointer<FrameBuffer> > m_framebuffers;
+    FrameBufferPool *m_framebufferPool;
+
+    int m_baseWidth;
+    int m_baseHeight;
+    int m_numberOfTransientTextures;
+};
+
+#endif // RENDERGRAPH_H
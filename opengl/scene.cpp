@@ -27,24 +27,25 @@
 
 using namespace std;
 
-Scene::Scene() : m_objects(QVector<Object>()), m_pointLights(QVector<Light>())
+Scene::Scene() : m_objects(QVector<Object>()), m_pointLights(QVector<Light>()), m_renderList(QVector<DrawRecord>())
 {
 
 
 }
 
-Scene::Scene(string object) : m_objects(QVector<Object>()), m_pointLights(QVector<Light>())
+Scene::Scene(string object, bool optimizeMesh, MeshAssetCache *meshAssets) : m_objects(QVector<Object>()), m_pointLights(QVector<Light>()),
+    m_renderList(QVector<DrawRecord>())
 {
-    buildScene(object);
+    buildScene(object, optimizeMesh, meshAssets);
 }
 
 
 Scene::Scene(QVector<string>& listOfObjectNames, const QVector<Light> &listOfPointLights) :
-    m_objects(QVector<Object>()), m_pointLights(listOfPointLights)
+    m_objects(QVector<Object>()), m_pointLights(listOfPointLights), m_renderList(QVector<DrawRecord>())
 {
     for (int i = 0; i < listOfObjectNames.size(); i++)
     {
-        m_objects.push_back(Object(listOfObjectNames[i]));
+        this->addObject(Object(listOfObjectNames[i]));
     }
 }
 
@@ -63,6 +64,56 @@ void Scene::updateObjectMaterial(int objectID, Material material)
 
 }
 
+void Scene::setInstances(int objectNumber, const QVector<QMatrix4x4> &transforms, const QVector<QVector4D> &colors)
+{
+    if (objectNumber < m_objects.size())
+    {
+        m_objects[objectNumber].setInstances(transforms, colors);
+        m_objects[objectNumber].uploadBuffers();
+        this->updateDrawRecord(objectNumber);
+    }
+}
+
+void Scene::setInstanceGrid(int objectNumber, int gridSize)
+{
+    if (objectNumber >= m_objects.size())
+        return;
+
+    gridSize = qBound(1, gridSize, MAX_INSTANCE_GRID_SIZE);
+
+    QVector<QMatrix4x4> transforms;
+    QVector<QVector4D> colors;
+
+    if (gridSize > 1)
+    {
+        const Object &object = m_objects[objectNumber];
+        QVector3D center = object.getBoundingSphereCenter();
+        float cellSize = 2.0 * object.getBoundingSphereRadius() / gridSize;
+
+        transforms.reserve(gridSize * gridSize);
+        colors.reserve(gridSize * gridSize);
+
+        for (int j = 0; j < gridSize; ++j)
+        {
+            for (int i = 0; i < gridSize; ++i)
+            {
+                //Each copy is scaled down around the center of the object and moved to its cell
+                QVector3D cellCenter = center + cellSize * QVector3D(i - 0.5 * (gridSize - 1), j - 0.5 * (gridSize - 1), 0.0);
+
+                QMatrix4x4 transform;
+                transform.translate(cellCenter);
+                transform.scale(INSTANCE_GRID_SCALE / gridSize);
+                transform.translate(-center);
+
+                transforms.push_back(transform);
+                colors.push_back(QVector4D((float)i / (gridSize - 1), (float)j / (gridSize - 1), 0.5, 1.0));
+            }
+        }
+    }
+
+    this->setInstances(objectNumber, transforms, colors);
+}
+
 void Scene::translateLightSourceX(int lightNumber, float translationX)
 {
     if (lightNumber < m_pointLights.size())
@@ -100,6 +151,7 @@ void Scene::rotateObjectX(int objectNumber, int rotationX)
     if (objectNumber < m_objects.size())
     {
         m_objects[objectNumber].rotateX(rotationX);
+        this->updateDrawRecordMatrices(objectNumber);
     }
 }
 
@@ -108,6 +160,7 @@ void Scene::rotateObjectY(int objectNumber, int rotationY)
     if (objectNumber < m_objects.size())
     {
         m_objects[objectNumber].rotateY(rotationY);
+        this->updateDrawRecordMatrices(objectNumber);
     }
 }
 
@@ -116,12 +169,14 @@ void Scene::rotateObjectZ(int objectNumber, int rotationZ)
     if (objectNumber < m_objects.size())
     {
         m_objects[objectNumber].rotateZ(rotationZ);
+        this->updateDrawRecordMatrices(objectNumber);
     }
 }
 
 void Scene::setModelMatrix(int objectNumber, QMatrix4x4 &matrix)
 {
     m_objects[objectNumber].setModelMatrix(matrix);
+    this->updateDrawRecordMatrices(objectNumber);
 }
 
 void Scene::resetTransformationsObjects()
@@ -130,6 +185,7 @@ void Scene::resetTransformationsObjects()
     {
         //Set the aspect ratio after loading the texture
         m_objects[k].resetModelMatrix();
+        this->updateDrawRecordMatrices(k);
     }
 }
 
@@ -138,9 +194,9 @@ void Scene::setAspectRatiosObjects()
 
 }
 
-void Scene::buildScene(string object)
+void Scene::buildScene(string object, bool optimizeMesh, MeshAssetCache *meshAssets)
 {
-    this->addObject(object);
+    this->addObject(object, optimizeMesh, meshAssets);
 
     //Be careful not to put the light inside the object
     m_pointLights.push_back(Light(QVector4D(0.0, 0.0, LIGHT_POSITION_Z, 1.0), QVector3D(1.0, 1.0, 1.0), 1.0));
@@ -150,12 +206,19 @@ void Scene::buildScene(string object)
 void Scene::removeObjects()
 {
     m_objects.clear();
+    m_renderList.clear();
+}
+
+void Scene::addObject(string object, bool optimizeMesh, MeshAssetCache *meshAssets)
+{
+    this->addObject(Object(object, optimizeMesh, meshAssets));
 }
 
-void Scene::addObject(string object)
+void Scene::addObject(const Object &object)
 {
-    Object newObject = Object(object);
-    m_objects.push_back(newObject);
+    m_objects.push_back(object);
+    m_renderList.push_back(DrawRecord());
+    this->updateDrawRecord(m_objects.size() - 1);
 }
 
 void Scene::resetScene()
@@ -168,7 +231,24 @@ void Scene::resetScene()
     }
 }
 
-QVector<Object> Scene::getObjects()
+bool Scene::pick(const QVector3D &origin, const QVector3D &direction, int &objectNumber, RayHit &hit)
+{
+    objectNumber = -1;
+
+    for (int k = 0; k < m_objects.size(); ++k)
+    {
+        RayHit objectHit;
+        if (m_objects[k].intersect(origin, direction, objectHit) && (objectNumber < 0 || objectHit.distance < hit.distance))
+        {
+            objectNumber = k;
+            hit = objectHit;
+        }
+    }
+
+    return objectNumber >= 0;
+}
+
+const QVector<Object> &Scene::getObjects() const
 {
     return m_objects;
 }
@@ -189,7 +269,59 @@ int Scene::getObjectRotation(int objectNumber, string rotationAxis)
     return rotation;
 }
 
-QVector<Light> Scene::getPointLightSources()
+const QVector<Light> &Scene::getPointLightSources() const
 {
     return m_pointLights;
 }
+
+const QVector<DrawRecord> &Scene::getRenderList() const
+{
+    return m_renderList;
+}
+
+const Material &Scene::getMaterial(int materialSlot) const
+{
+    return m_objects[materialSlot].getMaterial();
+}
+
+void Scene::updateDrawRecord(int objectNumber)
+{
+    const Object &object = m_objects[objectNumber];
+    const Mesh &mesh = object.getMesh();
+    DrawRecord &record = m_renderList[objectNumber];
+
+    record.vertexArrayObject = object.getVertexArrayObject();
+    record.indexType = object.getEncoding().getIndexType();
+    record.numberOfIndices = mesh.getIndicesArray().size();
+    record.firstIndex = object.getFirstIndex();
+    record.geometryPage = object.getGeometryPage();
+    record.materialSlot = objectNumber;
+    record.numberOfInstances = object.getNumberOfInstances();
+
+    QSharedPointer<InstanceBuffer> instances = object.getInstances();
+    if (instances.isNull())
+    {
+        record.boundingSphereCenter = object.getBoundingSphereCenter();
+        record.boundingSphereRadius = object.getBoundingSphereRadius();
+        record.instanceScale = 1.0;
+    }
+    else
+    {
+        record.boundingSphereCenter = instances->getBoundingSphereCenter();
+        record.boundingSphereRadius = instances->getBoundingSphereRadius();
+        record.instanceScale = instances->getMaximumScale();
+    }
+
+    record.levelsOfDetail = mesh.getLevelsOfDetail();
+    record.meshlets = mesh.getMeshlets();
+
+    this->updateDrawRecordMatrices(objectNumber);
+}
+
+void Scene::updateDrawRecordMatrices(int objectNumber)
+{
+    DrawRecord &record = m_renderList[objectNumber];
+
+    record.modelMatrix = m_objects[objectNumber].getModelMatrix();
+    record.encodedModelMatrix = record.modelMatrix * m_objects[objectNumber].getEncoding().getDequantizationMatrix();
+}
@@ -28,18 +28,77 @@
 
 #define LIGHT_POSITION_Z 33.87
 
+//Size of a copy of the object in a grid of instances, relative to the size of its cell
+#define INSTANCE_GRID_SCALE 0.8
+
+//Largest N of the grids of N x N instances (about 100k instances)
+#define MAX_INSTANCE_GRID_SIZE 320
+
 #include "opengl/object.h"
 #include "opengl/light.h"
 
+#include <QMatrix4x4>
 #include <QVector>
 #include <QVector4D>
 
+/**
+ * Everything needed to draw an object, kept up to date by the scene so that rendering a frame
+ * neither copies the objects nor their meshes. The arrays are shared with the mesh asset of the object.
+ */
+struct DrawRecord
+{
+    GLuint vertexArrayObject;
+    GLenum indexType;
+    int numberOfIndices;
+
+    /**
+     * Offset of the indices of the mesh in the index buffer of the VAO, added to the first index of the levels of detail and meshlets.
+     */
+    int firstIndex;
+
+    /**
+     * Page of the geometry arena holding the mesh, -1 if the mesh has buffers of its own (see GeometryArena).
+     */
+    int geometryPage;
+
+    QMatrix4x4 modelMatrix;
+
+    /**
+     * Model matrix applied to the quantized positions of the vertex buffer (see MeshEncoding).
+     */
+    QMatrix4x4 encodedModelMatrix;
+
+    /**
+     * Index of the object whose material is used (see Scene::getMaterial).
+     */
+    int materialSlot;
+
+    /**
+     * Sphere enclosing what is drawn (all the instances for an instanced object), in the space of the object.
+     */
+    QVector3D boundingSphereCenter;
+    float boundingSphereRadius;
+
+    /**
+     * Number of instances drawn with glDrawElementsInstanced, 0 for an object drawn once.
+     */
+    int numberOfInstances;
+
+    /**
+     * Largest scaling of an instance relative to the object, 1 for an object drawn once.
+     */
+    float instanceScale;
+
+    QVector<LevelOfDetail> levelsOfDetail;
+    QVector<Meshlet> meshlets;
+};
+
 class Scene
 {
 public:
 
     Scene();
-    Scene(std::string object);
+    Scene(std::string object, bool optimizeMesh = true, MeshAssetCache *meshAssets = 0);
     Scene(QVector<std::string>& listOfObjectNames, const QVector<Light> &listOfPointLights);
     ~Scene();
 
@@ -70,11 +129,18 @@ public:
      * Build the scene by loading the geometry and setting the light sources.
      * @brief buildScene
      */
-    void buildScene(std::string object);
+    void buildScene(std::string object, bool optimizeMesh = true, MeshAssetCache *meshAssets = 0);
 
     void removeObjects();
 
-    void addObject(std::string object);
+    void addObject(std::string object, bool optimizeMesh = true, MeshAssetCache *meshAssets = 0);
+
+    /**
+     * Adds an object that is already loaded (e.g. by a MeshLoader), its buffers must be uploaded.
+     * @brief addObject
+     * @param object
+     */
+    void addObject(const Object &object);
 
     /**
      * Reset the objects and the lights to their original position
@@ -84,14 +150,69 @@ public:
 
     void updateObjectMaterial(int objectID, Material material);
 
-    QVector<Object> getObjects();
+    /**
+     * Draws an object as several instances (see Object::setInstances) and uploads the instance buffer.
+     * The OpenGL context must be current.
+     * @brief setInstances
+     * @param objectNumber
+     * @param transforms empty to draw the object once
+     * @param colors
+     */
+    void setInstances(int objectNumber, const QVector<QMatrix4x4> &transforms, const QVector<QVector4D> &colors = QVector<QVector4D>());
+
+    /**
+     * Replaces an object by a grid of gridSize x gridSize copies in the xy plane, covering the size of the object,
+     * coloured by their position in the grid. A size of 1 draws the object once. The OpenGL context must be current.
+     * @brief setInstanceGrid
+     * @param objectNumber
+     * @param gridSize
+     */
+    void setInstanceGrid(int objectNumber, int gridSize);
+
+
+    /**
+     * Finds the closest object hit by a ray in the world space (see Object::intersect).
+     * @brief pick
+     * @param origin
+     * @param direction unit vector
+     * @param objectNumber the object hit
+     * @param hit
+     * @return true if an object is hit
+     */
+    bool pick(const QVector3D &origin, const QVector3D &direction, int &objectNumber, RayHit &hit);
+
+    const QVector<Object> &getObjects() const;
     int getObjectRotation(int objectNumber, std::string rotationAxis);
 
-    QVector<Light> getPointLightSources();
+    const QVector<Light> &getPointLightSources() const;
+
+    /**
+     * One draw record per object, in the order of the objects. It is only updated when the objects change.
+     * @brief getRenderList
+     * @return
+     */
+    const QVector<DrawRecord> &getRenderList() const;
+
+    const Material &getMaterial(int materialSlot) const;
 
 private:
+    /**
+     * Updates the draw record of an object after the object changed.
+     * @brief updateDrawRecord
+     * @param objectNumber
+     */
+    void updateDrawRecord(int objectNumber);
+
+    /**
+     * Updates the model matrices of the draw record of an object.
+     * @brief updateDrawRecordMatrices
+     * @param objectNumber
+     */
+    void updateDrawRecordMatrices(int objectNumber);
+
     QVector<Object> m_objects;
     QVector<Light> m_pointLights;
+    QVector<DrawRecord> m_renderList;
 };
 
 #endif // SCENE_H
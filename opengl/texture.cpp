@@ -24,6 +24,7 @@
 ****************************************************************************/
 
 #include "opengl/texture.h"
+#include "opengl/glstatecache.h"
 #include <QDir>
 
 using namespace std;
@@ -54,13 +55,14 @@ void Texture::loadEmptyTexture_8UC3()
     if (glIsTexture(m_textureId) == GL_TRUE)
     {
         glDeleteTextures(1, &m_textureId);
+        GLStateCache::instance().textureDeleted(m_textureId);
     }
 
     //Generate a new texture ID
     glGenTextures(1, &m_textureId);
 
     //Bind the texture and start working on it
-    glBindTexture(GL_TEXTURE_2D, m_textureId);
+    GLStateCache::instance().bindTexture(m_textureId);
 
     //Allocate memory for a width*height texture but without data
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, m_width, m_height, 0, GL_RGB, GL_FLOAT, NULL);
@@ -71,7 +73,7 @@ void Texture::loadEmptyTexture_8UC3()
     //Do not smooth textures that are far away (performance optimisation)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLStateCache::instance().bindTexture(0);
 
     m_isTextureLoaded = true;
 }
@@ -82,13 +84,14 @@ void Texture::loadEmptyTexture_32FC3()
     if (glIsTexture(m_textureId) == GL_TRUE)
     {
         glDeleteTextures(1, &m_textureId);
+        GLStateCache::instance().textureDeleted(m_textureId);
     }
 
     //Generate a new texture ID
     glGenTextures(1, &m_textureId);
 
     //Bind the texture and start working on it
-    glBindTexture(GL_TEXTURE_2D, m_textureId);
+    GLStateCache::instance().bindTexture(m_textureId);
 
     //Allocate memory for a width*height texture but without data
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, m_width, m_height, 0, GL_RGB, GL_FLOAT, NULL);
@@ -99,7 +102,7 @@ void Texture::loadEmptyTexture_32FC3()
     //Do not smooth textures that are far away (performance optimisation)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLStateCache::instance().bindTexture(0);
 
     m_isTextureLoaded = true;
 }
@@ -139,7 +142,7 @@ bool Texture::load_8UC3()
         glGenTextures(1, &m_textureId);
 
         //Bind a texture 2D to the texture
-        glBindTexture(GL_TEXTURE_2D, m_textureId);
+        GLStateCache::instance().bindTexture(m_textureId);
 
         //Send the data to the memory
         //The first GL_RGB says that the data used will be in the RGB format
@@ -162,7 +165,7 @@ bool Texture::load_8UC3()
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
         //Unbind
-        glBindTexture(GL_TEXTURE_2D, 0);
+        GLStateCache::instance().bindTexture(0);
     }
 
     //Texture correctly loaded
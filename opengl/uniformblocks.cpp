@@ -0,0 +1,151 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/uniformblocks.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <cstring>
+
+using namespace std;
+
+UniformBlocks::UniformBlocks() : m_objectData(), m_numberOfObjectData(0), m_objectDataStride(0),
+m_frameDataBuffer(QOpenGLBuffer::VertexBuffer), m_objectDataBuffer(QOpenGLBuffer::VertexBuffer)
+{
+    memset(&m_frameData, 0, sizeof(m_frameData));
+}
+
+void UniformBlocks::bindUniformBlocks(QGLShaderProgram *program, bool &hasFrameData, bool &hasObjectData)
+{
+    hasFrameData = false;
+    hasObjectData = false;
+
+    if (!program->isLinked())
+        return;
+
+    QOpenGLExtraFunctions *f = QOpenGLContext::currentContext()->extraFunctions();
+
+    GLuint frameDataIndex = f->glGetUniformBlockIndex(program->programId(), "FrameData");
+    if (frameDataIndex != GL_INVALID_INDEX)
+    {
+        f->glUniformBlockBinding(program->programId(), frameDataIndex, FRAME_DATA_BINDING);
+        hasFrameData = true;
+    }
+
+    GLuint objectDataIndex = f->glGetUniformBlockIndex(program->programId(), "ObjectData");
+    if (objectDataIndex != GL_INVALID_INDEX)
+    {
+        f->glUniformBlockBinding(program->programId(), objectDataIndex, OBJECT_DATA_BINDING);
+        hasObjectData = true;
+    }
+}
+
+void UniformBlocks::setFrameData(const QMatrix4x4 &projectionMatrix, const QMatrix4x4 &viewMatrix, const QVector4D &lightPosition, int time)
+{
+    //QMatrix4x4 is column major, as the mat4 of std140
+    memcpy(m_frameData.pMatrix, projectionMatrix.constData(), sizeof(m_frameData.pMatrix));
+    memcpy(m_frameData.vMatrix, viewMatrix.constData(), sizeof(m_frameData.vMatrix));
+    m_frameData.lightPosition_camSpace[0] = lightPosition.x();
+    m_frameData.lightPosition_camSpace[1] = lightPosition.y();
+    m_frameData.lightPosition_camSpace[2] = lightPosition.z();
+    m_frameData.lightPosition_camSpace[3] = lightPosition.w();
+    m_frameData.time = time;
+
+    if (!m_frameDataBuffer.isCreated())
+    {
+        m_frameDataBuffer.create();
+        m_frameDataBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+    }
+
+    m_frameDataBuffer.bind();
+    m_frameDataBuffer.allocate(&m_frameData, sizeof(m_frameData));
+    m_frameDataBuffer.release();
+
+    QOpenGLContext::currentContext()->extraFunctions()->glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, m_frameDataBuffer.bufferId());
+}
+
+void UniformBlocks::clearObjectData()
+{
+    //The array keeps its size : no allocation per frame
+    m_numberOfObjectData = 0;
+}
+
+int UniformBlocks::addObjectData(const QMatrix4x4 &modelMatrix, const QMatrix4x4 &modelViewMatrix, const QMatrix3x3 &normalMatrix)
+{
+    if (m_objectDataStride == 0)
+    {
+        GLint alignment = 0;
+        QOpenGLContext::currentContext()->functions()->glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = qMax(alignment, 1);
+        m_objectDataStride = (((int)sizeof(ObjectData) + alignment - 1) / alignment) * alignment;
+    }
+
+    int size = (m_numberOfObjectData + 1) * m_objectDataStride;
+    if (m_objectData.size() < size)
+        m_objectData.resize(qMax(size, 2 * m_objectData.size()));
+
+    ObjectData *objectData = (ObjectData *)(m_objectData.data() + m_numberOfObjectData * m_objectDataStride);
+    memcpy(objectData->mMatrix, modelMatrix.constData(), sizeof(objectData->mMatrix));
+    memcpy(objectData->mvMatrix, modelViewMatrix.constData(), sizeof(objectData->mvMatrix));
+
+    //Each column of a mat3 is padded to a vec4
+    const float *normal = normalMatrix.constData();
+    for (int column = 0; column < 3; ++column)
+    {
+        for (int row = 0; row < 3; ++row)
+            objectData->normalMatrix[4 * column + row] = normal[3 * column + row];
+        objectData->normalMatrix[4 * column + 3] = 0.0;
+    }
+
+    return m_numberOfObjectData++;
+}
+
+void UniformBlocks::uploadObjectData()
+{
+    if (m_numberOfObjectData == 0)
+        return;
+
+    if (!m_objectDataBuffer.isCreated())
+    {
+        m_objectDataBuffer.create();
+        m_objectDataBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+    }
+
+    m_objectDataBuffer.bind();
+    m_objectDataBuffer.allocate(m_objectData.constData(), m_numberOfObjectData * m_objectDataStride);
+    m_objectDataBuffer.release();
+}
+
+void UniformBlocks::bindObjectData(int objectData)
+{
+    QOpenGLContext::currentContext()->extraFunctions()->glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_DATA_BINDING, m_objectDataBuffer.bufferId(),
+                                                                          objectData * m_objectDataStride, sizeof(ObjectData));
+}
+
+int UniformBlocks::getNumberOfObjectData() const
+{
+    return m_numberOfObjectData;
+}
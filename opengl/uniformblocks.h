@@ -0,0 +1,158 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef UNIFORMBLOCKS_H
+#define UNIFORMBLOCKS_H
+
+#include <QByteArray>
+#include <QGLShaderProgram>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QVector4D>
+
+//Binding points of the uniform blocks, set on every program that declares them
+#define FRAME_DATA_BINDING 0
+#define OBJECT_DATA_BINDING 1
+
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER 0x8A11
+#endif
+
+#ifndef GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+#define GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT 0x8A34
+#endif
+
+#ifndef GL_INVALID_INDEX
+#define GL_INVALID_INDEX 0xFFFFFFFFu
+#endif
+
+/**
+ * std140 layout of the FrameData uniform block (160 bytes) :
+ *
+ * layout(std140) uniform FrameData
+ * {
+ *   mat4 pMatrix;
+ *   mat4 vMatrix;
+ *   vec4 lightPosition_camSpace;
+ *   int time;
+ * };
+ */
+struct FrameData
+{
+    GLfloat pMatrix[16];
+    GLfloat vMatrix[16];
+    GLfloat lightPosition_camSpace[4];
+    GLint time;
+    GLint padding[3];
+};
+
+/**
+ * std140 layout of the ObjectData uniform block (176 bytes), a mat3 takes three vec4 columns :
+ *
+ * layout(std140) uniform ObjectData
+ * {
+ *   mat4 mMatrix;
+ *   mat4 mvMatrix;
+ *   mat3 normalMatrix;
+ * };
+ */
+struct ObjectData
+{
+    GLfloat mMatrix[16];
+    GLfloat mvMatrix[16];
+    GLfloat normalMatrix[12];
+};
+
+/**
+ * Uniform buffers of the FrameData and ObjectData blocks, that replace the loose camera, light and transform uniforms.
+ * The frame data is written once per frame. The object data of every draw of a frame is written in one buffer,
+ * at offsets aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, uploaded once and bound per draw with glBindBufferRange.
+ * Both buffers are reallocated (orphaned) at every upload : the driver does not wait for the draws of the previous frame.
+ * @brief The UniformBlocks class
+ */
+class UniformBlocks
+{
+public:
+    UniformBlocks();
+
+    /**
+     * Binds the FrameData and ObjectData blocks of a linked program to their binding points.
+     * @brief bindUniformBlocks
+     * @param program
+     * @param hasFrameData set to true if the program declares the FrameData block
+     * @param hasObjectData set to true if the program declares the ObjectData block
+     */
+    static void bindUniformBlocks(QGLShaderProgram *program, bool &hasFrameData, bool &hasObjectData);
+
+    /**
+     * Uploads the frame data and binds it to FRAME_DATA_BINDING. The OpenGL context must be current.
+     * @brief setFrameData
+     * @param projectionMatrix
+     * @param viewMatrix
+     * @param lightPosition light position in the camera space
+     * @param time
+     */
+    void setFrameData(const QMatrix4x4 &projectionMatrix, const QMatrix4x4 &viewMatrix, const QVector4D &lightPosition, int time);
+
+    void clearObjectData();
+
+    /**
+     * Adds the transforms of a draw to the object data of the frame.
+     * @brief addObjectData
+     * @param modelMatrix
+     * @param modelViewMatrix
+     * @param normalMatrix
+     * @return index of the object data, to bind it with bindObjectData
+     */
+    int addObjectData(const QMatrix4x4 &modelMatrix, const QMatrix4x4 &modelViewMatrix, const QMatrix3x3 &normalMatrix);
+
+    /**
+     * Uploads the object data added since clearObjectData. The OpenGL context must be current.
+     * @brief uploadObjectData
+     */
+    void uploadObjectData();
+
+    /**
+     * Binds an object data of the uploaded buffer to OBJECT_DATA_BINDING.
+     * @brief bindObjectData
+     * @param objectData
+     */
+    void bindObjectData(int objectData);
+
+    int getNumberOfObjectData() const;
+
+private:
+    FrameData m_frameData;
+
+    //Object data of the frame, one every m_objectDataStride bytes
+    QByteArray m_objectData;
+    int m_numberOfObjectData;
+    int m_objectDataStride;
+
+    QOpenGLBuffer m_frameDataBuffer;
+    QOpenGLBuffer m_objectDataBuffer;
+};
+
+#endif // UNIFORMBLOCKS_H
@@ -0,0 +1,204 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#include "opengl/uniformcache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+
+#include <vector>
+
+using namespace std;
+
+static const char *uniformHandleNames[NUMBER_OF_UNIFORM_HANDLES] =
+{
+    "mMatrix",
+    "mvMatrix",
+    "mvMatrixScene",
+    "pMatrix",
+    "normalMatrix",
+    "lightPosition_camSpace",
+    "time",
+    "ambient",
+    "diffuse",
+    "specular",
+    "shininess",
+    "ambientCoefficent",
+    "diffuseCoefficent",
+    "specularCoefficent",
+    "textureRendered",
+    "passIndex"
+};
+
+UniformCache::UniformCache() : m_uniforms(), m_indices(), m_numberOfTextureUnits(0), m_numberOfLookups(0)
+{
+    for (int h = 0; h < NUMBER_OF_UNIFORM_HANDLES; ++h)
+        m_handles[h] = -1;
+}
+
+void UniformCache::build(QGLShaderProgram *program)
+{
+    this->clear();
+
+    if (!program->isLinked())
+        return;
+
+    QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+    GLuint programId = program->programId();
+
+    GLint numberOfUniforms = 0;
+    GLint maximumNameLength = 0;
+    f->glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &numberOfUniforms);
+    f->glGetProgramiv(programId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maximumNameLength);
+    m_numberOfLookups += 2;
+
+    vector<char> name(qMax(maximumNameLength, 1));
+
+    for (GLint u = 0; u < numberOfUniforms; ++u)
+    {
+        UniformInfo uniform;
+        GLsizei nameLength = 0;
+        f->glGetActiveUniform(programId, u, name.size(), &nameLength, &uniform.size, &uniform.type, name.data());
+        uniform.name = QString::fromLatin1(name.data(), nameLength);
+        ++m_numberOfLookups;
+
+        //The members of the uniform blocks have no location
+        uniform.location = f->glGetUniformLocation(programId, name.data());
+        ++m_numberOfLookups;
+        if (uniform.location == -1)
+            continue;
+
+        //An array is reported as its first element
+        if (uniform.name.endsWith("[0]"))
+            uniform.name.chop(3);
+
+        uniform.textureUnit = -1;
+        if (isSamplerType(uniform.type))
+        {
+            uniform.textureUnit = m_numberOfTextureUnits;
+            m_numberOfTextureUnits += uniform.size;
+        }
+
+        m_indices.insert(uniform.name, m_uniforms.size());
+        m_uniforms.push_back(uniform);
+    }
+
+    for (int h = 0; h < NUMBER_OF_UNIFORM_HANDLES; ++h)
+        m_handles[h] = m_indices.value(QString(uniformHandleNames[h]), -1);
+
+    //The texture units are part of the program : they do not change until the next link
+    if (m_numberOfTextureUnits > 0)
+    {
+        program->bind();
+        for (int k = 0; k < m_uniforms.size(); ++k)
+        {
+            const UniformInfo &uniform = m_uniforms[k];
+            if (uniform.textureUnit < 0)
+                continue;
+
+            vector<GLint> units(uniform.size);
+            for (int i = 0; i < uniform.size; ++i)
+                units[i] = uniform.textureUnit + i;
+            f->glUniform1iv(uniform.location, uniform.size, units.data());
+        }
+        program->release();
+    }
+}
+
+void UniformCache::clear()
+{
+    m_uniforms.clear();
+    m_indices.clear();
+    m_numberOfTextureUnits = 0;
+
+    for (int h = 0; h < NUMBER_OF_UNIFORM_HANDLES; ++h)
+        m_handles[h] = -1;
+}
+
+int UniformCache::find(const QString &name) const
+{
+    ++m_numberOfLookups;
+    return m_indices.value(name, -1);
+}
+
+int UniformCache::getNumberOfUniforms() const
+{
+    return m_uniforms.size();
+}
+
+const UniformInfo &UniformCache::getUniform(int index) const
+{
+    return m_uniforms[index];
+}
+
+GLint UniformCache::getLocation(UniformHandle handle) const
+{
+    int index = m_handles[handle];
+    return (index >= 0) ? m_uniforms[index].location : -1;
+}
+
+int UniformCache::getTextureUnit(UniformHandle handle) const
+{
+    int index = m_handles[handle];
+    return (index >= 0) ? m_uniforms[index].textureUnit : -1;
+}
+
+int UniformCache::getNumberOfTextureUnits() const
+{
+    return m_numberOfTextureUnits;
+}
+
+quint64 UniformCache::getNumberOfLookups() const
+{
+    return m_numberOfLookups;
+}
+
+const char *UniformCache::getHandleName(UniformHandle handle)
+{
+    return uniformHandleNames[handle];
+}
+
+bool UniformCache::isSamplerType(GLenum type)
+{
+    switch (type)
+    {
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_1D_SHADOW:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_2D_RECT:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_2D_MULTISAMPLE:
+    case GL_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,152 @@
+/****************************************************************************
+* This is the Computer Graphics Shader Lab.
+*
+* Copyright (c) 2016 Bernhard Kainz, Antoine S Toisoul
+* (b.kainz@imperial.ac.uk, antoine.toisoul13@imperial.ac.uk)
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+****************************************************************************/
+
+#ifndef UNIFORMCACHE_H
+#define UNIFORMCACHE_H
+
+#include <QGLShaderProgram>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+/**
+ * Uniforms set by the application, resolved once per link.
+ */
+enum UniformHandle
+{
+    UNIFORM_M_MATRIX,
+    UNIFORM_MV_MATRIX,
+    UNIFORM_MV_MATRIX_SCENE,
+    UNIFORM_P_MATRIX,
+    UNIFORM_NORMAL_MATRIX,
+    UNIFORM_LIGHT_POSITION,
+    UNIFORM_TIME,
+    UNIFORM_AMBIENT,
+    UNIFORM_DIFFUSE,
+    UNIFORM_SPECULAR,
+    UNIFORM_SHININESS,
+    UNIFORM_AMBIENT_COEFFICIENT,
+    UNIFORM_DIFFUSE_COEFFICIENT,
+    UNIFORM_SPECULAR_COEFFICIENT,
+    UNIFORM_TEXTURE_RENDERED,
+    UNIFORM_PASS_INDEX,
+    NUMBER_OF_UNIFORM_HANDLES
+};
+
+/**
+ * Active uniform of a program.
+ */
+struct UniformInfo
+{
+    QString name;
+    GLenum type;
+    GLint size;
+    GLint location;
+
+    //First texture unit of a sampler, -1 for the other types
+    int textureUnit;
+};
+
+/**
+ * Reflection of the active uniforms of a linked program : names, types, locations and texture units.
+ * It is built once after each link, which also gives every sampler its own texture unit.
+ * The draw path then sets the uniforms through their locations and binds the textures to their units,
+ * without any string lookup or query to the driver. The lookups by name and the driver queries are counted.
+ * @brief The UniformCache class
+ */
+class UniformCache
+{
+public:
+    UniformCache();
+
+    /**
+     * Reflects the uniforms of a program and sets the texture units of its samplers.
+     * The cache is empty if the program is not linked. The OpenGL context must be current.
+     * @brief build
+     * @param program
+     */
+    void build(QGLShaderProgram *program);
+
+    void clear();
+
+    /**
+     * Index of a uniform of the program, from its name. Counted as a lookup : not to be used per frame.
+     * @brief find
+     * @param name
+     * @return -1 if the program has no active uniform of this name
+     */
+    int find(const QString &name) const;
+
+    int getNumberOfUniforms() const;
+    const UniformInfo &getUniform(int index) const;
+
+    /**
+     * Location of a uniform set by the application.
+     * @brief getLocation
+     * @param handle
+     * @return -1 if the program does not use the uniform
+     */
+    GLint getLocation(UniformHandle handle) const;
+
+    /**
+     * Texture unit of a sampler set by the application.
+     * @brief getTextureUnit
+     * @param handle
+     * @return -1 if the program does not use the sampler
+     */
+    int getTextureUnit(UniformHandle handle) const;
+
+    int getNumberOfTextureUnits() const;
+
+    /**
+     * Lookups by name (find) and queries to the driver (build) since the cache was created.
+     * @brief getNumberOfLookups
+     * @return
+     */
+    quint64 getNumberOfLookups() const;
+
+    /**
+     * Name of a uniform set by the application, as declared in the shaders.
+     * @brief getHandleName
+     * @param handle
+     * @return
+     */
+    static const char *getHandleName(UniformHandle handle);
+
+    static bool isSamplerType(GLenum type);
+
+private:
+    QVector<UniformInfo> m_uniforms;
+    QHash<QString, int> m_indices;
+
+    //Index of the uniform of each handle, -1 if it is not active
+    int m_handles[NUMBER_OF_UNIFORM_HANDLES];
+
+    int m_numberOfTextureUnits;
+
+    mutable quint64 m_numberOfLookups;
+};
+
+#endif // UNIFORMCACHE_H
@@ -26,6 +26,7 @@
 #include "GLSLEditorWindow.h"
 #include "qt/GLSLCodeEditor.h"
 #include "qt/GLSLEditorWidget.h"
+#include "opengl/meshasset.h"
 #include <QDir>
 #include <QFileDialog>
 #include <QWidget>
@@ -140,12 +141,30 @@ void GLSLEditorWindow::loadDefaultShaders()
 in vec3 vertex_worldSpace;\n\
 in vec3 normal_worldSpace;\n\
 in vec2 textureCoordinate_input;\n\
+in vec4 tangent_worldSpace; //For normal mapping : bitangent = sign(tangent_worldSpace.w) * cross(normal, tangent)\n\
+//w is a 2 bit normalized value : use its sign, the drivers older than OpenGL 4.2 (e.g. macOS) may not read exactly +/-1\n\
 \n\
-uniform mat4 mvMatrix;\n\
-uniform mat4 pMatrix;\n\
-uniform mat3 normalMatrix; //mv matrix without translation\n\
+//Per instance model matrix, normal matrix and colour (identity and red when the object is not instanced)\n\
+in mat4 instanceMatrix;\n\
+in mat3 instanceNormalMatrix;\n\
+in vec4 instanceColor;\n\
+\n\
+//Per frame camera and light data\n\
+layout(std140) uniform FrameData\n\
+{\n\
+  mat4 pMatrix;\n\
+  mat4 vMatrix;\n\
+  vec4 lightPosition_camSpace; //light Position in camera space\n\
+  int time;\n\
+};\n\
 \n\
-uniform vec4 lightPosition_camSpace; //light Position in camera space\n\
+//Per object transforms\n\
+layout(std140) uniform ObjectData\n\
+{\n\
+  mat4 mMatrix;\n\
+  mat4 mvMatrix;\n\
+  mat3 normalMatrix; //mv matrix without translation\n\
+};\n\
 \n\
 uniform vec4 ambient;\n\
 uniform vec4 diffuse;\n\
@@ -167,12 +186,12 @@ out data\n\
 void main(void)\n\
 {\n\
   //Put the vertex in the correct coordinate system by applying the model view matrix\n\
-  vec4 vertex_camSpace = mvMatrix*vec4(vertex_worldSpace,1.0f); \n\
+  vec4 vertex_camSpace = mvMatrix*instanceMatrix*vec4(vertex_worldSpace,1.0f); \n\
   vertexInOut.position_camSpace = vertex_camSpace;\n\
   \n\
   //Apply the model-view transformation to the normal (only rotation, no translation)\n\
   //Normals put in the camera space\n\
-  vertexInOut.normal_camSpace = normalize(normalMatrix*normal_worldSpace);\n\
+  vertexInOut.normal_camSpace = normalize(normalMatrix*instanceNormalMatrix*normal_worldSpace);\n\
   \n\
   //we need to make sure that the normals and texture coordinates\n\
   //aren't optimised away, \n\
@@ -183,9 +202,9 @@ void main(void)\n\
   vec4 workaround = \n\
 		vec4((vertexInOut.normal_camSpace.x + textureCoordinate_input.x)*0.0001, 0, 0, 1);\n\
   \n\
-  //forwarding pure red as RGBA color\n\
+  //forwarding the colour of the instance as RGBA color (pure red by default)\n\
   //Try to use the normals as RGB color or the texture coordiantes!\n\
-  vertexInOut.color = vec4(1.0, 0.0, 0.0, 1.0);\n\
+  vertexInOut.color = instanceColor;\n\
   \n\
   //a negligible contribution from normals and texcoords is added \n\
   //to ensure these array objects are not optimsed away \n\
@@ -200,13 +219,22 @@ void main(void)\n\
 layout(triangles) in;\n\
 layout(triangle_strip, max_vertices = 3) out;\n\
 \n\
-uniform mat4 mvMatrix;\n\
-uniform mat4 pMatrix;\n\
-uniform mat3 normalMatrix; //mv matrix without translation\n\
-\n\
-uniform vec4 lightPosition_camSpace; //light Position in camera space\n\
+//Per frame camera and light data\n\
+layout(std140) uniform FrameData\n\
+{\n\
+  mat4 pMatrix;\n\
+  mat4 vMatrix;\n\
+  vec4 lightPosition_camSpace; //light Position in camera space\n\
+  int time;\n\
+};\n\
 \n\
-uniform int time;\n\
+//Per object transforms\n\
+layout(std140) uniform ObjectData\n\
+{\n\
+  mat4 mMatrix;\n\
+  mat4 mvMatrix;\n\
+  mat3 normalMatrix; //mv matrix without translation\n\
+};\n\
 \n\
 in data\n\
 {\n\
@@ -244,7 +272,14 @@ uniform float ambientCoefficent;\n\
 uniform float diffuseCoefficent;\n\
 uniform float specularCoefficent;\n\
 \n\
-uniform vec4 lightPosition_camSpace; //light Position in camera space\n\
+//Per frame camera and light data\n\
+layout(std140) uniform FrameData\n\
+{\n\
+  mat4 pMatrix;\n\
+  mat4 vMatrix;\n\
+  vec4 lightPosition_camSpace; //light Position in camera space\n\
+  int time;\n\
+};\n\
 \n\
 in fragmentData\n\
 {\n\
@@ -307,6 +342,10 @@ void main(void)\n\
 
 void GLSLEditorWindow::linkShader()
 {
+    //The VAOs of the meshes use fixed attribute locations
+    MeshAsset::bindAttributeLocations(m_shaderProgramDisplay);
+    MeshAsset::bindAttributeLocations(m_shaderProgram);
+
     bool displayShaderValid = false;
     if (!m_shaderProgramDisplay->link())
     {
@@ -517,6 +556,7 @@ bool GLSLEditorWindow::savePipeline(QString& fileName)
         out << T2TFragEditor->getShaderCode();
         out << "\n]]>";
         out << "</R2TFrag>\n";
+        out << m_renderGraphXml;
         out << "</pipeline>\n";
 
 #ifndef QT_NO_CURSOR
@@ -559,23 +599,39 @@ bool GLSLEditorWindow::loadPipeline()
 
 
         QDomElement domElement = dom.documentElement();
-        QDomNode node = domElement.firstChild();
+        QDomElement element = domElement.firstChildElement();
+
+        //Tab of each shader
+        QStringList shaderTags;
+        shaderTags << "vertex" << "geom" << "frag" << "R2TVert" << "R2TFrag";
 
         //Read the child one by one
-        int i = 0;
-        while (!node.isNull())
+        m_renderGraphXml.clear();
+        while (!element.isNull())
         {
-            //Current node
-            QDomElement element = node.toElement();
-
-            GLSLEditorWidget* sEdit = static_cast<GLSLEditorWidget*>(ui->EditorTabWidget->widget(i));
-            QString shaderCode = element.text();
-            sEdit->setShaderCode(shaderCode);
-            sEdit->updateShaderSource();
-            node = node.nextSibling();
-            ++i;
+            int i = shaderTags.indexOf(element.tagName());
+            if (i >= 0)
+            {
+                GLSLEditorWidget* sEdit = static_cast<GLSLEditorWidget*>(ui->EditorTabWidget->widget(i));
+                QString shaderCode = element.text();
+                sEdit->setShaderCode(shaderCode);
+                sEdit->updateShaderSource();
+            }
+            else if (element.tagName() == "graph")
+            {
+                QTextStream out(&m_renderGraphXml);
+                element.save(out, 4);
+            }
+            else
+            {
+                emit updateLog(QString("Unknown element <%1> in the pipeline").arg(element.tagName()));
+            }
+
+            element = element.nextSiblingElement();
         }
 
+        emit updateRenderGraph(m_renderGraphXml);
+
         //Close the document
         xmlDocument.close();
     }
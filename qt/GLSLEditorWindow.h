@@ -76,6 +76,12 @@ signals:
     */
     void updateShaderProgram();
 
+    /**
+    * Sets the render graph of the loaded pipeline, empty for the default graph.
+    * @brief updateRenderGraph
+    */
+    void updateRenderGraph(QString);
+
     public slots:
     void compileAndLink();
     bool savePipelineAction();
@@ -105,6 +111,9 @@ private:
     QGLShaderProgram* m_shaderProgram;
     QGLShaderProgram* m_shaderProgramDisplay;
     QString pipelineFileName;
+
+    //<graph> element of the loaded pipeline, saved back with the shaders
+    QString m_renderGraphXml;
 };
 
 #endif
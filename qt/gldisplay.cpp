@@ -29,17 +29,32 @@
 #include <QApplication>
 #include <QDesktopWidget>
 #include <QSize>
+#include <QElapsedTimer>
+#include <QFileInfo>
 #include <cstddef>
 
 using namespace std;
 
 GLDisplay::GLDisplay(QWidget *parent) : QOpenGLWidget(parent),
+m_framebufferPool(), m_renderGraph(&m_framebufferPool), m_resizeFramebuffers(false), m_sceneWidth(0), m_sceneHeight(0),
 m_cameraScene(Camera()), m_cameraQuad(Camera()),
 m_mousePos(0, 0),
 m_lastFPSUpdate(0), m_frameCounter(0), m_FPS(0),
-m_wireframe(false), m_backFaceCulling(false), m_renderCoordinateFrame(false)
+m_fragmentQueryIndex(0), m_fragmentCounter(0), m_fragmentFrameCounter(0), m_fragmentsPerFrame(0),
+m_numberOfMeshlets(0), m_numberOfVisibleMeshlets(0), m_renderAllocations(0),
+m_drawTime(0), m_numberOfDrawnObjects(0), m_drawTimePerObject(0.0), m_numberOfObjects(0), m_numberOfInstances(0),
+m_numberOfDrawCalls(0), m_uniformLookups(0), m_issuedStateCalls(0), m_elidedStateCalls(0), m_instanceGrid(false), m_instanceGridSize(INITIAL_INSTANCE_GRID_SIZE), m_meshLoader(0), m_scene(0),
+m_meshAssets(), m_geometryArena(m_meshAssets.getGeometryArena().data()), m_indirectDraws(false),
+m_uniformBlocks(), m_frameDataBlock(false), m_objectDataBlock(false),
+m_wireframe(false), m_backFaceCulling(false), m_renderCoordinateFrame(false), m_optimizeMesh(true), m_countFragments(false)
 {
 	m_objectFileName = "teapot";
+    for (int k = 0; k < NUMBER_OF_FRAGMENT_QUERIES; ++k)
+    {
+        m_fragmentQueries[k] = 0;
+        m_fragmentQueryPending[k] = false;
+    }
+
     m_shaderProgram = new QGLShaderProgram(this);
     m_shaderProgramDisplay = new QGLShaderProgram(this);
 
@@ -52,13 +67,35 @@ m_wireframe(false), m_backFaceCulling(false), m_renderCoordinateFrame(false)
 
 GLDisplay::~GLDisplay()
 {
+    //The loaders, including the cancelled ones, must finish before the mesh asset cache is deleted
+    const QList<MeshLoader *> meshLoaders = findChildren<MeshLoader *>();
+    for (MeshLoader *meshLoader : meshLoaders)
+    {
+        meshLoader->cancel();
+        meshLoader->wait();
+    }
+    qDeleteAll(meshLoaders);
+
+    //The OpenGL objects are deleted while the context still exists
+    makeCurrent();
+
+    if (m_fragmentQueries[0] != 0)
+        context()->extraFunctions()->glDeleteQueries(NUMBER_OF_FRAGMENT_QUERIES, m_fragmentQueries);
+
+    //The framebuffers of the render graph go back to the pool, which then deletes all of them
+    m_renderGraph.release();
+    m_framebufferPool.trim();
+
+    //The objects give their mesh assets and instance buffers back, then the pages of the geometry arena are deleted
     delete m_scene;
+    m_scene = 0;
+    m_R2Tsquare = Object();
+    m_meshAssets.release();
+
+    doneCurrent();
 
     delete m_shaderProgram;
     delete m_shaderProgramDisplay;
-    delete m_framebuffer;
-
-    delete m_framebufferFinalResult;
     delete m_shaderEditor;
 
 }
@@ -74,9 +111,6 @@ void GLDisplay::initializeGL()
     f = QOpenGLContext::currentContext()->functions();
     f->initializeOpenGLFunctions();
 
-	m_framebuffer = new FrameBuffer();
-	m_framebufferFinalResult = new FrameBuffer();
-
     QString OpenGLInfo;
     OpenGLInfo = QString("Widget OpenGl: %1.%2\n").arg(format().majorVersion()).arg(format().minorVersion());
 
@@ -87,9 +121,9 @@ void GLDisplay::initializeGL()
     OpenGLInfo += QString("\tVERSION :      %1\n").arg((const char*)glGetString(GL_VERSION));
     OpenGLInfo += QString("\tGLSL VERSION : %1\n").arg((const char*)glGetString(GL_SHADING_LANGUAGE_VERSION));
 
-    emit updateGLInfo(OpenGLInfo);
+    m_openGLInfo = OpenGLInfo;
 
-    glEnable(GL_DEPTH_TEST);
+    GLStateCache::instance().setDepthTest(true);
     glEnable(GL_MULTISAMPLE);
     glClearColor(0, 0, 0, 0);
 
@@ -98,6 +132,7 @@ void GLDisplay::initializeGL()
     connect(m_shaderEditor, SIGNAL(displayLog()), this, SIGNAL(displayLog()));
     connect(m_shaderEditor, SIGNAL(updateUniformTab()), this, SIGNAL(updateUniformTab()));
     connect(m_shaderEditor, SIGNAL(updateShaderProgram()), this, SLOT(linkShaderProgram()));
+    connect(m_shaderEditor, SIGNAL(updateRenderGraph(QString)), this, SLOT(setRenderGraph(QString)));
 
     m_shaderEditor->loadDefaultShaders();
 
@@ -113,29 +148,36 @@ void GLDisplay::initializeGL()
 
 void GLDisplay::reinitGL()
 {
-	glEnable(GL_DEPTH_TEST);
+	GLStateCache::instance().setDepthTest(true);
 	glEnable(GL_MULTISAMPLE);
 	glClearColor(0, 0, 0, 0);
 
 	qDebug() << "loading scene";
 
-	m_renderingVAO.destroy();
-	//Load VAO
-	if (!m_renderingVAO.create())
-		cerr << "Could not create VAO" << endl;
-
-	m_renderingVAO.bind();
-	
-	m_scene = new Scene(m_objectFileName);
+	//Each mesh asset has its own VAO, built when its buffers are uploaded
+	if (!m_scene)
+	{
+		m_scene = new Scene(m_objectFileName, m_optimizeMesh, &m_meshAssets);
+	}
+	else
+	{
+		//Rebuilt in place, the material editors point to the scene. The new object is created before
+		//the old one is removed : when the geometry has not changed, it comes from the mesh asset cache.
+		Object sceneObject(m_objectFileName, m_optimizeMesh, &m_meshAssets);
+		m_scene->removeObjects();
+		m_scene->addObject(sceneObject);
+	}
+	this->applyInstanceGrid();
 
-	m_shaderProgram->enableAttributeArray("vertex_worldSpace");
-	m_shaderProgram->enableAttributeArray("textureCoordinate_input");
-	m_shaderProgram->enableAttributeArray("normal_worldSpace");
-	m_shaderProgram->setAttributeBuffer("vertex_worldSpace", GL_FLOAT, 0, 3, 0);
-	m_shaderProgram->setAttributeBuffer("textureCoordinate_input", GL_FLOAT, m_scene->getObjects()[0].getTextureCoordinatesOffset(), 2, 0);
-	m_shaderProgram->setAttributeBuffer("normal_worldSpace", GL_FLOAT, m_scene->getObjects()[0].getNormalsOffset(), 3, 0);
+	//The block bindings, the uniform locations and the texture units are part of the programs : they are set again after every link
+	UniformBlocks::bindUniformBlocks(m_shaderProgram, m_frameDataBlock, m_objectDataBlock);
+	m_shaderProgramUniforms.build(m_shaderProgram);
+	m_displayProgramUniforms.build(m_shaderProgramDisplay);
+	this->updateTextureUniforms();
 
-	m_renderingVAO.release();
+	//Indirect draws replace the model matrix uniforms by the per draw data read through the instance attributes
+	m_indirectDraws = m_geometryArena->supportsIndirectDraws() && m_shaderProgram->isLinked()
+	        && m_shaderProgram->attributeLocation("instanceMatrix") != -1 && m_shaderProgramUniforms.getLocation(UNIFORM_M_MATRIX) == -1;
 
 	this->loadTexturesAndFramebuffers();
 
@@ -156,32 +198,17 @@ void GLDisplay::reinitGL()
 	QVector4D upVectorScene = QVector4D(0.0, 1.0, 0.0, 1.0);
 	QVector4D centerScene = QVector4D(0.0, 0.0, 0.0, 1.0);
 
-    m_R2TVAO.destroy();
-	if (!m_R2TVAO.create())
-		cerr << "Could not create R2T VAO" << endl;
-
-	m_R2TVAO.bind();
-
-	m_R2Tsquare = Object(string("square"));
+	m_R2Tsquare = Object(string("square"), true, &m_meshAssets);
 
 	//The square is betweem -0.5 and 0.5
 	//Scale it by a factor of 2 so that it covers the entire screen (between -1 and 1)
 	m_R2Tsquare.scale(2.0);
 
-	m_shaderProgramDisplay->setAttributeBuffer("vertex_worldSpace", GL_FLOAT, 0, 3, 0);
-	m_shaderProgramDisplay->setAttributeBuffer("textureCoordinate_input", GL_FLOAT, m_R2Tsquare.getTextureCoordinatesOffset(), 2, 0);
-	m_shaderProgramDisplay->setAttributeBuffer("normal_worldSpace", GL_FLOAT, m_R2Tsquare.getNormalsOffset(), 3, 0);
-
-	m_shaderProgramDisplay->enableAttributeArray("vertex_worldSpace");
-	m_shaderProgramDisplay->enableAttributeArray("textureCoordinate_input");
-	m_shaderProgramDisplay->enableAttributeArray("normal_worldSpace");
-
-	m_R2TVAO.release();
-
-	m_cameraScene = Camera(positionScene, upVectorScene, centerScene, true, (float)m_framebuffer->getWidth() / (float)m_framebuffer->getHeight(), 45.0);
+	m_cameraScene = Camera(positionScene, upVectorScene, centerScene, true, (float)m_renderGraph.getBaseWidth() / (float)m_renderGraph.getBaseHeight(), 45.0);
 	emit updateViewMatrix(m_cameraScene.getViewMatrix());
 	emit updateProjectionMatrix(m_cameraScene.getProjectionMatrix());
 	emit(updateMaterialTab());
+	this->updateGLInfoTab();
 
 	const QList<QOpenGLDebugMessage> messages = logger.loggedMessages();
 	for (const QOpenGLDebugMessage &message : messages)
@@ -189,6 +216,108 @@ void GLDisplay::reinitGL()
 
 }
 
+void GLDisplay::loadObject(const string &objectName)
+{
+    this->cancelObjectLoading();
+
+    m_meshLoader = new MeshLoader(objectName, m_optimizeMesh, &m_meshAssets, this);
+    connect(m_meshLoader, SIGNAL(finished()), this, SLOT(objectLoaded()));
+    m_meshLoader->start();
+
+    qDebug() << "loading" << QString::fromStdString(objectName) << "in the background";
+}
+
+void GLDisplay::cancelObjectLoading()
+{
+    //The thread stops at the next step of the processing, objectLoaded deletes it
+    if (m_meshLoader)
+    {
+        m_meshLoader->cancel();
+        m_meshLoader = 0;
+    }
+}
+
+void GLDisplay::objectLoaded()
+{
+    MeshLoader *meshLoader = qobject_cast<MeshLoader *>(sender());
+    if (!meshLoader)
+        return;
+
+    meshLoader->deleteLater();
+
+    //Cancelled loads and loads replaced by a newer one are dropped
+    if (meshLoader != m_meshLoader)
+        return;
+
+    m_meshLoader = 0;
+
+    //A file that cannot be read is reported, the current object stays displayed
+    if (!meshLoader->isLoaded())
+    {
+        if (!meshLoader->getLoadError().empty())
+        {
+            emit updateLog(QString::fromStdString(meshLoader->getLoadError()));
+            emit displayLog();
+        }
+        return;
+    }
+
+    //Swaps the object and uploads its buffers on the OpenGL thread
+    makeCurrent();
+
+    Object object = meshLoader->getObject();
+    object.uploadBuffers();
+
+    m_scene->removeObjects();
+    m_scene->addObject(object);
+    this->applyInstanceGrid();
+
+    doneCurrent();
+
+    m_objectFileName = meshLoader->getObjectName();
+
+    emit updateModelMatrix(object.getModelMatrix());
+    emit(updateMaterialTab());
+    this->updateGLInfoTab();
+    update();//Update openGL
+}
+
+void GLDisplay::applyInstanceGrid()
+{
+    if (m_instanceGrid)
+        m_scene->setInstanceGrid(0, m_instanceGridSize);
+}
+
+void GLDisplay::updateGLInfoTab()
+{
+    QString meshAssetsInfo = QString("Mesh assets : %1 in use, %2 cache hits, %3 cache misses\n").arg(m_meshAssets.getNumberOfAssets())
+            .arg(m_meshAssets.getNumberOfHits()).arg(m_meshAssets.getNumberOfMisses());
+
+    QString geometryArenaInfo = QString("Geometry arena : %1 pages, %2 meshes, %3 / %4 vertices, %5 / %6 indices\n")
+            .arg(m_geometryArena->getNumberOfPages()).arg(m_geometryArena->getNumberOfAllocations())
+            .arg(m_geometryArena->getNumberOfUsedVertices()).arg(m_geometryArena->getVertexCapacity())
+            .arg(m_geometryArena->getNumberOfUsedIndices()).arg(m_geometryArena->getIndexCapacity());
+    geometryArenaInfo += QString("Multi-draw indirect : %1\n").arg(m_indirectDraws ? "on" : "off");
+
+    QString uniformBlocksInfo = QString("Uniform blocks : FrameData %1, ObjectData %2\n").arg(m_frameDataBlock ? "on" : "off")
+            .arg(m_objectDataBlock ? "on" : "off");
+    uniformBlocksInfo += QString("Uniforms : %1 in the shader program (%2 samplers), %3 in the display program (%4 samplers)\n")
+            .arg(m_shaderProgramUniforms.getNumberOfUniforms()).arg(m_shaderProgramUniforms.getNumberOfTextureUnits())
+            .arg(m_displayProgramUniforms.getNumberOfUniforms()).arg(m_displayProgramUniforms.getNumberOfTextureUnits());
+
+    QString renderGraphInfo = QString("Render graph : %1 passes (%2 culled), %3 transient textures in %4 framebuffers (%5 MB)\n")
+            .arg(m_renderGraph.getNumberOfPasses()).arg(m_renderGraph.getNumberOfCulledPasses())
+            .arg(m_renderGraph.getNumberOfTransientTextures()).arg(m_renderGraph.getNumberOfFramebuffers())
+            .arg(m_renderGraph.getFramebufferMemory() / (1024.0 * 1024.0), 0, 'f', 1);
+
+    renderGraphInfo += QString("Framebuffer pool : %1 framebuffers, %2 created, %3 MB (high-water mark %4 MB)\n")
+            .arg(m_framebufferPool.getNumberOfFramebuffers()).arg(m_framebufferPool.getNumberOfAllocations())
+            .arg(m_framebufferPool.getMemory() / (1024.0 * 1024.0), 0, 'f', 1)
+            .arg(m_framebufferPool.getHighWaterMark() / (1024.0 * 1024.0), 0, 'f', 1);
+
+    emit updateGLInfo(m_openGLInfo + meshAssetsInfo + geometryArenaInfo + uniformBlocksInfo + renderGraphInfo);
+}
+
 void GLDisplay::resizeGL(int width, int height)
 {
     //Avoid division by 0
@@ -199,52 +328,87 @@ void GLDisplay::resizeGL(int width, int height)
     m_cameraQuad.setProjectionMatrix((float)width / (float)height, 30.0); //Reset the projection matrix
 
     //Map the projection to the GLWidget window
-    glViewport(0, 0, width, height);
+    GLStateCache::instance().setViewport(0, 0, width, height);
+
+    //Once before the next frame, however many resize events arrive until then
+    m_resizeFramebuffers = true;
 
 }
 
 void GLDisplay::paintGL()
 {
+    quint64 uniformLookups = m_shaderProgramUniforms.getNumberOfLookups() + m_displayProgramUniforms.getNumberOfLookups();
+
+    //Qt binds the framebuffer of the widget and sets the viewport before paintGL
+    GLStateCache &state = GLStateCache::instance();
+    state.invalidate();
+    quint64 issuedStateCalls = state.getNumberOfIssuedCalls();
+    quint64 elidedStateCalls = state.getNumberOfElidedCalls();
+
+    if (m_resizeFramebuffers)
+    {
+        //The scene camera follows the aspect ratio of the framebuffers
+        this->loadTexturesAndFramebuffers();
+        m_cameraScene.setProjectionMatrix((float)m_renderGraph.getBaseWidth() / (float)m_renderGraph.getBaseHeight(), m_cameraScene.getFieldOfView());
+        emit updateProjectionMatrix(m_cameraScene.getProjectionMatrix());
+        this->updateGLInfoTab();
+    }
+
     //Enable depth test
-    glEnable(GL_DEPTH_TEST);
+    state.setDepthTest(true);
 
-    //Render the scene
-    f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer->getFramebufferID());
+    //Passes of the render graph, the last ones render to the screen
+    const QVector<int> &schedule = m_renderGraph.getSchedule();
+    for (int k = 0; k < schedule.size(); ++k)
+    {
+        const RenderPass &pass = m_renderGraph.getPass(schedule[k]);
+        FrameBuffer *target = m_renderGraph.getFramebuffer(pass.framebuffer);
 
-    //Clear screen
-    //Clear the color and the z buffer
-    glClearColor(0.0, 0.0, 0.0, 1.0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glViewport(0, 0, m_framebuffer->getWidth(), m_framebuffer->getHeight());
+        //The framebuffer of the widget is not 0 (see defaultFramebufferObject)
+        state.bindFramebuffer(target ? target->getFramebufferID() : this->defaultFramebufferObject());
+        int targetWidth = target ? target->getWidth() : this->width();
+        int targetHeight = target ? target->getHeight() : this->height();
 
-    this->setOpenGLRenderingState();
+        //Clear screen
+        //Clear the color and the z buffer
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        state.setViewport(0, 0, targetWidth, targetHeight);
 
-    if (m_renderCoordinateFrame)
-        this->renderCoordinateFrame();
+        if (pass.type == RENDER_PASS_SCENE)
+        {
+            m_sceneWidth = targetWidth;
+            m_sceneHeight = targetHeight;
 
-    glClear(GL_DEPTH_BUFFER_BIT);
-    //Render the scene
-    this->renderScene();
+            this->setOpenGLRenderingState();
 
-    //Apply one render to texture pass
-    f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebufferFinalResult->getFramebufferID());
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glClearColor(0.0, 0.0, 0.0, 1.0);
-    glViewport(0, 0, m_framebufferFinalResult->getWidth(), m_framebufferFinalResult->getHeight());
+            if (m_renderCoordinateFrame)
+                this->renderCoordinateFrame();
 
-    this->renderToTexture(m_framebuffer->getColorBufferID(0), false);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            //Render the scene
+            this->renderScene();
+        }
+        else
+        {
+            //Apply one render to texture pass
+            this->renderToTexture(pass, schedule[k]);
+        }
+    }
 
-    /*------ Display the framebuffer on the screen -----*/
-    f->glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glClearColor(0.0, 0.0, 0.0, 1.0);
-    glViewport(0, 0, this->width(), this->height());
+    m_uniformLookups = m_shaderProgramUniforms.getNumberOfLookups() + m_displayProgramUniforms.getNumberOfLookups() - uniformLookups;
+    m_issuedStateCalls = state.getNumberOfIssuedCalls() - issuedStateCalls;
+    m_elidedStateCalls = state.getNumberOfElidedCalls() - elidedStateCalls;
 
-    //use the simplified pipeline for better speed
-    this->renderToTexture(m_framebufferFinalResult->getColorBufferID(0), true);
+    //The VAO and the program stay bound between the draws : unbind them once before QPainter draws the text
+    state.bindVertexArray(0);
+    state.useProgram(0);
 
     this->drawFPS();
 
+    //QPainter changes the state behind the cache
+    state.invalidate();
+
 	const QList<QOpenGLDebugMessage> messages = logger.loggedMessages();
 	for (const QOpenGLDebugMessage &message : messages)
 		qDebug() << message;
@@ -254,11 +418,11 @@ void GLDisplay::setOpenGLWireframeState(bool activateWireframeMode)
 {
     //Wireframe rendering
     if (activateWireframeMode) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        GLStateCache::instance().setPolygonMode(GL_LINE);
     }
     else
     {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        GLStateCache::instance().setPolygonMode(GL_FILL);
     }
 }
 
@@ -266,10 +430,7 @@ void GLDisplay::setOpenGLWireframeState(bool activateWireframeMode)
 void GLDisplay::setOpenGLRenderingState()
 {
     //Backface culling rendering
-    if (m_backFaceCulling)
-        glEnable(GL_CULL_FACE);
-    else
-        glDisable(GL_CULL_FACE);
+    GLStateCache::instance().setCullFace(m_backFaceCulling);
 }
 
 void GLDisplay::renderCoordinateFrame()
@@ -292,6 +453,10 @@ void GLDisplay::renderCoordinateFrame()
      * To only get the rotation of the camera set the camera position (PX, PY, PZ) to 0
      */
 
+    //Fixed function pipeline
+    GLStateCache::instance().useProgram(0);
+    GLStateCache::instance().bindVertexArray(0);
+
     float *matrix = m_cameraScene.getViewMatrix().data();
 
     matrix[12] = 0.0;
@@ -328,8 +493,11 @@ void GLDisplay::renderCoordinateFrame()
 
 void GLDisplay::renderScene()
 {
+    quint64 allocations = AllocationCounter::getNumberOfAllocations();
+
     //Switch to the regular shader program to render the objects
-    m_shaderProgram->bind();
+    GLStateCache &state = GLStateCache::instance();
+    state.useProgram(m_shaderProgram->programId());
 
     /*---Camera and matrices---*/
 
@@ -339,73 +507,200 @@ void GLDisplay::renderScene()
     viewMatrixScene = m_cameraScene.getViewMatrix();
     projectionScene = m_cameraScene.getProjectionMatrix();
 
+    QVector4D frustumPlanes[NUMBER_OF_FRUSTUM_PLANES];
+    m_cameraScene.getFrustumPlanes(frustumPlanes);
+
     //Setup the openGL pipeline
 
     /*---load the scene and draw it ---*/
 
-    //Load the scene
-    QVector<Object> objectList = m_scene->getObjects();
-    QVector<Light> pointLights = m_scene->getPointLightSources();
+    //The render list and the lights are read in place : nothing is copied or allocated per frame
+    const QVector<DrawRecord> &renderList = m_scene->getRenderList();
+    const QVector<Light> &pointLights = m_scene->getPointLightSources();
 
-    //Repeat that for each object
-    QMatrix4x4 modelMatrixObject = QMatrix4x4();
-    QVector<QVector3D> vertices;
-    QVector<QVector3D> normals;
-    QVector<QVector2D> textureCoordinates;
-    QVector<GLuint> indicesArray;
     QVector4D lightPosition = pointLights[0].getLightPosition();
-    QMatrix4x4 lightModelMatrix = pointLights[0].getModelMatrix();
 
-    for (int k = 0; k < objectList.size(); k++)
+    //Uniforms shared by all the objects
+    if (m_frameDataBlock)
+    {
+        m_uniformBlocks.setFrameData(projectionScene, viewMatrixScene, viewMatrixScene*lightPosition, m_timeFPS.elapsed());
+    }
+    else
+    {
+        m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_P_MATRIX), projectionScene);
+        m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_LIGHT_POSITION), viewMatrixScene*lightPosition); //Light position in the camera space
+        m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_TIME), m_timeFPS.elapsed()); //Time
+    }
+
+    //The transforms of all the objects are uploaded in one buffer before the draws.
+    //The first object data is the one of the indirect draws : their model matrices are in the per draw data.
+    if (m_objectDataBlock)
+    {
+        m_uniformBlocks.clearObjectData();
+        m_uniformBlocks.addObjectData(QMatrix4x4(), viewMatrixScene, viewMatrixScene.normalMatrix());
+
+        for (int k = 0; k < renderList.size(); k++)
+        {
+            const DrawRecord &record = renderList[k];
+            if (this->isIndirectDraw(record))
+                continue;
+
+            QMatrix4x4 modelViewMatrix = viewMatrixScene*record.modelMatrix;
+            m_uniformBlocks.addObjectData(record.encodedModelMatrix, viewMatrixScene*record.encodedModelMatrix, modelViewMatrix.normalMatrix());
+        }
+
+        m_uniformBlocks.uploadObjectData();
+    }
+
+    m_numberOfMeshlets = 0;
+    m_numberOfVisibleMeshlets = 0;
+
+    //Instance attributes of the objects drawn once
+    InstanceBuffer::setDefaultAttributes();
+
+    QOpenGLExtraFunctions *extraFunctions = QOpenGLContext::currentContext()->extraFunctions();
+    bool fragmentQueryIssued = false;
+    if (m_countFragments)
+    {
+        if (m_fragmentQueries[0] == 0)
+            extraFunctions->glGenQueries(NUMBER_OF_FRAGMENT_QUERIES, m_fragmentQueries);
+
+        //The next query in the rotation was issued NUMBER_OF_FRAGMENT_QUERIES frames ago : collect its result without waiting
+        GLuint query = m_fragmentQueries[m_fragmentQueryIndex];
+        if (m_fragmentQueryPending[m_fragmentQueryIndex])
+        {
+            GLuint available = GL_FALSE;
+            extraFunctions->glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint numberOfSamples = 0;
+                extraFunctions->glGetQueryObjectuiv(query, GL_QUERY_RESULT, &numberOfSamples);
+                m_fragmentCounter += numberOfSamples;
+                ++m_fragmentFrameCounter;
+                m_fragmentQueryPending[m_fragmentQueryIndex] = false;
+            }
+        }
+
+        //If the previous result is still in flight, this frame is not measured
+        if (!m_fragmentQueryPending[m_fragmentQueryIndex])
+        {
+            extraFunctions->glBeginQuery(GL_SAMPLES_PASSED, query);
+            fragmentQueryIssued = true;
+        }
+    }
+
+    QElapsedTimer drawTimer;
+    drawTimer.start();
+
+    //The objects of the geometry arena sharing a material are collected and drawn with one glMultiDrawElementsIndirect
+    m_numberOfDrawCalls = 0;
+    m_geometryArena->releaseEmptyPages();
+    m_geometryArena->clearDraws();
+    const Material *indirectMaterial = 0;
+    int objectData = 1;
+
+    for (int k = 0; k < renderList.size(); k++)
     {
-        //Get the data
-        modelMatrixObject = objectList[k].getModelMatrix();
-        vertices = objectList[k].getMesh().getVertices();
-        normals = objectList[k].getMesh().getVertexNormals();
-        textureCoordinates = objectList[k].getMesh().getTextureCoordinates();
-        indicesArray = objectList[k].getMesh().getIndicesArray();
+        const DrawRecord &record = renderList[k];
+        const Material &material = m_scene->getMaterial(record.materialSlot);
+        QMatrix4x4 modelViewMatrix = viewMatrixScene*record.modelMatrix;
+
+        //Range of the index buffer of the level of detail
+        int level = this->selectLevelOfDetail(record, modelViewMatrix, projectionScene);
+        const LevelOfDetail &levelOfDetail = record.levelsOfDetail[level];
+
+        if (this->isIndirectDraw(record))
+        {
+            if (indirectMaterial && *indirectMaterial != material)
+                this->submitIndirectDraws(*indirectMaterial, viewMatrixScene);
+            indirectMaterial = &material;
+
+            int drawData = m_geometryArena->addDrawData(record.encodedModelMatrix, record.modelMatrix.normalMatrix());
+
+            //The full resolution level is culled per meshlet
+            if (level == 0 && !record.meshlets.isEmpty())
+                this->drawVisibleMeshlets(record, frustumPlanes, modelViewMatrix, drawData);
+            else
+                this->drawRange(record, levelOfDetail.firstIndex, levelOfDetail.numberOfIndices, drawData);
+
+            continue;
+        }
 
         //Send uniform data to shaders
         //Do the maximum of matrix multiplication on the CPU for better efficiency
-        m_shaderProgram->setUniformValue("mMatrix", modelMatrixObject);
-        m_shaderProgram->setUniformValue("mvMatrix", viewMatrixScene*modelMatrixObject);
-        m_shaderProgram->setUniformValue("pMatrix", projectionScene);
-        m_shaderProgram->setUniformValue("normalMatrix", (viewMatrixScene*modelMatrixObject).normalMatrix()); //Normals are in the camera space
-        m_shaderProgram->setUniformValue("lightPosition_camSpace", viewMatrixScene*lightPosition); //Light position in the camera space
-        m_shaderProgram->setUniformValue("time", m_timeFPS.elapsed()); //Time
+        //The positions are quantized in the bounding box of the mesh : the dequantization is part of the model matrix
+        if (m_objectDataBlock)
+        {
+            m_uniformBlocks.bindObjectData(objectData++);
+        }
+        else
+        {
+            m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_M_MATRIX), record.encodedModelMatrix);
+            m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_MV_MATRIX), viewMatrixScene*record.encodedModelMatrix);
+            m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_NORMAL_MATRIX), modelViewMatrix.normalMatrix()); //Normals are in the camera space
+        }
 
         //sendData
-        this->sendObjectDataToShaders(objectList[k]);
+        this->sendObjectDataToShaders(material);
 
         //on some platforms Qt and ANGLE require this workaround
-        if (m_wireframe)
-        {
-            //activate wireframe
-            setOpenGLWireframeState(true);
-        }
+        //The polygon mode is only sent for the first object (see GLStateCache)
+        setOpenGLWireframeState(m_wireframe);
 
         //Draw the current object
-         m_renderingVAO.bind();
+         state.bindVertexArray(record.vertexArrayObject);
 
-         glDrawElements(GL_TRIANGLES, indicesArray.size(), GL_UNSIGNED_INT, 0);
-
-         if (m_wireframe)
+         //All the instances are drawn at the same level, the full resolution level is culled per meshlet otherwise
+         if (record.numberOfInstances > 0)
+         {
+             int indexSize = (record.indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+             extraFunctions->glDrawElementsInstanced(GL_TRIANGLES, levelOfDetail.numberOfIndices, record.indexType,
+                                                     (const void *)((size_t)(record.firstIndex + levelOfDetail.firstIndex) * indexSize),
+                                                     record.numberOfInstances);
+             ++m_numberOfDrawCalls;
+         }
+         else if (level == 0 && !record.meshlets.isEmpty())
+         {
+             this->drawVisibleMeshlets(record, frustumPlanes, modelViewMatrix, -1);
+         }
+         else
          {
-             //deactivate wireframe!
-             setOpenGLWireframeState(false);
+             this->drawRange(record, levelOfDetail.firstIndex, levelOfDetail.numberOfIndices, -1);
          }
+    }
+
+    if (indirectMaterial)
+        this->submitIndirectDraws(*indirectMaterial, viewMatrixScene);
 
-         //Unbind the textures
-         glBindTexture(GL_TEXTURE_2D, 0);
+    //deactivate wireframe!
+    setOpenGLWireframeState(false);
+
+    m_drawTime += drawTimer.nsecsElapsed();
+    m_numberOfDrawnObjects += renderList.size();
+    m_numberOfObjects = renderList.size();
+
+    m_numberOfInstances = 0;
+    for (int k = 0; k < renderList.size(); k++)
+        m_numberOfInstances += qMax(renderList[k].numberOfInstances, 1);
+
+    if (fragmentQueryIssued)
+    {
+        extraFunctions->glEndQuery(GL_SAMPLES_PASSED);
+        m_fragmentQueryPending[m_fragmentQueryIndex] = true;
+        m_fragmentQueryIndex = (m_fragmentQueryIndex + 1) % NUMBER_OF_FRAGMENT_QUERIES;
     }
 
-    m_renderingVAO.release();
-    m_shaderProgram->release();
+    //Includes the allocations of the OpenGL driver, if any
+    m_renderAllocations = AllocationCounter::getNumberOfAllocations() - allocations;
 }
 
 
 void GLDisplay::linkShaderProgram()
 {
+    //The VAOs of the meshes use fixed attribute locations
+    MeshAsset::bindAttributeLocations(m_shaderProgramDisplay);
+    MeshAsset::bindAttributeLocations(m_shaderProgram);
+
     bool displayShaderValid = false;
     if (!m_shaderProgramDisplay->link())
     {
@@ -434,39 +729,56 @@ void GLDisplay::linkShaderProgram()
 	reinitGL();
 }
 
-void GLDisplay::renderToTexture(const int textureId, bool isSimplifiedPipeline)
+void GLDisplay::setRenderGraph(QString xml)
+{
+    QVector<RenderPass> passes = RenderGraph::getDefaultPasses();
+    QString error;
+
+    if ((!xml.isEmpty() && !RenderGraph::parse(xml, passes, error)) || !m_renderGraph.setPasses(passes, error))
+    {
+        emit updateLog(error);
+        emit displayLog();
+        return;
+    }
+
+    makeCurrent();
+    this->loadTexturesAndFramebuffers();
+    this->updateTextureUniforms();
+    doneCurrent();
+
+    this->updateGLInfoTab();
+    this->update();
+}
+
+void GLDisplay::renderToTexture(const RenderPass &pass, int passIndex)
 {
     //Switch to the display shader
     //Always bind before sending the textures to the shader
-    if (!m_shaderProgramDisplay->bind())
+    GLStateCache &state = GLStateCache::instance();
+    if (m_shaderProgramDisplay->isLinked())
+        state.useProgram(m_shaderProgramDisplay->programId());
+    else
         cout << "m_shaderProgramDisplay not bound" << endl;
 
-    //The first texture will always be the rendered texture
-    GLint textureRenderedId = f->glGetUniformLocation(m_shaderProgramDisplay->programId(), "textureRendered");
-
-    f->glActiveTexture(GL_TEXTURE0);
-    f->glUniform1i(textureRenderedId, 0); // 0 is the texture number
-
-    //Bind the texture so that it can be used by the shader
-    f->glActiveTexture(GL_TEXTURE0);
-    f->glBindTexture(GL_TEXTURE_2D, textureId);
+    //The textures rendered by the previous passes are bound to the texture units of their samplers (see UniformCache)
+    for (int i = 0; i < pass.inputs.size(); ++i)
+    {
+        FrameBuffer *input = m_renderGraph.getFramebuffer(pass.inputs[i].framebuffer);
+        if (input && pass.inputs[i].textureUnit >= 0)
+            state.bindTexture(pass.inputs[i].textureUnit, input->getColorBufferID(0));
+    }
 
-    if (!isSimplifiedPipeline)
+    if (pass.userTextures)
     {
         //Additional textures
         for (int i = 0; i < m_texturesDisplayProgram.size(); ++i)
         {
-            //If the texture has been loaded correctly
-            if (m_texturesDisplayProgram[i].isTextureLoaded())
+            //If the texture has been loaded correctly and the program samples it
+            int uniform = m_textureUniformsDisplayProgram[i];
+            if (m_texturesDisplayProgram[i].isTextureLoaded() && uniform >= 0)
             {
-                GLint textureId = f->glGetUniformLocation(m_shaderProgramDisplay->programId(), m_textureNamesDisplayProgram[i].c_str());
-
-                f->glActiveTexture(GL_TEXTURE0 + i + 1);
-                f->glUniform1i(textureId, i); // 0 is the texture number
-
                 //Bind the texture so that it can be used by the shader
-                f->glActiveTexture(GL_TEXTURE0 + i + 1);
-                f->glBindTexture(GL_TEXTURE_2D, m_texturesDisplayProgram[i].getTextureId());
+                state.bindTexture(m_displayProgramUniforms.getUniform(uniform).textureUnit, m_texturesDisplayProgram[i].getTextureId());
             }
         }
     }
@@ -475,18 +787,22 @@ void GLDisplay::renderToTexture(const int textureId, bool isSimplifiedPipeline)
     QMatrix4x4 viewMatrixQuad = m_cameraQuad.getViewMatrix();
     QMatrix4x4 projectionMatrixQuad = m_cameraQuad.getProjectionMatrix();
 
-    m_shaderProgramDisplay->setUniformValue("mMatrix", m_R2Tsquare.getModelMatrix());
-    m_shaderProgramDisplay->setUniformValue("mvMatrix", viewMatrixQuad*m_R2Tsquare.getModelMatrix());
-    m_shaderProgramDisplay->setUniformValue("mvMatrixScene", m_scene->getObjects()[0].getModelMatrix()*m_cameraScene.getViewMatrix());
-    m_shaderProgramDisplay->setUniformValue("pMatrix", projectionMatrixQuad);
+    QMatrix4x4 dequantizationMatrix = m_R2Tsquare.getEncoding().getDequantizationMatrix();
+    m_shaderProgramDisplay->setUniformValue(m_displayProgramUniforms.getLocation(UNIFORM_M_MATRIX), m_R2Tsquare.getModelMatrix()*dequantizationMatrix);
+    m_shaderProgramDisplay->setUniformValue(m_displayProgramUniforms.getLocation(UNIFORM_MV_MATRIX),
+                                            viewMatrixQuad*m_R2Tsquare.getModelMatrix()*dequantizationMatrix);
+    m_shaderProgramDisplay->setUniformValue(m_displayProgramUniforms.getLocation(UNIFORM_MV_MATRIX_SCENE),
+                                            m_scene->getObjects()[0].getModelMatrix()*m_cameraScene.getViewMatrix());
+    m_shaderProgramDisplay->setUniformValue(m_displayProgramUniforms.getLocation(UNIFORM_P_MATRIX), projectionMatrixQuad);
+    m_shaderProgramDisplay->setUniformValue(m_displayProgramUniforms.getLocation(UNIFORM_PASS_INDEX), passIndex);
 
     //Draw the current object
-    m_R2TVAO.bind();
-
-    glDrawElements(GL_TRIANGLES, m_R2Tsquare.getMesh().getIndicesArray().size(), GL_UNSIGNED_INT, 0);
+    state.bindVertexArray(m_R2Tsquare.getVertexArrayObject());
 
-    m_R2TVAO.release();
-    m_shaderProgramDisplay->release();
+    GLenum indexType = m_R2Tsquare.getEncoding().getIndexType();
+    int indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+    glDrawElements(GL_TRIANGLES, m_R2Tsquare.getMesh().getIndicesArray().size(), indexType,
+                   (const void *)((size_t)m_R2Tsquare.getFirstIndex() * indexSize));
 }
 
 
@@ -495,49 +811,196 @@ void GLDisplay::loadTexturesAndFramebuffers()
 
     //If the FBO has the width and height of the window then the rendering is aliased (too low resolution)
     //The width is imposed to FRAMEBUFFER_WIDTH and the height is calculated to keep the aspec ratio
-    float aspectRatio = this->width() / this->height();
+    float aspectRatio = (float)qMax(this->width(), 1) / (float)qMax(this->height(), 1);
     int widthFBO = FRAMEBUFFER_WIDTH;
-    int heightFBO = widthFBO / aspectRatio;
+    int heightFBO = qMax(qRound(widthFBO / aspectRatio), 1);
 
-    //Create a framebuffer and load it (empty but creates its ID)
-    m_framebuffer = new FrameBuffer(widthFBO, heightFBO);
-    m_framebuffer->load_8UC3();
+    //Acquire the framebuffers of the render graph from the pool and load the new ones (empty but creates their IDs)
+    //A relink does not create any framebuffer
+    m_renderGraph.allocate(widthFBO, heightFBO);
+    m_resizeFramebuffers = false;
+}
+
+int GLDisplay::selectLevelOfDetail(const DrawRecord &record, const QMatrix4x4 &modelViewMatrix, const QMatrix4x4 &projectionMatrix) const
+{
+    const QVector<LevelOfDetail> &levels = record.levelsOfDetail;
+    float radius = record.boundingSphereRadius;
+    if (levels.size() <= 1 || radius <= 0.0)
+        return 0;
+
+    //Radius and center of the bounding sphere in the camera space (largest scaling of the model view matrix)
+    float scale = qMax(modelViewMatrix.column(0).toVector3D().length(),
+                       qMax(modelViewMatrix.column(1).toVector3D().length(), modelViewMatrix.column(2).toVector3D().length()));
+    float radiusCamSpace = radius * scale;
+    QVector3D centerCamSpace = modelViewMatrix * record.boundingSphereCenter;
+
+    //Pixels per unit of the camera space, at the nearest point of the sphere for a perspective projection
+    float pixelsPerUnit = 0.5 * m_sceneHeight * projectionMatrix(1, 1);
+    if (projectionMatrix(3, 2) != 0.0)
+    {
+        float distance = centerCamSpace.length() - radiusCamSpace;
+
+        //The camera is inside the sphere
+        if (distance <= 0.0)
+            return 0;
+
+        pixelsPerUnit /= distance;
+    }
 
-    m_framebufferFinalResult = new FrameBuffer(widthFBO, heightFBO);
-    m_framebufferFinalResult->load_8UC3();
+    //The errors are in the space of the mesh : scaled by the instances, the model view matrix and the projection to get pixels
+    float pixelsPerMeshUnit = record.instanceScale * scale * pixelsPerUnit;
+
+    int level = 0;
+    while (level + 1 < levels.size() && levels[level + 1].error * pixelsPerMeshUnit <= LOD_PIXEL_ERROR)
+        ++level;
+
+    return level;
 }
 
-void GLDisplay::sendObjectDataToShaders(Object &object)
+void GLDisplay::drawVisibleMeshlets(const DrawRecord &record, const QVector4D frustumPlanes[NUMBER_OF_FRUSTUM_PLANES],
+                                    const QMatrix4x4 &modelViewMatrix, int drawData)
 {
-    Material material = Material();
-    material = object.getMaterial();
+    const QVector<Meshlet> &meshlets = record.meshlets;
+    bool perspective = m_cameraScene.isPerspective();
+
+    //Spheres and cones in the camera space
+    float scale = qMax(modelViewMatrix.column(0).toVector3D().length(),
+                       qMax(modelViewMatrix.column(1).toVector3D().length(), modelViewMatrix.column(2).toVector3D().length()));
+    QMatrix4x4 normalTransform = modelViewMatrix.inverted().transposed();
+
+    int rangeStart = 0, rangeEnd = 0;
+
+    for (int m = 0; m < meshlets.size(); ++m)
+    {
+        const Meshlet &meshlet = meshlets[m];
+        QVector3D center = modelViewMatrix * meshlet.center;
+        float radius = meshlet.radius * scale;
+
+        bool visible = true;
+        for (int p = 0; p < NUMBER_OF_FRUSTUM_PLANES && visible; ++p)
+        {
+            visible = (QVector3D::dotProduct(frustumPlanes[p].toVector3D(), center) + frustumPlanes[p].w() >= -radius);
+        }
 
+        //Backfacing clusters : the view direction is (0, 0, -1) for an orthographic camera
+        if (visible && m_backFaceCulling && meshlet.coneCutoff < 1.0)
+        {
+            QVector3D axis = normalTransform.mapVector(meshlet.coneAxis).normalized();
+            if (perspective)
+                visible = (QVector3D::dotProduct(center, axis) < meshlet.coneCutoff * center.length() + radius);
+            else
+                visible = (-axis.z() < meshlet.coneCutoff);
+        }
+
+        if (!visible)
+            continue;
+
+        ++m_numberOfVisibleMeshlets;
+
+        //Merge with the previous range if they are consecutive in the index buffer
+        if (rangeEnd == meshlet.firstIndex && rangeEnd > rangeStart)
+        {
+            rangeEnd += meshlet.numberOfIndices;
+            continue;
+        }
+
+        if (rangeEnd > rangeStart)
+            this->drawRange(record, rangeStart, rangeEnd - rangeStart, drawData);
+
+        rangeStart = meshlet.firstIndex;
+        rangeEnd = meshlet.firstIndex + meshlet.numberOfIndices;
+    }
+
+    if (rangeEnd > rangeStart)
+        this->drawRange(record, rangeStart, rangeEnd - rangeStart, drawData);
+
+    m_numberOfMeshlets += meshlets.size();
+}
+
+void GLDisplay::drawRange(const DrawRecord &record, int firstIndex, int numberOfIndices, int drawData)
+{
+    if (drawData >= 0)
+    {
+        m_geometryArena->addDraw(record.geometryPage, record.firstIndex + firstIndex, numberOfIndices, drawData);
+        return;
+    }
+
+    int indexSize = (record.indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+    glDrawElements(GL_TRIANGLES, numberOfIndices, record.indexType, (const void *)((size_t)(record.firstIndex + firstIndex) * indexSize));
+    ++m_numberOfDrawCalls;
+}
+
+bool GLDisplay::isIndirectDraw(const DrawRecord &record) const
+{
+    return m_indirectDraws && record.geometryPage >= 0 && record.numberOfInstances == 0;
+}
+
+void GLDisplay::submitIndirectDraws(const Material &material, const QMatrix4x4 &viewMatrix)
+{
+    //The model matrices and their normal matrices are read from the per draw data (instanceMatrix and instanceNormalMatrix)
+    if (m_objectDataBlock)
+    {
+        m_uniformBlocks.bindObjectData(0);
+    }
+    else
+    {
+        m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_MV_MATRIX), viewMatrix);
+        m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_NORMAL_MATRIX), viewMatrix.normalMatrix());
+    }
+
+    this->sendObjectDataToShaders(material);
+
+    setOpenGLWireframeState(m_wireframe);
+
+    m_numberOfDrawCalls += m_geometryArena->submitDraws();
+    m_geometryArena->clearDraws();
+}
+
+void GLDisplay::sendObjectDataToShaders(const Material &material)
+{
     //TODO defaults should come and be set in Uniform Editor widget
     //or define a separate material editor and exclude these here
 
-    m_shaderProgram->setUniformValue("ambient", material.getAmbientColor());
-    m_shaderProgram->setUniformValue("diffuse", material.getDiffuseColor());
-    m_shaderProgram->setUniformValue("specular", material.getSpecularColor());
-    m_shaderProgram->setUniformValue("shininess", material.getShininess());
-    m_shaderProgram->setUniformValue("ambientCoefficent", material.getAmbientCoefficient());
-    m_shaderProgram->setUniformValue("diffuseCoefficent", material.getDiffuseCoefficient());
-    m_shaderProgram->setUniformValue("specularCoefficent", material.getSpecularCoefficient());
+    m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_AMBIENT), material.getAmbientColor());
+    m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_DIFFUSE), material.getDiffuseColor());
+    m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_SPECULAR), material.getSpecularColor());
+    m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_SHININESS), material.getShininess());
+    m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_AMBIENT_COEFFICIENT), material.getAmbientCoefficient());
+    m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_DIFFUSE_COEFFICIENT), material.getDiffuseCoefficient());
+    m_shaderProgram->setUniformValue(m_shaderProgramUniforms.getLocation(UNIFORM_SPECULAR_COEFFICIENT), material.getSpecularCoefficient());
 
     for (int i = 0; i < m_texturesShaderProgram.size(); ++i)
     {
-        //If the texture has been loaded correctly
-        if (m_texturesShaderProgram[i].isTextureLoaded())
+        //If the texture has been loaded correctly and the program samples it
+        int uniform = m_textureUniformsShaderProgram[i];
+        if (m_texturesShaderProgram[i].isTextureLoaded() && uniform >= 0)
         {
-            GLint textureId = f->glGetUniformLocation(m_shaderProgram->programId(), m_textureNamesShaderProgram[i].c_str());
+            //Bind the texture to the texture unit of its sampler (see UniformCache)
+            GLStateCache::instance().bindTexture(m_shaderProgramUniforms.getUniform(uniform).textureUnit, m_texturesShaderProgram[i].getTextureId());
+        }
+    }
+}
 
-            f->glActiveTexture(GL_TEXTURE0 + i);
-            f->glUniform1i(textureId, i); // 0 is the texture number
+void GLDisplay::updateTextureUniforms()
+{
+    m_textureUniformsShaderProgram.resize(m_texturesShaderProgram.size());
+    for (int i = 0; i < m_texturesShaderProgram.size(); ++i)
+    {
+        int uniform = m_shaderProgramUniforms.find(QString::fromStdString(m_textureNamesShaderProgram[i]));
+        bool isSampler = uniform >= 0 && m_shaderProgramUniforms.getUniform(uniform).textureUnit >= 0;
+        m_textureUniformsShaderProgram[i] = isSampler ? uniform : -1;
+    }
 
-            //Bind the texture so that it can be used by the shader
-            f->glActiveTexture(GL_TEXTURE0 + i);
-            f->glBindTexture(GL_TEXTURE_2D, m_texturesShaderProgram[i].getTextureId());
-        }
+    m_textureUniformsDisplayProgram.resize(m_texturesDisplayProgram.size());
+    for (int i = 0; i < m_texturesDisplayProgram.size(); ++i)
+    {
+        int uniform = m_displayProgramUniforms.find(QString::fromStdString(m_textureNamesDisplayProgram[i]));
+        bool isSampler = uniform >= 0 && m_displayProgramUniforms.getUniform(uniform).textureUnit >= 0;
+        m_textureUniformsDisplayProgram[i] = isSampler ? uniform : -1;
     }
+
+    //Samplers of the textures read by the passes of the render graph
+    m_renderGraph.resolveSamplers(m_displayProgramUniforms);
 }
 
 void GLDisplay::updateMaterial(int objectID, Material material)
@@ -557,6 +1020,14 @@ void GLDisplay::drawFPS()
         m_FPS = m_frameCounter;
         m_frameCounter = 0;
         m_lastFPSUpdate = currentTime;
+
+        m_fragmentsPerFrame = (m_fragmentFrameCounter > 0) ? m_fragmentCounter / m_fragmentFrameCounter : 0;
+        m_fragmentCounter = 0;
+        m_fragmentFrameCounter = 0;
+
+        m_drawTimePerObject = (m_numberOfDrawnObjects > 0) ? (double)m_drawTime / m_numberOfDrawnObjects : 0.0;
+        m_drawTime = 0;
+        m_numberOfDrawnObjects = 0;
     }
 
     QString textFPS = QString("%1 FPS").arg(m_FPS);
@@ -564,6 +1035,46 @@ void GLDisplay::drawFPS()
     //Set the color to white for to draw the FPS
    // glColor3f(1.0, 1.0, 1.0);
     renderText(width() - textFPS.size() - 60, 20, textFPS);
+
+    if (m_numberOfMeshlets > 0)
+    {
+        QString textMeshlets = QString("%1 / %2 meshlets drawn").arg(m_numberOfVisibleMeshlets).arg(m_numberOfMeshlets);
+        renderText(width() - 250, 60, textMeshlets);
+    }
+
+    //The allocations are only counted in a build configured with SHADERLAB_COUNT_ALLOCATIONS
+    QString renderAllocations = AllocationCounter::isEnabled() ? QString::number(m_renderAllocations) : QString("n/a");
+    QString textAllocations = QString("%1 allocations/frame in renderScene, %2 uniform lookups/frame").arg(renderAllocations)
+            .arg(m_uniformLookups);
+    renderText(width() - 250, 80, textAllocations);
+
+    QString textStateCalls = QString("%1 state changes/frame, %2 redundant ones skipped").arg(m_issuedStateCalls).arg(m_elidedStateCalls);
+    renderText(width() - 250, 120, textStateCalls);
+
+    //CPU cost of an object, the GPU executes the draw calls asynchronously
+    QString textDrawCost = QString("%1 objects (%2 instances), %3 draw calls, %4 us/object to submit").arg(m_numberOfObjects)
+            .arg(m_numberOfInstances).arg(m_numberOfDrawCalls).arg(m_drawTimePerObject / 1000.0, 0, 'f', 1);
+    renderText(width() - 250, 100, textDrawCost);
+
+    if (!m_pickText.isEmpty())
+    {
+        renderText(10, height() - 10, m_pickText);
+    }
+
+    if (m_meshLoader)
+    {
+        QString objectName = QFileInfo(QString::fromStdString(m_meshLoader->getObjectName())).fileName();
+        QString textLoading = QString("Loading %1 : %2% (Esc to cancel)").arg(objectName).arg(m_meshLoader->getProgress());
+        renderText(10, 20, textLoading);
+    }
+
+    if (m_countFragments)
+    {
+        //Fragments per frame and per pixel of the FBO
+        double fragmentsPerPixel = (double)m_fragmentsPerFrame / qMax(m_sceneWidth * m_sceneHeight, 1);
+        QString textFragments = QString("%1 fragments/frame (%2 per pixel)").arg(m_fragmentsPerFrame).arg(fragmentsPerPixel, 0, 'f', 2);
+        renderText(width() - 250, 40, textFragments);
+    }
 }
 
 void GLDisplay::renderText(double x, double y, const QString &str, const QFont & font) {
@@ -604,9 +1115,64 @@ void GLDisplay::mousePressEvent(QMouseEvent *event)
 {
     //When the mouse is pressed, save its position
     m_mousePos = QVector2D(event->pos().x(), event->pos().y());
+
+    //Left click : pick the surface under the cursor
+    //SHIFT+left click : move the light in front of it
+    if (event->button() == Qt::LeftButton && !(QApplication::keyboardModifiers() == Qt::ControlModifier))
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        int objectNumber = -1;
+        RayHit hit;
+        bool picked = this->pickScene(event->pos(), objectNumber, hit);
+        double latency = timer.nsecsElapsed() / 1000.0;
+
+        if (picked)
+        {
+            QString objectText = QString("Object %1").arg(objectNumber);
+            if (hit.instance >= 0)
+                objectText += QString(", instance %1").arg(hit.instance);
+
+            m_pickText = QString("%1, triangle %2, barycentrics (%3, %4, %5) picked in %6 us").arg(objectText).arg(hit.triangle)
+                    .arg(1.0 - hit.u - hit.v, 0, 'f', 3).arg(hit.u, 0, 'f', 3).arg(hit.v, 0, 'f', 3).arg(latency, 0, 'f', 1);
+
+            if (QApplication::keyboardModifiers() == Qt::ShiftModifier)
+            {
+                float offset = PICK_LIGHT_OFFSET * m_scene->getObjects()[objectNumber].getBoundingSphereRadius();
+                QVector3D lightPosition = hit.position + offset * hit.normal;
+                m_scene->setLightSourcePosition(0, lightPosition.x(), lightPosition.y(), lightPosition.z());
+            }
+        }
+        else
+        {
+            m_pickText = QString("Nothing picked in %1 us").arg(latency, 0, 'f', 1);
+        }
+
+        qDebug() << m_pickText;
+        update();
+    }
+
     event->accept();
 }
 
+bool GLDisplay::pickScene(const QPoint &position, int &objectNumber, RayHit &hit)
+{
+    //Point of the widget in normalized device coordinates
+    float x = 2.0 * (position.x() + 0.5) / this->width() - 1.0;
+    float y = 1.0 - 2.0 * (position.y() + 0.5) / this->height();
+
+    //Points of the ray on the near and far planes, in the world space
+    QMatrix4x4 inverseViewProjection = (m_cameraScene.getProjectionMatrix() * m_cameraScene.getViewMatrix()).inverted();
+    QVector4D nearPoint = inverseViewProjection * QVector4D(x, y, -1.0, 1.0);
+    QVector4D farPoint = inverseViewProjection * QVector4D(x, y, 1.0, 1.0);
+
+    QVector3D origin = nearPoint.toVector3DAffine();
+    QVector3D direction = (farPoint.toVector3DAffine() - origin).normalized();
+
+    return m_scene->pick(origin, direction, objectNumber, hit);
+}
+
 void GLDisplay::mouseMoveEvent(QMouseEvent *event)
 {
     // static float rotationX = 0.0;
@@ -650,6 +1216,10 @@ void GLDisplay::mouseMoveEvent(QMouseEvent *event)
 
 void GLDisplay::keyPressEvent(QKeyEvent *event)
 {
+    if (event->key() == Qt::Key_Escape)
+    {
+        this->cancelObjectLoading();
+    }
 
     //Quick translation of light source
     if (event->key() == Qt::Key_Z)
@@ -692,39 +1262,57 @@ void GLDisplay::updateCameraType(QString cameraType)
 void GLDisplay::updateCameraFieldOfView(double fieldOfView)
 {
     //Changes the field of view if the camera is a perspective camera
-    m_cameraScene.setProjectionMatrix((float)m_framebuffer->getWidth() / (float)m_framebuffer->getHeight(), fieldOfView);
+    m_cameraScene.setProjectionMatrix((float)m_renderGraph.getBaseWidth() / (float)m_renderGraph.getBaseHeight(), fieldOfView);
     emit updateProjectionMatrix(m_cameraScene.getProjectionMatrix());
     update();//Update openGL
 }
 
 void GLDisplay::updateObject(QString object)
 {
+    string objectFileName = m_objectFileName;
+
     if (object == "Square")
     {
-		m_objectFileName = "square";
+		objectFileName = "square";
     }
     else if (object == "Cube")
     {
-		m_objectFileName = "cube";
+		objectFileName = "cube";
     }
     else if (object == "Monkey")
     {
-		m_objectFileName = "monkey";
+		objectFileName = "monkey";
     }
     else if (object == "Teapot")
     {
-		m_objectFileName = "teapot";
+		objectFileName = "teapot";
     }
     else if (object == "Teapot low res")
     {
-		m_objectFileName = "teapot-low";
+		objectFileName = "teapot-low";
+    }
+    else if (object == "Teapot grid")
+    {
+		objectFileName = "teapot";
     }
+    else if (object == "Open mesh file...")
+    {
+        //Let the user choose a file
+        QString chosenFile = QFileDialog::getOpenFileName(this,
+            tr("Choose mesh"),
+            QDir::currentPath(),
+            QString(tr("All mesh files (*.off *.obj *.ply *.stl);;OFF (*.off);;OBJ (*.obj);;PLY (*.ply);;STL (*.stl)")));
 
-	this->linkShaderProgram();
-	//this->reinitGL();
+        if (chosenFile.isEmpty())
+            return;
 
-    emit(updateMaterialTab());
-    update();//Update openGL
+        objectFileName = chosenFile.toStdString();
+    }
+
+    m_instanceGrid = (object == "Teapot grid");
+
+    //The current object stays on the screen until the new one is loaded (see objectLoaded)
+    this->loadObject(objectFileName);
 }
 
 void GLDisplay::updateWireframeRendering(bool wireframe)
@@ -739,6 +1327,40 @@ void GLDisplay::updateBackfaceCulling(bool backface)
     update();//Update openGL
 }
 
+void GLDisplay::updateMeshOptimization(bool optimizeMesh)
+{
+    m_optimizeMesh = optimizeMesh;
+
+    //The object is reloaded with the new setting
+    this->loadObject(m_objectFileName);
+}
+
+void GLDisplay::updateInstanceGridSize(int gridSize)
+{
+    m_instanceGridSize = gridSize;
+
+    if (m_instanceGrid && m_scene)
+    {
+        makeCurrent();
+        this->applyInstanceGrid();
+        doneCurrent();
+        update();//Update openGL
+    }
+}
+
+void GLDisplay::updateFragmentCounting(bool countFragments)
+{
+    m_countFragments = countFragments;
+
+    //The results of the queries still in flight are dropped
+    for (int k = 0; k < NUMBER_OF_FRAGMENT_QUERIES; ++k)
+        m_fragmentQueryPending[k] = false;
+    m_fragmentCounter = 0;
+    m_fragmentFrameCounter = 0;
+    m_fragmentsPerFrame = 0;
+    update();//Update openGL
+}
+
 void GLDisplay::updateRenderCoordinateFrame(bool renderCoordFrame)
 {
     m_renderCoordinateFrame = renderCoordFrame;
@@ -806,7 +1428,7 @@ void GLDisplay::resetMatrices()
     QVector4D upVectorScene = QVector4D(0.0, 1.0, 0.0, 1.0);
     QVector4D centerScene = QVector4D(0.0, 0.0, 0.0, 1.0);
 
-    m_cameraScene = Camera(positionScene, upVectorScene, centerScene, true, (float)m_framebuffer->getWidth() / (float)m_framebuffer->getHeight(), 45.0);
+    m_cameraScene = Camera(positionScene, upVectorScene, centerScene, true, (float)m_renderGraph.getBaseWidth() / (float)m_renderGraph.getBaseHeight(), 45.0);
     emit updateViewMatrix(m_cameraScene.getViewMatrix());
     emit updateProjectionMatrix(m_cameraScene.getProjectionMatrix());
 
@@ -850,6 +1472,8 @@ void GLDisplay::setTexture(QString name, bool isAShaderProgramUniform)
                 m_textureNamesDisplayProgram.push_back(name.toStdString());
             }
 
+            this->updateTextureUniforms();
+
             QString text = QString("Texture correctly loaded : %1\n\n").arg(chosenFile);
             emit updateLog(text);
         }
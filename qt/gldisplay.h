@@ -30,12 +30,36 @@
 #define MAX_FPS 60.0
 #define INITIAL_CAMERA_Z_POSITION 40.0
 
+//Largest error of a level of detail on the screen, in pixels of the FBO
+#define LOD_PIXEL_ERROR 1.0
+
+//Distance from the surface of a light placed with Shift+click, relative to the radius of the object
+#define PICK_LIGHT_OFFSET 0.25
+
+//Default size N of the grid of N x N instances of the "Teapot grid" preset
+#define INITIAL_INSTANCE_GRID_SIZE 100
+
+//Occlusion query target counting the samples that pass the depth test (desktop OpenGL only)
+#ifndef GL_SAMPLES_PASSED
+#define GL_SAMPLES_PASSED 0x8914
+#endif
+
+//Occlusion queries used in rotation : a result is read a few frames after its query, once it is available
+#define NUMBER_OF_FRAGMENT_QUERIES 3
+
+#include "opengl/allocationcounter.h"
 #include "opengl/material.h"
 #include "opengl/object.h"
+#include "opengl/meshasset.h"
+#include "opengl/meshloader.h"
 #include "opengl/light.h"
 #include "opengl/scene.h"
 #include "opengl/framebuffer.h"
+#include "opengl/glstatecache.h"
+#include "opengl/rendergraph.h"
 #include "opengl/camera.h"
+#include "opengl/uniformblocks.h"
+#include "opengl/uniformcache.h"
 
 #include "opengl/openglheaders.h"
 
@@ -91,24 +115,122 @@ public:
     void renderScene();
 
     /**
-     * Renders the textureID on a quad.
+     * Renders the inputs of a display pass of the render graph on a quad.
      * @brief renderToTexture
-     * @param textureID
+     * @param pass
+     * @param passIndex index of the pass in the graph, sent to the display program (passIndex uniform)
      */
-    void renderToTexture(const int textureID, bool simplifiedPipeline);
+    void renderToTexture(const RenderPass &pass, int passIndex);
 
     /**
-     * Function to load textures and the framebuffers.
+     * Function to load textures and the framebuffers of the render graph, at the aspect ratio of the window.
+     * The framebuffers are recycled if their size did not change.
      * @brief loadTexturesAndFramebuffers
      */
     void loadTexturesAndFramebuffers();
 
     /**
-     * Sends object properties to shaders.
+     * Shows the OpenGL information and the statistics of the mesh asset cache in the GL info tab.
+     * @brief updateGLInfoTab
+     */
+    void updateGLInfoTab();
+
+    /**
+     * Loads an object on a worker thread (see MeshLoader) and cancels the load in progress, if any.
+     * The current object stays on the screen until the new one is loaded.
+     * @brief loadObject
+     * @param objectName
+     */
+    void loadObject(const string &objectName);
+
+    /**
+     * Cancels the object load in progress, if any.
+     * @brief cancelObjectLoading
+     */
+    void cancelObjectLoading();
+
+    /**
+     * Replaces the object of the scene by a grid of instances when the "Teapot grid" preset is selected.
+     * The OpenGL context must be current.
+     * @brief applyInstanceGrid
+     */
+    void applyInstanceGrid();
+
+    /**
+     * Sends the material of an object and the textures to shaders.
      * @brief sendObjectDataToShaders
-     * @param object
+     * @param material
+     */
+    void sendObjectDataToShaders(const Material &material);
+
+    /**
+     * Finds the sampler of each texture in the uniform caches, after a link or when a texture is added.
+     * @brief updateTextureUniforms
+     */
+    void updateTextureUniforms();
+
+    /**
+     * Returns the coarsest level of detail of the object whose error stays under LOD_PIXEL_ERROR pixels,
+     * given the size of its bounding sphere projected on the FBO.
+     * @brief selectLevelOfDetail
+     * @param record draw record of the object
+     * @param modelViewMatrix
+     * @param projectionMatrix
+     * @return
+     */
+    int selectLevelOfDetail(const DrawRecord &record, const QMatrix4x4 &modelViewMatrix, const QMatrix4x4 &projectionMatrix) const;
+
+    /**
+     * Draws the meshlets that are in the view frustum of the scene camera and, when backface culling is enabled,
+     * that have at least one triangle facing the camera (normal cone test).
+     * Consecutive visible meshlets are drawn as a single range (see drawRange).
+     * @brief drawVisibleMeshlets
+     * @param record draw record of the object
+     * @param frustumPlanes planes of the view frustum in the camera space (see Camera::getFrustumPlanes)
+     * @param modelViewMatrix
+     * @param drawData per draw data of the object in the geometry arena for an indirect draw, -1 to draw at once
+     */
+    void drawVisibleMeshlets(const DrawRecord &record, const QVector4D frustumPlanes[NUMBER_OF_FRUSTUM_PLANES],
+                             const QMatrix4x4 &modelViewMatrix, int drawData);
+
+    /**
+     * Draws a range of the indices of an object with glDrawElements from the bound VAO,
+     * or adds it to the indirect draws of the geometry arena.
+     * @brief drawRange
+     * @param record draw record of the object
+     * @param firstIndex relative to the indices of the mesh
+     * @param numberOfIndices
+     * @param drawData per draw data of the object in the geometry arena for an indirect draw, -1 to draw at once
+     */
+    void drawRange(const DrawRecord &record, int firstIndex, int numberOfIndices, int drawData);
+
+    /**
+     * True if the object is drawn with the indirect draws of the geometry arena.
+     * @brief isIndirectDraw
+     * @param record
+     * @return
+     */
+    bool isIndirectDraw(const DrawRecord &record) const;
+
+    /**
+     * Submits the indirect draws collected in the geometry arena, which share a material.
+     * The model matrices are in the per draw data : the model view matrix of the shaders is the view matrix.
+     * @brief submitIndirectDraws
+     * @param material
+     * @param viewMatrix
      */
-    void sendObjectDataToShaders(Object &object);
+    void submitIndirectDraws(const Material &material, const QMatrix4x4 &viewMatrix);
+
+    /**
+     * Casts the ray of the scene camera through a point of the widget and finds the closest object hit (see Scene::pick).
+     * The FBO of the scene is assumed to cover the whole widget.
+     * @brief pickScene
+     * @param position in pixels of the widget
+     * @param objectNumber
+     * @param hit
+     * @return true if an object is hit
+     */
+    bool pickScene(const QPoint &position, int &objectNumber, RayHit &hit);
 
     /**
      * Counts and draw the FPS on the screen.
@@ -156,6 +278,25 @@ signals:
     void updateWireframeRendering(bool wireframe);
     void updateBackfaceCulling(bool backface);
     void updateRenderCoordinateFrame(bool renderCoordFrame);
+    void updateMeshOptimization(bool optimizeMesh);
+
+    /**
+     * Size N of the grid of N x N instances of the "Teapot grid" preset, applied at once if the preset is selected.
+     * @brief updateInstanceGridSize
+     * @param gridSize
+     */
+    void updateInstanceGridSize(int gridSize);
+
+    /**
+     * Measurement mode : counts the fragments of the objects that pass the depth test with an occlusion query,
+     * i.e. the fragment shader invocations when the early depth test applies (the FBO is not multisampled).
+     * The average number per frame is displayed below the FPS, toggle the mesh optimization to compare.
+     * The queries are used in rotation and a result is read NUMBER_OF_FRAGMENT_QUERIES frames later, only once
+     * GL_QUERY_RESULT_AVAILABLE is set : a frame whose oldest query is still pending is not measured.
+     * @brief updateFragmentCounting
+     * @param countFragments
+     */
+    void updateFragmentCounting(bool countFragments);
     void modelMatrixUpdated(QMatrix4x4 modelMatrix);
     void viewMatrixUpdated(QMatrix4x4 viewMatrix);
     void projectionMatrixUpdated(QMatrix4x4 projectionMatrix);
@@ -164,6 +305,14 @@ signals:
     void updateMaterial(int objectID, Material material);
     void linkShaderProgram();
 
+    /**
+     * Replaces the passes of the frame by the <graph> element of a pipeline, or by the default passes if it is empty.
+     * The current graph is kept if the new one is invalid.
+     * @brief setRenderGraph
+     * @param xml
+     */
+    void setRenderGraph(QString xml);
+
     /**
      * Slot to select a texture file and use it in a shader.
      * @brief setTexture
@@ -179,6 +328,12 @@ signals:
 
 	void glMessageLogged(QOpenGLDebugMessage m);
 
+    /**
+     * Replaces the object of the scene with the object of the MeshLoader that finished and uploads its buffers.
+     * @brief objectLoaded
+     */
+    void objectLoaded();
+
 protected:
     void initializeGL();
 	void reinitGL();
@@ -193,9 +348,16 @@ protected:
 private:
     void renderText(double x, double y, const QString &str, const QFont & font = QFont());
    
-    //Framebuffer for highres rendering
-    FrameBuffer* m_framebuffer;
-    FrameBuffer* m_framebufferFinalResult;
+    //Passes of the frame, rendered in highres framebuffers recycled by the pool
+    FrameBufferPool m_framebufferPool;
+    RenderGraph m_renderGraph;
+
+    //The window was resized : the framebuffers are allocated again before the next frame
+    bool m_resizeFramebuffers;
+
+    //Size of the target of the last scene pass
+    int m_sceneWidth;
+    int m_sceneHeight;
 
     //Camera
     Camera m_cameraScene;
@@ -211,23 +373,92 @@ private:
     int m_FPS;
     QTimer m_timer;
 
+    //Shaded fragments (occlusion queries in rotation, m_fragmentQueryIndex is the next one to issue)
+    GLuint m_fragmentQueries[NUMBER_OF_FRAGMENT_QUERIES];
+    bool m_fragmentQueryPending[NUMBER_OF_FRAGMENT_QUERIES];
+    int m_fragmentQueryIndex;
+    quint64 m_fragmentCounter;
+    int m_fragmentFrameCounter;
+    quint64 m_fragmentsPerFrame;
+
+    //Meshlets of the last frame
+    int m_numberOfMeshlets;
+    int m_numberOfVisibleMeshlets;
+
+    //Heap allocations made by renderScene in the last frame (see AllocationCounter)
+    quint64 m_renderAllocations;
+
+    //CPU time spent submitting the objects (uniforms, VAO and draw calls), averaged every second
+    qint64 m_drawTime;
+    qint64 m_numberOfDrawnObjects;
+    double m_drawTimePerObject;
+    int m_numberOfObjects;
+    int m_numberOfInstances;
+    int m_numberOfDrawCalls;
+
+    //Uniform lookups by name and queries to the driver in the last frame (see UniformCache)
+    quint64 m_uniformLookups;
+
+    //State changes sent to OpenGL and skipped by the state cache in the last frame (see GLStateCache)
+    quint64 m_issuedStateCalls;
+    quint64 m_elidedStateCalls;
+
+    //Last mouse picking
+    QString m_pickText;
+
+    //"Teapot grid" preset : the object is drawn as a grid of m_instanceGridSize x m_instanceGridSize instances
+    bool m_instanceGrid;
+    int m_instanceGridSize;
+
+    //Object load in progress, 0 if none
+    MeshLoader* m_meshLoader;
+
     //Shaders
     QGLShaderProgram* m_shaderProgram;
     QGLShaderProgram* m_shaderProgramDisplay;
 
+    //Locations and texture units of the uniforms of the shader programs, rebuilt after each link
+    UniformCache m_shaderProgramUniforms;
+    UniformCache m_displayProgramUniforms;
+
     //Scene
     Scene* m_scene;
 
+    //Geometry shared by the objects of the scene, the square of the final pass and the loaders
+    MeshAssetCache m_meshAssets;
+
+    //Buffers of the mesh assets, owned by the mesh asset cache
+    GeometryArena *m_geometryArena;
+
+    //The objects of the arena are drawn with glMultiDrawElementsIndirect : OpenGL 4.3 and shaders that read the per draw data
+    bool m_indirectDraws;
+
+    //Camera, light and transforms of the FrameData and ObjectData uniform blocks
+    UniformBlocks m_uniformBlocks;
+
+    //The shader program declares the blocks : the loose uniforms they replace are not set
+    bool m_frameDataBlock;
+    bool m_objectDataBlock;
+
+    //OpenGL information of the GL info tab
+    QString m_openGLInfo;
+
     //Textures
     QVector<Texture> m_texturesShaderProgram;
     QVector<std::string> m_textureNamesShaderProgram;
     QVector<Texture> m_texturesDisplayProgram;
     QVector<std::string> m_textureNamesDisplayProgram;
 
+    //Index of the sampler of each texture in the uniform cache of its program, -1 if the program does not use it
+    QVector<int> m_textureUniformsShaderProgram;
+    QVector<int> m_textureUniformsDisplayProgram;
+
     //Rendering
     bool m_wireframe;
     bool m_backFaceCulling;
     bool m_renderCoordinateFrame;
+    bool m_optimizeMesh;
+    bool m_countFragments;
 
     //Editor
     GLSLEditorWindow* m_shaderEditor;
@@ -236,8 +467,6 @@ private:
     bool m_shaderProgramNeedsLink;
 
     Object m_R2Tsquare;
-    QOpenGLVertexArrayObject m_renderingVAO;
-    QOpenGLVertexArrayObject m_R2TVAO;
 	QOpenGLDebugLogger logger;
 	string m_objectFileName;
 };
@@ -597,7 +597,9 @@ QList<UniformEditorWidget::mUniform> UniformEditorWidget::parseUniformsFromSourc
             uniform.name == QString("diffuse") || uniform.name == QString("specular") ||
             uniform.name == QString("shininess") || 
             uniform.name == QString("ambientCoefficent") || uniform.name == QString("diffuseCoefficent") ||
-            uniform.name == QString("specularCoefficent") ||  uniform.name == QString("time"))
+            uniform.name == QString("specularCoefficent") ||  uniform.name == QString("time") ||
+            uniform.name == QString("passIndex") ||
+            uniform.name == QString("FrameData") || uniform.name == QString("ObjectData"))
         {
             continue;
         }